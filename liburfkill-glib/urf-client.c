@@ -38,6 +38,14 @@
 #include <gio/gio.h>
 
 #include "urf-client.h"
+#include "urf-client-private.h"
+#include "urf-device-private.h"
+
+#define URFKILL_DBUS_SERVICE	"org.freedesktop.URfkill"
+#define URFKILL_DBUS_PATH	"/org/freedesktop/URfkill"
+#define URFKILL_DEVICE_IFACE	"org.freedesktop.URfkill.Device"
+#define OBJECT_MANAGER_IFACE	"org.freedesktop.DBus.ObjectManager"
+#define MANAGER_PROXY_KEY	"urf-manager-proxy"
 
 static void	urf_client_class_init	(UrfClientClass	*klass);
 static void	urf_client_init		(UrfClient	*client);
@@ -49,6 +57,9 @@ static void	urf_client_finalize	(GObject	*object);
 struct _UrfClientPrivate
 {
 	GDBusProxy	*proxy;
+	guint		 interfaces_added_id;
+	guint		 interfaces_removed_id;
+	GList		*init_results;
 	GList		*devices;
 	char		*daemon_version;
 	gboolean	 key_control;
@@ -76,6 +87,81 @@ static gpointer urf_client_object = NULL;
 
 G_DEFINE_TYPE (UrfClient, urf_client, G_TYPE_OBJECT)
 
+/**
+ * urf_client_manager_proxy_finalized:
+ **/
+static void
+urf_client_manager_proxy_finalized (gpointer  data,
+				    GObject  *proxy)
+{
+	GObject *connection = G_OBJECT (data);
+
+	if (g_object_get_data (connection, MANAGER_PROXY_KEY) == proxy)
+		g_object_set_data (connection, MANAGER_PROXY_KEY, NULL);
+}
+
+/**
+ * urf_client_share_manager_proxy:
+ *
+ * Make @proxy the manager proxy used by the other objects on its
+ * connection. The connection only keeps a weak reference, so the proxy
+ * goes away with the last object using it.
+ **/
+static void
+urf_client_share_manager_proxy (GDBusProxy *proxy)
+{
+	GObject *connection = G_OBJECT (g_dbus_proxy_get_connection (proxy));
+
+	if (g_object_get_data (connection, MANAGER_PROXY_KEY) != NULL)
+		return;
+
+	g_object_set_data (connection, MANAGER_PROXY_KEY, proxy);
+	g_object_weak_ref (G_OBJECT (proxy), urf_client_manager_proxy_finalized, connection);
+}
+
+/**
+ * urf_client_get_manager_proxy:
+ * @connection: the connection to the daemon
+ *
+ * Get the proxy for org.freedesktop.URfkill on @connection, shared by
+ * the client, the devices and the killswitches for their method calls.
+ * The proxy of a #UrfClient is reused when there is one, otherwise a
+ * lightweight proxy without properties or signals is created.
+ *
+ * Return value: (transfer full): the proxy, or %NULL on failure
+ **/
+GDBusProxy *
+urf_client_get_manager_proxy (GDBusConnection *connection)
+{
+	GDBusProxy *proxy;
+	GError *error = NULL;
+
+	g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), NULL);
+
+	proxy = g_object_get_data (G_OBJECT (connection), MANAGER_PROXY_KEY);
+	if (proxy != NULL)
+		return g_object_ref (proxy);
+
+	proxy = g_dbus_proxy_new_sync (connection,
+				       G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+				       G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
+				       NULL,
+				       URFKILL_DBUS_SERVICE,
+				       URFKILL_DBUS_PATH,
+				       URFKILL_DBUS_SERVICE,
+				       NULL,
+				       &error);
+	if (proxy == NULL) {
+		g_warning ("Couldn't connect to proxy: %s", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	urf_client_share_manager_proxy (proxy);
+
+	return proxy;
+}
+
 /**
  * urf_client_find_device:
  **/
@@ -99,17 +185,38 @@ urf_client_find_device (UrfClient   *client,
 	return NULL;
 }
 
+/**
+ * urf_client_is_device:
+ * @interfaces: an a{sa{sv}} #GVariant from the ObjectManager
+ **/
+static gboolean
+urf_client_is_device (GVariant *interfaces)
+{
+	GVariant *properties;
+
+	properties = g_variant_lookup_value (interfaces,
+					     URFKILL_DEVICE_IFACE,
+					     G_VARIANT_TYPE ("a{sv}"));
+	if (properties == NULL)
+		return FALSE;
+
+	g_variant_unref (properties);
+	return TRUE;
+}
+
 /**
  * urf_client_add:
  **/
 static UrfDevice *
 urf_client_add (UrfClient  *client,
-		const char *object_path)
+		const char *object_path,
+		GVariant   *interfaces)
 {
 	UrfDevice *device;
 
-	device = urf_device_new ();
-	urf_device_set_object_path_sync (device, object_path, NULL, NULL);
+	device = urf_device_new_from_interfaces (g_dbus_proxy_get_connection (client->priv->proxy),
+						 object_path,
+						 interfaces);
 
 	client->priv->devices = g_list_append (client->priv->devices, device);
 
@@ -121,7 +228,8 @@ urf_client_add (UrfClient  *client,
  **/
 static void
 urf_client_device_added (UrfClient   *client,
-			 const gchar *object_path)
+			 const gchar *object_path,
+			 GVariant    *interfaces)
 {
 	UrfDevice *device;
 
@@ -131,7 +239,7 @@ urf_client_device_added (UrfClient   *client,
 		return;
 	}
 
-	device = urf_client_add (client, object_path);
+	device = urf_client_add (client, object_path, interfaces);
 
 	g_signal_emit (client, signals [URF_CLIENT_DEVICE_ADDED], 0, device);
 }
@@ -179,35 +287,63 @@ urf_client_device_changed (UrfClient  *client,
 	g_signal_emit (client, signals [URF_CLIENT_DEVICE_CHANGED], 0, device);
 }
 
+/**
+ * urf_client_add_managed_objects:
+ * @retval: the reply of GetManagedObjects
+ **/
+static void
+urf_client_add_managed_objects (UrfClient *client,
+				GVariant  *retval)
+{
+	GVariant *objects;
+	GVariant *interfaces;
+	GVariantIter iter;
+	const char *object_path;
+
+	objects = g_variant_get_child_value (retval, 0);
+	g_variant_iter_init (&iter, objects);
+	while (g_variant_iter_next (&iter, "{&o@a{sa{sv}}}", &object_path, &interfaces)) {
+		if (urf_client_is_device (interfaces) &&
+		    urf_client_find_device (client, object_path) == NULL)
+			urf_client_add (client, object_path, interfaces);
+		g_variant_unref (interfaces);
+	}
+	g_variant_unref (objects);
+
+	client->priv->is_enumerated = TRUE;
+}
+
 /**
  * urf_client_get_devices_private:
  **/
 static void
-urf_client_get_devices_private (UrfClient *client,
-				GError    **error)
+urf_client_get_devices_private (UrfClient    *client,
+				GCancellable *cancellable,
+				GError       **error)
 {
 	GVariant *retval;
-	GVariantIter *iter;
-	const char *object_path;
 	GError *error_local = NULL;
 
 	g_return_if_fail (URF_IS_CLIENT (client));
 	g_return_if_fail (client->priv->proxy != NULL);
 
-	retval = g_dbus_proxy_call_sync (client->priv->proxy, "EnumerateDevices",
-	                                 NULL,
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error_local);
+	/* one round trip for every device along with its properties */
+	retval = g_dbus_connection_call_sync (g_dbus_proxy_get_connection (client->priv->proxy),
+	                                      URFKILL_DBUS_SERVICE,
+	                                      URFKILL_DBUS_PATH,
+	                                      OBJECT_MANAGER_IFACE,
+	                                      "GetManagedObjects",
+	                                      NULL,
+	                                      G_VARIANT_TYPE ("(a{oa{sa{sv}}})"),
+	                                      G_DBUS_CALL_FLAGS_NONE,
+	                                      -1, cancellable, &error_local);
 	if (error_local) {
 		g_set_error (error, 1, 0, "%s", error_local->message);
 		g_error_free (error_local);
 		return;
 	}
 
-	g_variant_get (retval, "(ao)", &iter);
-	while (g_variant_iter_loop (iter, "o", &object_path))
-		urf_client_add (client, object_path);
-	g_variant_iter_free (iter);
+	urf_client_add_managed_objects (client, retval);
 	g_variant_unref (retval);
 }
 
@@ -228,19 +364,16 @@ urf_client_enumerate_devices_sync (UrfClient    *client,
 				   GCancellable *cancellable,
 				   GError       **error)
 {
-	UrfClientPrivate *priv = client->priv;
 	GError *error_local = NULL;
 	gboolean ret = FALSE;
 
-	urf_client_get_devices_private (client, &error_local);
+	urf_client_get_devices_private (client, cancellable, &error_local);
 	if (error_local) {
 		g_warning ("Failed to enumerate devices: %s", error_local->message);
 		g_set_error (error, 1, 0, "%s", error_local->message);
 		goto out;
 	}
 
-	priv->is_enumerated = TRUE;
-
 	ret = TRUE;
 out:
 	if (error_local != NULL)
@@ -248,6 +381,111 @@ out:
 	return ret;
 }
 
+/**
+ * urf_client_enumerate_devices_cb:
+ **/
+static void
+urf_client_enumerate_devices_cb (GDBusConnection *connection,
+				 GAsyncResult    *res,
+				 gpointer         user_data)
+{
+	GSimpleAsyncResult *simple = G_SIMPLE_ASYNC_RESULT (user_data);
+	GObject *client;
+	GVariant *retval;
+	GError *error = NULL;
+
+	client = g_async_result_get_source_object (G_ASYNC_RESULT (simple));
+
+	retval = g_dbus_connection_call_finish (connection, res, &error);
+	if (retval == NULL) {
+		g_simple_async_result_take_error (simple, error);
+	} else {
+		urf_client_add_managed_objects (URF_CLIENT (client), retval);
+		g_simple_async_result_set_op_res_gboolean (simple, TRUE);
+		g_variant_unref (retval);
+	}
+
+	g_simple_async_result_complete (simple);
+	g_object_unref (simple);
+	g_object_unref (client);
+}
+
+/**
+ * urf_client_enumerate_devices_async:
+ * @client: a #UrfClient instance
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the request is satisfied
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously enumerate the devices from the daemon. Call
+ * #urf_client_enumerate_devices_finish from @callback to get the result.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_enumerate_devices_async (UrfClient           *client,
+				    GCancellable        *cancellable,
+				    GAsyncReadyCallback  callback,
+				    gpointer             user_data)
+{
+	GSimpleAsyncResult *simple;
+
+	g_return_if_fail (URF_IS_CLIENT (client));
+
+	if (client->priv->proxy == NULL) {
+		g_simple_async_report_error_in_idle (G_OBJECT (client),
+						     callback, user_data,
+						     1, 0, "Not connected to the daemon");
+		return;
+	}
+
+	simple = g_simple_async_result_new (G_OBJECT (client), callback, user_data,
+					    urf_client_enumerate_devices_async);
+
+	g_dbus_connection_call (g_dbus_proxy_get_connection (client->priv->proxy),
+				URFKILL_DBUS_SERVICE,
+				URFKILL_DBUS_PATH,
+				OBJECT_MANAGER_IFACE,
+				"GetManagedObjects",
+				NULL,
+				G_VARIANT_TYPE ("(a{oa{sa{sv}}})"),
+				G_DBUS_CALL_FLAGS_NONE,
+				-1, cancellable,
+				(GAsyncReadyCallback) urf_client_enumerate_devices_cb,
+				simple);
+}
+
+/**
+ * urf_client_enumerate_devices_finish:
+ * @client: a #UrfClient instance
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_client_enumerate_devices_async.
+ *
+ * Return value: #TRUE for success, else #FALSE and @error is used
+ *
+ * Since: 0.6.0
+ **/
+gboolean
+urf_client_enumerate_devices_finish (UrfClient     *client,
+				     GAsyncResult  *res,
+				     GError       **error)
+{
+	GSimpleAsyncResult *simple;
+
+	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
+	g_return_val_if_fail (g_simple_async_result_is_valid (res, G_OBJECT (client),
+							      urf_client_enumerate_devices_async),
+			      FALSE);
+
+	simple = G_SIMPLE_ASYNC_RESULT (res);
+	if (g_simple_async_result_propagate_error (simple, error))
+		return FALSE;
+
+	return g_simple_async_result_get_op_res_gboolean (simple);
+}
+
 /**
  * urf_client_get_devices:
  * @client: a #UrfClient instance
@@ -382,6 +620,145 @@ out:
 	return status;
 }
 
+/**
+ * urf_client_set_block_many:
+ * @client: a #UrfClient instance
+ * @indexes: (array length=n_items): the indexes of the devices
+ * @blocks: (array length=n_items): %TRUE to block the matching device or %FALSE to unblock
+ * @n_items: the number of devices
+ * @results: (out caller-allocates) (array length=n_items) (allow-none): whether each device was changed
+ * @cancellable: a #GCancellable or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Block or unblock several devices at once. The daemon authorizes the
+ * request once and writes the devices in one batch, which is much cheaper
+ * than calling #urf_client_set_block_idx for each of them.
+ *
+ * Return value: #TRUE if at least one device was changed, else #FALSE
+ *
+ * Since: 0.6.0
+ **/
+gboolean
+urf_client_set_block_many (UrfClient      *client,
+			   const guint    *indexes,
+			   const gboolean *blocks,
+			   const guint     n_items,
+			   gboolean       *results,
+			   GCancellable   *cancellable,
+			   GError         **error)
+{
+	GVariantBuilder builder;
+	GVariantIter *iter;
+	GVariant *retval;
+	gboolean status = FALSE;
+	gboolean changed;
+	guint32 index;
+	GError *error_local = NULL;
+	guint i;
+
+	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
+	g_return_val_if_fail (client->priv->proxy != NULL, FALSE);
+	g_return_val_if_fail (n_items == 0 || (indexes != NULL && blocks != NULL), FALSE);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ub)"));
+	for (i = 0; i < n_items; i++) {
+		g_variant_builder_add (&builder, "(ub)", indexes[i], blocks[i]);
+		if (results)
+			results[i] = FALSE;
+	}
+
+	retval = g_dbus_proxy_call_sync (client->priv->proxy, "BlockMany",
+	                                 g_variant_new ("(a(ub))", &builder),
+	                                 G_DBUS_CALL_FLAGS_NONE,
+	                                 -1, cancellable, &error_local);
+	if (error_local) {
+		g_warning ("Couldn't sent BlockMany: %s", error_local->message);
+		g_set_error (error, 1, 0, "%s", error_local->message);
+		goto out;
+	}
+
+	/* the results come back in the order of the request */
+	g_variant_get (retval, "(a(ub))", &iter);
+	for (i = 0; g_variant_iter_next (iter, "(ub)", &index, &changed); i++) {
+		if (results && i < n_items)
+			results[i] = changed;
+		if (changed)
+			status = TRUE;
+	}
+	g_variant_iter_free (iter);
+	g_variant_unref (retval);
+out:
+	if (error_local != NULL)
+		g_error_free (error_local);
+	return status;
+}
+
+/**
+ * urf_client_set_block_types:
+ * @client: a #UrfClient instance
+ * @type_mask: (1 &lt;&lt; type) for every #UrfEnumType to change
+ * @block: %TRUE to block the devices or %FALSE to unblock
+ * @results: (out caller-allocates) (array fixed-size=9) (allow-none): #URF_ENUM_TYPE_NUM results indexed by type
+ * @cancellable: a #GCancellable or %NULL
+ * @error: a #GError, or %NULL
+ *
+ * Block or unblock the devices of several types with one request. The
+ * bit of #URF_ENUM_TYPE_ALL selects every type with a device.
+ *
+ * Return value: #TRUE if at least one type was changed, else #FALSE
+ *
+ * Since: 0.6.0
+ **/
+gboolean
+urf_client_set_block_types (UrfClient      *client,
+			    const guint     type_mask,
+			    const gboolean  block,
+			    gboolean       *results,
+			    GCancellable   *cancellable,
+			    GError         **error)
+{
+	GVariantIter *iter;
+	GVariant *retval;
+	gboolean status = FALSE;
+	gboolean changed;
+	guint32 type;
+	GError *error_local = NULL;
+	guint i;
+
+	g_return_val_if_fail (URF_IS_CLIENT (client), FALSE);
+	g_return_val_if_fail (client->priv->proxy != NULL, FALSE);
+	g_return_val_if_fail (type_mask < (1 << URF_ENUM_TYPE_NUM), FALSE);
+
+	if (results) {
+		for (i = 0; i < URF_ENUM_TYPE_NUM; i++)
+			results[i] = FALSE;
+	}
+
+	retval = g_dbus_proxy_call_sync (client->priv->proxy, "BlockTypes",
+	                                 g_variant_new ("(ub)", type_mask, block),
+	                                 G_DBUS_CALL_FLAGS_NONE,
+	                                 -1, cancellable, &error_local);
+	if (error_local) {
+		g_warning ("Couldn't sent BlockTypes: %s", error_local->message);
+		g_set_error (error, 1, 0, "%s", error_local->message);
+		goto out;
+	}
+
+	g_variant_get (retval, "(a(ub))", &iter);
+	while (g_variant_iter_next (iter, "(ub)", &type, &changed)) {
+		if (results && type < URF_ENUM_TYPE_NUM)
+			results[type] = changed;
+		if (changed)
+			status = TRUE;
+	}
+	g_variant_iter_free (iter);
+	g_variant_unref (retval);
+out:
+	if (error_local != NULL)
+		g_error_free (error_local);
+	return status;
+}
+
 /**
  * urf_client_is_inhibited:
  * @client: a #UrfClient instance
@@ -752,21 +1129,57 @@ urf_client_proxy_signal_cb (GDBusProxy *proxy,
 	if (!client->priv->is_enumerated)
 		return;
 
-	if (g_strcmp0 (signal_name, "DeviceAdded") == 0) {
-		char *device_path;
-		g_variant_get (parameters, "(o)", &device_path);
-		urf_client_device_added (client, device_path);
-	} else if (g_strcmp0 (signal_name, "DeviceRemoved") == 0) {
-		char *device_path;
-		g_variant_get (parameters, "(o)", &device_path);
-		urf_client_device_removed (client, device_path);
-	} else if (g_strcmp0 (signal_name, "DeviceChanged") == 0) {
-		char *device_path;
-		g_variant_get (parameters, "(o)", &device_path);
+	/* DeviceAdded and DeviceRemoved are followed by the ObjectManager
+	 * signals, which carry the properties as well */
+	if (g_strcmp0 (signal_name, "DeviceChanged") == 0) {
+		const char *device_path;
+		g_variant_get (parameters, "(&o)", &device_path);
 		urf_client_device_changed (client, device_path);
 	}
 }
 
+/**
+ * urf_client_object_manager_signal_cb:
+ **/
+static void
+urf_client_object_manager_signal_cb (GDBusConnection *connection,
+				     const gchar     *sender_name,
+				     const gchar     *object_path,
+				     const gchar     *interface_name,
+				     const gchar     *signal_name,
+				     GVariant        *parameters,
+				     gpointer         user_data)
+{
+	UrfClient *client = URF_CLIENT (user_data);
+	const char *device_path;
+
+	if (!client->priv->is_enumerated)
+		return;
+
+	if (g_strcmp0 (signal_name, "InterfacesAdded") == 0 &&
+	    g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oa{sa{sv}})"))) {
+		GVariant *interfaces;
+
+		g_variant_get (parameters, "(&o@a{sa{sv}})", &device_path, &interfaces);
+		if (urf_client_is_device (interfaces))
+			urf_client_device_added (client, device_path, interfaces);
+		g_variant_unref (interfaces);
+	} else if (g_strcmp0 (signal_name, "InterfacesRemoved") == 0 &&
+		   g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(oas)"))) {
+		const char **interfaces;
+		guint i;
+
+		g_variant_get (parameters, "(&o^a&s)", &device_path, &interfaces);
+		for (i = 0; interfaces[i] != NULL; i++) {
+			if (g_strcmp0 (interfaces[i], URFKILL_DEVICE_IFACE) == 0) {
+				urf_client_device_removed (client, device_path);
+				break;
+			}
+		}
+		g_free (interfaces);
+	}
+}
+
 /**
  * urf_client_init:
  * @client: This class instance
@@ -774,34 +1187,55 @@ urf_client_proxy_signal_cb (GDBusProxy *proxy,
 static void
 urf_client_init (UrfClient *client)
 {
-	GError *error = NULL;
-
 	client->priv = URF_CLIENT_GET_PRIVATE (client);
 	client->priv->daemon_version = NULL;
 	client->priv->key_control = FALSE;
 	client->priv->have_properties = FALSE;
 	client->priv->is_enumerated = FALSE;
 	client->priv->devices = NULL;
+	client->priv->interfaces_added_id = 0;
+	client->priv->interfaces_removed_id = 0;
+	client->priv->init_results = NULL;
+	client->priv->proxy = NULL;
+}
 
-	/* connect to main interface */
-	client->priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                                     G_DBUS_PROXY_FLAGS_NONE,
-	                                                     NULL,
-	                                                     "org.freedesktop.URfkill",
-	                                                     "/org/freedesktop/URfkill",
-	                                                     "org.freedesktop.URfkill",
-	                                                     NULL,
-	                                                     &error);
-	if (error) {
-		g_warning ("Couldn't connect to proxy: %s", error->message);
-		g_error_free (error);
-		return;
-	}
+/**
+ * urf_client_set_proxy:
+ * @proxy: the proxy for the main interface of the daemon
+ **/
+static void
+urf_client_set_proxy (UrfClient  *client,
+		      GDBusProxy *proxy)
+{
+	client->priv->proxy = g_object_ref (proxy);
+	urf_client_share_manager_proxy (proxy);
 
 	/* callbacks */
 	g_signal_connect (client->priv->proxy, "g-signal",
 	                  G_CALLBACK (urf_client_proxy_signal_cb), client);
-	return;
+
+	client->priv->interfaces_added_id =
+		g_dbus_connection_signal_subscribe (g_dbus_proxy_get_connection (client->priv->proxy),
+		                                    URFKILL_DBUS_SERVICE,
+		                                    OBJECT_MANAGER_IFACE,
+		                                    "InterfacesAdded",
+		                                    URFKILL_DBUS_PATH,
+		                                    NULL,
+		                                    G_DBUS_SIGNAL_FLAGS_NONE,
+		                                    urf_client_object_manager_signal_cb,
+		                                    client,
+		                                    NULL);
+	client->priv->interfaces_removed_id =
+		g_dbus_connection_signal_subscribe (g_dbus_proxy_get_connection (client->priv->proxy),
+		                                    URFKILL_DBUS_SERVICE,
+		                                    OBJECT_MANAGER_IFACE,
+		                                    "InterfacesRemoved",
+		                                    URFKILL_DBUS_PATH,
+		                                    NULL,
+		                                    G_DBUS_SIGNAL_FLAGS_NONE,
+		                                    urf_client_object_manager_signal_cb,
+		                                    client,
+		                                    NULL);
 }
 
 /**
@@ -817,6 +1251,22 @@ urf_client_dispose (GObject *object)
 	client = URF_CLIENT (object);
 
 	if (client->priv->proxy) {
+		GDBusConnection *connection;
+
+		connection = g_dbus_proxy_get_connection (client->priv->proxy);
+		if (client->priv->interfaces_added_id > 0)
+			g_dbus_connection_signal_unsubscribe (connection,
+			                                      client->priv->interfaces_added_id);
+		if (client->priv->interfaces_removed_id > 0)
+			g_dbus_connection_signal_unsubscribe (connection,
+			                                      client->priv->interfaces_removed_id);
+		client->priv->interfaces_added_id = 0;
+		client->priv->interfaces_removed_id = 0;
+
+		/* devices may keep the proxy alive as their manager proxy */
+		g_signal_handlers_disconnect_by_func (client->priv->proxy,
+		                                      urf_client_proxy_signal_cb,
+		                                      client);
 		g_object_unref (client->priv->proxy);
 		client->priv->proxy = NULL;
 	}
@@ -860,12 +1310,164 @@ urf_client_finalize (GObject *object)
 UrfClient *
 urf_client_new (void)
 {
+	UrfClient *client;
+	GDBusProxy *proxy;
+	GError *error = NULL;
+
 	if (urf_client_object != NULL) {
 		g_object_ref (urf_client_object);
 	} else {
 		urf_client_object = g_object_new (URF_TYPE_CLIENT, NULL);
 		g_object_add_weak_pointer (urf_client_object, &urf_client_object);
 	}
-	return URF_CLIENT (urf_client_object);
+
+	client = URF_CLIENT (urf_client_object);
+	if (client->priv->proxy != NULL)
+		return client;
+
+	/* connect to main interface */
+	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                                       G_DBUS_PROXY_FLAGS_NONE,
+	                                       NULL,
+	                                       URFKILL_DBUS_SERVICE,
+	                                       URFKILL_DBUS_PATH,
+	                                       URFKILL_DBUS_SERVICE,
+	                                       NULL,
+	                                       &error);
+	if (error) {
+		g_warning ("Couldn't connect to proxy: %s", error->message);
+		g_error_free (error);
+		return client;
+	}
+
+	urf_client_set_proxy (client, proxy);
+	g_object_unref (proxy);
+
+	return client;
+}
+
+/**
+ * urf_client_proxy_new_cb:
+ **/
+static void
+urf_client_proxy_new_cb (GObject      *source_object,
+			 GAsyncResult *res,
+			 gpointer      user_data)
+{
+	UrfClient *client = URF_CLIENT (user_data);
+	GSimpleAsyncResult *simple;
+	GDBusProxy *proxy;
+	GList *results, *item;
+	gboolean connected;
+	GError *error = NULL;
+
+	proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (proxy != NULL) {
+		/* urf_client_new may have connected in the meantime */
+		if (client->priv->proxy == NULL)
+			urf_client_set_proxy (client, proxy);
+		g_object_unref (proxy);
+	}
+
+	connected = (client->priv->proxy != NULL);
+	results = client->priv->init_results;
+	client->priv->init_results = NULL;
+
+	/* each result holds a reference, so the client may be gone after
+	 * the last one is released */
+	for (item = results; item; item = item->next) {
+		simple = G_SIMPLE_ASYNC_RESULT (item->data);
+		if (!connected)
+			g_simple_async_result_set_from_error (simple, error);
+		g_simple_async_result_complete (simple);
+		g_object_unref (simple);
+	}
+
+	g_list_free (results);
+	if (error)
+		g_error_free (error);
+}
+
+/**
+ * urf_client_new_async:
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the client is ready
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously creates a new #UrfClient object without blocking on
+ * the daemon. Call #urf_client_new_finish from @callback to get it.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_client_new_async (GCancellable        *cancellable,
+		      GAsyncReadyCallback  callback,
+		      gpointer             user_data)
+{
+	UrfClient *client;
+	GSimpleAsyncResult *simple;
+	gboolean pending;
+
+	if (urf_client_object != NULL) {
+		client = g_object_ref (urf_client_object);
+	} else {
+		client = g_object_new (URF_TYPE_CLIENT, NULL);
+		urf_client_object = client;
+		g_object_add_weak_pointer (urf_client_object, &urf_client_object);
+	}
+
+	simple = g_simple_async_result_new (NULL, callback, user_data,
+					    urf_client_new_async);
+	g_simple_async_result_set_op_res_gpointer (simple, client, g_object_unref);
+
+	if (client->priv->proxy != NULL) {
+		g_simple_async_result_complete_in_idle (simple);
+		g_object_unref (simple);
+		return;
+	}
+
+	/* join the connection already in progress */
+	pending = (client->priv->init_results != NULL);
+	client->priv->init_results = g_list_append (client->priv->init_results, simple);
+	if (pending)
+		return;
+
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+				  G_DBUS_PROXY_FLAGS_NONE,
+				  NULL,
+				  URFKILL_DBUS_SERVICE,
+				  URFKILL_DBUS_PATH,
+				  URFKILL_DBUS_SERVICE,
+				  cancellable,
+				  urf_client_proxy_new_cb,
+				  client);
+}
+
+/**
+ * urf_client_new_finish:
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_client_new_async.
+ *
+ * Return value: (transfer full): a #UrfClient object, or %NULL and @error is used
+ *
+ * Since: 0.6.0
+ **/
+UrfClient *
+urf_client_new_finish (GAsyncResult  *res,
+		       GError       **error)
+{
+	GSimpleAsyncResult *simple;
+
+	g_return_val_if_fail (g_simple_async_result_is_valid (res, NULL,
+							      urf_client_new_async),
+			      NULL);
+
+	simple = G_SIMPLE_ASYNC_RESULT (res);
+	if (g_simple_async_result_propagate_error (simple, error))
+		return NULL;
+
+	return g_object_ref (g_simple_async_result_get_op_res_gpointer (simple));
 }
 
@@ -80,11 +80,23 @@ struct _UrfClientClass
 /* general */
 GType		 urf_client_get_type			(void);
 UrfClient	*urf_client_new				(void);
+void		 urf_client_new_async			(GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+UrfClient	*urf_client_new_finish			(GAsyncResult	*res,
+							 GError		**error);
 
 /* generic */
 gboolean	 urf_client_enumerate_devices_sync	(UrfClient	*client,
 							 GCancellable	*cancellable,
 							 GError		**error);
+void		 urf_client_enumerate_devices_async	(UrfClient	*client,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+gboolean	 urf_client_enumerate_devices_finish	(UrfClient	*client,
+							 GAsyncResult	*res,
+							 GError		**error);
 GList		*urf_client_get_devices			(UrfClient	*client);
 gboolean	 urf_client_set_block 			(UrfClient	*client,
 							 UrfEnumType	 type,
@@ -96,6 +108,19 @@ gboolean	 urf_client_set_block_idx 		(UrfClient	*client,
 							 const gboolean	 block,
 							 GCancellable	*cancellable,
 							 GError		**error);
+gboolean	 urf_client_set_block_many		(UrfClient	*client,
+							 const guint	*indexes,
+							 const gboolean	*blocks,
+							 const guint	 n_items,
+							 gboolean	*results,
+							 GCancellable	*cancellable,
+							 GError		**error);
+gboolean	 urf_client_set_block_types		(UrfClient	*client,
+							 const guint	 type_mask,
+							 const gboolean	 block,
+							 gboolean	*results,
+							 GCancellable	*cancellable,
+							 GError		**error);
 gboolean	 urf_client_is_inhibited		(UrfClient	*client,
 							 GError		**error);
 guint		 urf_client_inhibit			(UrfClient	*client,
@@ -37,15 +37,21 @@
 #include <gio/gio.h>
 
 #include "urf-device.h"
+#include "urf-device-private.h"
+#include "urf-client-private.h"
 #include "urf-enum.h"
 
+#define URFKILL_DBUS_SERVICE	"org.freedesktop.URfkill"
+#define URFKILL_DEVICE_IFACE	"org.freedesktop.URfkill.Device"
+
 #define URF_DEVICE_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
 					URF_TYPE_DEVICE, UrfDevicePrivate))
 
 struct _UrfDevicePrivate
 {
-	GDBusProxy *proxy;
-	GDBusProxy *specialized_proxy;
+	GDBusConnection *connection;
+	GDBusProxy *manager;
+	guint       properties_id;
 	char       *object_path;
 	gint        index;
 	gint        type;
@@ -54,7 +60,6 @@ struct _UrfDevicePrivate
 	char       *name;
 	char       *urftype;
 	gboolean    platform;
-	gboolean    is_initialized;
 };
 
 enum {
@@ -71,55 +76,139 @@ enum {
 G_DEFINE_TYPE (UrfDevice, urf_device, G_TYPE_OBJECT)
 
 /**
- * urf_device_refresh_private:
+ * urf_device_update_properties:
+ * @properties: an a{sv} #GVariant of any interface the device exports
+ *
+ * The device interfaces share no property names, so the properties of
+ * all of them are folded into the same set of fields.
  **/
 static void
-urf_device_refresh_private (UrfDevice *device,
-			    GError    **error)
+urf_device_update_properties (UrfDevice *device,
+			      GVariant  *properties)
 {
 	UrfDevicePrivate *priv = device->priv;
+	GVariantIter iter;
+	const char *key;
 	GVariant *value;
-	gsize length;
 
-	if (priv->specialized_proxy) {
-		value = g_dbus_proxy_get_cached_property (priv->specialized_proxy, "soft");
-		if (value)
-			priv->soft = g_variant_get_boolean (value);
-
-		value = g_dbus_proxy_get_cached_property (priv->specialized_proxy, "hard");
-		if (value)
-			priv->hard = g_variant_get_boolean (value);
+	g_variant_iter_init (&iter, properties);
+	while (g_variant_iter_next (&iter, "{&sv}", &key, &value)) {
+		if (g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN)) {
+			gboolean state = g_variant_get_boolean (value);
+
+			if (g_strcmp0 (key, "soft") == 0) {
+				if (priv->soft != state) {
+					priv->soft = state;
+					g_object_notify (G_OBJECT (device), "soft");
+				}
+			} else if (g_strcmp0 (key, "hard") == 0) {
+				if (priv->hard != state) {
+					priv->hard = state;
+					g_object_notify (G_OBJECT (device), "hard");
+				}
+			} else if (g_strcmp0 (key, "platform") == 0)
+				priv->platform = g_variant_get_boolean (value);
+		} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_INT32)) {
+			if (g_strcmp0 (key, "index") == 0)
+				priv->index = g_variant_get_int32 (value);
+			else if (g_strcmp0 (key, "type") == 0)
+				priv->type = g_variant_get_int32 (value);
+		} else if (g_variant_is_of_type (value, G_VARIANT_TYPE_STRING)) {
+			if (g_strcmp0 (key, "name") == 0) {
+				g_free (priv->name);
+				priv->name = g_variant_dup_string (value, NULL);
+			} else if (g_strcmp0 (key, "urftype") == 0) {
+				g_free (priv->urftype);
+				priv->urftype = g_variant_dup_string (value, NULL);
+			}
+		}
+		g_variant_unref (value);
 	}
+}
 
-	if (priv->is_initialized)
-		return;
-
-	value = g_dbus_proxy_get_cached_property (priv->proxy, "index");
-	priv->index = g_variant_get_int32 (value);
+/**
+ * urf_device_properties_changed_cb:
+ **/
+static void
+urf_device_properties_changed_cb (GDBusConnection *connection,
+				  const gchar     *sender_name,
+				  const gchar     *object_path,
+				  const gchar     *interface_name,
+				  const gchar     *signal_name,
+				  GVariant        *parameters,
+				  gpointer         user_data)
+{
+	UrfDevice *device = URF_DEVICE (user_data);
+	GVariant *changed;
 
-	value = g_dbus_proxy_get_cached_property (priv->proxy, "type");
-	priv->type = g_variant_get_int32 (value);
+	if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)")))
+		return;
 
-	value = g_dbus_proxy_get_cached_property (priv->proxy, "platform");
-	priv->platform = g_variant_get_boolean (value);
+	changed = g_variant_get_child_value (parameters, 1);
+	urf_device_update_properties (device, changed);
+	g_variant_unref (changed);
+}
 
-	value = g_dbus_proxy_get_cached_property (priv->proxy, "name");
-	priv->name = g_variant_dup_string (value, &length);
+/**
+ * urf_device_setup:
+ *
+ * Bind the device to @object_path and follow its property changes.
+ **/
+static void
+urf_device_setup (UrfDevice       *device,
+		  GDBusConnection *connection,
+		  const char      *object_path)
+{
+	UrfDevicePrivate *priv = device->priv;
 
+	priv->connection = g_object_ref (connection);
+	priv->object_path = g_strdup (object_path);
+	priv->properties_id =
+		g_dbus_connection_signal_subscribe (priv->connection,
+						    URFKILL_DBUS_SERVICE,
+						    "org.freedesktop.DBus.Properties",
+						    "PropertiesChanged",
+						    priv->object_path,
+						    NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    urf_device_properties_changed_cb,
+						    device,
+						    NULL);
 }
 
 /**
- * urf_device_changed_cb:
+ * urf_device_get_all_sync:
  **/
-static void
-urf_device_changed_cb (GDBusProxy *proxy,
-                       GVariant   *changed_properties,
-                       GStrv       invalidated_properties,
-                       gpointer    user_data)
+static gboolean
+urf_device_get_all_sync (UrfDevice    *device,
+			 const char   *interface_name,
+			 GCancellable *cancellable,
+			 GError       **error)
 {
-	UrfDevice *device = URF_DEVICE (user_data);
+	UrfDevicePrivate *priv = device->priv;
+	GVariant *retval;
+	GVariant *properties;
+
+	retval = g_dbus_connection_call_sync (priv->connection,
+					      URFKILL_DBUS_SERVICE,
+					      priv->object_path,
+					      "org.freedesktop.DBus.Properties",
+					      "GetAll",
+					      g_variant_new ("(s)", interface_name),
+					      G_VARIANT_TYPE ("(a{sv})"),
+					      G_DBUS_CALL_FLAGS_NONE,
+					      -1,
+					      cancellable,
+					      error);
+	if (retval == NULL)
+		return FALSE;
+
+	properties = g_variant_get_child_value (retval, 0);
+	urf_device_update_properties (device, properties);
+	g_variant_unref (properties);
+	g_variant_unref (retval);
 
-	urf_device_refresh_private (device, NULL);
+	return TRUE;
 }
 
 /**
@@ -142,68 +231,69 @@ urf_device_set_object_path_sync (UrfDevice    *device,
 				 GError       **error)
 {
 	UrfDevicePrivate *priv = device->priv;
-	GError *error_local = NULL;
-	gboolean ret = FALSE;
-	GVariant *value;
-	gsize length;
+	GDBusConnection *connection;
 
 	g_return_val_if_fail (URF_IS_DEVICE (device), FALSE);
 
-	if (device->priv->object_path != NULL)
-		return FALSE;
-	if (object_path == NULL)
+	if (priv->object_path != NULL)
 		return FALSE;
 
 	/* invalid */
 	if (object_path == NULL || object_path[0] != '/') {
 		g_set_error (error, 1, 0, "Object path %s invalid", object_path);
-		goto out;
+		return FALSE;
 	}
 
-	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                             G_DBUS_PROXY_FLAGS_NONE,
-	                                             NULL,
-	                                             "org.freedesktop.URfkill",
-	                                             object_path,
-	                                             "org.freedesktop.URfkill.Device",
-	                                             NULL,
-	                                             &error_local);
-	if (error_local) {
-		g_warning ("Couldn't connect to proxy: %s", error_local->message);
-		g_set_error (error, 1, 0, "%s", error_local->message);
+	connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, cancellable, error);
+	if (connection == NULL)
 		return FALSE;
-	}
 
-        priv->object_path = g_strdup (object_path);
-
-	value = g_dbus_proxy_get_cached_property (priv->proxy, "urftype");
-	priv->urftype = g_variant_dup_string (value, &length);
-
-	priv->specialized_proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                                         G_DBUS_PROXY_FLAGS_NONE,
-	                                                         NULL,
-	                                                         "org.freedesktop.URfkill",
-	                                                         priv->object_path,
-	                                                         priv->urftype,
-	                                                         NULL,
-	                                                         &error_local);
-	if (error_local) {
-		g_warning ("Couldn't connect to specialized device proxy: %s", error_local->message);
-		g_set_error (error, 1, 0, "%s", error_local->message);
-		priv->specialized_proxy = NULL;
+	urf_device_setup (device, connection, object_path);
+	g_object_unref (connection);
+
+	if (!urf_device_get_all_sync (device, URFKILL_DEVICE_IFACE,
+				      cancellable, error))
 		return FALSE;
-	}
 
-	urf_device_refresh_private (device, &error_local);
-	priv->is_initialized = TRUE;
+	if (priv->urftype == NULL)
+		return TRUE;
 
-	/* connect signals */
-	g_signal_connect (priv->proxy, "g-properties-changed",
-	                  G_CALLBACK (urf_device_changed_cb), device);
-	g_signal_connect (priv->specialized_proxy, "g-properties-changed",
-	                  G_CALLBACK (urf_device_changed_cb), device);
-out:
-	return ret;
+	return urf_device_get_all_sync (device, priv->urftype, cancellable, error);
+}
+
+/**
+ * urf_device_new_from_interfaces:
+ * @connection: the connection to the daemon
+ * @object_path: the object path of the device
+ * @interfaces: an a{sa{sv}} #GVariant as returned by GetManagedObjects
+ *
+ * Create a device from the properties already sent by the daemon,
+ * without any further round trip.
+ *
+ * Return value: a new #UrfDevice object.
+ **/
+UrfDevice *
+urf_device_new_from_interfaces (GDBusConnection *connection,
+				const char      *object_path,
+				GVariant        *interfaces)
+{
+	UrfDevice *device;
+	GVariantIter iter;
+	GVariant *properties;
+
+	g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), NULL);
+	g_return_val_if_fail (object_path != NULL, NULL);
+
+	device = urf_device_new ();
+	urf_device_setup (device, connection, object_path);
+
+	g_variant_iter_init (&iter, interfaces);
+	while (g_variant_iter_next (&iter, "{&s@a{sv}}", NULL, &properties)) {
+		urf_device_update_properties (device, properties);
+		g_variant_unref (properties);
+	}
+
+	return device;
 }
 
 /**
@@ -228,17 +318,19 @@ urf_device_get_object_path (UrfDevice *device)
  * set_block_idx_cb:
  **/
 static void
-set_block_idx_cb (GDBusProxy     *proxy,
-                  GAsyncResult   *res,
-                  gpointer        user_data)
+set_block_idx_cb (GDBusProxy   *proxy,
+                  GAsyncResult *res,
+                  gpointer      user_data)
 {
 	GVariant *retval;
-	gboolean status;
+	gboolean status = FALSE;
 	GError *error = NULL;
 
 	retval = g_dbus_proxy_call_finish (proxy, res, &error);
-	if (retval)
+	if (retval) {
 		g_variant_get (retval, "(b)", &status);
+		g_variant_unref (retval);
+	}
 
 	if (error) {
 		g_warning ("Failed to set BLOCK: %s", error->message);
@@ -246,8 +338,6 @@ set_block_idx_cb (GDBusProxy     *proxy,
 	} else if (!status) {
 		g_warning ("Failed to set BLOCK");
 	}
-
-	g_object_unref (proxy);
 }
 
 /**
@@ -257,32 +347,28 @@ static void
 urf_device_set_block (UrfDevice *device,
 		      gboolean   block)
 {
-	GDBusProxy *proxy;
-	GError *error = NULL;
+	UrfDevicePrivate *priv = device->priv;
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                       G_DBUS_PROXY_FLAGS_NONE,
-	                                       NULL,
-	                                       "org.freedesktop.URfkill",
-	                                       "/org/freedesktop/URfkill",
-	                                       "org.freedesktop.URfkill",
-	                                       NULL,
-	                                       &error);
-	if (error) {
-		g_warning ("Couldn't connect to proxy to set block: %s",
-		           error->message);
-		g_error_free (error);
+	if (priv->connection == NULL) {
+		g_warning ("Device is not bound to an object path");
 		return;
 	}
 
-	g_dbus_proxy_call (proxy, "BlockIdx",
-	                   g_variant_new ("(ub)",
-	                                  device->priv->index,
-	                                  block),
+	/* shared with the client and the other devices, and kept until
+	 * the device goes away, so toggling does not pay for a proxy */
+	if (priv->manager == NULL)
+		priv->manager = urf_client_get_manager_proxy (priv->connection);
+	if (priv->manager == NULL)
+		return;
+
+	/* calls are not serialized, several toggles can be in flight */
+	g_dbus_proxy_call (priv->manager,
+	                   "BlockIdx",
+	                   g_variant_new ("(ub)", priv->index, block),
 	                   G_DBUS_CALL_FLAGS_NONE,
 	                   -1, NULL,
 	                   (GAsyncReadyCallback) set_block_idx_cb,
-	                   device);
+	                   NULL);
 }
 
 /**
@@ -358,6 +444,7 @@ urf_device_finalize (GObject *object)
 	priv = URF_DEVICE (object)->priv;
 
 	g_free (priv->name);
+	g_free (priv->urftype);
 	g_free (priv->object_path);
 
 	G_OBJECT_CLASS(urf_device_parent_class)->finalize(object);
@@ -375,14 +462,16 @@ urf_device_dispose (GObject *object)
 
 	priv = URF_DEVICE (object)->priv;
 
-	if (priv->specialized_proxy) {
-		g_object_unref (priv->specialized_proxy);
-		priv->specialized_proxy = NULL;
+	if (priv->manager) {
+		g_object_unref (priv->manager);
+		priv->manager = NULL;
 	}
 
-	if (priv->proxy) {
-		g_object_unref (priv->proxy);
-		priv->proxy = NULL;
+	if (priv->connection) {
+		g_dbus_connection_signal_unsubscribe (priv->connection,
+						      priv->properties_id);
+		g_object_unref (priv->connection);
+		priv->connection = NULL;
 	}
 
 	G_OBJECT_CLASS(urf_device_parent_class)->dispose(object);
@@ -494,10 +583,11 @@ urf_device_init (UrfDevice *device)
 {
 	device->priv = URF_DEVICE_GET_PRIVATE (device);
 	device->priv->name = NULL;
+	device->priv->urftype = NULL;
 	device->priv->object_path = NULL;
-	device->priv->is_initialized = FALSE;
-	device->priv->proxy = NULL;
-	device->priv->specialized_proxy = NULL;
+	device->priv->connection = NULL;
+	device->priv->manager = NULL;
+	device->priv->properties_id = 0;
 }
 
 /**
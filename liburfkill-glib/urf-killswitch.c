@@ -37,6 +37,7 @@
 #include <gio/gio.h>
 
 #include "urf-killswitch.h"
+#include "urf-client-private.h"
 #include "urf-enum.h"
 
 #define URF_KILLSWITCH_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
@@ -47,9 +48,11 @@
 struct _UrfKillswitchPrivate
 {
 	GDBusProxy	*proxy;
+	GDBusProxy	*manager;
 	UrfEnumType	 type;
 	UrfEnumState	 state;
 	char		*object_path;
+	GList		*init_results;
 };
 
 enum {
@@ -102,7 +105,10 @@ urf_killswitch_changed_cb (GDBusProxy *proxy,
 	int state;
 
 	value = g_dbus_proxy_get_cached_property (priv->proxy, "state");
+	if (value == NULL)
+		return;
 	state = g_variant_get_int32 (value);
+	g_variant_unref (value);
 	if (priv->state != state) {
 		priv->state = state;
 		g_signal_emit (killswitch,
@@ -112,122 +118,104 @@ urf_killswitch_changed_cb (GDBusProxy *proxy,
 }
 
 /**
- * urf_killswitch_set_object_path_sync:
+ * urf_killswitch_set_proxy:
  **/
-static gboolean
-urf_killswitch_set_object_path_sync (UrfKillswitch *killswitch,
-				     const char    *object_path,
-				     GError        **error)
+static void
+urf_killswitch_set_proxy (UrfKillswitch *killswitch,
+			  GDBusProxy    *proxy)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
 	GVariant *value;
-	GError *error_local = NULL;
-
-	if (priv->object_path != NULL)
-		return FALSE;
-	if (object_path == NULL)
-		return FALSE;
-
-	/* invalid */
-	if (object_path == NULL || object_path[0] != '/') {
-		g_set_error (error, 1, 0, "Object path %s invalid", object_path);
-		goto out;
-	}
 
-	/* connect to the correct path for properties */
-	priv->proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                             G_DBUS_PROXY_FLAGS_NONE,
-	                                             NULL,
-	                                             "org.freedesktop.URfkill",
-	                                             object_path,
-	                                             "org.freedesktop.URfkill.Killswitch",
-	                                             NULL,
-	                                             &error_local);
-	if (error_local) {
-		g_warning ("Couldn't connect to proxy: %s", error_local->message);
-		g_set_error (error, 1, 0, "%s", error_local->message);
-		return FALSE;
-	}
-
-        priv->object_path = g_strdup (object_path);
+	priv->proxy = g_object_ref (proxy);
+	priv->object_path = g_strdup (g_dbus_proxy_get_object_path (proxy));
 
 	value = g_dbus_proxy_get_cached_property (priv->proxy, "state");
-	priv->state = g_variant_get_int32 (value);
+	if (value) {
+		priv->state = g_variant_get_int32 (value);
+		g_variant_unref (value);
+	}
 
 	/* connect signals */
 	g_signal_connect (priv->proxy, "g-properties-changed",
 	                  G_CALLBACK (urf_killswitch_changed_cb), killswitch);
-out:
-	return TRUE;
 }
 
 /**
- * urf_killswitch_startup:
+ * urf_killswitch_type_to_object_path:
  **/
-static gboolean
-urf_killswitch_startup (UrfKillswitch *killswitch)
+static const char *
+urf_killswitch_type_to_object_path (UrfEnumType type)
 {
-	const char *object_path;
-	GError *error = NULL;
-	gboolean ret = FALSE;
-
-	switch (killswitch->priv->type) {
+	switch (type) {
 	case URF_ENUM_TYPE_WLAN:
-		object_path = BASE_OBJECT_PATH"WLAN";
-		break;
+		return BASE_OBJECT_PATH"WLAN";
 	case URF_ENUM_TYPE_BLUETOOTH:
-		object_path = BASE_OBJECT_PATH"BLUETOOTH";
-		break;
+		return BASE_OBJECT_PATH"BLUETOOTH";
 	case URF_ENUM_TYPE_UWB:
-		object_path = BASE_OBJECT_PATH"UWB";
-		break;
+		return BASE_OBJECT_PATH"UWB";
 	case URF_ENUM_TYPE_WIMAX:
-		object_path = BASE_OBJECT_PATH"WIMAX";
-		break;
+		return BASE_OBJECT_PATH"WIMAX";
 	case URF_ENUM_TYPE_WWAN:
-		object_path = BASE_OBJECT_PATH"WWAN";
-		break;
+		return BASE_OBJECT_PATH"WWAN";
 	case URF_ENUM_TYPE_GPS:
-		object_path = BASE_OBJECT_PATH"GPS";
-		break;
+		return BASE_OBJECT_PATH"GPS";
 	case URF_ENUM_TYPE_FM:
-		object_path = BASE_OBJECT_PATH"FM";
-		break;
+		return BASE_OBJECT_PATH"FM";
 	case URF_ENUM_TYPE_NFC:
-		object_path = BASE_OBJECT_PATH"NFC";
-		break;
+		return BASE_OBJECT_PATH"NFC";
 	default:
-		object_path = NULL;
-		break;
+		return NULL;
 	}
+}
 
-	ret = urf_killswitch_set_object_path_sync (killswitch,
-						   object_path,
-						   &error);
+/**
+ * urf_killswitch_startup:
+ **/
+static gboolean
+urf_killswitch_startup (UrfKillswitch *killswitch)
+{
+	GDBusProxy *proxy;
+	GError *error = NULL;
 
+	/* connect to the correct path for properties */
+	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                                       G_DBUS_PROXY_FLAGS_NONE,
+	                                       NULL,
+	                                       "org.freedesktop.URfkill",
+	                                       urf_killswitch_type_to_object_path (killswitch->priv->type),
+	                                       "org.freedesktop.URfkill.Killswitch",
+	                                       NULL,
+	                                       &error);
 	if (error) {
-		g_warning ("UrfKillswitch: %s", error->message);
+		g_warning ("UrfKillswitch: Couldn't connect to proxy: %s", error->message);
 		g_error_free (error);
+		return FALSE;
 	}
 
-	return ret;
+	urf_killswitch_set_proxy (killswitch, proxy);
+	g_object_unref (proxy);
+
+	return TRUE;
 }
 
 /**
  * set_block_cb:
  **/
 static void
-set_block_cb (GDBusProxy     *proxy,
-              GAsyncResult   *res,
-	      gpointer        user_data)
+set_block_cb (GDBusProxy   *proxy,
+              GAsyncResult *res,
+	      gpointer      user_data)
 {
 	GVariant *retval;
-	gboolean status;
+	gboolean status = FALSE;
 	GError *error = NULL;
 
 	retval = g_dbus_proxy_call_finish (proxy, res, &error);
-	if (retval)
+	if (retval) {
 		g_variant_get (retval, "(b)", &status);
+		g_variant_unref (retval);
+	}
 
 	if (error) {
 		g_warning ("Failed to set BLOCK: %s", error->message);
@@ -235,8 +223,6 @@ set_block_cb (GDBusProxy     *proxy,
 	} else if (!status) {
 		g_warning ("Failed to set BLOCK");
 	}
-
-	g_object_unref (proxy);
 }
 
 /**
@@ -247,37 +233,28 @@ urf_killswitch_set_block (UrfKillswitch  *killswitch,
 			  UrfEnumState    state)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
-	GDBusProxy *proxy;
 	gboolean block;
-	GError *error = NULL;
+
+	if (priv->proxy == NULL)
+		return;
 
 	if (state == URF_ENUM_STATE_UNBLOCKED)
 		block = FALSE;
 	else
 		block = TRUE;
 
-	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                       G_DBUS_PROXY_FLAGS_NONE,
-	                                       NULL,
-	                                       "org.freedesktop.URfkill",
-	                                       "/org/freedesktop/URfkill",
-	                                       "org.freedesktop.URfkill",
-	                                       NULL,
-	                                       &error);
-	if (error) {
-		g_warning ("Couldn't connect to proxy to set block: %s",
-		           error->message);
-		g_error_free (error);
+	if (priv->manager == NULL)
+		priv->manager = urf_client_get_manager_proxy (g_dbus_proxy_get_connection (priv->proxy));
+	if (priv->manager == NULL)
 		return;
-	}
-	g_dbus_proxy_call (proxy, "Block",
-	                   g_variant_new ("(ub)",
-	                                  priv->type,
-	                                  block),
+
+	g_dbus_proxy_call (priv->manager,
+	                   "Block",
+	                   g_variant_new ("(ub)", priv->type, block),
 	                   G_DBUS_CALL_FLAGS_NONE,
 	                   -1, NULL,
 	                   (GAsyncReadyCallback) set_block_cb,
-	                   killswitch);
+	                   NULL);
 }
 
 /**
@@ -354,6 +331,11 @@ urf_killswitch_dispose (GObject *object)
 
 	priv = URF_KILLSWITCH (object)->priv;
 
+	if (priv->manager) {
+		g_object_unref (priv->manager);
+		priv->manager = NULL;
+	}
+
 	if (priv->proxy) {
 		g_object_unref (priv->proxy);
 		priv->proxy = NULL;
@@ -429,6 +411,10 @@ urf_killswitch_init (UrfKillswitch *killswitch)
 {
 	killswitch->priv = URF_KILLSWITCH_GET_PRIVATE (killswitch);
 	killswitch->priv->object_path = NULL;
+	killswitch->priv->proxy = NULL;
+	killswitch->priv->manager = NULL;
+	killswitch->priv->init_results = NULL;
+	killswitch->priv->state = URF_ENUM_STATE_NO_ADAPTER;
 }
 
 /**
@@ -446,19 +432,158 @@ urf_killswitch_new (UrfEnumType type)
 {
 	UrfKillswitch *killswitch;
 
-	if (type == URF_ENUM_TYPE_ALL)
+	if (type == URF_ENUM_TYPE_ALL || type >= URF_ENUM_TYPE_NUM)
 		return NULL;
 
 	if (urf_killswitch_object[type] != NULL) {
-		g_object_ref (urf_killswitch_object[type]);
+		killswitch = g_object_ref (urf_killswitch_object[type]);
+		/* still waiting for urf_killswitch_new_async */
+		if (killswitch->priv->proxy == NULL &&
+		    urf_killswitch_startup (killswitch) == FALSE) {
+			g_object_unref (killswitch);
+			return NULL;
+		}
 	} else {
 		killswitch = URF_KILLSWITCH (g_object_new (URF_TYPE_KILLSWITCH, NULL));
 		killswitch->priv->type = type;
-		if (urf_killswitch_startup (killswitch) == FALSE)
+		if (urf_killswitch_startup (killswitch) == FALSE) {
+			g_object_unref (killswitch);
 			return NULL;
+		}
+		urf_killswitch_object[type] = (gpointer)killswitch;
+		g_object_add_weak_pointer (urf_killswitch_object[type], &urf_killswitch_object[type]);
+	}
+
+	return killswitch;
+}
+
+/**
+ * urf_killswitch_proxy_new_cb:
+ **/
+static void
+urf_killswitch_proxy_new_cb (GObject      *source_object,
+			     GAsyncResult *res,
+			     gpointer      user_data)
+{
+	UrfKillswitch *killswitch = URF_KILLSWITCH (user_data);
+	GSimpleAsyncResult *simple;
+	GDBusProxy *proxy;
+	GList *results, *item;
+	gboolean connected;
+	GError *error = NULL;
+
+	proxy = g_dbus_proxy_new_for_bus_finish (res, &error);
+	if (proxy != NULL) {
+		if (killswitch->priv->proxy == NULL)
+			urf_killswitch_set_proxy (killswitch, proxy);
+		g_object_unref (proxy);
+	}
+
+	connected = (killswitch->priv->proxy != NULL);
+	results = killswitch->priv->init_results;
+	killswitch->priv->init_results = NULL;
+
+	/* the results hold the only references to the killswitch */
+	for (item = results; item; item = item->next) {
+		simple = G_SIMPLE_ASYNC_RESULT (item->data);
+		if (!connected)
+			g_simple_async_result_set_from_error (simple, error);
+		g_simple_async_result_complete (simple);
+		g_object_unref (simple);
+	}
+
+	g_list_free (results);
+	if (error)
+		g_error_free (error);
+}
+
+/**
+ * urf_killswitch_new_async:
+ * @type: The killswitch type
+ * @cancellable: a #GCancellable or %NULL
+ * @callback: a #GAsyncReadyCallback to call when the killswitch is ready
+ * @user_data: the data to pass to @callback
+ *
+ * Asynchronously creates a new #UrfKillswitch object. Call
+ * #urf_killswitch_new_finish from @callback to get it.
+ *
+ * Since: 0.6.0
+ **/
+void
+urf_killswitch_new_async (UrfEnumType          type,
+			  GCancellable        *cancellable,
+			  GAsyncReadyCallback  callback,
+			  gpointer             user_data)
+{
+	UrfKillswitch *killswitch;
+	GSimpleAsyncResult *simple;
+	gboolean pending;
+
+	if (type == URF_ENUM_TYPE_ALL || type >= URF_ENUM_TYPE_NUM) {
+		g_simple_async_report_error_in_idle (NULL, callback, user_data,
+						     1, 0, "Invalid killswitch type %d", type);
+		return;
+	}
+
+	if (urf_killswitch_object[type] != NULL) {
+		killswitch = g_object_ref (urf_killswitch_object[type]);
+	} else {
+		killswitch = URF_KILLSWITCH (g_object_new (URF_TYPE_KILLSWITCH, NULL));
+		killswitch->priv->type = type;
 		urf_killswitch_object[type] = (gpointer)killswitch;
 		g_object_add_weak_pointer (urf_killswitch_object[type], &urf_killswitch_object[type]);
 	}
 
-	return URF_KILLSWITCH (urf_killswitch_object[type]);
+	simple = g_simple_async_result_new (NULL, callback, user_data,
+					    urf_killswitch_new_async);
+	g_simple_async_result_set_op_res_gpointer (simple, killswitch, g_object_unref);
+
+	if (killswitch->priv->proxy != NULL) {
+		g_simple_async_result_complete_in_idle (simple);
+		g_object_unref (simple);
+		return;
+	}
+
+	pending = (killswitch->priv->init_results != NULL);
+	killswitch->priv->init_results = g_list_append (killswitch->priv->init_results, simple);
+	if (pending)
+		return;
+
+	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
+				  G_DBUS_PROXY_FLAGS_NONE,
+				  NULL,
+				  "org.freedesktop.URfkill",
+				  urf_killswitch_type_to_object_path (type),
+				  "org.freedesktop.URfkill.Killswitch",
+				  cancellable,
+				  urf_killswitch_proxy_new_cb,
+				  killswitch);
+}
+
+/**
+ * urf_killswitch_new_finish:
+ * @res: the #GAsyncResult passed to the callback
+ * @error: a #GError, or %NULL
+ *
+ * Finish an operation started with #urf_killswitch_new_async.
+ *
+ * Return value: (transfer full): a #UrfKillswitch object, or %NULL and @error is used
+ *
+ * Since: 0.6.0
+ **/
+UrfKillswitch *
+urf_killswitch_new_finish (GAsyncResult  *res,
+			   GError       **error)
+{
+	GSimpleAsyncResult *simple;
+
+	g_return_val_if_fail (g_simple_async_result_is_valid (res, NULL,
+							      urf_killswitch_new_async),
+			      NULL);
+
+	simple = G_SIMPLE_ASYNC_RESULT (res);
+	if (g_simple_async_result_propagate_error (simple, error))
+		return NULL;
+
+	return g_object_ref (g_simple_async_result_get_op_res_gpointer (simple));
 }
@@ -73,6 +73,12 @@ struct _UrfKillswitchClass
 /* general */
 GType			 urf_killswitch_get_type	(void);
 UrfKillswitch		*urf_killswitch_new		(UrfEnumType	 type);
+void			 urf_killswitch_new_async	(UrfEnumType	 type,
+							 GCancellable	*cancellable,
+							 GAsyncReadyCallback callback,
+							 gpointer	 user_data);
+UrfKillswitch		*urf_killswitch_new_finish	(GAsyncResult	*res,
+							 GError		**error);
 UrfEnumType		 urf_killswitch_get_switch_type	(UrfKillswitch	*killswitch);
 
 G_END_DECLS
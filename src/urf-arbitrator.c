@@ -25,6 +25,7 @@
 #endif
 
 #include <errno.h>
+#include <string.h>
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
@@ -37,9 +38,13 @@
 #define RFKILL_EVENT_SIZE_V1    8
 #endif
 
+/* Large enough for any known and future rfkill_event layout */
+#define RFKILL_EVENT_BUF_SIZE	64
+
 #include "urf-config.h"
 #include "urf-arbitrator.h"
 #include "urf-killswitch.h"
+#include "urf-rfkill-writer.h"
 #include "urf-utils.h"
 
 #include "urf-device.h"
@@ -59,12 +64,17 @@ static int signals[LAST_SIGNAL] = { 0 };
 
 struct UrfArbitratorPrivate {
 	int		 fd;
+	UrfRfkillWriter	*writer;
 	UrfConfig	*config;
 	gboolean	 force_sync;
 	gboolean	 persist;
 	GIOChannel	*channel;
 	guint		 watch_id;
-	GList		*devices; /* a GList of UrfDevice */
+	guint		 n_events_read;
+	guint		 n_events_applied;
+	GDBusConnection	*connection;
+	GQueue		*devices; /* UrfDevice in the order they were added */
+	GHashTable	*device_index; /* index -> GList link in devices */
 	UrfKillswitch	*killswitch[NUM_RFKILL_TYPES];
 };
 
@@ -77,19 +87,112 @@ static UrfDevice *
 urf_arbitrator_find_device (UrfArbitrator *arbitrator,
                             gint           index)
 {
-	UrfArbitratorPrivate *priv = arbitrator->priv;
-	UrfDevice *device;
-	GList *item;
+	GList *link;
 
 	g_return_val_if_fail (index >= 0, NULL);
 
-	for (item = priv->devices; item != NULL; item = item->next) {
-		device = (UrfDevice *)item->data;
-		if (urf_device_get_index (device) == index)
-			return device;
+	link = g_hash_table_lookup (arbitrator->priv->device_index,
+				    GINT_TO_POINTER (index));
+	if (link == NULL)
+		return NULL;
+
+	return (UrfDevice *)link->data;
+}
+
+/**
+ * urf_arbitrator_unlink_device:
+ *
+ * Drop the device from the registry without touching its reference.
+ *
+ * Return value: #TRUE if the device was registered, otherwise #FALSE
+ **/
+static gboolean
+urf_arbitrator_unlink_device (UrfArbitrator *arbitrator,
+			      UrfDevice     *device)
+{
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	gpointer key;
+	GList *link;
+
+	key = GINT_TO_POINTER (urf_device_get_index (device));
+	link = g_hash_table_lookup (priv->device_index, key);
+	if (link == NULL || link->data != device)
+		return FALSE;
+
+	g_hash_table_remove (priv->device_index, key);
+	g_queue_delete_link (priv->devices, link);
+
+	return TRUE;
+}
+
+/**
+ * urf_arbitrator_set_block_types:
+ * @type_mask: (1 << type) for every type to change; the bit of
+ *             RFKILL_TYPE_ALL selects every type with a device
+ * @results: (out) (allow-none): NUM_RFKILL_TYPES results indexed by type
+ *
+ * All the types are queued first and written to the kernel in a single
+ * flush. Only the types that were changed are persisted.
+ *
+ * Return value: #TRUE if at least one type was changed
+ **/
+gboolean
+urf_arbitrator_set_block_types (UrfArbitrator  *arbitrator,
+				const guint32   type_mask,
+				const gboolean  block,
+				gboolean       *results)
+{
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	KillswitchState targets[NUM_RFKILL_TYPES];
+	gboolean changed[NUM_RFKILL_TYPES];
+	gboolean result = FALSE;
+	gboolean flushed;
+	int i;
+
+	for (i = RFKILL_TYPE_ALL; i < NUM_RFKILL_TYPES; i++) {
+		targets[i] = KILLSWITCH_STATE_NO_ADAPTER;
+		changed[i] = FALSE;
 	}
 
-	return NULL;
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		/* There is no killswitch for ALL, it only picks the
+		 * types which have devices */
+		if (!(type_mask & (1 << i)) &&
+		    (!(type_mask & (1 << RFKILL_TYPE_ALL)) ||
+		     urf_killswitch_get_state (priv->killswitch[i]) == KILLSWITCH_STATE_NO_ADAPTER))
+			continue;
+
+		g_message ("Setting %s devices to %s",
+		           type_to_string (i),
+		           block ? "blocked" : "unblocked");
+
+		changed[i] = urf_killswitch_set_software_blocked (priv->killswitch[i], block);
+	}
+
+	flushed = urf_rfkill_writer_flush (priv->writer);
+
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		if (changed[i] && !flushed)
+			/* no device index, only CHANGE_ALL was queued */
+			changed[i] = urf_rfkill_writer_flushed (priv->writer, G_MAXUINT32, i);
+		if (!changed[i])
+			continue;
+
+		targets[i] = block ? KILLSWITCH_STATE_SOFT_BLOCKED
+		                   : KILLSWITCH_STATE_UNBLOCKED;
+		result = TRUE;
+	}
+
+	if (result)
+		urf_config_set_persist_states (priv->config, targets);
+
+	if (results) {
+		for (i = RFKILL_TYPE_ALL; i < NUM_RFKILL_TYPES; i++)
+			results[i] = changed[i];
+		results[RFKILL_TYPE_ALL] = result;
+	}
+
+	return result;
 }
 
 /**
@@ -100,23 +203,94 @@ urf_arbitrator_set_block (UrfArbitrator  *arbitrator,
 			  const gint      type,
 			  const gboolean  block)
 {
-	UrfArbitratorPrivate *priv = arbitrator->priv;
-	gboolean result = FALSE;
+	gboolean result;
 
 	g_return_val_if_fail (type >= 0, FALSE);
 	g_return_val_if_fail (type < NUM_RFKILL_TYPES, FALSE);
 
-	g_message ("Setting %s devices to %s",
-                   type_to_string (type),
-                   block ? "blocked" : "unblocked");
-
-	result = urf_killswitch_set_software_blocked (priv->killswitch[type], block);
+	result = urf_arbitrator_set_block_types (arbitrator, 1 << type, block, NULL);
 	if (!result)
 		g_warning ("No device with type %u to block", type);
-	else {
-		urf_config_set_persist_state (priv->config, type, block);
+
+	return result;
+}
+
+/**
+ * urf_arbitrator_set_block_many:
+ * @results: (out) (allow-none): @n_items results in the order of @indexes
+ *
+ * The kernel devices are queued and written in a single flush; the
+ * others are set directly as they come.
+ *
+ * Return value: #TRUE if at least one device was changed
+ **/
+gboolean
+urf_arbitrator_set_block_many (UrfArbitrator  *arbitrator,
+			       const guint32  *indexes,
+			       const gboolean *blocks,
+			       const guint     n_items,
+			       gboolean       *results)
+{
+	UrfArbitratorPrivate *priv = arbitrator->priv;
+	UrfDevice *device;
+	gboolean *queued;
+	gboolean *done;
+	gboolean result = FALSE;
+	gboolean flushed;
+	guint i;
+
+	queued = g_new0 (gboolean, n_items);
+	done = results ? results : g_new0 (gboolean, n_items);
+
+	for (i = 0; i < n_items; i++) {
+		done[i] = FALSE;
+
+		/* the indexes come straight from a(ub) */
+		if (indexes[i] > G_MAXINT) {
+			g_warning ("Block many: Invalid index %u", indexes[i]);
+			continue;
+		}
+
+		device = urf_arbitrator_find_device (arbitrator, indexes[i]);
+		if (device == NULL) {
+			g_warning ("Block many: No device with index %u", indexes[i]);
+			continue;
+		}
+
+		g_message ("Setting device %u (%s) to %s",
+		           indexes[i],
+		           type_to_string (urf_device_get_device_type (device)),
+		           blocks[i] ? "blocked" : "unblocked");
+
+		if (URF_IS_DEVICE_KERNEL (device)) {
+			urf_rfkill_writer_queue (priv->writer, RFKILL_OP_CHANGE,
+						 indexes[i],
+						 urf_device_get_device_type (device),
+						 blocks[i]);
+			queued[i] = TRUE;
+		} else {
+			done[i] = urf_device_set_software_blocked (device, blocks[i]);
+		}
 	}
 
+	flushed = urf_rfkill_writer_flush (priv->writer);
+
+	for (i = 0; i < n_items; i++) {
+		if (queued[i] && !flushed) {
+			device = urf_arbitrator_find_device (arbitrator, indexes[i]);
+			done[i] = urf_rfkill_writer_flushed (priv->writer, indexes[i],
+			                                     urf_device_get_device_type (device));
+		} else if (queued[i]) {
+			done[i] = TRUE;
+		}
+		if (done[i])
+			result = TRUE;
+	}
+
+	g_free (queued);
+	if (done != results)
+		g_free (done);
+
 	return result;
 }
 
@@ -151,6 +325,10 @@ urf_arbitrator_set_block_idx (UrfArbitrator  *arbitrator,
 
 /**
  * urf_arbitrator_set_flight_mode:
+ *
+ * Flight mode is applied as one transaction: the target state of every
+ * type is worked out first, all the kernel writes go out in a single
+ * flush, and the persistence data is only updated once that succeeded.
  **/
 gboolean
 urf_arbitrator_set_flight_mode (UrfArbitrator  *arbitrator,
@@ -159,52 +337,80 @@ urf_arbitrator_set_flight_mode (UrfArbitrator  *arbitrator,
 	UrfArbitratorPrivate *priv = arbitrator->priv;
 	KillswitchState state = KILLSWITCH_STATE_NO_ADAPTER;
 	KillswitchState saved_state = KILLSWITCH_STATE_NO_ADAPTER;
+	KillswitchState targets[NUM_RFKILL_TYPES];
 	gboolean want_state = FALSE;
-	gboolean ret = FALSE;
+	gboolean found = FALSE;
+	gboolean ret = TRUE;
 	int i;
 
 	g_message("set_flight_mode: %d:", (int) block);
 
-        urf_config_set_persist_state (priv->config, RFKILL_TYPE_ALL, block);
+	targets[RFKILL_TYPE_ALL] = block ? KILLSWITCH_STATE_SOFT_BLOCKED
+	                                 : KILLSWITCH_STATE_UNBLOCKED;
 
 	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		targets[i] = KILLSWITCH_STATE_NO_ADAPTER;
 		state = urf_killswitch_get_state (priv->killswitch[i]);
 
-		if (state != KILLSWITCH_STATE_NO_ADAPTER) {
-			g_message("killswitch[%s] state: %s", type_to_string(i),
-				  state_to_string(state));
+		if (state == KILLSWITCH_STATE_NO_ADAPTER)
+			continue;
 
-			saved_state = urf_killswitch_get_saved_state(priv->killswitch[i]);
-			g_debug("saved_state is: %s", state_to_string(saved_state));
+		g_message("killswitch[%s] state: %s", type_to_string(i),
+			  state_to_string(state));
 
-			if (block)
-				urf_killswitch_set_saved_state(priv->killswitch[i], state);
+		saved_state = urf_killswitch_get_saved_state(priv->killswitch[i]);
+		g_debug("saved_state is: %s", state_to_string(saved_state));
 
-			if (!block && state == saved_state)
-				want_state = (gboolean)(saved_state > KILLSWITCH_STATE_UNBLOCKED);
-			else
-				want_state = block;
+		if (block)
+			urf_killswitch_set_saved_state(priv->killswitch[i], state);
 
-			g_debug ("calling set_block %s %s",
-				 type_to_string(i),
-				 want_state ? "TRUE" : "FALSE");
+		if (!block && state == saved_state)
+			want_state = (gboolean)(saved_state > KILLSWITCH_STATE_UNBLOCKED);
+		else
+			want_state = block;
 
-			ret = urf_arbitrator_set_block (arbitrator, i, want_state);
-		}
+		targets[i] = want_state ? KILLSWITCH_STATE_SOFT_BLOCKED
+		                        : KILLSWITCH_STATE_UNBLOCKED;
 	}
 
-	return ret;
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		if (targets[i] == KILLSWITCH_STATE_NO_ADAPTER)
+			continue;
+
+		g_debug ("queueing %s %s",
+			 type_to_string(i),
+			 targets[i] != KILLSWITCH_STATE_UNBLOCKED ? "TRUE" : "FALSE");
+
+		found = TRUE;
+		if (!urf_killswitch_set_software_blocked (priv->killswitch[i],
+							  targets[i] != KILLSWITCH_STATE_UNBLOCKED))
+			ret = FALSE;
+	}
+
+	if (!urf_rfkill_writer_flush (priv->writer))
+		ret = FALSE;
+
+	if (ret)
+		urf_config_set_persist_states (priv->config, targets);
+
+	return ret && found;
 }
 
 /**
  * urf_arbitrator_get_state:
+ *
+ * For RFKILL_TYPE_ALL the least blocked state of all the killswitches
+ * with devices is returned, i.e. it only reads as blocked when no radio
+ * of any type is usable.
  **/
 KillswitchState
 urf_arbitrator_get_state (UrfArbitrator *arbitrator,
 			  gint           type)
 {
 	UrfArbitratorPrivate *priv;
+	KillswitchState type_state;
 	int state = KILLSWITCH_STATE_NO_ADAPTER;
+	int i;
 
 	g_return_val_if_fail (URF_IS_ARBITRATOR (arbitrator), state);
 	g_return_val_if_fail (type >= 0, state);
@@ -212,9 +418,17 @@ urf_arbitrator_get_state (UrfArbitrator *arbitrator,
 
 	priv = arbitrator->priv;
 
-	if (type == RFKILL_TYPE_ALL)
-		type = RFKILL_TYPE_WLAN;
-	state = urf_killswitch_get_state (priv->killswitch[type]);
+	if (type == RFKILL_TYPE_ALL) {
+		for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+			type_state = urf_killswitch_get_state (priv->killswitch[i]);
+			if (type_state == KILLSWITCH_STATE_NO_ADAPTER)
+				continue;
+			if (state == KILLSWITCH_STATE_NO_ADAPTER || type_state < state)
+				state = type_state;
+		}
+	} else {
+		state = urf_killswitch_get_state (priv->killswitch[type]);
+	}
 
 	g_debug ("devices %s state %s",
 		 type_to_string (type), state_to_string (state));
@@ -238,9 +452,6 @@ urf_arbitrator_get_state_idx (UrfArbitrator *arbitrator,
 
 	priv = arbitrator->priv;
 
-	if (priv->devices == NULL)
-		return state;
-
 	device = urf_arbitrator_find_device (arbitrator, index);
 	if (device) {
 		state = urf_device_get_state (device);
@@ -269,7 +480,15 @@ urf_arbitrator_add_device (UrfArbitrator *arbitrator, UrfDevice *device)
 	index = urf_device_get_index (device);
 	soft = urf_device_is_software_blocked (device);
 
-	priv->devices = g_list_append (priv->devices, device);
+	if (urf_arbitrator_find_device (arbitrator, index) != NULL) {
+		g_warning ("device with index %u already in the list", index);
+		return FALSE;
+	}
+
+	g_queue_push_tail (priv->devices, device);
+	g_hash_table_insert (priv->device_index,
+			     GINT_TO_POINTER (index),
+			     priv->devices->tail);
 
 	urf_killswitch_add_device (priv->killswitch[type], device);
 
@@ -289,8 +508,7 @@ urf_arbitrator_add_device (UrfArbitrator *arbitrator, UrfDevice *device)
 		urf_arbitrator_set_block_idx (arbitrator, index, soft);
 	}
 
-	g_signal_emit (G_OBJECT (arbitrator), signals[DEVICE_ADDED], 0,
-		       urf_device_get_object_path (device));
+	g_signal_emit (G_OBJECT (arbitrator), signals[DEVICE_ADDED], 0, device);
 
 	return TRUE;
 }
@@ -310,12 +528,12 @@ urf_arbitrator_remove_device (UrfArbitrator *arbitrator, UrfDevice *device)
 
 	g_return_val_if_fail (type >= 0, FALSE);
 
-	arbitrator->priv->devices = g_list_remove (arbitrator->priv->devices, device);
+	if (!urf_arbitrator_unlink_device (arbitrator, device))
+		return FALSE;
 
 	urf_killswitch_del_device (arbitrator->priv->killswitch[type], device);
 
-	g_signal_emit (G_OBJECT (arbitrator), signals[DEVICE_REMOVED], 0,
-	               urf_device_get_object_path (device));
+	g_signal_emit (G_OBJECT (arbitrator), signals[DEVICE_REMOVED], 0, device);
 
 	return TRUE;
 }
@@ -328,7 +546,7 @@ urf_arbitrator_has_devices (UrfArbitrator *arbitrator)
 {
 	g_return_val_if_fail (URF_IS_ARBITRATOR (arbitrator), FALSE);
 
-	return (arbitrator->priv->devices != NULL);
+	return !g_queue_is_empty (arbitrator->priv->devices);
 }
 
 /**
@@ -339,7 +557,20 @@ urf_arbitrator_get_devices (UrfArbitrator *arbitrator)
 {
 	g_return_val_if_fail (URF_IS_ARBITRATOR (arbitrator), NULL);
 
-	return arbitrator->priv->devices;
+	return arbitrator->priv->devices->head;
+}
+
+/**
+ * urf_arbitrator_get_killswitch:
+ **/
+UrfKillswitch *
+urf_arbitrator_get_killswitch (UrfArbitrator *arbitrator,
+			       const gint     type)
+{
+	g_return_val_if_fail (URF_IS_ARBITRATOR (arbitrator), NULL);
+	g_return_val_if_fail (type > RFKILL_TYPE_ALL && type < NUM_RFKILL_TYPES, NULL);
+
+	return arbitrator->priv->killswitch[type];
 }
 
 /**
@@ -415,7 +646,6 @@ remove_killswitch (UrfArbitrator *arbitrator,
 	UrfDevice *device;
 	gint type;
 	const char *name;
-	char *object_path = NULL;
 
 	g_return_if_fail (index >= 0);
 
@@ -425,18 +655,16 @@ remove_killswitch (UrfArbitrator *arbitrator,
 		return;
 	}
 
-	priv->devices = g_list_remove (priv->devices, device);
+	urf_arbitrator_unlink_device (arbitrator, device);
 	type = urf_device_get_device_type (device);
-	object_path = g_strdup (urf_device_get_object_path(device));
 
 	name = urf_device_get_name (device);
 	g_message ("removing killswitch idx %d %s", index, name);
 
 	urf_killswitch_del_device (priv->killswitch[type], device);
-	g_object_unref (device);
 
-	g_signal_emit (G_OBJECT (arbitrator), signals[DEVICE_REMOVED], 0, object_path);
-	g_free (object_path);
+	g_signal_emit (G_OBJECT (arbitrator), signals[DEVICE_REMOVED], 0, device);
+	g_object_unref (device);
 }
 
 /**
@@ -450,6 +678,7 @@ add_killswitch (UrfArbitrator *arbitrator,
 		gboolean       hard)
 
 {
+	UrfArbitratorPrivate *priv = arbitrator->priv;
 	UrfDevice *device;
 
 	g_return_if_fail (index >= 0);
@@ -463,9 +692,13 @@ add_killswitch (UrfArbitrator *arbitrator,
 
 	g_message ("adding killswitch idx %d soft %d hard %d", index, soft, hard);
 
-	device = urf_device_kernel_new (index, type, soft, hard);
+	device = urf_device_kernel_new (index, type, soft, hard,
+					priv->writer, priv->connection);
+	if (device == NULL)
+		return;
 
-	urf_arbitrator_add_device (arbitrator, device);
+	if (!urf_arbitrator_add_device (arbitrator, device))
+		g_object_unref (device);
 }
 
 static const char *
@@ -495,6 +728,91 @@ print_event (struct rfkill_event *event)
 		 event->soft, event->hard);
 }
 
+/**
+ * read_events:
+ *
+ * Drain every pending event from the rfkill control device. The kernel
+ * hands out one event per read(), so keep reading until EAGAIN. Events
+ * of any size from RFKILL_EVENT_SIZE_V1 upwards are accepted. A CHANGE
+ * event replaces an earlier CHANGE for the same index in the batch, so
+ * each device is only updated once per wakeup.
+ *
+ * Return value: a #GArray of struct rfkill_event, free with g_array_free()
+ **/
+static GArray *
+read_events (int    fd,
+	     guint *n_read)
+{
+	GArray *events;
+	GHashTable *pending; /* idx -> position of the last CHANGE in events */
+	struct rfkill_event event;
+	guint8 buf[RFKILL_EVENT_BUF_SIZE];
+	gpointer pos;
+	ssize_t len;
+
+	events = g_array_new (FALSE, FALSE, sizeof (struct rfkill_event));
+	pending = g_hash_table_new (g_direct_hash, g_direct_equal);
+	*n_read = 0;
+
+	while (1) {
+		len = read (fd, buf, sizeof (buf));
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			if (errno != EAGAIN)
+				g_debug ("Reading of RFKILL events failed");
+			break;
+		}
+
+		if (len == 0)
+			break;
+
+		/* There has been a change in the kernel that allows for an extra
+		 * byte in the rfkill event struct that tracks a reason field.
+		 * see commit id 14486c82612a177cb910980c70ba900827ca0894 for
+		 * more information
+		 */
+		if (len < RFKILL_EVENT_SIZE_V1) {
+			g_warning ("Wrong size of RFKILL event");
+			continue;
+		}
+
+		memset (&event, 0, sizeof (event));
+		memcpy (&event, buf, MIN ((gsize) len, sizeof (event)));
+
+		if (event.op > RFKILL_OP_CHANGE_ALL) {
+			g_debug ("Unknown RFKILL operation %u", event.op);
+			continue;
+		}
+
+		print_event (&event);
+		(*n_read)++;
+
+		if (event.op == RFKILL_OP_CHANGE &&
+		    g_hash_table_lookup_extended (pending,
+						  GUINT_TO_POINTER (event.idx),
+						  NULL, &pos)) {
+			g_array_index (events, struct rfkill_event,
+				       GPOINTER_TO_UINT (pos)) = event;
+			continue;
+		}
+
+		g_array_append_val (events, event);
+
+		/* Never fold a CHANGE across an ADD or DEL of the same index */
+		if (event.op == RFKILL_OP_CHANGE)
+			g_hash_table_insert (pending,
+					     GUINT_TO_POINTER (event.idx),
+					     GUINT_TO_POINTER (events->len - 1));
+		else
+			g_hash_table_remove (pending, GUINT_TO_POINTER (event.idx));
+	}
+
+	g_hash_table_destroy (pending);
+
+	return events;
+}
+
 /**
  * event_cb:
  **/
@@ -504,37 +822,37 @@ event_cb (GIOChannel    *source,
 	  UrfArbitrator *arbitrator)
 {
 	if (condition & G_IO_IN) {
-		GIOStatus status;
-		struct rfkill_event event;
-		gsize read;
+		UrfArbitratorPrivate *priv = arbitrator->priv;
+		GArray *events;
+		struct rfkill_event *event;
 		gboolean soft, hard;
+		guint n_read;
+		guint i;
 
-		status = g_io_channel_read_chars (source,
-						  (char *) &event,
-						  sizeof(event),
-						  &read,
-						  NULL);
+		events = read_events (g_io_channel_unix_get_fd (source), &n_read);
 
-		while (status == G_IO_STATUS_NORMAL && read == sizeof(event)) {
-			print_event (&event);
+		priv->n_events_read += n_read;
+		priv->n_events_applied += events->len;
+		g_debug ("Applying %u of %u RFKILL events (%u of %u so far)",
+			 events->len, n_read,
+			 priv->n_events_applied, priv->n_events_read);
 
-			soft = (event.soft > 0)?TRUE:FALSE;
-			hard = (event.hard > 0)?TRUE:FALSE;
+		for (i = 0; i < events->len; i++) {
+			event = &g_array_index (events, struct rfkill_event, i);
 
-			if (event.op == RFKILL_OP_CHANGE) {
-				update_killswitch (arbitrator, event.idx, soft, hard);
-			} else if (event.op == RFKILL_OP_DEL) {
-				remove_killswitch (arbitrator, event.idx);
-			} else if (event.op == RFKILL_OP_ADD) {
-				add_killswitch (arbitrator, event.idx, event.type, soft, hard);
-			}
+			soft = (event->soft > 0)?TRUE:FALSE;
+			hard = (event->hard > 0)?TRUE:FALSE;
 
-			status = g_io_channel_read_chars (source,
-							  (char *) &event,
-							  sizeof(event),
-							  &read,
-							  NULL);
+			if (event->op == RFKILL_OP_CHANGE) {
+				update_killswitch (arbitrator, event->idx, soft, hard);
+			} else if (event->op == RFKILL_OP_DEL) {
+				remove_killswitch (arbitrator, event->idx);
+			} else if (event->op == RFKILL_OP_ADD) {
+				add_killswitch (arbitrator, event->idx, event->type, soft, hard);
+			}
 		}
+
+		g_array_free (events, TRUE);
 	} else {
 		g_debug ("something else happened");
 		return FALSE;
@@ -544,26 +862,38 @@ event_cb (GIOChannel    *source,
 }
 
 /**
- * urf_arbitrator_startup
+ * urf_arbitrator_startup_fd:
+ * @fd: the rfkill control device, open for reading and writing and
+ *      non-blocking; the arbitrator takes it over
+ *
+ * The tests hand in one end of a socketpair here and play the kernel on
+ * the other end.
  **/
 gboolean
-urf_arbitrator_startup (UrfArbitrator *arbitrator,
-			UrfConfig     *config)
+urf_arbitrator_startup_fd (UrfArbitrator   *arbitrator,
+			   UrfConfig       *config,
+			   GDBusConnection *connection,
+			   int              fd)
 {
 	UrfArbitratorPrivate *priv = arbitrator->priv;
-	struct rfkill_event event;
-	int fd;
+	struct rfkill_event *event;
+	GArray *events;
+	guint n_read;
+	guint j;
 	int i;
 
+	g_return_val_if_fail (priv->fd < 0, FALSE);
+
+	priv->fd = fd;
 	priv->config = g_object_ref (config);
 	priv->force_sync = urf_config_get_force_sync (config);
 	priv->persist =	urf_config_get_persist (config);
+	priv->connection = g_object_ref (connection);
 
-	fd = open("/dev/rfkill", O_RDWR | O_NONBLOCK);
-	if (fd < 0) {
-		if (errno == EACCES)
-			g_warning ("Could not open RFKILL control device, please verify your installation");
-		return FALSE;
+	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+		priv->killswitch[i] = urf_killswitch_new (i, priv->writer, connection);
+		if (priv->killswitch[i] == NULL)
+			return FALSE;
 	}
 
 	/* Set initial flight mode state from persistence */
@@ -574,36 +904,21 @@ urf_arbitrator_startup (UrfArbitrator *arbitrator,
 	/* Disable rfkill input */
 	ioctl(fd, RFKILL_IOCTL_NOINPUT);
 
-	priv->fd = fd;
+	urf_rfkill_writer_set_fd (priv->writer, fd);
 
-	while (1) {
-		ssize_t len;
+	events = read_events (fd, &n_read);
+	for (j = 0; j < events->len; j++) {
+		event = &g_array_index (events, struct rfkill_event, j);
 
-		len = read(fd, &event, sizeof(event));
-		if (len < 0) {
-			if (errno == EAGAIN)
-				break;
-			g_debug ("Reading of RFKILL events failed");
-			break;
-		}
-
-		/* There has been a change in the kernel that allows for an extra
-                 * byte in the rfkill event struct that tracks a reason field.
-		 * see commit id 14486c82612a177cb910980c70ba900827ca0894 for
-                 * more information
-		 */
-		if (len < RFKILL_EVENT_SIZE_V1) {
-			g_warning("Wrong size of RFKILL event\n");
-			continue;
-		}
-
-		if (event.op != RFKILL_OP_ADD)
+		if (event->op != RFKILL_OP_ADD)
 			continue;
-		if (event.type >= NUM_RFKILL_TYPES)
+		if (event->type >= NUM_RFKILL_TYPES)
 			continue;
 
-		add_killswitch (arbitrator, event.idx, event.type, event.soft, event.hard);
+		add_killswitch (arbitrator, event->idx, event->type,
+				event->soft, event->hard);
 	}
+	g_array_free (events, TRUE);
 
 	/* Setup monitoring */
 	priv->channel = g_io_channel_unix_new (priv->fd);
@@ -623,6 +938,26 @@ urf_arbitrator_startup (UrfArbitrator *arbitrator,
 	return TRUE;
 }
 
+/**
+ * urf_arbitrator_startup
+ **/
+gboolean
+urf_arbitrator_startup (UrfArbitrator   *arbitrator,
+			UrfConfig       *config,
+			GDBusConnection *connection)
+{
+	int fd;
+
+	fd = open("/dev/rfkill", O_RDWR | O_NONBLOCK);
+	if (fd < 0) {
+		if (errno == EACCES)
+			g_warning ("Could not open RFKILL control device, please verify your installation");
+		return FALSE;
+	}
+
+	return urf_arbitrator_startup_fd (arbitrator, config, connection, fd);
+}
+
 /**
  * urf_arbitrator_init:
  **/
@@ -633,12 +968,15 @@ urf_arbitrator_init (UrfArbitrator *arbitrator)
 	int i;
 
 	arbitrator->priv = priv;
-	priv->devices = NULL;
+	priv->devices = g_queue_new ();
+	priv->device_index = g_hash_table_new (g_direct_hash, g_direct_equal);
 	priv->fd = -1;
+	priv->writer = urf_rfkill_writer_new ();
+	priv->connection = NULL;
 
-	priv->killswitch[RFKILL_TYPE_ALL] = NULL;
-	for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++)
-		priv->killswitch[i] = urf_killswitch_new (i);
+	/* created in startup, once the bus connection is known */
+	for (i = 0; i < NUM_RFKILL_TYPES; i++)
+		priv->killswitch[i] = NULL;
 }
 
 /**
@@ -653,6 +991,8 @@ urf_arbitrator_dispose (GObject *object)
 
 	if (priv->persist) {
 		for (i = RFKILL_TYPE_ALL + 1; i < NUM_RFKILL_TYPES; i++) {
+			if (priv->killswitch[i] == NULL)
+				continue;
 			state = urf_killswitch_get_state (priv->killswitch[i]);
                         g_debug("dispose arbitrator: state for %d is %d", i, state);
 			urf_config_set_persist_state (priv->config, i, state);
@@ -666,12 +1006,27 @@ urf_arbitrator_dispose (GObject *object)
 		}
 	}
 
+	if (priv->device_index) {
+		g_hash_table_destroy (priv->device_index);
+		priv->device_index = NULL;
+	}
+
 	if (priv->devices) {
-		g_list_foreach (priv->devices, (GFunc) g_object_unref, NULL);
-		g_list_free (priv->devices);
+		g_queue_foreach (priv->devices, (GFunc) g_object_unref, NULL);
+		g_queue_free (priv->devices);
 		priv->devices = NULL;
 	}
 
+	if (priv->writer) {
+		g_object_unref (priv->writer);
+		priv->writer = NULL;
+	}
+
+	if (priv->connection) {
+		g_object_unref (priv->connection);
+		priv->connection = NULL;
+	}
+
 	if (priv->config) {
 		g_object_unref (priv->config);
 		priv->config = NULL;
@@ -695,7 +1050,8 @@ urf_arbitrator_finalize (GObject *object)
 		g_io_channel_shutdown (priv->channel, FALSE, NULL);
 		g_io_channel_unref (priv->channel);
 	}
-	close(priv->fd);
+	if (priv->fd >= 0)
+		close(priv->fd);
 
 	G_OBJECT_CLASS(urf_arbitrator_parent_class)->finalize(object);
 }
@@ -718,8 +1074,8 @@ urf_arbitrator_class_init(UrfArbitratorClass *klass)
 			      G_SIGNAL_RUN_LAST,
 			      G_STRUCT_OFFSET (UrfArbitratorClass, device_added),
 			      NULL, NULL,
-			      g_cclosure_marshal_VOID__STRING,
-			      G_TYPE_NONE, 1, G_TYPE_STRING);
+			      g_cclosure_marshal_VOID__OBJECT,
+			      G_TYPE_NONE, 1, URF_TYPE_DEVICE);
 
 	signals[DEVICE_REMOVED] =
 		g_signal_new ("device-removed",
@@ -727,8 +1083,8 @@ urf_arbitrator_class_init(UrfArbitratorClass *klass)
 			      G_SIGNAL_RUN_LAST,
 			      G_STRUCT_OFFSET (UrfArbitratorClass, device_removed),
 			      NULL, NULL,
-			      g_cclosure_marshal_VOID__STRING,
-			      G_TYPE_NONE, 1, G_TYPE_STRING);
+			      g_cclosure_marshal_VOID__OBJECT,
+			      G_TYPE_NONE, 1, URF_TYPE_DEVICE);
 
 	signals[DEVICE_CHANGED] =
 		g_signal_new ("device-changed",
@@ -27,6 +27,7 @@
 
 #include "urf-config.h"
 #include "urf-device.h"
+#include "urf-killswitch.h"
 #include "urf-utils.h"
 
 G_BEGIN_DECLS
@@ -54,9 +55,9 @@ typedef struct {
         GObjectClass 		 parent_class;
 
         void 			(*device_added)		(UrfArbitrator	*arbitrator,
-							 const char	*object_path);
+							 UrfDevice	*device);
         void 			(*device_removed)	(UrfArbitrator	*arbitrator,
-							 const char	*object_path);
+							 UrfDevice	*device);
         void 			(*device_changed)	(UrfArbitrator	*arbitrator,
 							 const char	*object_path);
 } UrfArbitratorClass;
@@ -65,7 +66,12 @@ GType			 urf_arbitrator_get_type		(void);
 UrfArbitrator		*urf_arbitrator_new			(void);
 
 gboolean		 urf_arbitrator_startup			(UrfArbitrator  *arbitrator,
-								 UrfConfig	*config);
+								 UrfConfig	*config,
+								 GDBusConnection *connection);
+gboolean		 urf_arbitrator_startup_fd		(UrfArbitrator  *arbitrator,
+								 UrfConfig	*config,
+								 GDBusConnection *connection,
+								 int		 fd);
 
 gboolean		 urf_arbitrator_add_device		(UrfArbitrator	*arbitrator,
 								 UrfDevice	*device);
@@ -73,11 +79,22 @@ gboolean		 urf_arbitrator_remove_device		(UrfArbitrator	*arbitrator,
 								 UrfDevice	*device);
 gboolean		 urf_arbitrator_has_devices		(UrfArbitrator	*arbitrator);
 GList			*urf_arbitrator_get_devices		(UrfArbitrator	*arbitrator);
+UrfKillswitch		*urf_arbitrator_get_killswitch		(UrfArbitrator	*arbitrator,
+								 const gint	 type);
 UrfDevice		*urf_arbitrator_get_device		(UrfArbitrator  *arbitrator,
 								 const gint	 index);
 gboolean		 urf_arbitrator_set_block		(UrfArbitrator	*arbitrator,
 								 const gint	 type,
 								 const gboolean	 block);
+gboolean		 urf_arbitrator_set_block_types		(UrfArbitrator	*arbitrator,
+								 const guint32	 type_mask,
+								 const gboolean	 block,
+								 gboolean	*results);
+gboolean		 urf_arbitrator_set_block_many		(UrfArbitrator	*arbitrator,
+								 const guint32	*indexes,
+								 const gboolean	*blocks,
+								 const guint	 n_items,
+								 gboolean	*results);
 gboolean		 urf_arbitrator_set_block_idx		(UrfArbitrator	*arbitrator,
 								 const gint	 index,
 								 const gboolean	 block);
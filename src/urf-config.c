@@ -25,450 +25,78 @@
 #include <glib.h>
 #include <glib/gstdio.h>
 #include <string.h>
-#include <expat.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
 #include <sys/stat.h>
 #include "urf-utils.h"
 #include "urf-config.h"
+#include "urf-profile.h"
 
 #define URFKILL_PROFILE_DIR URFKILL_CONFIG_DIR"profile/"
+#define URFKILL_PROFILE_DB URFKILL_PROFILE_DIR"profiles.db"
 #define URFKILL_CONFIGURED_PROFILE URFKILL_CONFIG_DIR"hardware.conf"
 #define URFKILL_PERSISTENCE_FILENAME PACKAGE_LOCALSTATE_DIR "/lib/urfkill/saved-states"
-
-enum
-{
-	OPT_NONE,
-	OPT_KEY_CONTROL,
-	OPT_MASTER_KEY,
-	OPT_FORCE_SYNC,
-	OPT_PERSIST,
-	OPT_UNKNOWN,
-};
-
-enum
-{
-	OPT_TYPE_NONE,
-	OPT_TYPE_BOOLEAN,
-	OPT_TYPE_UNKNOWN,
-};
-
-enum
-{
-	OPER_STRING,
-	OPER_STRING_OUTOF,
-	OPER_CONTAINS,
-	OPER_CONTAINS_NCASE,
-	OPER_CONTAINS_NOT,
-	OPER_CONTAINS_OUTOF,
-	OPER_PREFIX,
-	OPER_PREFIX_NCASE,
-	OPER_PREFIX_OUTOF,
-	OPER_SUFFIX,
-	OPER_SUFFIX_NCASE,
-	OPER_SUFFIX_OUTOF,
-	OPER_UNKNOWN,
-};
-
-typedef struct {
-	gboolean key_control;
-	gboolean master_key;
-	gboolean force_sync;
-	gboolean persist;
-} Options;
-
-typedef struct {
-	int	 xml_depth;
-	int	 xml_bound;
-	int	 opt;
-	int	 opt_type;
-	Options	 options;
-	DmiInfo	*hardware_info;
-} ParseInfo;
+#define URFKILL_PERSISTENCE_JOURNAL URFKILL_PERSISTENCE_FILENAME ".journal"
+
+/* Wait this long for more changes before syncing the journal... */
+#define PERSIST_SYNC_DELAY_MS		500
+/* ...but never hold a change back longer than this */
+#define PERSIST_SYNC_MAX_DELAY_MS	3000
+/* Fold the journal into the snapshot once it has this many records */
+#define PERSIST_COMPACT_RECORDS		64
+/* Reuse a polkit authorization for this many seconds by default */
+#define AUTH_CACHE_TTL_DEFAULT		5
+/* Fold rfkill key presses this close together by default */
+#define KEY_WINDOW_DEFAULT		250
 
 #define URF_CONFIG_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), \
                                      URF_TYPE_CONFIG, UrfConfigPrivate))
 struct UrfConfigPrivate {
 	char 	*user;
-	Options	 options;
-	GKeyFile *persistence_file;
+	guint	 auth_cache_ttl;
+	guint	 key_window;
+	UrfProfileOptions options;
+	gboolean persist_soft[NUM_RFKILL_TYPES];
+	gboolean persist_known[NUM_RFKILL_TYPES];
+	GString	*journal_pending; /* records not synced to the journal yet */
+	guint	 journal_pending_records;
+	gint64	 journal_pending_since;
+	guint	 journal_records; /* records in the journal file */
+	guint	 journal_sync_id;
+	gint	 journal_failed; /* set by the persistence thread */
+	GThreadPool *persist_pool;
 };
 
-G_DEFINE_TYPE(UrfConfig, urf_config, G_TYPE_OBJECT)
-
-static gpointer urf_config_object = NULL;
-
-static int
-get_option (const char *option)
-{
-	if (g_strcmp0 (option, "key_control") == 0)
-		return OPT_KEY_CONTROL;
-	else if (g_strcmp0 (option, "master_key") == 0)
-		return OPT_MASTER_KEY;
-	else if (g_strcmp0 (option, "force_sync") == 0)
-		return OPT_FORCE_SYNC;
-	else if (g_strcmp0 (option, "persist") == 0)
-		return OPT_PERSIST;
-	return OPT_UNKNOWN;
-}
-
-static int
-get_option_type (const char *type)
-{
-	if (g_strcmp0 (type, "bool") == 0)
-		return OPT_TYPE_BOOLEAN;
-	return OPT_TYPE_UNKNOWN;
-}
-
-static char *
-get_match_key (DmiInfo    *hardware_info,
-	       const char *key)
-{
-	if (hardware_info == NULL)
-		return NULL;
-
-	if (g_strcmp0 (key, "sys_vendor") == 0)
-		return hardware_info->sys_vendor;
-	else if (g_strcmp0 (key, "bios_date") == 0)
-		return hardware_info->bios_date;
-	else if (g_strcmp0 (key, "bios_vendor") == 0)
-		return hardware_info->bios_vendor;
-	else if (g_strcmp0 (key, "bios_version") == 0)
-		return hardware_info->bios_version;
-	else if (g_strcmp0 (key, "product_name") == 0)
-		return hardware_info->product_name;
-	else if (g_strcmp0 (key, "product_version") == 0)
-		return hardware_info->product_version;
-	return NULL;
-}
-
-static int
-get_operator (const char *operator)
-{
-	if (g_strcmp0 (operator, "string") == 0)
-		return OPER_STRING;
-	else if (g_strcmp0 (operator, "string_outof") == 0)
-		return OPER_STRING_OUTOF;
-	else if (g_strcmp0 (operator, "contains") == 0)
-		return OPER_CONTAINS;
-	else if (g_strcmp0 (operator, "contains_ncase") == 0)
-		return OPER_CONTAINS_NCASE;
-	else if (g_strcmp0 (operator, "contains_not") == 0)
-		return OPER_CONTAINS_NOT;
-	else if (g_strcmp0 (operator, "contains_outof") == 0)
-		return OPER_CONTAINS_OUTOF;
-	else if (g_strcmp0 (operator, "prefix") == 0)
-		return OPER_PREFIX;
-	else if (g_strcmp0 (operator, "prefix_ncase") == 0)
-		return OPER_PREFIX_NCASE;
-	else if (g_strcmp0 (operator, "prefix_outof") == 0)
-		return OPER_PREFIX_OUTOF;
-	else if (g_strcmp0 (operator, "suffix") == 0)
-		return OPER_SUFFIX;
-	else if (g_strcmp0 (operator, "suffix_ncase") == 0)
-		return OPER_SUFFIX_NCASE;
-	else if (g_strcmp0 (operator, "suffix_outof") == 0)
-		return OPER_SUFFIX_OUTOF;
-	return OPER_UNKNOWN;
-}
-
-static gboolean
-match_rule (const char *str1,
-	    const int   operator,
-	    const char *str2)
-{
-	gboolean match = FALSE;
-	char **token;
-	char *str1_lower;
-	char *str2_lower;
-	int i;
-
-	if (strlen (str1) < 1 || strlen (str2) < 1)
-		return FALSE;
-
-	switch (operator) {
-	case OPER_STRING:
-		if (g_strcmp0 (str1, str2) == 0)
-			match = TRUE;
-		break;
-	case OPER_STRING_OUTOF:
-		token = g_strsplit (str2, ";", 0);
-		for (i = 0; token[i]; i++) {
-			if (g_strcmp0 (str1, token[i]) == 0) {
-				match = TRUE;
-				break;
-			}
-		}
-		g_strfreev (token);
-		break;
-	case OPER_CONTAINS:
-		if (g_strrstr (str1, str2))
-			match = TRUE;
-		break;
-	case OPER_CONTAINS_NCASE:
-		str1_lower = g_ascii_strdown (str1, -1);
-		str2_lower = g_ascii_strdown (str2, -1);
-		if (g_strrstr (str1_lower, str2_lower))
-			match = TRUE;
-		g_free (str1_lower);
-		g_free (str2_lower);
-		break;
-	case OPER_CONTAINS_NOT:
-		if (g_strrstr (str1, str2) == NULL)
-			match = TRUE;
-		break;
-	case OPER_CONTAINS_OUTOF:
-		token = g_strsplit (str2, ";", 0);
-		for (i = 0; token[i]; i++) {
-			if (strlen (token[i]) < 1) {
-				continue;
-			} else if (g_strrstr (str1, token[i])) {
-				match = TRUE;
-				break;
-			}
-		}
-		g_strfreev (token);
-		break;
-	case OPER_PREFIX:
-		if (g_str_has_prefix (str1, str2))
-			match = TRUE;
-		break;
-	case OPER_PREFIX_NCASE:
-		str1_lower = g_ascii_strdown (str1, -1);
-		str2_lower = g_ascii_strdown (str2, -1);
-		if (g_str_has_prefix (str1_lower, str2_lower))
-			match = TRUE;
-		g_free (str1_lower);
-		g_free (str2_lower);
-		break;
-	case OPER_PREFIX_OUTOF:
-		token = g_strsplit (str2, ";", 0);
-		for (i = 0; token[i]; i++) {
-			if (strlen (token[i]) < 1) {
-				continue;
-			} else if (g_str_has_prefix (str1, token[i])) {
-				match = TRUE;
-				break;
-			}
-		}
-		g_strfreev (token);
-		break;
-	case OPER_SUFFIX:
-		if (g_str_has_suffix (str1, str2))
-			match = TRUE;
-		break;
-	case OPER_SUFFIX_NCASE:
-		str1_lower = g_ascii_strdown (str1, -1);
-		str2_lower = g_ascii_strdown (str2, -1);
-		if (g_str_has_suffix (str1_lower, str2_lower))
-			match = TRUE;
-		g_free (str1_lower);
-		g_free (str2_lower);
-		break;
-	case OPER_SUFFIX_OUTOF:
-		token = g_strsplit (str2, ";", 0);
-		for (i = 0; token[i]; i++) {
-			if (strlen (token[i]) < 1) {
-				continue;
-			} else if (g_str_has_suffix (str1, token[i])) {
-				match = TRUE;
-				break;
-			}
-		}
-		g_strfreev (token);
-		break;
-	default:
-		match = FALSE;
-		break;
-	}
-
-	return match;
-}
-
-static void
-parse_xml_cdata_handler (void       *data,
-			 const char *cdata,
-			 int         len)
-{
-	ParseInfo *info = (ParseInfo *)data;
-	char *str;
-
-	if (info->opt == OPT_NONE ||
-	    info->opt == OPT_UNKNOWN) {
-		return;
-	}
-
-	str = g_strndup (cdata, len);
-
-	switch (info->opt) {
-	case OPT_KEY_CONTROL:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.key_control = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.key_control = FALSE;
-		break;
-	case OPT_MASTER_KEY:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.master_key = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.master_key = FALSE;
-		break;
-	case OPT_FORCE_SYNC:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.force_sync = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.force_sync = FALSE;
-		break;
-	case OPT_PERSIST:
-		if (g_ascii_strcasecmp (str, "TRUE") == 0)
-			info->options.persist = TRUE;
-		else if (g_ascii_strcasecmp (str, "FALSE") == 0)
-			info->options.persist = FALSE;
-		break;
-	default:
-		break;
-	}
-
-	g_free (str);
-}
-
-static void
-parse_xml_start_element (void       *data,
-			 const char *name,
-			 const char **atts)
-{
-	ParseInfo *info = (ParseInfo *)data;
-	const char *key = NULL;
-	const char *type = NULL;
-	const char *match_key = NULL;
-	const char *match_body = NULL;
-	int operator = 0;
-	int i;
-
-	info->xml_depth++;
-
-	if (info->xml_depth > info->xml_bound)
-		return;
-	else if (info->xml_depth < info->xml_bound)
-		info->xml_bound = info->xml_depth + 1;
-
-	info->opt = OPT_NONE;
-	info->opt_type = OPT_TYPE_NONE;
-
-	if (g_strcmp0 (name, "match") == 0) {
-		for (i = 0; atts[i]; i++) {
-			if (g_strcmp0 (atts[i], "key") == 0) {
-				if (!atts[i+1])
-					continue;
-				key = atts[i+1];
-				i++;
-			} else if ((operator = get_operator (atts[i])) != OPER_UNKNOWN) {
-				if (!atts[i+1])
-					continue;
-				match_body = atts[i+1];
-				i++;
-			}
-		}
-
-		match_key = get_match_key (info->hardware_info, key);
-		if (match_key && !match_rule (match_key, operator, match_body))
-			return;
-	} else if (g_strcmp0 (name, "option") == 0) {
-		for (i = 0; atts[i]; i++) {
-			if (g_strcmp0 (atts[i], "key") == 0) {
-				if (!atts[i+1])
-					continue;
-				key = atts[i+1];
-				i++;
-			} else if (g_strcmp0 (atts[i], "type") == 0) {
-				if (!atts[i+1])
-					continue;
-				type = atts[i+1];
-				i++;
-			}
-		}
-
-		info->opt = get_option (key);
-		info->opt_type = get_option_type (type);
-	}
-
-	info->xml_bound++;
-}
-
-static void
-parse_xml_end_element (void       *data,
-		       const char *name)
-{
-	ParseInfo *info = (ParseInfo *)data;
-
-	if (info->xml_bound > info->xml_depth)
-		info->xml_bound = info->xml_depth;
-
-	info->opt = OPT_NONE;
-	info->opt_type = OPT_TYPE_NONE;
-
-	info->xml_depth--;
-}
-
-static gboolean
-profile_xml_parse (DmiInfo    *hardware_info,
-		   Options    *options,
-		   const char *filename)
-{
-	ParseInfo *info;
-	XML_Parser parser;
-	char *content;
-	gsize length;
-	int len;
-
-	if (!g_file_get_contents (filename, &content, &length, NULL)) {
-		g_warning ("Failed to read profile: %s", filename);
-		return FALSE;
-	}
-
-	info = g_new0 (ParseInfo, 1);
-	info->hardware_info = hardware_info;
-	info->xml_depth = 0;
-	info->xml_bound = 1;
-	info->opt = OPT_NONE;
-	info->opt_type = OPT_TYPE_NONE;
-	info->options.key_control = options->key_control;
-	info->options.master_key = options->master_key;
-	info->options.force_sync = options->force_sync;
-	info->options.persist = options->persist;
-
-	parser = XML_ParserCreate (NULL);
-	XML_SetUserData (parser, (void *)info);
-	XML_SetElementHandler (parser,
-			       parse_xml_start_element,
-			       parse_xml_end_element);
-	XML_SetCharacterDataHandler (parser,
-				     parse_xml_cdata_handler);
-	len = strlen (content);
-
-	if (XML_Parse (parser, content, len, 1) == XML_STATUS_ERROR) {
-		g_warning ("Profile Parse error: %s", filename);
-		XML_ParserFree (parser);
-		g_free (info);
-		return FALSE;
-	}
+typedef enum {
+	PERSIST_JOB_JOURNAL,
+	PERSIST_JOB_SNAPSHOT
+} PersistJobKind;
 
-	XML_ParserFree (parser);
+typedef struct {
+	PersistJobKind kind;
+	char	*content;
+	gsize	 length;
+} PersistJob;
 
-	options->key_control = info->options.key_control;
-	options->master_key = info->options.master_key;
-	options->force_sync = info->options.force_sync;
-	options->persist = info->options.persist;
+G_DEFINE_TYPE(UrfConfig, urf_config, G_TYPE_OBJECT)
 
-	g_free (info);
-	return TRUE;
-}
+static gpointer urf_config_object = NULL;
 
+/**
+ * load_configured_settings:
+ * @fingerprint: the fingerprint hardware.conf must have been written
+ *               for, or %NULL to accept it as it is
+ **/
 static gboolean
-load_configured_settings (UrfConfig *config)
+load_configured_settings (UrfConfig  *config,
+			  const char *fingerprint)
 {
 	UrfConfigPrivate *priv = config->priv;
 	GKeyFile *profile = g_key_file_new ();
 	gboolean ret = FALSE;
 	GError *error = NULL;
+	char *saved_fingerprint;
 
 	ret = g_key_file_load_from_file (profile,
 					 URFKILL_CONFIGURED_PROFILE,
@@ -482,8 +110,20 @@ load_configured_settings (UrfConfig *config)
 
 	if (!g_key_file_has_group (profile, "Profile")) {
 		g_warning ("No valid group in the configured profile");
+		g_key_file_free (profile);
+		return FALSE;
+	}
+
+	/* The hardware or the profiles changed since it was written.
+	 * Without DMI there is nothing to compare with, so trust it. */
+	saved_fingerprint = g_key_file_get_string (profile, "Profile", "fingerprint", NULL);
+	if (fingerprint != NULL && g_strcmp0 (saved_fingerprint, fingerprint) != 0) {
+		g_message ("Configured profile is out of date");
+		g_free (saved_fingerprint);
+		g_key_file_free (profile);
 		return FALSE;
 	}
+	g_free (saved_fingerprint);
 
 	ret = g_key_file_get_boolean (profile, "Profile", "key_control", &error);
 	if (!error)
@@ -519,7 +159,8 @@ load_configured_settings (UrfConfig *config)
 }
 
 static void
-save_configured_profile (UrfConfig *config)
+save_configured_profile (UrfConfig  *config,
+			 const char *fingerprint)
 {
 	UrfConfigPrivate *priv = config->priv;
 	GKeyFile *profile;
@@ -527,10 +168,6 @@ save_configured_profile (UrfConfig *config)
 	const char *header = "# DO NOT EDIT! This file is created by urfkilld automatically.\n";
 	char *content = NULL;
 
-	/* Remove the existed profile */
-	if (g_file_test (URFKILL_CONFIGURED_PROFILE, G_FILE_TEST_IS_REGULAR))
-		g_unlink (URFKILL_CONFIGURED_PROFILE);
-
 	profile = g_key_file_new ();
 	ret = g_key_file_load_from_data (profile,
 					 header,
@@ -542,6 +179,8 @@ save_configured_profile (UrfConfig *config)
 		return;
 	}
 
+	g_key_file_set_string (profile, "Profile", "fingerprint", fingerprint);
+
 	value = priv->options.key_control;
 	g_key_file_set_value (profile, "Profile", "key_control",
 			      value?"true":"false");
@@ -561,7 +200,7 @@ save_configured_profile (UrfConfig *config)
 	content = g_key_file_to_data (profile, NULL, NULL);
 	g_key_file_free (profile);
 
-	/* Write back the configured profile */
+	/* Write back the configured profile, replacing the old one atomically */
 	if (content) {
 		ret = g_file_set_contents (URFKILL_CONFIGURED_PROFILE,
 					   content, -1, NULL);
@@ -581,6 +220,118 @@ string_sorter (gconstpointer str1,
 	return g_strcmp0 ((const char*)str1, (const char*)str2);
 }
 
+/**
+ * get_profile_list:
+ *
+ * Return value: the sorted file names of the XML profiles
+ **/
+static GList *
+get_profile_list (void)
+{
+	GList *profile_list = NULL;
+	GDir *profile_dir = NULL;
+	const char *file;
+	char *full;
+
+	profile_dir = g_dir_open (URFKILL_PROFILE_DIR, 0, NULL);
+	if (profile_dir == NULL)
+		return NULL;
+
+	while ((file = g_dir_read_name (profile_dir))) {
+		if (file[0] == '.' || !g_str_has_suffix (file, ".xml"))
+			continue;
+
+		full = g_build_filename( URFKILL_PROFILE_DIR, file, NULL );
+		if (g_file_test (full, G_FILE_TEST_IS_REGULAR))
+			profile_list = g_list_append (profile_list, g_strdup (file));
+		g_free (full);
+	}
+	g_dir_close (profile_dir);
+
+	return g_list_sort (profile_list, string_sorter);
+}
+
+/**
+ * dmi_info_lower:
+ *
+ * Lower the DMI strings once so that the _ncase rules don't have to
+ * do it for every rule.
+ **/
+static DmiInfo *
+dmi_info_lower (DmiInfo *hardware_info)
+{
+	DmiInfo *lower = g_new0 (DmiInfo, 1);
+
+#define LOWER_FIELD(field) \
+	if (hardware_info->field) \
+		lower->field = g_ascii_strdown (hardware_info->field, -1)
+
+	LOWER_FIELD (sys_vendor);
+	LOWER_FIELD (bios_date);
+	LOWER_FIELD (bios_vendor);
+	LOWER_FIELD (bios_version);
+	LOWER_FIELD (product_name);
+	LOWER_FIELD (product_version);
+
+#undef LOWER_FIELD
+
+	return lower;
+}
+
+/**
+ * get_profile_fingerprint:
+ *
+ * Hash everything the resolved profile depends on: the DMI fields used
+ * for matching, and the name, size and mtime of every profile. A BIOS
+ * update or a changed profile package gives a different fingerprint.
+ **/
+static char *
+get_profile_fingerprint (DmiInfo *hardware_info,
+			 GList   *profile_list)
+{
+	GChecksum *checksum;
+	GList *lptr;
+	struct stat st;
+	char *full, *stamp, *fingerprint;
+	const char *fields[] = {
+		hardware_info->sys_vendor,
+		hardware_info->bios_date,
+		hardware_info->bios_vendor,
+		hardware_info->bios_version,
+		hardware_info->product_name,
+		hardware_info->product_version,
+	};
+	guint i;
+
+	checksum = g_checksum_new (G_CHECKSUM_SHA1);
+
+	for (i = 0; i < G_N_ELEMENTS (fields); i++) {
+		if (fields[i])
+			g_checksum_update (checksum, (const guchar *)fields[i], -1);
+		g_checksum_update (checksum, (const guchar *)"\n", 1);
+	}
+
+	for (lptr = profile_list; lptr; lptr = lptr->next) {
+		full = g_build_filename (URFKILL_PROFILE_DIR,
+					 (const char*)lptr->data,
+					 NULL);
+		if (g_stat (full, &st) == 0) {
+			stamp = g_strdup_printf ("%s:%lld:%lld\n",
+						 (const char*)lptr->data,
+						 (long long) st.st_size,
+						 (long long) st.st_mtime);
+			g_checksum_update (checksum, (const guchar *)stamp, -1);
+			g_free (stamp);
+		}
+		g_free (full);
+	}
+
+	fingerprint = g_strdup (g_checksum_get_string (checksum));
+	g_checksum_free (checksum);
+
+	return fingerprint;
+}
+
 /**
  * urf_config_load_profile:
  **/
@@ -589,20 +340,23 @@ urf_config_load_profile (UrfConfig *config)
 {
 	UrfConfigPrivate *priv = config->priv;
 	DmiInfo *hardware_info;
-	Options *options;
+	DmiInfo *hardware_info_lower;
+	UrfProfileOptions options;
+	UrfProfileDb *db;
 	GList *profile_list = NULL;
 	GList *lptr;
-	GDir *profile_dir = NULL;
-	const char *file;
-	char *profile, *full;
-
-	if (load_configured_settings (config))
-		return;
+	char *profile;
+	char *fingerprint;
 
 	hardware_info = get_dmi_info ();
 	if (hardware_info == NULL) {
 		g_warning ("Failed to get DMI information");
 
+		/* Machines without DMI can't be matched against the
+		 * profiles, but may still have a hardware.conf */
+		if (load_configured_settings (config, NULL))
+			return;
+
 		/* If we don't have hardware info, then we can't assume key
 		 * control to be enabled: there would not be a way to disable
 		 * it for devices that don't have it.
@@ -612,48 +366,47 @@ urf_config_load_profile (UrfConfig *config)
 		return;
 	}
 
-	options = g_new0 (Options, 1);
-	options->key_control = priv->options.key_control;
-	options->master_key = priv->options.master_key;
-	options->force_sync = priv->options.force_sync;
-	options->persist = priv->options.persist;
+	profile_list = get_profile_list ();
+	fingerprint = get_profile_fingerprint (hardware_info, profile_list);
 
-	profile_dir = g_dir_open (URFKILL_PROFILE_DIR, 0, NULL);
-	while ((file = g_dir_read_name (profile_dir))) {
-		if (file[0] == '.' || !g_str_has_suffix (file, ".xml"))
-			continue;
+	if (load_configured_settings (config, fingerprint))
+		goto out;
 
-		full = g_build_filename( URFKILL_PROFILE_DIR, file, NULL );
-		if (g_file_test (full, G_FILE_TEST_IS_REGULAR))
-			profile_list = g_list_append (profile_list, g_strdup (file));
-		g_free (full);
+	options = priv->options;
+	hardware_info_lower = dmi_info_lower (hardware_info);
+
+	/* The ruleset compiled at build time gives the same result without
+	 * parsing anything, as long as nobody added or changed a profile */
+	db = urf_profile_db_open (URFKILL_PROFILE_DB);
+	if (db && urf_profile_db_covers (db, URFKILL_PROFILE_DIR, profile_list)) {
+		urf_profile_db_apply (db, hardware_info, hardware_info_lower, &options);
+	} else {
+		if (db)
+			g_debug ("Compiled profiles are out of date, parsing the XML");
+		for (lptr = profile_list; lptr; lptr = lptr->next) {
+			profile = g_build_filename (URFKILL_PROFILE_DIR,
+						    (const char*)lptr->data,
+						    NULL);
+			urf_profile_xml_apply (hardware_info, hardware_info_lower,
+					       &options, profile);
+			g_free (profile);
+		}
 	}
-	g_dir_close (profile_dir);
+	urf_profile_db_free (db);
 
-	profile_list = g_list_sort (profile_list, string_sorter);
+	dmi_info_free (hardware_info_lower);
 
-	for (lptr = profile_list; lptr; lptr = lptr->next) {
-		profile = g_build_filename (URFKILL_PROFILE_DIR,
-					    (const char*)lptr->data,
-					    NULL);
-		profile_xml_parse (hardware_info, options, profile);
-		g_free (profile);
-	}
+	priv->options = options;
 
+	save_configured_profile (config, fingerprint);
+out:
 	/* Clean up the list */
 	for (lptr = profile_list; lptr; lptr = lptr->next)
 		g_free (lptr->data);
 	g_list_free (profile_list);
 
-	priv->options.key_control = options->key_control;
-	priv->options.master_key = options->master_key;
-	priv->options.force_sync = options->force_sync;
-	priv->options.persist = options->persist;
-
-	save_configured_profile (config);
-
+	g_free (fingerprint);
 	dmi_info_free (hardware_info);
-	g_free (options);
 }
 
 /**
@@ -666,6 +419,8 @@ urf_config_load_from_file (UrfConfig  *config,
 	UrfConfigPrivate *priv = config->priv;
 	GKeyFile *key_file = g_key_file_new ();
 	gboolean ret = FALSE;
+	gint ttl;
+	gint window;
 	GError *error = NULL;
 
 	urf_config_load_profile (config);
@@ -709,6 +464,20 @@ urf_config_load_from_file (UrfConfig  *config,
 		g_error_free (error);
 	error = NULL;
 
+	ttl = g_key_file_get_integer (key_file, "general", "auth_cache_ttl", &error);
+	if (!error)
+		priv->auth_cache_ttl = MAX (ttl, 0);
+	else
+		g_error_free (error);
+	error = NULL;
+
+	window = g_key_file_get_integer (key_file, "general", "key_window", &error);
+	if (!error)
+		priv->key_window = MAX (window, 0);
+	else
+		g_error_free (error);
+	error = NULL;
+
 	g_key_file_free (key_file);
 }
 
@@ -721,6 +490,30 @@ urf_config_get_user (UrfConfig *config)
 	return (const char *)config->priv->user;
 }
 
+/**
+ * urf_config_get_auth_cache_ttl:
+ *
+ * Return value: how many seconds a polkit authorization may be reused
+ * by the same bus connection, 0 to check every request.
+ **/
+guint
+urf_config_get_auth_cache_ttl (UrfConfig *config)
+{
+	return config->priv->auth_cache_ttl;
+}
+
+/**
+ * urf_config_get_key_window:
+ *
+ * Return value: how many milliseconds rfkill key presses are collected
+ * before acting on them, 0 to act on every press.
+ **/
+guint
+urf_config_get_key_window (UrfConfig *config)
+{
+	return config->priv->key_window;
+}
+
 /**
  * urf_config_get_key_control:
  **/
@@ -765,24 +558,286 @@ urf_config_get_persist_state (UrfConfig *config,
                               const gint type)
 {
 	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
-	gboolean state = FALSE;
-	GError *error = NULL;
 
 	g_return_val_if_fail (type >= 0, FALSE);
+	g_return_val_if_fail (type < NUM_RFKILL_TYPES, FALSE);
 
-	state = g_key_file_get_boolean (priv->persistence_file, type_to_string(type), "soft", &error);
+	if (!priv->persist_known[type]) {
+		/* Debug only; there can be devices disappearing when some killswitches
+		 * are triggered.
+		 */
+		g_debug ("Could not get state for device %s", type_to_string(type));
+		return FALSE;
+	}
 
-	if (error) {
-			/* Debug only; there can be devices disappearing when some killswitches
-			 * are triggered.
-			 */
-			g_debug ("Could not get state for device %s: %s", type_to_string(type), error->message);
-			g_error_free (error);
+	g_debug ("saved state for device %s: %s", type_to_string(type),
+		 priv->persist_soft[type] ? "blocked" : "unblocked");
+
+	return priv->persist_soft[type];
+}
+
+static gboolean
+write_all (int         fd,
+	   const char *buf,
+	   gsize       length)
+{
+	ssize_t len;
+
+	while (length > 0) {
+		len = write (fd, buf, length);
+		if (len < 0) {
+			if (errno == EINTR)
+				continue;
+			return FALSE;
+		}
+		buf += len;
+		length -= len;
 	}
 
-	g_debug ("saved state for device %s: %s", type_to_string(type), state ? "blocked" : "unblocked");
+	return TRUE;
+}
+
+/**
+ * write_file_synced:
+ *
+ * Replace @filename atomically with a file of the given @mode, making
+ * sure the new content is on disk before it becomes visible.
+ **/
+static gboolean
+write_file_synced (const char *filename,
+		   const char *content,
+		   gsize       length,
+		   mode_t      mode)
+{
+	char *tmp;
+	int fd;
+	gboolean ret = FALSE;
+
+	tmp = g_strconcat (filename, ".tmp", NULL);
 
-	return state;
+	/* A read-only leftover of an earlier crash can't be reopened */
+	g_unlink (tmp);
+	fd = open (tmp, O_WRONLY | O_CREAT | O_EXCL, mode);
+	if (fd < 0)
+		goto out;
+
+	ret = write_all (fd, content, length) && fsync (fd) == 0;
+	close (fd);
+
+	if (ret)
+		ret = (rename (tmp, filename) == 0);
+	if (!ret)
+		g_unlink (tmp);
+out:
+	if (!ret)
+		g_warning ("Failed to write %s: %s", filename, g_strerror (errno));
+	g_free (tmp);
+
+	return ret;
+}
+
+/**
+ * persist_append_journal:
+ *
+ * Append records to the journal and flush them to disk.
+ **/
+static gboolean
+persist_append_journal (const char *content,
+			gsize       length)
+{
+	gboolean ret;
+	int fd;
+
+	fd = open (URFKILL_PERSISTENCE_JOURNAL, O_WRONLY | O_APPEND | O_CREAT,
+		   S_IRUSR | S_IWUSR | S_IRGRP | S_IROTH);
+	if (fd < 0) {
+		g_warning ("Failed to open %s: %s",
+		           URFKILL_PERSISTENCE_JOURNAL, g_strerror (errno));
+		return FALSE;
+	}
+
+	ret = write_all (fd, content, length) && fdatasync (fd) == 0;
+	if (!ret)
+		g_warning ("Failed to write %s: %s",
+		           URFKILL_PERSISTENCE_JOURNAL, g_strerror (errno));
+	close (fd);
+
+	return ret;
+}
+
+/**
+ * persist_write_snapshot:
+ *
+ * Replace the snapshot and empty the journal it supersedes.
+ **/
+static void
+persist_write_snapshot (const char *content,
+			gsize       length)
+{
+	/* Only drop the journal once the snapshot is safely on disk */
+	if (!write_file_synced (URFKILL_PERSISTENCE_FILENAME, content, length,
+				S_IRUSR | S_IRGRP | S_IROTH))
+		return;
+
+	if (truncate (URFKILL_PERSISTENCE_JOURNAL, 0) < 0 && errno != ENOENT)
+		g_warning ("Failed to truncate %s: %s",
+		           URFKILL_PERSISTENCE_JOURNAL, g_strerror (errno));
+}
+
+/**
+ * persist_job_run:
+ *
+ * Runs in the persistence thread, one job at a time and in the order
+ * they were queued, so the main loop never waits for the disk.
+ **/
+static void
+persist_job_run (gpointer data,
+		 gpointer user_data)
+{
+	PersistJob *job = data;
+	UrfConfigPrivate *priv = user_data;
+
+	switch (job->kind) {
+	case PERSIST_JOB_JOURNAL:
+		/* The next sync writes a whole snapshot instead */
+		if (!persist_append_journal (job->content, job->length))
+			g_atomic_int_set (&priv->journal_failed, TRUE);
+		break;
+	case PERSIST_JOB_SNAPSHOT:
+		persist_write_snapshot (job->content, job->length);
+		break;
+	}
+
+	g_free (job->content);
+	g_free (job);
+}
+
+/**
+ * urf_config_queue_persist_job:
+ * @content: the data to write, freed once it is written
+ **/
+static void
+urf_config_queue_persist_job (UrfConfig      *config,
+			      PersistJobKind  kind,
+			      char           *content,
+			      gsize           length)
+{
+	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+	PersistJob *job;
+
+	job = g_new0 (PersistJob, 1);
+	job->kind = kind;
+	job->content = content;
+	job->length = length;
+
+	if (priv->persist_pool)
+		g_thread_pool_push (priv->persist_pool, job, NULL);
+	else
+		persist_job_run (job, priv);
+}
+
+/**
+ * urf_config_compact_persistence:
+ *
+ * Write every known state into the snapshot and empty the journal.
+ **/
+static void
+urf_config_compact_persistence (UrfConfig *config)
+{
+	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+	GKeyFile *snapshot;
+	char *content;
+	gsize length;
+	int i;
+
+	snapshot = g_key_file_new ();
+	for (i = RFKILL_TYPE_ALL; i < NUM_RFKILL_TYPES; i++) {
+		if (priv->persist_known[i])
+			g_key_file_set_boolean (snapshot, type_to_string (i), "soft",
+			                        priv->persist_soft[i]);
+	}
+	content = g_key_file_to_data (snapshot, &length, NULL);
+	g_key_file_free (snapshot);
+
+	if (content == NULL)
+		return;
+
+	/* The snapshot holds the pending records as well */
+	g_string_truncate (priv->journal_pending, 0);
+	priv->journal_pending_records = 0;
+	priv->journal_records = 0;
+
+	urf_config_queue_persist_job (config, PERSIST_JOB_SNAPSHOT, content, length);
+}
+
+/**
+ * urf_config_sync_journal:
+ *
+ * Hand the pending records to the persistence thread, or the whole
+ * state once the journal is due for compaction.
+ **/
+static void
+urf_config_sync_journal (UrfConfig *config)
+{
+	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+	char *content;
+	gsize length;
+
+	if (priv->journal_pending->len == 0)
+		return;
+
+	/* A failed append may have left a torn record behind, which the
+	 * snapshot gets rid of along with the journal */
+	if (g_atomic_int_compare_and_exchange (&priv->journal_failed, TRUE, FALSE) ||
+	    priv->journal_records + priv->journal_pending_records >= PERSIST_COMPACT_RECORDS) {
+		urf_config_compact_persistence (config);
+		return;
+	}
+
+	priv->journal_records += priv->journal_pending_records;
+	priv->journal_pending_records = 0;
+	length = priv->journal_pending->len;
+	content = g_strndup (priv->journal_pending->str, length);
+	g_string_truncate (priv->journal_pending, 0);
+
+	urf_config_queue_persist_job (config, PERSIST_JOB_JOURNAL, content, length);
+}
+
+static gboolean
+journal_sync_cb (gpointer data)
+{
+	UrfConfig *config = URF_CONFIG (data);
+
+	config->priv->journal_sync_id = 0;
+	urf_config_sync_journal (config);
+
+	return FALSE;
+}
+
+/**
+ * urf_config_schedule_journal_sync:
+ *
+ * Batch changes that come in quick succession into one sync, but don't
+ * let a steady stream of changes postpone it forever.
+ **/
+static void
+urf_config_schedule_journal_sync (UrfConfig *config)
+{
+	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+	gint64 now, deadline;
+	guint delay;
+
+	now = g_get_monotonic_time ();
+	if (priv->journal_pending_records == 1)
+		priv->journal_pending_since = now;
+
+	deadline = priv->journal_pending_since + PERSIST_SYNC_MAX_DELAY_MS * 1000;
+	delay = (deadline > now) ? (guint) ((deadline - now) / 1000) : 0;
+	delay = MIN (delay, PERSIST_SYNC_DELAY_MS);
+
+	if (priv->journal_sync_id > 0)
+		g_source_remove (priv->journal_sync_id);
+	priv->journal_sync_id = g_timeout_add (delay, journal_sync_cb, config);
 }
 
 /**
@@ -794,49 +849,123 @@ urf_config_set_persist_state (UrfConfig *config,
                               const KillswitchState state)
 {
 	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+	gboolean soft = state > 0;
 
 	g_return_if_fail (type >= 0);
+	g_return_if_fail (type < NUM_RFKILL_TYPES);
+
+	if (priv->persist_known[type] && priv->persist_soft[type] == soft)
+		return;
+
+	g_debug ("setting state for device %s: %s", type_to_string(type), soft ? "blocked" : "unblocked");
+
+	priv->persist_soft[type] = soft;
+	priv->persist_known[type] = TRUE;
 
-	g_debug ("setting state for device %s: %s", type_to_string(type), state > 0 ? "blocked" : "unblocked");
+	g_string_append_printf (priv->journal_pending, "%s %d\n",
+	                        type_to_string (type), soft ? 1 : 0);
+	priv->journal_pending_records++;
 
-	g_key_file_set_boolean (priv->persistence_file, type_to_string (type), "soft", state > 0);
+	urf_config_schedule_journal_sync (config);
 }
 
-static void
-urf_config_save_persistence_file (UrfConfig *config)
+/**
+ * urf_config_set_persist_states:
+ * @states: an array of NUM_RFKILL_TYPES states, indexed by rfkill type
+ *
+ * Update the persisted state of several types at once. Types set to
+ * KILLSWITCH_STATE_NO_ADAPTER are left untouched.
+ **/
+void
+urf_config_set_persist_states (UrfConfig *config,
+                               const KillswitchState *states)
+{
+	int i;
+
+	g_return_if_fail (states != NULL);
+
+	for (i = RFKILL_TYPE_ALL; i < NUM_RFKILL_TYPES; i++) {
+		if (states[i] == KILLSWITCH_STATE_NO_ADAPTER)
+			continue;
+
+		urf_config_set_persist_state (config, i, states[i]);
+	}
+}
+
+static gint
+type_from_string (const char *name)
+{
+	gint type;
+
+	for (type = RFKILL_TYPE_ALL; type < NUM_RFKILL_TYPES; type++) {
+		if (g_strcmp0 (name, type_to_string (type)) == 0)
+			return type;
+	}
+
+	return -1;
+}
+
+/**
+ * urf_config_replay_journal:
+ *
+ * Apply the records of the journal on top of the snapshot.
+ *
+ * Return value: %TRUE if the journal was not empty, even if all it
+ * held was a torn record
+ **/
+static gboolean
+urf_config_replay_journal (UrfConfig *config)
 {
 	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
 	char *content = NULL;
-	gboolean ret = FALSE;
-	GError *error = NULL;
+	gsize length = 0;
+	char **lines;
+	char **fields;
+	gint type;
+	int i;
+
+	if (!g_file_get_contents (URFKILL_PERSISTENCE_JOURNAL, &content, &length, NULL))
+		return FALSE;
 
-	content = g_key_file_to_data (priv->persistence_file, NULL, NULL);
+	lines = g_strsplit (content, "\n", -1);
 
-	if (content) {
-		ret = g_file_set_contents (URFKILL_PERSISTENCE_FILENAME,
-					   content, -1, &error);
-		if (!ret) {
-			if (error) {
-				g_warning ("Failed to write persistence data: %s", error->message);
-				g_error_free (error);
-			}
+	/* The last element follows the last newline; if it's not empty it
+	 * is a record cut short by a crash, so it is ignored. */
+	for (i = 0; lines[i] && lines[i+1]; i++) {
+		fields = g_strsplit (lines[i], " ", 2);
+		type = type_from_string (fields[0]);
+
+		if (type >= 0 && fields[1] &&
+		    (g_strcmp0 (fields[1], "0") == 0 || g_strcmp0 (fields[1], "1") == 0)) {
+			priv->persist_soft[type] = (fields[1][0] == '1');
+			priv->persist_known[type] = TRUE;
 		} else {
-			g_chmod (URFKILL_PERSISTENCE_FILENAME,
-				 S_IRUSR | S_IRGRP | S_IROTH);
+			g_warning ("Ignoring invalid persistence record: '%s'", lines[i]);
 		}
 
-		g_free (content);
+		g_strfreev (fields);
 	}
+
+	g_strfreev (lines);
+	g_free (content);
+
+	return length > 0;
 }
 
+/**
+ * urf_config_load_persistence:
+ **/
 static void
-urf_config_get_persistence_file (UrfConfig *config)
+urf_config_load_persistence (UrfConfig *config)
 {
 	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+	GKeyFile *snapshot;
 	GError *error = NULL;
+	gboolean soft;
+	int i;
 
-	priv->persistence_file = g_key_file_new ();
-	g_key_file_load_from_file (priv->persistence_file,
+	snapshot = g_key_file_new ();
+	g_key_file_load_from_file (snapshot,
 	                           URFKILL_PERSISTENCE_FILENAME,
 	                           G_KEY_FILE_NONE,
 	                           &error);
@@ -844,7 +973,26 @@ urf_config_get_persistence_file (UrfConfig *config)
 	if (error) {
 		g_warning ("Persistence file could not be loaded: %s", error->message);
 		g_error_free (error);
+		error = NULL;
 	}
+
+	for (i = RFKILL_TYPE_ALL; i < NUM_RFKILL_TYPES; i++) {
+		soft = g_key_file_get_boolean (snapshot, type_to_string (i), "soft", &error);
+		if (error) {
+			g_error_free (error);
+			error = NULL;
+			continue;
+		}
+		priv->persist_soft[i] = soft;
+		priv->persist_known[i] = TRUE;
+	}
+	g_key_file_free (snapshot);
+
+	/* Recover the changes made since the last snapshot. The journal is
+	 * emptied even if it only held a torn record, or the next record
+	 * appended would be glued to it and lost. */
+	if (urf_config_replay_journal (config))
+		urf_config_compact_persistence (config);
 }
 
 /**
@@ -854,14 +1002,28 @@ static void
 urf_config_init (UrfConfig *config)
 {
 	UrfConfigPrivate *priv = URF_CONFIG_GET_PRIVATE (config);
+	GError *error = NULL;
+
 	priv->user = NULL;
 	priv->options.key_control = TRUE;
 	priv->options.master_key = FALSE;
 	priv->options.force_sync = FALSE;
 	priv->options.persist = TRUE;
+	priv->auth_cache_ttl = AUTH_CACHE_TTL_DEFAULT;
+	priv->key_window = KEY_WINDOW_DEFAULT;
+	priv->journal_pending = g_string_new (NULL);
 	config->priv = priv;
 
-	urf_config_get_persistence_file (config);
+	/* One thread, so the journal and snapshot are written in order */
+	priv->persist_pool = g_thread_pool_new (persist_job_run, priv,
+						1, FALSE, &error);
+	if (priv->persist_pool == NULL) {
+		g_warning ("Saved states will be written synchronously: %s",
+			   error->message);
+		g_error_free (error);
+	}
+
+	urf_config_load_persistence (config);
 }
 
 /**
@@ -881,12 +1043,17 @@ urf_config_finalize (GObject *object)
 {
 	UrfConfigPrivate *priv = URF_CONFIG(object)->priv;
 
-	if (priv->persistence_file) {
-		urf_config_save_persistence_file (URF_CONFIG (object));
-		g_key_file_free (priv->persistence_file);
-		priv->persistence_file = NULL;
+	if (priv->journal_sync_id > 0) {
+		g_source_remove (priv->journal_sync_id);
+		priv->journal_sync_id = 0;
 	}
 
+	/* Leave the final state in the snapshot and wait until it's written */
+	urf_config_compact_persistence (URF_CONFIG (object));
+	if (priv->persist_pool)
+		g_thread_pool_free (priv->persist_pool, FALSE, TRUE);
+	g_string_free (priv->journal_pending, TRUE);
+
 	g_free (priv->user);
 
 	G_OBJECT_CLASS(urf_config_parent_class)->finalize(object);
@@ -58,6 +58,8 @@ UrfConfig	*urf_config_new			(void);
 void		 urf_config_load_from_file	(UrfConfig	*config,
 						 const char	*filename);
 const char	*urf_config_get_user		(UrfConfig	*config);
+guint		 urf_config_get_auth_cache_ttl	(UrfConfig	*config);
+guint		 urf_config_get_key_window	(UrfConfig	*config);
 gboolean	 urf_config_get_key_control	(UrfConfig	*config);
 gboolean	 urf_config_get_master_key	(UrfConfig	*config);
 gboolean	 urf_config_get_force_sync	(UrfConfig	*config);
@@ -68,6 +70,8 @@ gboolean	 urf_config_get_persist_state	(UrfConfig	*config,
 void		 urf_config_set_persist_state	(UrfConfig *config,
 						 const gint type,
 						 const KillswitchState state);
+void		 urf_config_set_persist_states	(UrfConfig *config,
+						 const KillswitchState *states);
 
 G_END_DECLS
 
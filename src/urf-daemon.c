@@ -36,6 +36,7 @@
 #include "urf-input.h"
 #include "urf-utils.h"
 #include "urf-config.h"
+#include "urf-dbus.h"
 #include "urf-ofono-manager.h"
 
 #if defined SESSION_TRACKING_CK
@@ -47,61 +48,9 @@
 #endif
 
 #define URFKILL_DBUS_INTERFACE "org.freedesktop.URfkill"
+#define OBJECT_MANAGER_INTERFACE "org.freedesktop.DBus.ObjectManager"
 #define URFKILL_OBJECT_PATH "/org/freedesktop/URfkill"
 
-static const char introspection_xml[] =
-"<node>"
-"  <interface name='org.freedesktop.URfkill'>"
-"    <method name='Block'>"
-"      <arg type='u' name='type' direction='in'/>"
-"      <arg type='b' name='block' direction='in'/>"
-"      <arg type='b' name='ret' direction='out'/>"
-"    </method>"
-"    <method name='BlockIdx'>"
-"      <arg type='u' name='index' direction='in'/>"
-"      <arg type='b' name='block' direction='in'/>"
-"      <arg type='b' name='ret' direction='out'/>"
-"    </method>"
-"    <method name='EnumerateDevices'>"
-"      <arg type='ao' name='array' direction='out'/>"
-"    </method>"
-"    <method name='IsFlightMode'>"
-"      <arg type='b' name='is_flight_mode' direction='out'/>"
-"    </method>"
-"    <method name='FlightMode'>"
-"      <arg type='b' name='block' direction='in'/>"
-"      <arg type='b' name='ret' direction='out'/>"
-"    </method>"
-"    <method name='IsInhibited'>"
-"      <arg type='b' name='is_inhibited' direction='out'/>"
-"    </method>"
-"    <method name='Inhibit'>"
-"      <arg type='s' name='reason' direction='in'/>"
-"      <arg type='u' name='inhibit_cookie' direction='out'/>"
-"    </method>"
-"    <method name='Uninhibit'>"
-"      <arg type='u' name='inhibit_cookie' direction='in'/>"
-"    </method>"
-"    <signal name='DeviceAdded'>"
-"      <arg type='o' name='device' direction='out'/>"
-"    </signal>"
-"    <signal name='DeviceRemoved'>"
-"      <arg type='o' name='device' direction='out'/>"
-"    </signal>"
-"    <signal name='DeviceChanged'>"
-"      <arg type='o' name='device' direction='out'/>"
-"    </signal>"
-"    <signal name='FlightModeChanged'>"
-"      <arg type='b' name='flight_mode' direction='out'/>"
-"    </signal>"
-"    <signal name='UrfkeyPressed'>"
-"      <arg type='i' name='keycode' direction='out'/>"
-"    </signal>"
-"    <property name='DaemonVersion' type='s' access='read'/>"
-"    <property name='KeyControl' type='b' access='read'/>"
-"  </interface>"
-"</node>";
-
 static const GDBusErrorEntry urf_daemon_error_entries[] =
 {
 	{URF_DAEMON_ERROR_GENERAL, "org.freedesktop.URfkill.Daemon.Error.General"},
@@ -112,9 +61,54 @@ enum
 	PROP_0,
 	PROP_DAEMON_VERSION,
 	PROP_KEY_CONTROL,
+	PROP_KEY_PRESSES,
+	PROP_KEY_PRESSES_SUPPRESSED,
+	PROP_KEY_PRESSES_DUPLICATE,
 	PROP_LAST
 };
 
+enum
+{
+	METHOD_0,
+	METHOD_BLOCK,
+	METHOD_BLOCK_IDX,
+	METHOD_BLOCK_MANY,
+	METHOD_BLOCK_TYPES,
+	METHOD_ENUMERATE_DEVICES,
+	METHOD_IS_FLIGHT_MODE,
+	METHOD_FLIGHT_MODE,
+	METHOD_IS_INHIBITED,
+	METHOD_INHIBIT,
+	METHOD_UNINHIBIT,
+};
+
+static const UrfDBusMember daemon_methods[] =
+{
+	{ "Block",		METHOD_BLOCK },
+	{ "BlockIdx",		METHOD_BLOCK_IDX },
+	{ "BlockMany",		METHOD_BLOCK_MANY },
+	{ "BlockTypes",		METHOD_BLOCK_TYPES },
+	{ "EnumerateDevices",	METHOD_ENUMERATE_DEVICES },
+	{ "IsFlightMode",	METHOD_IS_FLIGHT_MODE },
+	{ "FlightMode",		METHOD_FLIGHT_MODE },
+	{ "IsInhibited",	METHOD_IS_INHIBITED },
+	{ "Inhibit",		METHOD_INHIBIT },
+	{ "Uninhibit",		METHOD_UNINHIBIT },
+};
+
+static const UrfDBusMember daemon_properties[] =
+{
+	{ "DaemonVersion",	PROP_DAEMON_VERSION },
+	{ "KeyControl",		PROP_KEY_CONTROL },
+	{ "KeyPresses",		PROP_KEY_PRESSES },
+	{ "KeyPressesSuppressed", PROP_KEY_PRESSES_SUPPRESSED },
+	{ "KeyPressesDuplicate", PROP_KEY_PRESSES_DUPLICATE },
+};
+
+/* built once from the generated interface info */
+static GHashTable *method_table = NULL;
+static GHashTable *property_table = NULL;
+
 enum
 {
 	SIGNAL_DEVICE_ADDED,
@@ -138,10 +132,21 @@ struct UrfDaemonPrivate
 	gboolean		 key_control;
 	gboolean		 flight_mode;
 	gboolean		 master_key;
+	guint			 key_window;
+	GHashTable		*key_bursts;
+	guint			 n_key_presses;
+	guint			 n_key_suppressed;
 	GDBusConnection		*connection;
-	GDBusNodeInfo		*introspection_data;
 };
 
+/* Presses of one key waiting for the window to close */
+typedef struct {
+	UrfDaemon	*daemon;
+	guint		 code;
+	guint		 presses;
+	guint		 timeout_id;
+} UrfKeyBurst;
+
 static void urf_daemon_dispose (GObject *object);
 
 G_DEFINE_TYPE (UrfDaemon, urf_daemon, G_TYPE_OBJECT)
@@ -150,14 +155,12 @@ G_DEFINE_TYPE (UrfDaemon, urf_daemon, G_TYPE_OBJECT)
 				URF_TYPE_DAEMON, UrfDaemonPrivate))
 
 /**
- * urf_daemon_input_event_cb:
+ * urf_daemon_key_toggle:
  **/
 static void
-urf_daemon_input_event_cb (UrfInput *input,
-			   guint     code,
-			   gpointer  data)
+urf_daemon_key_toggle (UrfDaemon *daemon,
+		       guint      code)
 {
-	UrfDaemon *daemon = URF_DAEMON (data);
 	UrfDaemonPrivate *priv = daemon->priv;
 	UrfArbitrator *arbitrator = priv->arbitrator;
 	gint type;
@@ -221,40 +224,219 @@ out:
 	}
 }
 
+static void
+free_key_burst (UrfKeyBurst *burst)
+{
+	if (burst->timeout_id > 0)
+		g_source_remove (burst->timeout_id);
+	g_free (burst);
+}
+
+/**
+ * urf_daemon_key_burst_cb:
+ *
+ * The window of a key is over. Every second press undoes the one before
+ * it, so the whole burst is worth a single toggle or none at all.
+ **/
+static gboolean
+urf_daemon_key_burst_cb (gpointer user_data)
+{
+	UrfKeyBurst *burst = user_data;
+	UrfDaemon *daemon = burst->daemon;
+	UrfDaemonPrivate *priv = daemon->priv;
+	guint suppressed;
+	guint n_duplicates = 0;
+
+	burst->timeout_id = 0;
+
+	suppressed = burst->presses - burst->presses % 2;
+	priv->n_key_suppressed += suppressed;
+
+	if (suppressed > 0) {
+		urf_input_get_counters (priv->input, NULL, NULL, &n_duplicates);
+		g_debug ("Key %u pressed %u times, %s; suppressed %u of %u presses and %u duplicates so far",
+			 burst->code, burst->presses,
+			 burst->presses % 2 ? "toggling once" : "nothing to do",
+			 priv->n_key_suppressed, priv->n_key_presses, n_duplicates);
+	}
+
+	if (burst->presses % 2)
+		urf_daemon_key_toggle (daemon, burst->code);
+
+	/* frees the burst */
+	g_hash_table_remove (priv->key_bursts, GUINT_TO_POINTER (burst->code));
+
+	return FALSE;
+}
+
+/**
+ * urf_daemon_input_event_cb:
+ **/
+static void
+urf_daemon_input_event_cb (UrfInput *input,
+			   guint     code,
+			   gpointer  data)
+{
+	UrfDaemon *daemon = URF_DAEMON (data);
+	UrfDaemonPrivate *priv = daemon->priv;
+	UrfKeyBurst *burst;
+
+	priv->n_key_presses++;
+
+	if (priv->key_window == 0) {
+		urf_daemon_key_toggle (daemon, code);
+		return;
+	}
+
+	/* The window starts with the first press and is not extended, so
+	 * a key that keeps bouncing still gets handled in time */
+	burst = g_hash_table_lookup (priv->key_bursts, GUINT_TO_POINTER (code));
+	if (burst) {
+		burst->presses++;
+		return;
+	}
+
+	burst = g_new0 (UrfKeyBurst, 1);
+	burst->daemon = daemon;
+	burst->code = code;
+	burst->presses = 1;
+	burst->timeout_id = g_timeout_add (priv->key_window,
+					   urf_daemon_key_burst_cb,
+					   burst);
+	g_hash_table_insert (priv->key_bursts, GUINT_TO_POINTER (code), burst);
+}
+
+/* A method call waiting for polkit. It owns the reference to the
+ * invocation until the reply is sent. */
+typedef void (*UrfDaemonAuthorizedFunc) (UrfDaemon		*daemon,
+					 GDBusMethodInvocation	*invocation);
+
+typedef struct {
+	UrfDaemon		*daemon;
+	GDBusMethodInvocation	*invocation;
+	UrfDaemonAuthorizedFunc	 authorized;
+} UrfDaemonRequest;
+
+/**
+ * urf_daemon_authorize_cb:
+ **/
+static void
+urf_daemon_authorize_cb (GObject      *source_object,
+			 GAsyncResult *res,
+			 gpointer      user_data)
+{
+	UrfDaemonRequest *request = user_data;
+	GError *error = NULL;
+
+	if (urf_polkit_check_auth_finish (URF_POLKIT (source_object), res, &error)) {
+		request->authorized (request->daemon, request->invocation);
+	} else {
+		g_dbus_method_invocation_return_gerror (request->invocation, error);
+		g_error_free (error);
+	}
+
+	g_object_unref (request->daemon);
+	g_free (request);
+}
+
+/**
+ * urf_daemon_authorize:
+ *
+ * Ask polkit about @action_id without blocking the main loop, and run
+ * @authorized with the original call if it is allowed. Requests from
+ * several clients are checked concurrently.
+ **/
+static void
+urf_daemon_authorize (UrfDaemon               *daemon,
+		      GDBusMethodInvocation   *invocation,
+		      const char              *action_id,
+		      UrfDaemonAuthorizedFunc  authorized)
+{
+	UrfDaemonRequest *request;
+
+	request = g_new0 (UrfDaemonRequest, 1);
+	request->daemon = g_object_ref (daemon);
+	request->invocation = invocation;
+	request->authorized = authorized;
+
+	urf_polkit_check_auth_async (daemon->priv->polkit, invocation, action_id,
+				     urf_daemon_authorize_cb, request);
+}
+
+/**
+ * urf_daemon_block_authorized:
+ **/
+static void
+urf_daemon_block_authorized (UrfDaemon             *daemon,
+			     GDBusMethodInvocation *invocation)
+{
+	GVariant *parameters;
+	guint32 type;
+	gboolean block;
+	gboolean ret = FALSE;
+
+	parameters = g_dbus_method_invocation_get_parameters (invocation);
+	g_variant_get (parameters, "(ub)", &type, &block);
+
+	if (type < NUM_RFKILL_TYPES)
+		ret = urf_arbitrator_set_block (daemon->priv->arbitrator, type, block);
+
+	g_dbus_method_invocation_return_value (invocation,
+	                                       g_variant_new ("(b)", ret));
+}
+
 /**
  * urf_daemon_block:
+ *
+ * Return value: %FALSE if the call was answered right away, %TRUE if
+ * the reply follows once polkit has authorized it.
  **/
 gboolean
 urf_daemon_block (UrfDaemon             *daemon,
-		  const gint             type,
+		  const guint32          type,
 		  const gboolean         block,
 		  GDBusMethodInvocation *invocation)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	PolkitSubject *subject = NULL;
-	gboolean ret = FALSE;
 
-	g_return_val_if_fail (type >= 0, FALSE);
+	if (type >= NUM_RFKILL_TYPES) {
+		g_dbus_method_invocation_return_error (invocation,
+		                                       URF_DAEMON_ERROR,
+		                                       URF_DAEMON_ERROR_GENERAL,
+		                                       "invalid type %u", type);
+		return FALSE;
+	}
 
-	if (!urf_arbitrator_has_devices (priv->arbitrator))
-		goto out;
+	if (!urf_arbitrator_has_devices (priv->arbitrator)) {
+		g_dbus_method_invocation_return_value (invocation,
+		                                       g_variant_new ("(b)", FALSE));
+		return FALSE;
+	}
 
-	subject = urf_polkit_get_subject (priv->polkit, invocation);
-	if (subject == NULL)
-		goto out;
+	urf_daemon_authorize (daemon, invocation, "org.freedesktop.urfkill.block",
+			      urf_daemon_block_authorized);
+	return TRUE;
+}
 
-	if (!urf_polkit_check_auth (priv->polkit, subject, "org.freedesktop.urfkill.block", invocation))
-		goto out;
+/**
+ * urf_daemon_block_idx_authorized:
+ **/
+static void
+urf_daemon_block_idx_authorized (UrfDaemon             *daemon,
+				 GDBusMethodInvocation *invocation)
+{
+	GVariant *parameters;
+	guint32 index;
+	gboolean block;
+	gboolean ret;
 
-	ret = urf_arbitrator_set_block (priv->arbitrator, type, block);
+	parameters = g_dbus_method_invocation_get_parameters (invocation);
+	g_variant_get (parameters, "(ub)", &index, &block);
+
+	ret = urf_arbitrator_set_block_idx (daemon->priv->arbitrator, index, block);
 
 	g_dbus_method_invocation_return_value (invocation,
 	                                       g_variant_new ("(b)", ret));
-out:
-	if (subject != NULL)
-		g_object_unref (subject);
-
-	return ret;
 }
 
 /**
@@ -262,35 +444,164 @@ out:
  **/
 gboolean
 urf_daemon_block_idx (UrfDaemon             *daemon,
-		      const gint             index,
+		      const guint32          index,
 		      const gboolean         block,
 		      GDBusMethodInvocation *invocation)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	PolkitSubject *subject = NULL;
-	gboolean ret = FALSE;
 
-	g_return_val_if_fail (index >= 0, FALSE);
+	/* device indexes are gint inside the daemon */
+	if (index > G_MAXINT) {
+		g_dbus_method_invocation_return_error (invocation,
+		                                       URF_DAEMON_ERROR,
+		                                       URF_DAEMON_ERROR_GENERAL,
+		                                       "invalid device index %u", index);
+		return FALSE;
+	}
 
-	if (!urf_arbitrator_has_devices (priv->arbitrator))
-		goto out;
+	if (!urf_arbitrator_has_devices (priv->arbitrator)) {
+		g_dbus_method_invocation_return_value (invocation,
+		                                       g_variant_new ("(b)", FALSE));
+		return FALSE;
+	}
 
-	subject = urf_polkit_get_subject (priv->polkit, invocation);
-	if (subject == NULL)
-		goto out;
+	urf_daemon_authorize (daemon, invocation, "org.freedesktop.urfkill.blockidx",
+			      urf_daemon_block_idx_authorized);
+	return TRUE;
+}
 
-	if (!urf_polkit_check_auth (priv->polkit, subject, "org.freedesktop.urfkill.blockidx", invocation))
-		goto out;
+/**
+ * urf_daemon_block_many_authorized:
+ **/
+static void
+urf_daemon_block_many_authorized (UrfDaemon             *daemon,
+				  GDBusMethodInvocation *invocation)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	GVariantBuilder builder;
+	GVariantIter iter;
+	GVariant *devices;
+	guint32 *indexes;
+	gboolean *blocks;
+	gboolean *results;
+	guint n_items, i;
+
+	devices = g_variant_get_child_value (g_dbus_method_invocation_get_parameters (invocation), 0);
+	n_items = g_variant_n_children (devices);
+
+	indexes = g_new (guint32, n_items);
+	blocks = g_new (gboolean, n_items);
+	results = g_new0 (gboolean, n_items);
+
+	i = 0;
+	g_variant_iter_init (&iter, devices);
+	while (g_variant_iter_next (&iter, "(ub)", &indexes[i], &blocks[i]))
+		i++;
+
+	if (urf_arbitrator_has_devices (priv->arbitrator))
+		urf_arbitrator_set_block_many (priv->arbitrator, indexes,
+					       blocks, n_items, results);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ub)"));
+	for (i = 0; i < n_items; i++)
+		g_variant_builder_add (&builder, "(ub)", indexes[i], results[i]);
+
+	g_dbus_method_invocation_return_value (invocation,
+	                                       g_variant_new ("(a(ub))", &builder));
+
+	g_variant_unref (devices);
+	g_free (indexes);
+	g_free (blocks);
+	g_free (results);
+}
+
+/**
+ * urf_daemon_block_many:
+ * @devices: an a(ub) #GVariant of device indexes and block states
+ *
+ * One authorization covers the whole list, and the arbitrator writes the
+ * kernel devices in one batch.
+ **/
+gboolean
+urf_daemon_block_many (UrfDaemon             *daemon,
+		       GVariant              *devices,
+		       GDBusMethodInvocation *invocation)
+{
+	if (g_variant_n_children (devices) == 0) {
+		g_dbus_method_invocation_return_value (invocation,
+		                                       g_variant_new ("(a(ub))", NULL));
+		return FALSE;
+	}
 
-	ret = urf_arbitrator_set_block_idx (priv->arbitrator, index, block);
+	urf_daemon_authorize (daemon, invocation, "org.freedesktop.urfkill.blockidx",
+			      urf_daemon_block_many_authorized);
+	return TRUE;
+}
+
+/**
+ * urf_daemon_block_types_authorized:
+ **/
+static void
+urf_daemon_block_types_authorized (UrfDaemon             *daemon,
+				   GDBusMethodInvocation *invocation)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	GVariantBuilder builder;
+	gboolean results[NUM_RFKILL_TYPES];
+	guint32 type_mask;
+	gboolean block;
+	int i;
+
+	g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+		       "(ub)", &type_mask, &block);
+
+	for (i = RFKILL_TYPE_ALL; i < NUM_RFKILL_TYPES; i++)
+		results[i] = FALSE;
+
+	if (urf_arbitrator_has_devices (priv->arbitrator))
+		urf_arbitrator_set_block_types (priv->arbitrator, type_mask,
+						block, results);
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(ub)"));
+	for (i = RFKILL_TYPE_ALL; i < NUM_RFKILL_TYPES; i++) {
+		if (type_mask & (1 << i))
+			g_variant_builder_add (&builder, "(ub)", (guint32) i, results[i]);
+	}
 
 	g_dbus_method_invocation_return_value (invocation,
-	                                       g_variant_new ("(b)", ret));
-out:
-	if (subject != NULL)
-		g_object_unref (subject);
+	                                       g_variant_new ("(a(ub))", &builder));
+}
 
-	return ret;
+/**
+ * urf_daemon_block_types:
+ * @type_mask: (1 << type) for every type to change
+ **/
+gboolean
+urf_daemon_block_types (UrfDaemon             *daemon,
+			const guint32          type_mask,
+			const gboolean         block,
+			GDBusMethodInvocation *invocation)
+{
+	guint32 valid_mask;
+
+	valid_mask = (1 << NUM_RFKILL_TYPES) - 1;
+	if (type_mask & ~valid_mask) {
+		g_dbus_method_invocation_return_error (invocation,
+		                                       URF_DAEMON_ERROR,
+		                                       URF_DAEMON_ERROR_GENERAL,
+		                                       "invalid type mask 0x%x", type_mask);
+		return FALSE;
+	}
+
+	if (type_mask == 0) {
+		g_dbus_method_invocation_return_value (invocation,
+		                                       g_variant_new ("(a(ub))", NULL));
+		return FALSE;
+	}
+
+	urf_daemon_authorize (daemon, invocation, "org.freedesktop.urfkill.block",
+			      urf_daemon_block_types_authorized);
+	return TRUE;
 }
 
 /**
@@ -343,36 +654,25 @@ urf_daemon_is_flight_mode (UrfDaemon             *daemon,
 }
 
 /**
- * urf_daemon_flight_mode:
+ * urf_daemon_flight_mode_authorized:
  **/
-gboolean
-urf_daemon_flight_mode (UrfDaemon             *daemon,
-			const gboolean         block,
-			GDBusMethodInvocation *invocation)
+static void
+urf_daemon_flight_mode_authorized (UrfDaemon             *daemon,
+				   GDBusMethodInvocation *invocation)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	PolkitSubject *subject = NULL;
-	gboolean ret = FALSE;
+	gboolean block;
+	gboolean ret;
 	GError *error = NULL;
 
-	if (!urf_arbitrator_has_devices (priv->arbitrator))
-		goto out;
-
-	subject = urf_polkit_get_subject (priv->polkit, invocation);
-	if (subject == NULL)
-		goto out;
-
-	if (!urf_polkit_check_auth (priv->polkit, subject, "org.freedesktop.urfkill.flight_mode", invocation))
-		goto out;
+	g_variant_get (g_dbus_method_invocation_get_parameters (invocation),
+		       "(b)", &block);
 
+	/* The arbitrator also takes care of the persistence data */
 	ret = urf_arbitrator_set_flight_mode (priv->arbitrator, block);
 
-	if (ret == TRUE) {
+	if (ret == TRUE && priv->flight_mode != block) {
 		priv->flight_mode = block;
-		urf_config_set_persist_state (priv->config, RFKILL_TYPE_ALL,
-		                              block
-		                              ? KILLSWITCH_STATE_SOFT_BLOCKED
-		                              : KILLSWITCH_STATE_UNBLOCKED);
 
 		g_signal_emit (daemon, signals[SIGNAL_FLIGHT_MODE_CHANGED], 0, priv->flight_mode);
 		g_dbus_connection_emit_signal (priv->connection,
@@ -383,18 +683,34 @@ urf_daemon_flight_mode (UrfDaemon             *daemon,
 		                               g_variant_new ("(b)", priv->flight_mode),
 		                               &error);
 		if (error) {
-			g_warning ("Failed to emit UrfkeyPressed: %s", error->message);
+			g_warning ("Failed to emit FlightModeChanged: %s", error->message);
 			g_error_free (error);
 		}
 	}
 
 	g_dbus_method_invocation_return_value (invocation,
 	                                       g_variant_new ("(b)", ret));
-out:
-	if (subject != NULL)
-		g_object_unref (subject);
+}
 
-	return ret;
+/**
+ * urf_daemon_flight_mode:
+ **/
+gboolean
+urf_daemon_flight_mode (UrfDaemon             *daemon,
+			const gboolean         block,
+			GDBusMethodInvocation *invocation)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+
+	if (!urf_arbitrator_has_devices (priv->arbitrator)) {
+		g_dbus_method_invocation_return_value (invocation,
+		                                       g_variant_new ("(b)", FALSE));
+		return FALSE;
+	}
+
+	urf_daemon_authorize (daemon, invocation, "org.freedesktop.urfkill.flight_mode",
+			      urf_daemon_flight_mode_authorized);
+	return TRUE;
 }
 
 /**
@@ -413,6 +729,22 @@ urf_daemon_is_inhibited (UrfDaemon             *daemon,
 	return TRUE;
 }
 
+/**
+ * urf_daemon_inhibit_cb:
+ **/
+static void
+urf_daemon_inhibit_cb (GObject      *source_object,
+		       GAsyncResult *res,
+		       gpointer      user_data)
+{
+	GDBusMethodInvocation *invocation = user_data;
+	guint cookie;
+
+	cookie = urf_session_checker_inhibit_finish (URF_SESSION_CHECKER (source_object), res);
+	g_dbus_method_invocation_return_value (invocation,
+	                                       g_variant_new ("(u)", cookie));
+}
+
 /**
  * urf_daemon_inhibit:
  **/
@@ -423,12 +755,10 @@ urf_daemon_inhibit (UrfDaemon             *daemon,
 {
 	UrfDaemonPrivate *priv = daemon->priv;
 	const char *bus_name;
-	guint cookie = 0;
 
 	bus_name = g_dbus_method_invocation_get_sender (invocation);
-	cookie = urf_session_checker_inhibit (priv->session_checker, bus_name, reason);
-	g_dbus_method_invocation_return_value (invocation,
-	                                       g_variant_new ("(u)", cookie));
+	urf_session_checker_inhibit_async (priv->session_checker, bus_name, reason,
+					   urf_daemon_inhibit_cb, invocation);
 
 	return TRUE;
 }
@@ -442,74 +772,70 @@ urf_daemon_uninhibit (UrfDaemon             *daemon,
 		      GDBusMethodInvocation *invocation)
 {
 	urf_session_checker_uninhibit (daemon->priv->session_checker, cookie);
+	g_dbus_method_invocation_return_value (invocation, NULL);
 }
 
 static void
-handle_method_call_main (UrfDaemon             *daemon,
-                         const gchar           *method_name,
-                         GVariant              *parameters,
-                         GDBusMethodInvocation *invocation)
-{
-	if (g_strcmp0 (method_name, "Block") == 0) {
-		gint type;
-		gboolean block;
+handle_method_call (GDBusConnection       *connection,
+                    const gchar           *sender,
+                    const gchar           *object_path,
+                    const gchar           *interface_name,
+                    const gchar           *method_name,
+                    GVariant              *parameters,
+                    GDBusMethodInvocation *invocation,
+                    gpointer               user_data)
+{
+	UrfDaemon *daemon = URF_DAEMON (user_data);
+	guint32 type;
+	guint32 index;
+	guint32 type_mask;
+	gboolean block;
+	const char *reason;
+	guint cookie;
+	GVariant *devices;
+
+	switch (urf_dbus_method_lookup (method_table, invocation)) {
+	case METHOD_BLOCK:
 		g_variant_get (parameters, "(ub)", &type, &block);
 		urf_daemon_block (daemon, type, block, invocation);
-		return;
-	} else if (g_strcmp0 (method_name, "BlockIdx") == 0) {
-		gint index;
-		gboolean block;
+		break;
+	case METHOD_BLOCK_IDX:
 		g_variant_get (parameters, "(ub)", &index, &block);
 		urf_daemon_block_idx (daemon, index, block, invocation);
-		return;
-	} else if (g_strcmp0 (method_name, "EnumerateDevices") == 0) {
+		break;
+	case METHOD_BLOCK_MANY:
+		devices = g_variant_get_child_value (parameters, 0);
+		urf_daemon_block_many (daemon, devices, invocation);
+		g_variant_unref (devices);
+		break;
+	case METHOD_BLOCK_TYPES:
+		g_variant_get (parameters, "(ub)", &type_mask, &block);
+		urf_daemon_block_types (daemon, type_mask, block, invocation);
+		break;
+	case METHOD_ENUMERATE_DEVICES:
 		urf_daemon_enumerate_devices (daemon, invocation);
-		return;
-	} else if (g_strcmp0 (method_name, "IsFlightMode") == 0) {
+		break;
+	case METHOD_IS_FLIGHT_MODE:
 		urf_daemon_is_flight_mode (daemon, invocation);
-		return;
-	} else if (g_strcmp0 (method_name, "FlightMode") == 0) {
-		gboolean block;
+		break;
+	case METHOD_FLIGHT_MODE:
 		g_variant_get (parameters, "(b)", &block);
 		urf_daemon_flight_mode (daemon, block, invocation);
-		return;
-	} else if (g_strcmp0 (method_name, "IsInhibited") == 0) {
+		break;
+	case METHOD_IS_INHIBITED:
 		urf_daemon_is_inhibited (daemon, invocation);
-		return;
-	} else if (g_strcmp0 (method_name, "Inhibit") == 0) {
-		char *reason;
-		g_variant_get (parameters, "(s)", &reason);
+		break;
+	case METHOD_INHIBIT:
+		g_variant_get (parameters, "(&s)", &reason);
 		urf_daemon_inhibit (daemon, reason, invocation);
-		return;
-	} else if (g_strcmp0 (method_name, "Uninhibit") == 0) {
-		guint cookie;
+		break;
+	case METHOD_UNINHIBIT:
 		g_variant_get (parameters, "(u)", &cookie);
 		urf_daemon_uninhibit (daemon, cookie, invocation);
-		return;
-	}
-
-	g_assert_not_reached ();
-}
-
-static void
-handle_method_call (GDBusConnection       *connection,
-                    const gchar           *sender,
-                    const gchar           *object_path,
-                    const gchar           *interface_name,
-                    const gchar           *method_name,
-                    GVariant              *parameters,
-                    GDBusMethodInvocation *invocation,
-                    gpointer               user_data)
-{
-	UrfDaemon *daemon = URF_DAEMON (user_data);
-
-	if (g_strcmp0 (interface_name, URFKILL_DBUS_INTERFACE) == 0) {
-		handle_method_call_main (daemon,
-		                         method_name,
-		                         parameters,
-		                         invocation);
-	} else {
-		g_warning ("not recognised interface: %s", interface_name);
+		break;
+	default:
+		g_warning ("not recognised method: %s.%s", interface_name, method_name);
+		break;
 	}
 }
 
@@ -524,11 +850,28 @@ handle_get_property (GDBusConnection *connection,
 {
 	UrfDaemon *daemon = URF_DAEMON (user_data);
 	GVariant *retval = NULL;
+	guint n_duplicates = 0;
 
-	if (g_strcmp0 (property_name, "DaemonVersion") == 0)
+	switch (urf_dbus_property_lookup (property_table, property_name)) {
+	case PROP_DAEMON_VERSION:
 		retval = g_variant_new_string (PACKAGE_VERSION);
-	else if (g_strcmp0 (property_name, "KeyControl") == 0)
+		break;
+	case PROP_KEY_CONTROL:
 		retval = g_variant_new_boolean (daemon->priv->key_control);
+		break;
+	case PROP_KEY_PRESSES:
+		retval = g_variant_new_uint32 (daemon->priv->n_key_presses);
+		break;
+	case PROP_KEY_PRESSES_SUPPRESSED:
+		retval = g_variant_new_uint32 (daemon->priv->n_key_suppressed);
+		break;
+	case PROP_KEY_PRESSES_DUPLICATE:
+		urf_input_get_counters (daemon->priv->input, NULL, NULL, &n_duplicates);
+		retval = g_variant_new_uint32 (n_duplicates);
+		break;
+	default:
+		break;
+	}
 
 	return retval;
 }
@@ -540,6 +883,75 @@ static const GDBusInterfaceVTable interface_vtable =
 	NULL, /* handle set_property */
 };
 
+/**
+ * urf_daemon_get_managed_objects:
+ *
+ * Every device and killswitch with all of their properties, so that
+ * clients can populate themselves with a single round trip.
+ **/
+static GVariant *
+urf_daemon_get_managed_objects (UrfDaemon *daemon)
+{
+	UrfDaemonPrivate *priv = daemon->priv;
+	UrfKillswitch *killswitch;
+	UrfDevice *device;
+	GVariantBuilder builder;
+	GList *item;
+	gint type;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{oa{sa{sv}}}"));
+
+	for (item = urf_arbitrator_get_devices (priv->arbitrator); item; item = item->next) {
+		device = URF_DEVICE (item->data);
+		g_variant_builder_add (&builder, "{o@a{sa{sv}}}",
+				       urf_device_get_object_path (device),
+				       urf_device_get_interfaces (device));
+	}
+
+	for (type = RFKILL_TYPE_ALL + 1; type < NUM_RFKILL_TYPES; type++) {
+		killswitch = urf_arbitrator_get_killswitch (priv->arbitrator, type);
+		if (killswitch == NULL)
+			continue;
+		g_variant_builder_add (&builder, "{o@a{sa{sv}}}",
+				       urf_killswitch_get_object_path (killswitch),
+				       urf_killswitch_get_interfaces (killswitch));
+	}
+
+	return g_variant_builder_end (&builder);
+}
+
+static void
+handle_object_manager_call (GDBusConnection       *connection,
+			    const gchar           *sender,
+			    const gchar           *object_path,
+			    const gchar           *interface_name,
+			    const gchar           *method_name,
+			    GVariant              *parameters,
+			    GDBusMethodInvocation *invocation,
+			    gpointer               user_data)
+{
+	UrfDaemon *daemon = URF_DAEMON (user_data);
+
+	if (g_strcmp0 (method_name, "GetManagedObjects") != 0) {
+		g_dbus_method_invocation_return_error (invocation,
+						       G_DBUS_ERROR,
+						       G_DBUS_ERROR_UNKNOWN_METHOD,
+						       "Unknown method %s", method_name);
+		return;
+	}
+
+	g_dbus_method_invocation_return_value (invocation,
+		g_variant_new ("(@a{oa{sa{sv}}})",
+			       urf_daemon_get_managed_objects (daemon)));
+}
+
+static const GDBusInterfaceVTable object_manager_vtable =
+{
+	handle_object_manager_call,
+	NULL, /* handle get_property */
+	NULL, /* handle set_property */
+};
+
 /**
  * urf_daemon_register_rfkill_daemon:
  **/
@@ -547,13 +959,9 @@ static gboolean
 urf_daemon_register_rfkill_daemon (UrfDaemon *daemon)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
-	GDBusInterfaceInfo **infos;
 	guint reg_id;
 	GError *error = NULL;
 
-	priv->introspection_data = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
-	g_assert (priv->introspection_data != NULL);
-
 	priv->connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
 	if (priv->connection == NULL) {
 		g_error ("error getting system bus: %s", error->message);
@@ -562,16 +970,24 @@ urf_daemon_register_rfkill_daemon (UrfDaemon *daemon)
 	}
 
 	/* register GObject */
-	infos = priv->introspection_data->interfaces;
 	reg_id = g_dbus_connection_register_object (priv->connection,
 		                                    URFKILL_OBJECT_PATH,
-		                                    infos[0],
+		                                    urf_dbus_urfkill_interface_info (),
 		                                    &interface_vtable,
 		                                    daemon,
 		                                    NULL,
 		                                    NULL);
 	g_assert (reg_id > 0);
 
+	reg_id = g_dbus_connection_register_object (priv->connection,
+		                                    URFKILL_OBJECT_PATH,
+		                                    urf_dbus_dbus_object_manager_interface_info (),
+		                                    &object_manager_vtable,
+		                                    daemon,
+		                                    NULL,
+		                                    NULL);
+	g_assert (reg_id > 0);
+
 	return TRUE;
 }
 
@@ -591,18 +1007,24 @@ urf_daemon_startup (UrfDaemon *daemon)
 		goto out;
 	}
 
+	ret = urf_polkit_startup (priv->polkit, priv->config, priv->connection);
+	if (!ret) {
+		g_warning ("failed to setup polkit");
+		goto out;
+	}
+
 	/* start up the arbitrator */
-	ret = urf_arbitrator_startup (priv->arbitrator, priv->config);
+	ret = urf_arbitrator_startup (priv->arbitrator, priv->config, priv->connection);
 	if (!ret) {
 		g_warning ("failed to setup arbitrator");
 		goto out;
 	}
 
-	ret = urf_ofono_manager_startup (priv->ofono_manager, priv->arbitrator);
+	ret = urf_ofono_manager_startup (priv->ofono_manager, priv->arbitrator, priv->connection);
 
 	if (priv->key_control) {
 		/* start up input device monitor */
-		ret = urf_input_startup (priv->input);
+		ret = urf_input_startup (priv->input, priv->config);
 		if (!ret) {
 			g_warning ("failed to setup input device monitor");
 			goto out;
@@ -624,15 +1046,17 @@ out:
  **/
 static void
 urf_daemon_device_added_cb (UrfArbitrator *arbitrator,
-			    const char    *object_path,
+			    UrfDevice     *device,
 			    UrfDaemon     *daemon)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
+	const char *object_path;
 	GError *error = NULL;
 
 	g_return_if_fail (URF_IS_DAEMON (daemon));
 	g_return_if_fail (URF_IS_ARBITRATOR (arbitrator));
 
+	object_path = urf_device_get_object_path (device);
 	if (object_path == NULL) {
 		g_warning ("Invalid object path");
 		return;
@@ -647,6 +1071,20 @@ urf_daemon_device_added_cb (UrfArbitrator *arbitrator,
 	                               &error);
 	if (error) {
 		g_warning ("Failed to emit DeviceAdded: %s", error->message);
+		g_clear_error (&error);
+	}
+
+	g_dbus_connection_emit_signal (priv->connection,
+	                               NULL,
+	                               URFKILL_OBJECT_PATH,
+	                               OBJECT_MANAGER_INTERFACE,
+	                               "InterfacesAdded",
+	                               g_variant_new ("(o@a{sa{sv}})",
+	                                              object_path,
+	                                              urf_device_get_interfaces (device)),
+	                               &error);
+	if (error) {
+		g_warning ("Failed to emit InterfacesAdded: %s", error->message);
 		g_error_free (error);
 	}
 }
@@ -656,14 +1094,18 @@ urf_daemon_device_added_cb (UrfArbitrator *arbitrator,
  **/
 static void
 urf_daemon_device_removed_cb (UrfArbitrator *arbitrator,
-			      const char    *object_path,
+			      UrfDevice     *device,
 			      UrfDaemon     *daemon)
 {
 	UrfDaemonPrivate *priv = daemon->priv;
+	const char *object_path;
+	const char *interfaces[3];
 	GError *error = NULL;
 
 	g_return_if_fail (URF_IS_DAEMON (daemon));
 	g_return_if_fail (URF_IS_ARBITRATOR (arbitrator));
+
+	object_path = urf_device_get_object_path (device);
 	if (object_path == NULL) {
 		g_warning ("Invalid object path");
 		return;
@@ -678,6 +1120,21 @@ urf_daemon_device_removed_cb (UrfArbitrator *arbitrator,
 	                               &error);
 	if (error) {
 		g_warning ("Failed to emit DeviceRemoved: %s", error->message);
+		g_clear_error (&error);
+	}
+
+	interfaces[0] = urf_dbus_urfkill_device_interface_info ()->name;
+	interfaces[1] = urf_device_get_urf_type (device);
+	interfaces[2] = NULL;
+	g_dbus_connection_emit_signal (priv->connection,
+	                               NULL,
+	                               URFKILL_OBJECT_PATH,
+	                               OBJECT_MANAGER_INTERFACE,
+	                               "InterfacesRemoved",
+	                               g_variant_new ("(o^as)", object_path, interfaces),
+	                               &error);
+	if (error) {
+		g_warning ("Failed to emit InterfacesRemoved: %s", error->message);
 		g_error_free (error);
 	}
 }
@@ -737,6 +1194,11 @@ urf_daemon_init (UrfDaemon *daemon)
 			  G_CALLBACK (urf_daemon_input_event_cb), daemon);
 
 	daemon->priv->session_checker = urf_session_checker_new ();
+
+	daemon->priv->key_bursts = g_hash_table_new_full (g_direct_hash,
+							  g_direct_equal,
+							  NULL,
+							  (GDestroyNotify) free_key_burst);
 }
 
 /**
@@ -790,6 +1252,13 @@ urf_daemon_class_init (UrfDaemonClass *klass)
 
 	g_type_class_add_private (klass, sizeof (UrfDaemonPrivate));
 
+	method_table = urf_dbus_method_table_new (urf_dbus_urfkill_interface_info (),
+	                                          daemon_methods,
+	                                          G_N_ELEMENTS (daemon_methods));
+	property_table = urf_dbus_property_table_new (urf_dbus_urfkill_interface_info (),
+	                                              daemon_properties,
+	                                              G_N_ELEMENTS (daemon_properties));
+
 	signals[SIGNAL_DEVICE_ADDED] =
 		g_signal_new ("device-added",
 			      G_OBJECT_CLASS_TYPE (klass),
@@ -856,6 +1325,11 @@ urf_daemon_dispose (GObject *object)
 	UrfDaemon *daemon = URF_DAEMON (object);
 	UrfDaemonPrivate *priv = daemon->priv;
 
+	if (priv->key_bursts) {
+		g_hash_table_destroy (priv->key_bursts);
+		priv->key_bursts = NULL;
+	}
+
 	if (priv->ofono_manager) {
 		g_object_unref (priv->ofono_manager);
 		priv->ofono_manager = NULL;
@@ -900,6 +1374,7 @@ urf_daemon_new (UrfConfig *config)
 	daemon->priv->config = g_object_ref (config);
 	daemon->priv->key_control = urf_config_get_key_control (config);
 	daemon->priv->master_key = urf_config_get_master_key (config);
+	daemon->priv->key_window = urf_config_get_key_window (config);
 	daemon->priv->flight_mode = urf_config_get_persist_state (config, RFKILL_TYPE_ALL);
 	return daemon;
 }
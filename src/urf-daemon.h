@@ -62,11 +62,18 @@ UrfDaemon	*urf_daemon_new			(UrfConfig		*config);
 
 gboolean	 urf_daemon_startup		(UrfDaemon		*daemon);
 gboolean	 urf_daemon_block		(UrfDaemon		*daemon,
-						 const gint		 type,
+						 const guint32		 type,
 						 const gboolean		 block,
 						 GDBusMethodInvocation  *invocation);
 gboolean	 urf_daemon_block_idx		(UrfDaemon		*daemon,
-						 const gint		 index,
+						 const guint32		 index,
+						 const gboolean		 block,
+						 GDBusMethodInvocation  *invocation);
+gboolean	 urf_daemon_block_many		(UrfDaemon		*daemon,
+						 GVariant		*devices,
+						 GDBusMethodInvocation  *invocation);
+gboolean	 urf_daemon_block_types		(UrfDaemon		*daemon,
+						 const guint32		 type_mask,
 						 const gboolean		 block,
 						 GDBusMethodInvocation  *invocation);
 gboolean	 urf_daemon_enumerate_devices	(UrfDaemon		*daemon,
@@ -0,0 +1,164 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 The urfkill authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include "urf-dbus.h"
+
+/**
+ * urf_dbus_method_table_new:
+ *
+ * Build a table to dispatch the methods of @info by their #GDBusMethodInfo.
+ * The interface info is generated from the XML files in data/, so a member
+ * missing there is a programming error.
+ **/
+GHashTable *
+urf_dbus_method_table_new (GDBusInterfaceInfo  *info,
+			   const UrfDBusMember *members,
+			   guint                n_members)
+{
+	GHashTable *table;
+	GDBusMethodInfo *method;
+	guint i;
+
+	table = g_hash_table_new (g_direct_hash, g_direct_equal);
+
+	for (i = 0; i < n_members; i++) {
+		g_assert (members[i].id > 0);
+
+		method = g_dbus_interface_info_lookup_method (info, members[i].name);
+		if (method == NULL)
+			g_error ("%s has no method %s", info->name, members[i].name);
+
+		g_hash_table_insert (table, method, GINT_TO_POINTER (members[i].id));
+	}
+
+	return table;
+}
+
+/**
+ * urf_dbus_method_lookup:
+ *
+ * Return value: the id of the invoked method, or 0 if it is unknown
+ **/
+gint
+urf_dbus_method_lookup (GHashTable            *table,
+			GDBusMethodInvocation *invocation)
+{
+	const GDBusMethodInfo *method;
+
+	method = g_dbus_method_invocation_get_method_info (invocation);
+
+	return GPOINTER_TO_INT (g_hash_table_lookup (table, method));
+}
+
+/**
+ * urf_dbus_property_table_new:
+ *
+ * Build a table to dispatch the properties of @info by name.
+ **/
+GHashTable *
+urf_dbus_property_table_new (GDBusInterfaceInfo  *info,
+			     const UrfDBusMember *members,
+			     guint                n_members)
+{
+	GHashTable *table;
+	GDBusPropertyInfo *property;
+	guint i;
+
+	table = g_hash_table_new (g_str_hash, g_str_equal);
+
+	for (i = 0; i < n_members; i++) {
+		g_assert (members[i].id > 0);
+
+		property = g_dbus_interface_info_lookup_property (info, members[i].name);
+		if (property == NULL)
+			g_error ("%s has no property %s", info->name, members[i].name);
+
+		g_hash_table_insert (table, property->name, GINT_TO_POINTER (members[i].id));
+	}
+
+	return table;
+}
+
+/**
+ * urf_dbus_property_lookup:
+ *
+ * Return value: the id of the property, or 0 if it is unknown
+ **/
+gint
+urf_dbus_property_lookup (GHashTable *table,
+			  const char *property_name)
+{
+	return GPOINTER_TO_INT (g_hash_table_lookup (table, property_name));
+}
+
+/**
+ * urf_dbus_get_all_properties:
+ *
+ * Collect the readable properties of @info through the get_property
+ * handler of @vtable, the same way org.freedesktop.DBus.Properties.GetAll
+ * would see them.
+ *
+ * Return value: a floating a{sv} #GVariant
+ **/
+GVariant *
+urf_dbus_get_all_properties (GDBusConnection            *connection,
+			     const char                 *object_path,
+			     GDBusInterfaceInfo         *info,
+			     const GDBusInterfaceVTable *vtable,
+			     gpointer                    user_data)
+{
+	GVariantBuilder builder;
+	GDBusPropertyInfo *property;
+	GVariant *value;
+	GError *error;
+	guint i;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+
+	if (info->properties == NULL || vtable->get_property == NULL)
+		return g_variant_builder_end (&builder);
+
+	for (i = 0; info->properties[i] != NULL; i++) {
+		property = info->properties[i];
+		if (!(property->flags & G_DBUS_PROPERTY_INFO_FLAGS_READABLE))
+			continue;
+
+		error = NULL;
+		value = vtable->get_property (connection, NULL, object_path,
+					      info->name, property->name,
+					      &error, user_data);
+		if (value == NULL) {
+			g_warning ("Failed to get %s.%s: %s", info->name,
+				   property->name,
+				   error ? error->message : "unknown error");
+			g_clear_error (&error);
+			continue;
+		}
+
+		g_variant_builder_add (&builder, "{sv}", property->name, value);
+		g_variant_unref (g_variant_ref_sink (value));
+	}
+
+	return g_variant_builder_end (&builder);
+}
@@ -0,0 +1,56 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 The urfkill authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __URF_DBUS_H__
+#define __URF_DBUS_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "urf-dbus-generated.h"
+
+G_BEGIN_DECLS
+
+/* Maps a method or property name to the id used for dispatching.
+ * Ids must be greater than 0. */
+typedef struct {
+	const char	*name;
+	gint		 id;
+} UrfDBusMember;
+
+GHashTable		*urf_dbus_method_table_new	(GDBusInterfaceInfo	*info,
+							 const UrfDBusMember	*members,
+							 guint			 n_members);
+gint			 urf_dbus_method_lookup		(GHashTable		*table,
+							 GDBusMethodInvocation	*invocation);
+GHashTable		*urf_dbus_property_table_new	(GDBusInterfaceInfo	*info,
+							 const UrfDBusMember	*members,
+							 guint			 n_members);
+gint			 urf_dbus_property_lookup	(GHashTable		*table,
+							 const char		*property_name);
+GVariant		*urf_dbus_get_all_properties	(GDBusConnection	*connection,
+							 const char		*object_path,
+							 GDBusInterfaceInfo	*info,
+							 const GDBusInterfaceVTable *vtable,
+							 gpointer		 user_data);
+
+G_END_DECLS
+
+#endif /* __URF_DBUS_H__ */
@@ -24,33 +24,19 @@
 
 #include <stdlib.h>
 #include <string.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <fcntl.h>
-#include <errno.h>
 #include <glib.h>
 #include <gio/gio.h>
-#include <libudev.h>
 
 #include <linux/rfkill.h>
 
-#ifndef RFKILL_EVENT_SIZE_V1
-#define RFKILL_EVENT_SIZE_V1    8
-#endif
-
 #include "urf-device-kernel.h"
+#include "urf-dbus.h"
+#include "urf-rfkill-writer.h"
 
 #include "urf-utils.h"
 
 #define URF_DEVICE_KERNEL_INTERFACE "org.freedesktop.URfkill.Device.Kernel"
 
-static const char introspection_xml[] =
-"  <interface name='org.freedesktop.URfkill.Device.Kernel'>"
-"    <signal name='Changed'/>"
-"    <property name='soft' type='b' access='read'/>"
-"    <property name='hard' type='b' access='read'/>"
-"  </interface>";
-
 enum
 {
 	PROP_0,
@@ -66,6 +52,14 @@ enum {
 
 static int signals[LAST_SIGNAL] = { 0 };
 
+static const UrfDBusMember kernel_properties[] =
+{
+	{ "soft",	PROP_DEVICE_SOFT },
+	{ "hard",	PROP_DEVICE_HARD },
+};
+
+static GHashTable *property_table = NULL;
+
 #define URF_DEVICE_KERNEL_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), \
                                 URF_TYPE_DEVICE_KERNEL, UrfDeviceKernelPrivate))
 
@@ -76,10 +70,7 @@ struct _UrfDeviceKernelPrivate {
 	gboolean	 soft;
 	gboolean	 hard;
 	gboolean	 platform;
-	char		*object_path;
-	GDBusConnection	*connection;
-	GDBusNodeInfo	*introspection_data;
-	int		 fd;
+	UrfRfkillWriter	*writer;
 };
 
 G_DEFINE_TYPE_WITH_PRIVATE (UrfDeviceKernel, urf_device_kernel, URF_TYPE_DEVICE)
@@ -105,9 +96,9 @@ emit_properites_changed (UrfDeviceKernel *device)
 	                       "hard",
 	                       g_variant_new_boolean (priv->hard));
 
-	g_dbus_connection_emit_signal (priv->connection,
+	g_dbus_connection_emit_signal (urf_device_get_connection (URF_DEVICE (device)),
 	                               NULL,
-	                               priv->object_path,
+	                               urf_device_get_object_path (URF_DEVICE (device)),
 	                               "org.freedesktop.DBus.Properties",
 	                               "PropertiesChanged",
 	                               g_variant_new ("(sa{sv}as)",
@@ -141,17 +132,18 @@ urf_device_kernel_update_states (UrfDevice *device,
 
 		g_signal_emit (G_OBJECT (device), signals[SIGNAL_CHANGED], 0);
 		emit_properites_changed (URF_DEVICE_KERNEL (device));
-		g_dbus_connection_emit_signal (priv->connection,
+		g_dbus_connection_emit_signal (urf_device_get_connection (device),
 		                               NULL,
-		                               priv->object_path,
+		                               urf_device_get_object_path (device),
 		                               URF_DEVICE_KERNEL_INTERFACE,
 		                               "Changed",
 		                               NULL,
 		                               &error);
+		/* The state did change, whether or not the clients heard
+		 * about it */
 		if (error) {
 			g_warning ("Failed to emit Changed: %s", error->message);
 			g_error_free (error);
-			return FALSE;
 		}
 
 		return TRUE;
@@ -222,28 +214,17 @@ set_soft (UrfDevice *device, gboolean blocked)
 {
 	UrfDeviceKernel *self = URF_DEVICE_KERNEL (device);
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (self);
-	struct rfkill_event event;
-	ssize_t len;
-
-	memset (&event, 0, sizeof(event));
-	event.op = RFKILL_OP_CHANGE_ALL;
-	event.type = priv->type;
-	event.soft = blocked;
 
-	g_message ("Setting %s to %s",
+	g_message ("Setting %s device %u to %s",
 	           type_to_string (priv->type),
+	           priv->index,
 	           blocked ? "blocked" : "unblocked");
 
-	len = write (priv->fd, &event, sizeof(event));
-	if (len < 0) {
-		g_warning ("Failed to change RFKILL state: %s",
-			   g_strerror (errno));
-		return FALSE;
-	}
-
-	priv->soft = blocked;
+	/* The new state is picked up from the CHANGE event of the kernel */
+	urf_rfkill_writer_queue (priv->writer, RFKILL_OP_CHANGE,
+				 priv->index, priv->type, blocked);
 
-	return TRUE;
+	return urf_rfkill_writer_flush (priv->writer);
 }
 
 /**
@@ -348,19 +329,9 @@ dispose (GObject *object)
 {
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (object);
 
-	if (priv->introspection_data) {
-		g_dbus_node_info_unref (priv->introspection_data);
-		priv->introspection_data = NULL;
-	}
-
-	if (priv->connection) {
-		g_object_unref (priv->connection);
-		priv->connection = NULL;
-	}
-
-	if (priv->introspection_data) {
-		g_dbus_node_info_unref (priv->introspection_data);
-		priv->introspection_data = NULL;
+	if (priv->writer) {
+		g_object_unref (priv->writer);
+		priv->writer = NULL;
 	}
 
 	G_OBJECT_CLASS(urf_device_kernel_parent_class)->dispose(object);
@@ -373,19 +344,10 @@ static void
 urf_device_kernel_init (UrfDeviceKernel *device)
 {
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
-	int fd;
 
 	priv->name = NULL;
 	priv->platform = FALSE;
-	priv->object_path = NULL;
-
-	fd = open("/dev/rfkill", O_RDWR | O_NONBLOCK);
-	if (fd < 0) {
-		if (errno == EACCES)
-			g_warning ("Could not open RFKILL control device");
-	}
-
-	priv->fd = fd;
+	priv->writer = NULL;
 }
 
 /**
@@ -403,6 +365,10 @@ urf_device_kernel_class_init(UrfDeviceKernelClass *class)
 	object_class->set_property = set_property;
 	object_class->dispose = dispose;
 
+	property_table = urf_dbus_property_table_new (urf_dbus_urfkill_device_kernel_interface_info (),
+	                                              kernel_properties,
+	                                              G_N_ELEMENTS (kernel_properties));
+
 	parent_class->get_index = get_index;
 	parent_class->get_state = get_state;
 	parent_class->get_name = get_name;
@@ -456,10 +422,16 @@ handle_get_property (GDBusConnection *connection,
 
 	GVariant *retval = NULL;
 
-	if (g_strcmp0 (property_name, "soft") == 0)
+	switch (urf_dbus_property_lookup (property_table, property_name)) {
+	case PROP_DEVICE_SOFT:
 		retval = g_variant_new_boolean (priv->soft);
-	else if (g_strcmp0 (property_name, "hard") == 0)
+		break;
+	case PROP_DEVICE_HARD:
 		retval = g_variant_new_boolean (priv->hard);
+		break;
+	default:
+		break;
+	}
 
 	return retval;
 }
@@ -485,46 +457,27 @@ static const GDBusInterfaceVTable interface_vtable =
 };
 
 /**
- * get_udev_attrs
+ * get_sysfs_attrs
  */
 static void
-get_udev_attrs (UrfDeviceKernel *device)
+get_sysfs_attrs (UrfDeviceKernel *device)
 {
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
-	struct udev *udev;
-	struct udev_device *dev;
-	struct udev_device *parent_dev;
-
-	udev = udev_new ();
-	if (udev == NULL) {
-		g_warning ("udev_new() failed");
-		return;
-	}
-	dev = get_rfkill_device_by_index (udev, priv->index);
-	if (!dev) {
-		g_warning ("Failed to get udev device for index %u", priv->index);
-		udev_unref (udev);
-		return;
-	}
-
-	priv->name = g_strdup (udev_device_get_sysattr_value (dev, "name"));
-
-	parent_dev = udev_device_get_parent_with_subsystem_devtype (dev, "platform", NULL);
-	if (parent_dev)
-		priv->platform = TRUE;
 
-	udev_device_unref (dev);
-	udev_unref (udev);
+	if (!get_rfkill_device_attrs (priv->index, &priv->name, &priv->platform))
+		g_warning ("Failed to get the sysfs attributes of index %u", priv->index);
 }
 
 /**
  * urf_device_kernel_new:
  */
 UrfDevice *
-urf_device_kernel_new (gint    index,
-                       gint    type,
-                       gboolean soft,
-                       gboolean hard)
+urf_device_kernel_new (gint             index,
+                       gint             type,
+                       gboolean         soft,
+                       gboolean         hard,
+                       UrfRfkillWriter *writer,
+                       GDBusConnection *connection)
 {
 	UrfDeviceKernel *device = g_object_new (URF_TYPE_DEVICE_KERNEL, NULL);
 	UrfDeviceKernelPrivate *priv = URF_DEVICE_KERNEL_GET_PRIVATE (device);
@@ -533,10 +486,12 @@ urf_device_kernel_new (gint    index,
 	priv->type = type;
 	priv->soft = soft;
 	priv->hard = hard;
+	priv->writer = g_object_ref (writer);
 
-	get_udev_attrs (device);
+	get_sysfs_attrs (device);
 
-	if (!urf_device_register_device (URF_DEVICE (device), interface_vtable, introspection_xml)) {
+	if (!urf_device_register_device (URF_DEVICE (device), connection, &interface_vtable,
+	                                 urf_dbus_urfkill_device_kernel_interface_info ())) {
 		g_object_unref (device);
 		return NULL;
 	}
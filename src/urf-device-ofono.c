@@ -32,17 +32,12 @@
 #include <linux/rfkill.h>
 
 #include "urf-device-ofono.h"
+#include "urf-dbus.h"
 
 #include "urf-utils.h"
 
 #define URF_DEVICE_OFONO_INTERFACE "org.freedesktop.URfkill.Device.Ofono"
 
-static const char introspection_xml[] =
-"  <interface name='org.freedesktop.URfkill.Device.Ofono'>"
-"    <signal name='Changed'/>"
-"    <property name='soft' type='b' access='read'/>"
-"  </interface>";
-
 enum
 {
 	PROP_0,
@@ -57,15 +52,38 @@ enum {
 
 static int signals[LAST_SIGNAL] = { 0 };
 
+static const UrfDBusMember ofono_properties[] =
+{
+	{ "soft",	PROP_SOFT },
+};
+
+static GHashTable *property_table = NULL;
+
 #define URF_DEVICE_OFONO_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), \
                                            URF_TYPE_DEVICE_OFONO, UrfDeviceOfonoPrivate))
 
+/* The oFono modem properties we make use of */
+typedef enum {
+	MODEM_PROP_NONE		= 0,
+	MODEM_PROP_ONLINE	= 1 << 0,
+	MODEM_PROP_POWERED	= 1 << 1,
+	MODEM_PROP_MANUFACTURER	= 1 << 2,
+	MODEM_PROP_MODEL	= 1 << 3,
+} ModemProperty;
+
+typedef struct {
+	gboolean online;
+	gboolean powered;
+	char *manufacturer;
+	char *model;
+} ModemState;
+
 struct _UrfDeviceOfonoPrivate {
 	gint index;
 	char *object_path;
-	char *name;
+	char *name; /* built from the state, NULL until asked for */
 
-	GHashTable *properties;
+	ModemState state;
 	gboolean soft;
 
 	GDBusProxy *proxy;
@@ -90,14 +108,19 @@ urf_device_ofono_update_states (UrfDeviceOfono      *device,
 	return TRUE;
 }
 
-gchar *
+/**
+ * urf_device_ofono_get_path:
+ *
+ * Return value: the oFono object path of the modem, owned by the device
+ **/
+const gchar *
 urf_device_ofono_get_path (UrfDeviceOfono *ofono)
 {
 	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (ofono);
 
 	g_return_val_if_fail (URF_IS_DEVICE_OFONO (ofono), NULL);
 
-	return g_strdup(priv->object_path);
+	return priv->object_path;
 }
 
 /**
@@ -136,30 +159,20 @@ get_name (UrfDevice *device)
 {
 	UrfDeviceOfono *modem = URF_DEVICE_OFONO (device);
 	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
-	GVariant *manufacturer = NULL;
-	GVariant *model = NULL;
-
-	if (priv->name)
-		g_free (priv->name);
 
-	if (!priv->proxy) {
-		g_debug( "have no proxy");
+	/* dropped whenever Manufacturer or Model change */
+	if (priv->name == NULL) {
+		priv->name = g_strjoin (" ",
+		                        priv->state.manufacturer
+		                            ? priv->state.manufacturer
+		                            : _("unknown"),
+		                        priv->state.model
+		                            ? priv->state.model
+		                            : _("unknown"),
+		                        NULL);
+		g_debug ("%s: new name: '%s'", __func__, priv->name);
 	}
 
-	manufacturer = g_hash_table_lookup (priv->properties, "Manufacturer");
-	model = g_hash_table_lookup (priv->properties, "Model");
-
-	priv->name = g_strjoin (" ",
-	                        manufacturer
-                                    ? g_variant_get_string (manufacturer, NULL)
-	                            : _("unknown"),
-	                        model
-	                            ? g_variant_get_string (model, NULL)
-	                            : _("unknown"),
-	                        NULL);
-
-	g_debug ("%s: new name: '%s'", __func__, priv->name);
-
 	return priv->name;
 }
 
@@ -171,14 +184,8 @@ get_soft (UrfDevice *device)
 {
 	UrfDeviceOfono *modem = URF_DEVICE_OFONO (device);
 	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
-	GVariant *online;
-	gboolean soft = FALSE;
 
-	online = g_hash_table_lookup (priv->properties, "Online");
-	if (online)
-		soft = !g_variant_get_boolean (online);
-
-	return soft;
+	return !priv->state.online;
 }
 
 static void
@@ -186,19 +193,20 @@ set_online_cb (GObject *source_object,
                GAsyncResult *res,
                gpointer user_data)
 {
-	UrfDeviceOfono *modem = URF_DEVICE_OFONO (user_data);
-	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
 	GVariant *result;
 	GError *error = NULL;
 
-	result = g_dbus_proxy_call_finish (priv->proxy, res, &error);
+	/* the modem may be gone if the call was cancelled */
+	result = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
 
 	if (!error) {
-		g_debug ("online change successful: %s",
-		         g_variant_print (result, TRUE));
+		g_debug ("online change successful");
+		g_variant_unref (result);
 	} else {
-		g_warning ("Could not set Online property in oFono: %s",
-		           error ? error->message : "(unknown error)");
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Could not set Online property in oFono: %s",
+			           error->message);
+		g_error_free (error);
 	}
 }
 
@@ -212,6 +220,11 @@ set_soft (UrfDevice *device, gboolean blocked)
 	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
 
 	priv->soft = blocked;
+
+	/* applied once the modem is powered */
+	if (priv->proxy == NULL)
+		return TRUE;
+
 	g_dbus_proxy_call (priv->proxy,
 	                   "SetProperty",
 	                   g_variant_new ("(sv)",
@@ -243,6 +256,111 @@ get_state (UrfDevice *device)
 	return state;
 }
 
+/**
+ * emit_properties_changed:
+ **/
+static void
+emit_properties_changed (UrfDeviceOfono *modem)
+{
+	GDBusConnection *connection;
+	GVariantBuilder builder;
+	GError *error = NULL;
+
+	connection = urf_device_get_connection (URF_DEVICE (modem));
+	if (connection == NULL)
+		return;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", "soft",
+			       g_variant_new_boolean (get_soft (URF_DEVICE (modem))));
+
+	g_dbus_connection_emit_signal (connection,
+	                               NULL,
+	                               urf_device_get_object_path (URF_DEVICE (modem)),
+	                               "org.freedesktop.DBus.Properties",
+	                               "PropertiesChanged",
+	                               g_variant_new ("(sa{sv}as)",
+	                                              URF_DEVICE_OFONO_INTERFACE,
+	                                              &builder,
+	                                              NULL),
+	                               &error);
+	if (error) {
+		g_warning ("Failed to emit PropertiesChanged: %s", error->message);
+		g_error_free (error);
+	}
+}
+
+static gboolean
+modem_update_boolean (gboolean *field,
+                      GVariant *value)
+{
+	gboolean b;
+
+	if (!g_variant_is_of_type (value, G_VARIANT_TYPE_BOOLEAN))
+		return FALSE;
+
+	b = g_variant_get_boolean (value);
+	if (*field == b)
+		return FALSE;
+
+	*field = b;
+	return TRUE;
+}
+
+static gboolean
+modem_update_string (char **field,
+                     GVariant *value)
+{
+	const char *str;
+
+	if (!g_variant_is_of_type (value, G_VARIANT_TYPE_STRING))
+		return FALSE;
+
+	str = g_variant_get_string (value, NULL);
+	if (g_strcmp0 (*field, str) == 0)
+		return FALSE;
+
+	g_free (*field);
+	*field = g_strdup (str);
+	return TRUE;
+}
+
+/**
+ * modem_update_property:
+ *
+ * Return value: the property that changed, or MODEM_PROP_NONE if the
+ *               value is the same or not one we keep
+ **/
+static ModemProperty
+modem_update_property (UrfDeviceOfono *modem,
+                       const char *name,
+                       GVariant *value)
+{
+	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
+	ModemProperty changed = MODEM_PROP_NONE;
+
+	if (g_strcmp0 (name, "Online") == 0) {
+		if (modem_update_boolean (&priv->state.online, value))
+			changed = MODEM_PROP_ONLINE;
+	} else if (g_strcmp0 (name, "Powered") == 0) {
+		if (modem_update_boolean (&priv->state.powered, value))
+			changed = MODEM_PROP_POWERED;
+	} else if (g_strcmp0 (name, "Manufacturer") == 0) {
+		if (modem_update_string (&priv->state.manufacturer, value))
+			changed = MODEM_PROP_MANUFACTURER;
+	} else if (g_strcmp0 (name, "Model") == 0) {
+		if (modem_update_string (&priv->state.model, value))
+			changed = MODEM_PROP_MODEL;
+	}
+
+	if (changed & (MODEM_PROP_MANUFACTURER | MODEM_PROP_MODEL)) {
+		g_free (priv->name);
+		priv->name = NULL;
+	}
+
+	return changed;
+}
+
 static void
 modem_signal_cb (GDBusProxy *proxy,
                  gchar *sender_name,
@@ -254,32 +372,28 @@ modem_signal_cb (GDBusProxy *proxy,
 	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
 
 	if (g_strcmp0 (signal_name, "PropertyChanged") == 0) {
-		gchar *prop_name;
-		GVariant *prop_value = NULL;
-
-		g_debug ("properties changed for %s: %s",
-		         priv->object_path,
-		         g_variant_print (parameters, TRUE));
+		const gchar *prop_name;
+		GVariant *prop_value;
+		ModemProperty changed;
 
-		g_variant_get_child (parameters, 0, "s", &prop_name);
-		g_variant_get_child (parameters, 1, "v", &prop_value);
+		if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sv)")))
+			return;
 
-		if (prop_value)
-			g_hash_table_replace (priv->properties,
-			                      g_strdup (prop_name),
-			                      g_variant_ref (prop_value));
+		g_variant_get (parameters, "(&sv)", &prop_name, &prop_value);
+		changed = modem_update_property (modem, prop_name, prop_value);
+		g_variant_unref (prop_value);
 
-		if (g_strcmp0 ("Powered", prop_name) == 0) {
-			gboolean powered = FALSE;
+		if (changed == MODEM_PROP_NONE)
+			return;
 
-			powered = g_variant_get_boolean (prop_value);
+		g_debug ("%s changed for %s", prop_name, priv->object_path);
 
-			if (powered)
-				set_soft (URF_DEVICE (modem), priv->soft);
+		if (changed == MODEM_PROP_POWERED && priv->state.powered) {
+			set_soft (URF_DEVICE (modem), priv->soft);
+		} else if (changed == MODEM_PROP_ONLINE) {
+			g_signal_emit_by_name (modem, "state-changed");
+			emit_properties_changed (modem);
 		}
-
-		g_free (prop_name);
-		g_variant_unref (prop_value);
 	}
 }
 
@@ -288,38 +402,42 @@ get_properties_cb (GObject *source_object,
                    GAsyncResult *res,
                    gpointer user_data)
 {
-	UrfDeviceOfono *modem = URF_DEVICE_OFONO (user_data);
-	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
+	UrfDeviceOfono *modem;
+	UrfDeviceOfonoPrivate *priv;
 	GVariant *result, *properties, *variant = NULL;
 	GVariantIter iter;
 	GError *error = NULL;
-	gchar *key;
+	const gchar *key;
 
-	result = g_dbus_proxy_call_finish (priv->proxy, res, &error);
+	result = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
 
 	if (!error) {
+		modem = URF_DEVICE_OFONO (user_data);
+		priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
+
 		properties = g_variant_get_child_value (result, 0);
 		g_debug ("%zd properties for %s", g_variant_n_children (properties), priv->object_path);
-		g_debug ("%s", g_variant_print (properties, TRUE));
 
 		g_variant_iter_init (&iter, properties);
-		while (g_variant_iter_next (&iter, "{sv}", &key, &variant)) {
-			if (g_strcmp0 ("Powered", key) == 0 &&
-			    g_variant_get_boolean (variant) == TRUE) {
-				set_soft (URF_DEVICE (modem), priv->soft);
-			}
-
-			g_hash_table_insert (priv->properties, g_strdup (key),
-			                     g_variant_ref (variant));
+		while (g_variant_iter_next (&iter, "{&sv}", &key, &variant)) {
+			modem_update_property (modem, key, variant);
 			g_variant_unref (variant);
-                        g_free (key);
-                }
+		}
+
+		if (priv->state.powered)
+			set_soft (URF_DEVICE (modem), priv->soft);
+
+		/* The state comes from the Online property we just got */
+		g_signal_emit_by_name (modem, "state-changed");
+		emit_properties_changed (modem);
 
 		g_variant_unref (properties);
 		g_variant_unref (result);
 	} else {
-		g_warning ("Error getting properties: %s",
-		           error ? error->message : "(unknown error)");
+		/* the modem may be gone if the call was cancelled */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Error getting properties: %s", error->message);
+		g_error_free (error);
 	}
 }
 
@@ -328,14 +446,17 @@ proxy_ready_cb (GObject *source_object,
                 GAsyncResult *res,
                 gpointer user_data)
 {
-	UrfDeviceOfono *modem = URF_DEVICE_OFONO (user_data);
-	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
+	UrfDeviceOfono *modem;
+	UrfDeviceOfonoPrivate *priv;
+	GDBusProxy *proxy;
 	GError *error = NULL;
 
-	priv->proxy = g_dbus_proxy_new_finish (res, &error);
+	proxy = g_dbus_proxy_new_finish (res, &error);
 
 	if (!error) {
-		g_cancellable_reset (priv->cancellable);
+		modem = URF_DEVICE_OFONO (user_data);
+		priv = URF_DEVICE_OFONO_GET_PRIVATE (modem);
+		priv->proxy = proxy;
 		g_signal_connect (priv->proxy, "g-signal",
 		                  G_CALLBACK (modem_signal_cb), modem);
 		g_dbus_proxy_call (priv->proxy,
@@ -347,8 +468,10 @@ proxy_ready_cb (GObject *source_object,
 		                   (GAsyncReadyCallback) get_properties_cb,
 		                   modem);
 	} else {
-		g_warning ("Could not get oFono Modem proxy: %s",
-		           error ? error->message : "(unknown error)");
+		/* the modem may be gone if the call was cancelled */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Could not get oFono Modem proxy: %s", error->message);
+		g_error_free (error);
 	}
 }
 
@@ -409,9 +532,38 @@ constructor (GType type,
 static void
 dispose (GObject *object)
 {
+	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (object);
+
+	/* Pending calls must not come back to a modem that is gone */
+	if (priv->cancellable)
+		g_cancellable_cancel (priv->cancellable);
+
+	if (priv->proxy) {
+		g_signal_handlers_disconnect_by_data (priv->proxy, object);
+		g_object_unref (priv->proxy);
+		priv->proxy = NULL;
+	}
+
 	G_OBJECT_CLASS(urf_device_ofono_parent_class)->dispose(object);
 }
 
+/**
+ * finalize:
+ **/
+static void
+finalize (GObject *object)
+{
+	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (object);
+
+	g_object_unref (priv->cancellable);
+	g_free (priv->state.manufacturer);
+	g_free (priv->state.model);
+	g_free (priv->object_path);
+	g_free (priv->name);
+
+	G_OBJECT_CLASS(urf_device_ofono_parent_class)->finalize(object);
+}
+
 /**
  * urf_device_ofono_init:
  **/
@@ -421,8 +573,12 @@ urf_device_ofono_init (UrfDeviceOfono *device)
 	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (device);
 
 	priv->cancellable = g_cancellable_new ();
-	priv->properties = g_hash_table_new_full (g_str_hash, g_str_equal,
-	                                          g_free, (GDestroyNotify) g_variant_unref);
+	/* Not blocked until oFono tells otherwise */
+	priv->state.online = TRUE;
+	priv->state.powered = FALSE;
+	priv->state.manufacturer = NULL;
+	priv->state.model = NULL;
+	priv->name = NULL;
 	priv->soft = FALSE;
 }
 
@@ -440,6 +596,11 @@ urf_device_ofono_class_init(UrfDeviceOfonoClass *class)
 	object_class->get_property = get_property;
 	object_class->set_property = set_property;
 	object_class->dispose = dispose;
+	object_class->finalize = finalize;
+
+	property_table = urf_dbus_property_table_new (urf_dbus_urfkill_device_ofono_interface_info (),
+	                                              ofono_properties,
+	                                              G_N_ELEMENTS (ofono_properties));
 
 	parent_class->get_index = get_index;
 	parent_class->get_state = get_state;
@@ -480,8 +641,13 @@ handle_get_property (GDBusConnection *connection,
 
 	GVariant *retval = NULL;
 
-	if (g_strcmp0 (property_name, "soft") == 0)
+	switch (urf_dbus_property_lookup (property_table, property_name)) {
+	case PROP_SOFT:
 		retval = g_variant_new_boolean (get_soft (URF_DEVICE (device)));
+		break;
+	default:
+		break;
+	}
 
 	return retval;
 }
@@ -510,7 +676,7 @@ static const GDBusInterfaceVTable interface_vtable =
  * urf_device_ofono_new:
  */
 UrfDevice *
-urf_device_ofono_new (gint index, const char *object_path)
+urf_device_ofono_new (gint index, const char *object_path, GDBusConnection *connection)
 {
 	UrfDeviceOfono *device = g_object_new (URF_TYPE_DEVICE_OFONO, NULL);
 	UrfDeviceOfonoPrivate *priv = URF_DEVICE_OFONO_GET_PRIVATE (device);
@@ -520,20 +686,21 @@ urf_device_ofono_new (gint index, const char *object_path)
 
 	g_debug ("new ofono device: %p for %s", device, priv->object_path);
 
-        if (!urf_device_register_device (URF_DEVICE (device), interface_vtable, introspection_xml)) {
+        if (!urf_device_register_device (URF_DEVICE (device), connection, &interface_vtable,
+	                                 urf_dbus_urfkill_device_ofono_interface_info ())) {
                 g_object_unref (device);
                 return NULL;
         }
 
-	g_dbus_proxy_new_for_bus (G_BUS_TYPE_SYSTEM,
-	                          G_DBUS_PROXY_FLAGS_NONE,
-	                          NULL,
-	                          "org.ofono",
-	                          priv->object_path,
-	                          "org.ofono.Modem",
-	                          priv->cancellable,
-	                          proxy_ready_cb,
-	                          device);
+	g_dbus_proxy_new (connection,
+	                  G_DBUS_PROXY_FLAGS_NONE,
+	                  NULL,
+	                  "org.ofono",
+	                  priv->object_path,
+	                  "org.ofono.Modem",
+	                  priv->cancellable,
+	                  proxy_ready_cb,
+	                  device);
 
 	return URF_DEVICE (device);
 }
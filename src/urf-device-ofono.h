@@ -52,9 +52,10 @@ typedef struct {
 
 GType			 urf_device_ofono_get_type		(void);
 
-UrfDevice		*urf_device_ofono_new			(gint index, const char *object_path);
+UrfDevice		*urf_device_ofono_new			(gint index, const char *object_path,
+								 GDBusConnection *connection);
 
-gchar			*urf_device_ofono_get_path		(UrfDeviceOfono *ofono);
+const gchar		*urf_device_ofono_get_path		(UrfDeviceOfono *ofono);
 
 G_END_DECLS
 
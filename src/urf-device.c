@@ -30,20 +30,11 @@
 
 #include "urf-device.h"
 
+#include "urf-dbus.h"
 #include "urf-utils.h"
 
 #define URF_DEVICE_INTERFACE "org.freedesktop.URfkill.Device"
 
-static const char introspection_generic[] =
-"  <interface name='org.freedesktop.URfkill.Device'>"
-"    <signal name='Changed'/>"
-"    <property name='index' type='i' access='read'/>"
-"    <property name='type' type='i' access='read'/>"
-"    <property name='urftype' type='s' access='read'/>"
-"    <property name='name' type='s' access='read'/>"
-"    <property name='platform' type='b' access='read'/>"
-"  </interface>";
-
 enum
 {
 	PROP_0,
@@ -63,13 +54,27 @@ enum {
 
 static int signals[LAST_SIGNAL] = { 0 };
 
+static const UrfDBusMember device_properties[] =
+{
+	{ "index",	PROP_DEVICE_INDEX },
+	{ "type",	PROP_DEVICE_TYPE },
+	{ "urftype",	PROP_URF_TYPE },
+	{ "name",	PROP_DEVICE_NAME },
+	{ "platform",	PROP_DEVICE_PLATFORM },
+};
+
+static GHashTable *property_table = NULL;
+
 #define URF_DEVICE_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), \
                                 URF_TYPE_DEVICE, UrfDevicePrivate))
 
 struct _UrfDevicePrivate {
 	char		*object_path;
 	GDBusConnection	*connection;
-	GDBusNodeInfo	*introspection_data;
+	guint		 device_reg_id;
+	guint		 urftype_reg_id;
+	GDBusInterfaceInfo		*urftype_info;
+	const GDBusInterfaceVTable	*urftype_vtable;
 };
 
 G_DEFINE_ABSTRACT_TYPE_WITH_PRIVATE (UrfDevice, urf_device, G_TYPE_OBJECT)
@@ -223,6 +228,19 @@ urf_device_get_object_path (UrfDevice *device)
 	return priv->object_path;
 }
 
+/**
+ * urf_device_get_connection:
+ *
+ * Return value: the connection the device is exported on
+ **/
+GDBusConnection *
+urf_device_get_connection (UrfDevice *device)
+{
+	UrfDevicePrivate *priv = URF_DEVICE_GET_PRIVATE (device);
+
+	return priv->connection;
+}
+
 /**
  * urf_device_is_platform:
  */
@@ -248,10 +266,15 @@ urf_device_update_states (UrfDevice      *device,
 			  const gboolean  soft,
 			  const gboolean  hard)
 {
+	gboolean changed = FALSE;
+
 	if (URF_GET_DEVICE_CLASS (device)->update_states)
-		return URF_GET_DEVICE_CLASS (device)->update_states (device, soft, hard);
+		changed = URF_GET_DEVICE_CLASS (device)->update_states (device, soft, hard);
 
-	return FALSE;
+	if (changed)
+		g_signal_emit (G_OBJECT (device), signals[SIGNAL_CHANGED], 0);
+
+	return changed;
 }
 
 /**
@@ -319,21 +342,19 @@ urf_device_dispose (GObject *object)
 {
 	UrfDevicePrivate *priv = URF_DEVICE_GET_PRIVATE (object);
 
-	if (priv->introspection_data) {
-		g_dbus_node_info_unref (priv->introspection_data);
-		priv->introspection_data = NULL;
-	}
-
 	if (priv->connection) {
+		if (priv->urftype_reg_id > 0)
+			g_dbus_connection_unregister_object (priv->connection,
+							     priv->urftype_reg_id);
+		if (priv->device_reg_id > 0)
+			g_dbus_connection_unregister_object (priv->connection,
+							     priv->device_reg_id);
+		priv->urftype_reg_id = 0;
+		priv->device_reg_id = 0;
 		g_object_unref (priv->connection);
 		priv->connection = NULL;
 	}
 
-	if (priv->introspection_data) {
-		g_dbus_node_info_unref (priv->introspection_data);
-		priv->introspection_data = NULL;
-	}
-
 	G_OBJECT_CLASS(urf_device_parent_class)->dispose(object);
 }
 
@@ -366,6 +387,10 @@ urf_device_class_init(UrfDeviceClass *class)
 	object_class->constructor = constructor;
 	object_class->constructed = constructed;
 
+	property_table = urf_dbus_property_table_new (urf_dbus_urfkill_device_interface_info (),
+	                                              device_properties,
+	                                              G_N_ELEMENTS (device_properties));
+
 	signals[SIGNAL_CHANGED] =
 		g_signal_new ("state-changed",
 			      G_OBJECT_CLASS_TYPE (class),
@@ -433,18 +458,25 @@ handle_get_property (GDBusConnection *connection,
 
 	GVariant *retval = NULL;
 
-	if (g_strcmp0 (property_name, "index") == 0)
+	switch (urf_dbus_property_lookup (property_table, property_name)) {
+	case PROP_DEVICE_INDEX:
 		retval = g_variant_new_int32 (urf_device_get_index (device));
-	else if (g_strcmp0 (property_name, "type") == 0)
+		break;
+	case PROP_DEVICE_TYPE:
 		retval = g_variant_new_int32 (urf_device_get_device_type (device));
-	else if (g_strcmp0 (property_name, "state") == 0)
-		retval = g_variant_new_int32 (urf_device_get_state (device));
-	else if (g_strcmp0 (property_name, "urftype") == 0)
+		break;
+	case PROP_URF_TYPE:
 		retval = g_variant_new_string (urf_device_get_urf_type (device));
-	else if (g_strcmp0 (property_name, "name") == 0)
+		break;
+	case PROP_DEVICE_NAME:
 		retval = g_variant_new_string (urf_device_get_name (device));
-	else if (g_strcmp0 (property_name, "platform") == 0)
+		break;
+	case PROP_DEVICE_PLATFORM:
 		retval = g_variant_new_boolean (urf_device_is_platform (device));
+		break;
+	default:
+		break;
+	}
 
 	return retval;
 }
@@ -471,54 +503,78 @@ urf_device_compute_object_path (UrfDevice *device)
  * urf_device_register_device:
  **/
 gboolean
-urf_device_register_device (UrfDevice *device, const GDBusInterfaceVTable vtable, const char *xml)
+urf_device_register_device (UrfDevice                  *device,
+                            GDBusConnection            *connection,
+                            const GDBusInterfaceVTable *vtable,
+                            GDBusInterfaceInfo         *info)
 {
 	UrfDevicePrivate *priv = URF_DEVICE_GET_PRIVATE (device);
-	GDBusInterfaceInfo **infos;
-	guint reg_id;
-	GError *error = NULL;
-	GString *introspection_xml;
-	gchar *xml_data;
-
-	introspection_xml = g_string_new ("<node>");
-	introspection_xml = g_string_append (introspection_xml, introspection_generic);
-	introspection_xml = g_string_append (introspection_xml, xml);
-	introspection_xml = g_string_append (introspection_xml, "</node>");
-	xml_data = g_string_free (introspection_xml, FALSE);
-
-	priv->introspection_data = g_dbus_node_info_new_for_xml (xml_data, NULL);
-	g_assert (priv->introspection_data != NULL);
-	g_free (xml_data);
-
-	priv->connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
-	if (priv->connection == NULL) {
-		g_error ("error getting system bus: %s", error->message);
-		g_error_free (error);
-		return FALSE;
-	}
 
+	g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), FALSE);
+
+	priv->connection = g_object_ref (connection);
 	priv->object_path = urf_device_compute_object_path (device);
-	infos = priv->introspection_data->interfaces;
-	reg_id = g_dbus_connection_register_object (priv->connection,
-		                                    priv->object_path,
-		                                    infos[0],
-		                                    &interface_vtable,
-		                                    device,
-		                                    NULL,
-		                                    NULL);
-	g_assert (reg_id > 0);
-	reg_id = g_dbus_connection_register_object (priv->connection,
-		                                    priv->object_path,
-		                                    infos[1],
-		                                    &vtable,
-		                                    device,
-		                                    NULL,
-		                                    NULL);
-	g_assert (reg_id > 0);
+	priv->urftype_info = info;
+	priv->urftype_vtable = vtable;
+	priv->device_reg_id =
+		g_dbus_connection_register_object (priv->connection,
+						   priv->object_path,
+						   urf_dbus_urfkill_device_interface_info (),
+						   &interface_vtable,
+						   device,
+						   NULL,
+						   NULL);
+	g_assert (priv->device_reg_id > 0);
+	priv->urftype_reg_id =
+		g_dbus_connection_register_object (priv->connection,
+						   priv->object_path,
+						   info,
+						   vtable,
+						   device,
+						   NULL,
+						   NULL);
+	g_assert (priv->urftype_reg_id > 0);
 
 	return TRUE;
 }
 
+/**
+ * urf_device_get_interfaces:
+ *
+ * Snapshot the interfaces exported for the device along with their
+ * properties, in the form ObjectManager.GetManagedObjects returns them.
+ *
+ * Return value: a floating a{sa{sv}} #GVariant
+ **/
+GVariant *
+urf_device_get_interfaces (UrfDevice *device)
+{
+	UrfDevicePrivate *priv = URF_DEVICE_GET_PRIVATE (device);
+	GDBusInterfaceInfo *info;
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+
+	info = urf_dbus_urfkill_device_interface_info ();
+	g_variant_builder_add (&builder, "{s@a{sv}}", info->name,
+			       urf_dbus_get_all_properties (priv->connection,
+							    priv->object_path,
+							    info,
+							    &interface_vtable,
+							    device));
+
+	if (priv->urftype_info)
+		g_variant_builder_add (&builder, "{s@a{sv}}",
+				       priv->urftype_info->name,
+				       urf_dbus_get_all_properties (priv->connection,
+								    priv->object_path,
+								    priv->urftype_info,
+								    priv->urftype_vtable,
+								    device));
+
+	return g_variant_builder_end (&builder);
+}
+
 /**
  * urf_device_init:
  **/
@@ -528,5 +584,9 @@ urf_device_init (UrfDevice *device)
 	UrfDevicePrivate *priv = URF_DEVICE_GET_PRIVATE (device);
 
 	priv->object_path = NULL;
+	priv->device_reg_id = 0;
+	priv->urftype_reg_id = 0;
+	priv->urftype_info = NULL;
+	priv->urftype_vtable = NULL;
 }
 
@@ -86,7 +86,9 @@ gboolean		 urf_device_update_states	(UrfDevice	*device,
 
 gint			 urf_device_get_index		(UrfDevice	*device);
 const char		*urf_device_get_object_path	(UrfDevice	*device);
+GDBusConnection		*urf_device_get_connection	(UrfDevice	*device);
 gint			 urf_device_get_device_type	(UrfDevice	*device);
+const char		*urf_device_get_urf_type	(UrfDevice	*device);
 const char		*urf_device_get_name		(UrfDevice	*device);
 KillswitchState		 urf_device_get_state		(UrfDevice	*device);
 gboolean		 urf_device_is_platform		(UrfDevice	*device);
@@ -96,8 +98,10 @@ gboolean		 urf_device_set_software_blocked (UrfDevice	*device,
 gboolean		 urf_device_is_software_blocked	(UrfDevice	*device);
 
 gboolean		 urf_device_register_device	(UrfDevice			*device,
-							 const GDBusInterfaceVTable	 vtable,
-							 const char			*xml);
+							 GDBusConnection		*connection,
+							 const GDBusInterfaceVTable	*vtable,
+							 GDBusInterfaceInfo		*info);
+GVariant		*urf_device_get_interfaces	(UrfDevice			*device);
 
 G_END_DECLS
 
@@ -26,6 +26,7 @@
 #include <unistd.h>
 #include <sys/types.h>
 #include <sys/stat.h>
+#include <sys/ioctl.h>
 #include <fcntl.h>
 #include <stdio.h>
 #include <string.h>
@@ -38,7 +39,13 @@
 #define KEY_PRESS 1
 #define KEY_KEEPING_PRESSED 2
 
+#define BITS_PER_LONG (sizeof (unsigned long) * 8)
+#define NBITS(x) ((((x) - 1) / BITS_PER_LONG) + 1)
+#define TEST_BIT(bit, array) ((array[(bit) / BITS_PER_LONG] >> ((bit) % BITS_PER_LONG)) & 1)
+#define SET_BIT(bit, array) (array[(bit) / BITS_PER_LONG] |= 1UL << ((bit) % BITS_PER_LONG))
+
 #include "urf-input.h"
+#include "urf-utils.h"
 
 enum {
 	RF_KEY_PRESSED,
@@ -47,42 +54,132 @@ enum {
 
 static int signals[LAST_SIGNAL] = { 0 };
 
+/* The keys we emit rf-key-pressed for */
+static const unsigned int rfkill_keys[] = {
+	KEY_WLAN,
+	KEY_BLUETOOTH,
+	KEY_UWB,
+	KEY_WIMAX,
+#ifdef KEY_RFKILL
+	KEY_RFKILL,
+#endif
+};
+
+/* The event types evdev keeps a mask for, EV_SYN aside */
+static const unsigned int masked_types[] = {
+	EV_KEY,
+	EV_REL,
+	EV_ABS,
+	EV_MSC,
+	EV_SW,
+	EV_LED,
+	EV_SND,
+	EV_FF,
+};
+
+/* A press of the same key on another device within this long is the
+ * firmware reporting it twice */
+#define DEDUP_WINDOW_MS 50
+
 #define URF_INPUT_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), \
                                 URF_TYPE_INPUT, UrfInputPrivate))
 
-struct UrfInputPrivate {
+/* One watched event device, keyed by its syspath */
+typedef struct {
+	UrfInput	*input;
+	char		*syspath;
+	char		*dev_node;
 	int		 fd;
-	guint		 watch_id;
 	GIOChannel	*channel;
+	guint		 watch_id;
+} UrfInputDevice;
+
+struct UrfInputPrivate {
+	GHashTable		*devices;
+	struct udev_monitor	*monitor;
+	GIOChannel		*monitor_channel;
+	guint			 monitor_watch_id;
+	gint64			 dedup_window; /* microseconds */
+	UrfInputDevice		*last_device[G_N_ELEMENTS (rfkill_keys)];
+	gint64			 last_press[G_N_ELEMENTS (rfkill_keys)];
+	guint			 n_wakeups;
+	guint			 n_events;
+	guint			 n_duplicates;
 };
 
 G_DEFINE_TYPE(UrfInput, urf_input, G_TYPE_OBJECT)
 
-static const char *
-match_hotkey_device (struct udev_device *dev)
+static void
+free_input_device (UrfInputDevice *device)
 {
-	struct udev_device *input_dev;
-	struct udev_device *platform_dev;
-	const char *dev_name;
+	UrfInputPrivate *priv = device->input->priv;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (rfkill_keys); i++) {
+		if (priv->last_device[i] == device)
+			priv->last_device[i] = NULL;
+	}
+	if (device->watch_id > 0)
+		g_source_remove (device->watch_id);
+	g_io_channel_shutdown (device->channel, FALSE, NULL);
+	g_io_channel_unref (device->channel);
+	close (device->fd);
+	g_debug ("Unwatch %s", device->dev_node);
+	g_free (device->syspath);
+	g_free (device->dev_node);
+	g_free (device);
+}
+
+/**
+ * input_is_duplicate:
+ *
+ * Some firmware reports the same key press on the platform input device
+ * and on the keyboard. A press of the same key from another device
+ * within the window is taken as such a duplicate. Each key is tracked
+ * on its own, so pressing two different keys is never merged.
+ **/
+static gboolean
+input_is_duplicate (UrfInput       *input,
+		    UrfInputDevice *device,
+		    guint           code)
+{
+	UrfInputPrivate *priv = input->priv;
+	gint64 now;
+	guint i;
+
+	for (i = 0; i < G_N_ELEMENTS (rfkill_keys); i++) {
+		if (rfkill_keys[i] == code)
+			break;
+	}
+	if (i == G_N_ELEMENTS (rfkill_keys))
+		return FALSE;
 
-	/* We only need the input device from the platform subsystem. */
-	platform_dev = udev_device_get_parent_with_subsystem_devtype(dev, "platform", 0);
-	if (!platform_dev)
-		return NULL;
-	input_dev = udev_device_get_parent_with_subsystem_devtype(dev, "input", 0);
-	if (!input_dev)
-		return NULL;
+	now = g_get_monotonic_time ();
+	if (priv->last_device[i] != NULL &&
+	    priv->last_device[i] != device &&
+	    now - priv->last_press[i] < priv->dedup_window) {
+		priv->n_duplicates++;
+		g_debug ("Dropped key %u from %s, already seen on %s",
+			 code, device->dev_node, priv->last_device[i]->dev_node);
+		return TRUE;
+	}
 
-	dev_name = udev_device_get_sysattr_value (input_dev, "name");
+	priv->last_device[i] = device;
+	priv->last_press[i] = now;
 
-	return dev_name;
+	return FALSE;
 }
 
 static gboolean
-input_event_cb (GIOChannel   *source,
-		GIOCondition  condition,
-		UrfInput     *input)
+input_event_cb (GIOChannel     *source,
+		GIOCondition    condition,
+		UrfInputDevice *device)
 {
+	UrfInput *input = device->input;
+	UrfInputPrivate *priv = input->priv;
+
+	priv->n_wakeups++;
+
 	if (condition & G_IO_IN) {
 		GIOStatus status;
 		struct input_event event;
@@ -95,7 +192,8 @@ input_event_cb (GIOChannel   *source,
 						  NULL);
 
 		while (status == G_IO_STATUS_NORMAL && read == sizeof(event)) {
-			if (event.value == KEY_PRESS) {
+			priv->n_events++;
+			if (event.type == EV_KEY && event.value == KEY_PRESS) {
 				switch (event.code) {
 				case KEY_WLAN:
 				case KEY_BLUETOOTH:
@@ -104,6 +202,8 @@ input_event_cb (GIOChannel   *source,
 #ifdef KEY_RFKILL
 				case KEY_RFKILL:
 #endif
+					if (input_is_duplicate (input, device, event.code))
+						break;
 					g_signal_emit (G_OBJECT (input),
 						       signals[RF_KEY_PRESSED],
 						       0,
@@ -120,19 +220,95 @@ input_event_cb (GIOChannel   *source,
 							  &read,
 							  NULL);
 		}
-	} else {
-		g_warning ("Failed to fetch the input event");
+	}
+
+	if (condition & (G_IO_HUP | G_IO_ERR)) {
+		/* The device is gone; udev will tell us as well, but the
+		 * watch must not fire again until then */
+		g_debug ("Lost %s", device->dev_node);
+		device->watch_id = 0;
+		g_hash_table_remove (priv->devices, device->syspath);
 		return FALSE;
 	}
 
 	return TRUE;
 }
 
+static gboolean
+input_dev_has_rfkill_keys (int fd)
+{
+	unsigned long bits[NBITS (KEY_CNT)];
+	guint i;
+
+	memset (bits, 0, sizeof (bits));
+	if (ioctl (fd, EVIOCGBIT (EV_KEY, sizeof (bits)), bits) < 0)
+		return FALSE;
+
+	for (i = 0; i < G_N_ELEMENTS (rfkill_keys); i++) {
+		if (TEST_BIT (rfkill_keys[i], bits))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gboolean
+input_dev_set_mask (int         fd,
+		    const char *dev_node)
+{
+#ifdef EVIOCSMASK
+	unsigned long codes[NBITS (KEY_CNT)];
+	unsigned long types[NBITS (EV_CNT)];
+	struct input_mask mask;
+	unsigned int type;
+	guint i;
+
+	memset (types, 0, sizeof (types));
+	if (ioctl (fd, EVIOCGBIT (0, sizeof (types)), types) < 0)
+		return FALSE;
+
+	memset (codes, 0, sizeof (codes));
+	for (i = 0; i < G_N_ELEMENTS (rfkill_keys); i++)
+		SET_BIT (rfkill_keys[i], codes);
+
+	/* Types without a mask deliver all of their codes, so mask every
+	 * type the device has and let only the rfkill keys through. The
+	 * kernel drops a SYN_REPORT whose packet was filtered empty, so
+	 * ordinary keystrokes do not wake us up at all. The types evdev
+	 * has no mask for (EV_REP, EV_PWR, ...) are refused with EINVAL
+	 * and are left alone. */
+	for (i = 0; i < G_N_ELEMENTS (masked_types); i++) {
+		type = masked_types[i];
+		if (!TEST_BIT (type, types))
+			continue;
+
+		memset (&mask, 0, sizeof (mask));
+		mask.type = type;
+		if (type == EV_KEY) {
+			mask.codes_size = sizeof (codes);
+			mask.codes_ptr = (__u64) (unsigned long) codes;
+		}
+
+		if (ioctl (fd, EVIOCSMASK, &mask) < 0) {
+			g_debug ("Failed to mask the events of %s: %s",
+				 dev_node, g_strerror (errno));
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+#else
+	return FALSE;
+#endif
+}
+
 static gboolean
 input_dev_open_channel (UrfInput   *input,
+			const char *syspath,
 			const char *dev_node)
 {
 	UrfInputPrivate *priv = input->priv;
+	UrfInputDevice *device;
 	int fd;
 
 	fd = open(dev_node, O_RDONLY | O_NONBLOCK);
@@ -142,38 +318,148 @@ input_dev_open_channel (UrfInput   *input,
 		return FALSE;
 	}
 
+	/* Most keyboards have no rfkill key at all */
+	if (!input_dev_has_rfkill_keys (fd)) {
+		close (fd);
+		return FALSE;
+	}
+
+	if (!input_dev_set_mask (fd, dev_node))
+		g_debug ("%s delivers all of its events", dev_node);
+
 	/* Setup a channel for the device node */
-	priv->fd = fd;
-	priv->channel = g_io_channel_unix_new (priv->fd);
-	g_io_channel_set_encoding (priv->channel, NULL, NULL);
-	priv->watch_id = g_io_add_watch (priv->channel,
-					 G_IO_IN | G_IO_HUP | G_IO_ERR,
-					 (GIOFunc) input_event_cb,
-					 input);
+	device = g_new0 (UrfInputDevice, 1);
+	device->input = input;
+	device->syspath = g_strdup (syspath);
+	device->dev_node = g_strdup (dev_node);
+	device->fd = fd;
+	device->channel = g_io_channel_unix_new (fd);
+	g_io_channel_set_encoding (device->channel, NULL, NULL);
+	device->watch_id = g_io_add_watch (device->channel,
+					   G_IO_IN | G_IO_HUP | G_IO_ERR,
+					   (GIOFunc) input_event_cb,
+					   device);
+	g_hash_table_insert (priv->devices, device->syspath, device);
 	g_debug ("Watch %s", dev_node);
 
 	return TRUE;
 }
 
+static void
+input_add_device (UrfInput           *input,
+		  struct udev_device *dev)
+{
+	const char *syspath;
+	const char *dev_node;
+	const char *key;
+
+	/* Only the evdev nodes, not the parent input devices or the
+	 * legacy mouse and joystick nodes */
+	if (!g_str_has_prefix (udev_device_get_sysname (dev), "event"))
+		return;
+
+	key = udev_device_get_property_value (dev, "ID_INPUT_KEY");
+	if (g_strcmp0 (key, "1") != 0)
+		return;
+
+	syspath = udev_device_get_syspath (dev);
+	dev_node = udev_device_get_devnode (dev);
+	if (!syspath || !dev_node)
+		return;
+
+	if (g_hash_table_lookup (input->priv->devices, syspath) != NULL)
+		return;
+
+	input_dev_open_channel (input, syspath, dev_node);
+}
+
+static gboolean
+input_monitor_cb (GIOChannel   *source,
+		  GIOCondition  condition,
+		  UrfInput     *input)
+{
+	UrfInputPrivate *priv = input->priv;
+	struct udev_device *dev;
+	const char *action;
+
+	dev = udev_monitor_receive_device (priv->monitor);
+	if (!dev)
+		return TRUE;
+
+	action = udev_device_get_action (dev);
+	if (g_strcmp0 (action, "add") == 0)
+		input_add_device (input, dev);
+	else if (g_strcmp0 (action, "remove") == 0)
+		g_hash_table_remove (priv->devices, udev_device_get_syspath (dev));
+
+	udev_device_unref (dev);
+
+	return TRUE;
+}
+
+/**
+ * urf_input_get_counters:
+ *
+ * How often an input device woke us up, how many events were read and
+ * how many key presses were dropped as duplicates since the object was
+ * created.
+ **/
+void
+urf_input_get_counters (UrfInput *input,
+			guint    *n_wakeups,
+			guint    *n_events,
+			guint    *n_duplicates)
+{
+	g_return_if_fail (URF_IS_INPUT (input));
+
+	if (n_wakeups)
+		*n_wakeups = input->priv->n_wakeups;
+	if (n_events)
+		*n_events = input->priv->n_events;
+	if (n_duplicates)
+		*n_duplicates = input->priv->n_duplicates;
+}
+
 /**
  * urf_input_startup:
  **/
 gboolean
-urf_input_startup (UrfInput *input)
+urf_input_startup (UrfInput  *input,
+		   UrfConfig *config)
 {
+	UrfInputPrivate *priv = input->priv;
 	struct udev *udev;
 	struct udev_enumerate *enumerate;
 	struct udev_list_entry *devices;
 	struct udev_list_entry *dev_list_entry;
 	struct udev_device *dev;
-	char *dev_node = NULL;
-	gboolean ret;
 
-	udev = udev_new ();
-	if (!udev) {
-		g_warning ("Cannot create udev object");
+	/* key_window=0 only turns off the folding of bursts, not this */
+	priv->dedup_window = (gint64) MAX (DEDUP_WINDOW_MS, urf_config_get_key_window (config)) * 1000;
+
+	udev = get_udev_context ();
+	if (!udev)
+		return FALSE;
+
+	/* Listen before enumerating, so that no device slips through */
+	priv->monitor = udev_monitor_new_from_netlink (udev, "udev");
+	if (!priv->monitor) {
+		g_warning ("Failed to create the input device monitor");
 		return FALSE;
 	}
+	udev_monitor_filter_add_match_subsystem_devtype (priv->monitor, "input", NULL);
+	if (udev_monitor_enable_receiving (priv->monitor) < 0) {
+		g_warning ("Failed to enable the input device monitor");
+		udev_monitor_unref (priv->monitor);
+		priv->monitor = NULL;
+		return FALSE;
+	}
+
+	priv->monitor_channel = g_io_channel_unix_new (udev_monitor_get_fd (priv->monitor));
+	priv->monitor_watch_id = g_io_add_watch (priv->monitor_channel,
+						 G_IO_IN,
+						 (GIOFunc) input_monitor_cb,
+						 input);
 
 	enumerate = udev_enumerate_new (udev);
 	udev_enumerate_add_match_subsystem (enumerate, "input");
@@ -183,42 +469,20 @@ urf_input_startup (UrfInput *input)
 
 	udev_list_entry_foreach (dev_list_entry, devices) {
 		const char *path;
-		const char *dev_name;
 
 		path = udev_list_entry_get_name (dev_list_entry);
 		dev = udev_device_new_from_syspath (udev, path);
-
-		dev_name = match_hotkey_device (dev);
-		if (!dev_name) {
-			udev_device_unref(dev);
+		if (!dev)
 			continue;
-		}
 
-		g_free (dev_node);
-		dev_node = g_strdup (udev_device_get_devnode (dev));
-		if (!dev_node) {
-			udev_device_unref(dev);
-			continue;
-		}
-
-		/* Use the device from the platform driver if there is one. */
-		if (g_strcmp0 (dev_name, "AT Translated Set 2 keyboard") != 0) {
-			udev_device_unref(dev);
-			break;
-		}
-
-		udev_device_unref(dev);
+		input_add_device (input, dev);
+		udev_device_unref (dev);
 	}
-	udev_enumerate_unref(enumerate);
-	udev_unref(udev);
-
-	if (!dev_node)
-		return FALSE;
+	udev_enumerate_unref (enumerate);
 
-	ret = input_dev_open_channel (input, dev_node);
-	g_free (dev_node);
+	g_debug ("Watching %u input devices", g_hash_table_size (priv->devices));
 
-	return ret;
+	return TRUE;
 }
 
 /**
@@ -228,8 +492,13 @@ static void
 urf_input_init (UrfInput *input)
 {
 	input->priv = URF_INPUT_GET_PRIVATE (input);
-	input->priv->fd = -1;
-	input->priv->channel = NULL;
+	input->priv->devices = g_hash_table_new_full (g_str_hash,
+						      g_str_equal,
+						      NULL,
+						      (GDestroyNotify) free_input_device);
+	input->priv->monitor = NULL;
+	input->priv->monitor_channel = NULL;
+	input->priv->monitor_watch_id = 0;
 }
 
 /**
@@ -240,13 +509,14 @@ urf_input_finalize (GObject *object)
 {
 	UrfInputPrivate *priv = URF_INPUT_GET_PRIVATE (object);
 
-	if (priv->fd > 0) {
-		g_source_remove (priv->fd);
-		g_io_channel_shutdown (priv->channel, FALSE, NULL);
-		g_io_channel_unref (priv->channel);
-		close (priv->fd);
-		priv->fd = 0;
-	}
+	if (priv->monitor_watch_id > 0)
+		g_source_remove (priv->monitor_watch_id);
+	if (priv->monitor_channel)
+		g_io_channel_unref (priv->monitor_channel);
+	if (priv->monitor)
+		udev_monitor_unref (priv->monitor);
+
+	g_hash_table_destroy (priv->devices);
 
 	G_OBJECT_CLASS(urf_input_parent_class)->finalize(object);
 }
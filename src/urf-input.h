@@ -23,6 +23,8 @@
 
 #include <glib-object.h>
 
+#include "urf-config.h"
+
 G_BEGIN_DECLS
 
 #define URF_TYPE_INPUT (urf_input_get_type())
@@ -52,7 +54,12 @@ typedef struct {
 
 GType		 urf_input_get_type 	(void);
 UrfInput	*urf_input_new		(void);
-gboolean	 urf_input_startup	(UrfInput	*input);
+gboolean	 urf_input_startup	(UrfInput	*input,
+					 UrfConfig	*config);
+void		 urf_input_get_counters	(UrfInput	*input,
+					 guint		*n_wakeups,
+					 guint		*n_events,
+					 guint		*n_duplicates);
 
 G_END_DECLS
 
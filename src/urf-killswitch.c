@@ -28,18 +28,12 @@
 
 #include "urf-killswitch.h"
 #include "urf-device.h"
+#include "urf-device-kernel.h"
+#include "urf-dbus.h"
 
 #define BASE_OBJECT_PATH "/org/freedesktop/URfkill/"
 #define URF_KILLSWITCH_INTERFACE "org.freedesktop.URfkill.Killswitch"
 
-static const char introspection_xml[] =
-"<node>"
-"  <interface name='org.freedesktop.URfkill.Killswitch'>"
-"    <signal name='StateChanged'/>"
-"    <property name='state' type='i' access='read'/>"
-"  </interface>"
-"</node>";
-
 enum
 {
 	PROP_0,
@@ -47,15 +41,32 @@ enum
 	PROP_LAST
 };
 
+static const UrfDBusMember killswitch_properties[] =
+{
+	{ "state",	PROP_STATE },
+};
+
+static GHashTable *property_table = NULL;
+
+#define NUM_COUNTED_STATES (KILLSWITCH_STATE_HARD_BLOCKED + 1)
+
+typedef struct {
+	KillswitchState	 state;
+	gboolean	 platform;
+} DeviceState;
+
 struct UrfKillswitchPrivate
 {
-	GList		 *devices;
+	GPtrArray	 *devices;
+	GArray		 *device_states; /* DeviceState, parallel to devices */
+	GHashTable	 *slots; /* UrfDevice -> slot in devices + 1 */
+	guint		  counts[2][NUM_COUNTED_STATES]; /* [platform][state] */
+	UrfRfkillWriter	 *writer;
 	enum rfkill_type  type;
 	KillswitchState   saved_state;
 	KillswitchState   state;
 	char		 *object_path;
 	GDBusConnection	 *connection;
-	GDBusNodeInfo	 *introspection_data;
 };
 
 G_DEFINE_TYPE (UrfKillswitch, urf_killswitch, G_TYPE_OBJECT)
@@ -106,8 +117,48 @@ emit_properites_changed (UrfKillswitch *killswitch)
 	}
 }
 
+/**
+ * count_device_state:
+ **/
+static void
+count_device_state (UrfKillswitchPrivate *priv,
+		    const DeviceState    *device_state,
+		    gboolean              add)
+{
+	guint *count;
+
+	if (device_state->state < KILLSWITCH_STATE_UNBLOCKED ||
+	    device_state->state >= NUM_COUNTED_STATES)
+		return;
+
+	count = &priv->counts[device_state->platform ? 1 : 0][device_state->state];
+	if (add)
+		(*count)++;
+	else
+		(*count)--;
+}
+
+/**
+ * highest_counted_state:
+ **/
+static KillswitchState
+highest_counted_state (const guint *counts)
+{
+	int state;
+
+	for (state = NUM_COUNTED_STATES - 1; state >= KILLSWITCH_STATE_UNBLOCKED; state--) {
+		if (counts[state] > 0)
+			return state;
+	}
+
+	return KILLSWITCH_STATE_NO_ADAPTER;
+}
+
 /**
  * urf_killswitch_state_refresh:
+ *
+ * Work out the state of the killswitch from the per-state device
+ * counters, and announce it if it changed.
  **/
 static void
 urf_killswitch_state_refresh (UrfKillswitch *killswitch)
@@ -115,44 +166,24 @@ urf_killswitch_state_refresh (UrfKillswitch *killswitch)
 	UrfKillswitchPrivate *priv = killswitch->priv;
 	KillswitchState platform;
 	KillswitchState new_state;
-	gboolean platform_checked = FALSE;
-	UrfDevice *device;
-	GList *iter;
 	GError *error = NULL;
 
-	if (priv->devices == NULL) {
-		priv->state = KILLSWITCH_STATE_NO_ADAPTER;
-		priv->saved_state = KILLSWITCH_STATE_NO_ADAPTER;
-		return;
-	}
-
-	platform = KILLSWITCH_STATE_NO_ADAPTER;
-	new_state = KILLSWITCH_STATE_NO_ADAPTER;
-
-	for (iter = priv->devices; iter; iter = iter->next) {
-		KillswitchState state;
-		device = (UrfDevice *)iter->data;
-		state = urf_device_get_state (device);
-
-		if (urf_device_is_platform (device) == TRUE) {
-			/* Update the state of platform switch */
-			platform_checked = TRUE;
-			if (state > platform)
-				platform = state;
-		} else {
-			/* Update the state of non-platform switch */
-			if (state > new_state)
-				new_state = state;
-		}
-	}
+	platform = highest_counted_state (priv->counts[1]);
+	new_state = highest_counted_state (priv->counts[0]);
 
-	if (platform_checked)
+	if (platform != KILLSWITCH_STATE_NO_ADAPTER)
 		new_state = aggregate_states (platform, new_state);
 
-	g_message("killswitch state: %s new_state: %s",
-		  state_to_string(priv->state), state_to_string(new_state));
+	if (priv->devices->len == 0)
+		priv->saved_state = KILLSWITCH_STATE_NO_ADAPTER;
+
 	/* emit a signal for change */
 	if (priv->state != new_state) {
+		g_debug ("killswitch %s state: %s new_state: %s",
+			 type_to_string (priv->type),
+			 state_to_string (priv->state),
+			 state_to_string (new_state));
+
 		priv->state = new_state;
 		emit_properites_changed (killswitch);
 		g_dbus_connection_emit_signal (priv->connection,
@@ -173,7 +204,6 @@ urf_killswitch_state_refresh (UrfKillswitch *killswitch)
 KillswitchState
 urf_killswitch_get_state (UrfKillswitch *killswitch)
 {
-	urf_killswitch_state_refresh (killswitch);
 	return killswitch->priv->state;
 }
 
@@ -195,7 +225,22 @@ static void
 device_changed_cb (UrfDevice     *device,
 		   UrfKillswitch *killswitch)
 {
-	g_message("device_changed_cb: %s", urf_device_get_name(device));
+	UrfKillswitchPrivate *priv = killswitch->priv;
+	DeviceState *device_state;
+	guint slot;
+
+	slot = GPOINTER_TO_UINT (g_hash_table_lookup (priv->slots, device));
+	if (slot == 0)
+		return;
+
+	g_debug ("device_changed_cb: %s", urf_device_get_name (device));
+
+	device_state = &g_array_index (priv->device_states, DeviceState, slot - 1);
+	count_device_state (priv, device_state, FALSE);
+	device_state->state = urf_device_get_state (device);
+	device_state->platform = urf_device_is_platform (device);
+	count_device_state (priv, device_state, TRUE);
+
 	urf_killswitch_state_refresh (killswitch);
 }
 
@@ -207,16 +252,23 @@ urf_killswitch_add_device (UrfKillswitch *killswitch,
 			   UrfDevice     *device)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
+	DeviceState device_state;
 
 	if (urf_device_get_device_type (device) != priv->type ||
-	    g_list_find (priv->devices, (gconstpointer)device) != NULL)
+	    g_hash_table_lookup (priv->slots, device) != NULL)
 		return;
 
-	priv->devices = g_list_prepend (priv->devices,
-					(gpointer)g_object_ref (device));
+	device_state.state = urf_device_get_state (device);
+	device_state.platform = urf_device_is_platform (device);
+
+	g_ptr_array_add (priv->devices, g_object_ref (device));
+	g_array_append_val (priv->device_states, device_state);
+	g_hash_table_insert (priv->slots, device,
+			     GUINT_TO_POINTER (priv->devices->len));
 	g_signal_connect (G_OBJECT (device), "state-changed",
 			  G_CALLBACK (device_changed_cb), killswitch);
 
+	count_device_state (priv, &device_state, TRUE);
 	urf_killswitch_state_refresh (killswitch);
 }
 
@@ -228,42 +280,94 @@ urf_killswitch_del_device (UrfKillswitch *killswitch,
 			   UrfDevice     *device)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
+	UrfDevice *last;
+	guint slot;
 
-	if (urf_device_get_device_type (device) != priv->type ||
-	    g_list_find (priv->devices, (gconstpointer)device) == NULL)
+	if (urf_device_get_device_type (device) != priv->type)
 		return;
 
-	priv->devices = g_list_remove (priv->devices, (gpointer)device);
-	g_object_unref (device);
+	slot = GPOINTER_TO_UINT (g_hash_table_lookup (priv->slots, device));
+	if (slot == 0)
+		return;
+
+	count_device_state (priv,
+			    &g_array_index (priv->device_states, DeviceState, slot - 1),
+			    FALSE);
+
+	/* Move the last device into the hole to keep the array dense */
+	last = g_ptr_array_index (priv->devices, priv->devices->len - 1);
+	if (last != device)
+		g_hash_table_insert (priv->slots, last, GUINT_TO_POINTER (slot));
+	g_hash_table_remove (priv->slots, device);
+
+	g_signal_handlers_disconnect_by_func (device, device_changed_cb, killswitch);
+	g_array_remove_index_fast (priv->device_states, slot - 1);
+	g_ptr_array_remove_index_fast (priv->devices, slot - 1);
 
 	urf_killswitch_state_refresh (killswitch);
 }
 
 /**
  * urf_killswitch_set_software_blocked:
+ *
+ * Kernel devices are not written one by one: a single CHANGE_ALL for
+ * the type is queued on the rfkill writer, which the caller flushes.
+ * Other devices are set directly.
+ *
+ * Return value: #FALSE if a device failed or there is no device at all
  **/
 gboolean
 urf_killswitch_set_software_blocked (UrfKillswitch *killswitch,
                                      gboolean blocked)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
-	GList *dev;
+	UrfDevice *device;
 	gboolean result, ret = TRUE;
+	gboolean has_kernel = FALSE;
+	guint i;
+
+	if (priv->devices->len == 0) {
+		g_debug ("No %s device to set", type_to_string (priv->type));
+		return FALSE;
+	}
+
+	for (i = 0; i < priv->devices->len; i++) {
+		device = URF_DEVICE (g_ptr_array_index (priv->devices, i));
+
+		if (URF_IS_DEVICE_KERNEL (device)) {
+			has_kernel = TRUE;
+			continue;
+		}
 
-	for (dev = priv->devices; dev; dev = dev->next) {
 		g_debug ("Setting device %s to %s",
-		         urf_device_get_object_path (URF_DEVICE (dev->data)),
+		         urf_device_get_object_path (device),
 		         blocked ? "blocked" : "unblocked");
 
-		result = urf_device_set_software_blocked (URF_DEVICE (dev->data), blocked);
+		result = urf_device_set_software_blocked (device, blocked);
 
 		if (!result)
 			ret = FALSE;
 	}
 
+	if (has_kernel) {
+		g_debug ("Setting all %s devices to %s",
+		         type_to_string (priv->type),
+		         blocked ? "blocked" : "unblocked");
+
+		urf_rfkill_writer_queue (priv->writer, RFKILL_OP_CHANGE_ALL,
+					 0, priv->type, blocked);
+	}
+
 	return ret;
 }
 
+static void
+disconnect_device (UrfDevice     *device,
+		   UrfKillswitch *killswitch)
+{
+	g_signal_handlers_disconnect_by_func (device, device_changed_cb, killswitch);
+}
+
 /**
  * urf_killswitch_dispose:
  **/
@@ -273,22 +377,32 @@ urf_killswitch_dispose (GObject *object)
 	UrfKillswitch *killswitch = URF_KILLSWITCH (object);
 	UrfKillswitchPrivate *priv = killswitch->priv;
 
-	if (priv->introspection_data) {
-		g_dbus_node_info_unref (priv->introspection_data);
-		priv->introspection_data = NULL;
-	}
-
 	if (priv->connection) {
 		g_object_unref (priv->connection);
 		priv->connection = NULL;
 	}
 
+	if (priv->writer) {
+		g_object_unref (priv->writer);
+		priv->writer = NULL;
+	}
+
+	if (priv->slots) {
+		g_hash_table_destroy (priv->slots);
+		priv->slots = NULL;
+	}
+
 	if (priv->devices) {
-		g_list_foreach (priv->devices, (GFunc) g_object_unref, NULL);
-		g_list_free (priv->devices);
+		g_ptr_array_foreach (priv->devices, (GFunc) disconnect_device, killswitch);
+		g_ptr_array_unref (priv->devices);
 		priv->devices = NULL;
 	}
 
+	if (priv->device_states) {
+		g_array_free (priv->device_states, TRUE);
+		priv->device_states = NULL;
+	}
+
 	G_OBJECT_CLASS (urf_killswitch_parent_class)->dispose (object);
 }
 
@@ -340,6 +454,10 @@ urf_killswitch_class_init (UrfKillswitchClass *klass)
 
 	g_type_class_add_private (klass, sizeof (UrfKillswitchPrivate));
 
+	property_table = urf_dbus_property_table_new (urf_dbus_urfkill_killswitch_interface_info (),
+	                                              killswitch_properties,
+	                                              G_N_ELEMENTS (killswitch_properties));
+
 	g_object_class_install_property (object_class,
 					 PROP_STATE,
 					 g_param_spec_int ("state",
@@ -358,7 +476,10 @@ static void
 urf_killswitch_init (UrfKillswitch *killswitch)
 {
 	killswitch->priv = URF_KILLSWITCH_GET_PRIVATE (killswitch);
-	killswitch->priv->devices = NULL;
+	killswitch->priv->devices = g_ptr_array_new_with_free_func (g_object_unref);
+	killswitch->priv->device_states = g_array_new (FALSE, FALSE, sizeof (DeviceState));
+	killswitch->priv->slots = g_hash_table_new (g_direct_hash, g_direct_equal);
+	killswitch->priv->writer = NULL;
 	killswitch->priv->object_path = NULL;
 	killswitch->priv->state = KILLSWITCH_STATE_NO_ADAPTER;
 	killswitch->priv->saved_state = KILLSWITCH_STATE_NO_ADAPTER;
@@ -377,8 +498,13 @@ handle_get_property (GDBusConnection *connection,
 
 	GVariant *retval = NULL;
 
-	if (g_strcmp0 (property_name, "state") == 0)
+	switch (urf_dbus_property_lookup (property_table, property_name)) {
+	case PROP_STATE:
 		retval = g_variant_new_int32 (killswitch->priv->state);
+		break;
+	default:
+		break;
+	}
 
 	return retval;
 }
@@ -391,32 +517,23 @@ static const GDBusInterfaceVTable interface_vtable =
 };
 
 /**
- * urf_device_register_device:
+ * urf_killswitch_register_switch:
  **/
 static gboolean
-urf_killswitch_register_switch (UrfKillswitch *killswitch)
+urf_killswitch_register_switch (UrfKillswitch   *killswitch,
+				GDBusConnection *connection)
 {
 	UrfKillswitchPrivate *priv = killswitch->priv;
-	GDBusInterfaceInfo **infos;
 	guint reg_id;
-	GError *error = NULL;
 
-	priv->introspection_data = g_dbus_node_info_new_for_xml (introspection_xml, NULL);
-	g_assert (priv->introspection_data != NULL);
-
-	priv->connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
-	if (priv->connection == NULL) {
-		g_error ("error getting system bus: %s", error->message);
-		g_error_free (error);
-		return FALSE;
-	}
+	g_return_val_if_fail (G_IS_DBUS_CONNECTION (connection), FALSE);
 
+	priv->connection = g_object_ref (connection);
 	priv->object_path = g_strdup_printf (BASE_OBJECT_PATH"%s",
 					     type_to_string (priv->type));
-	infos = priv->introspection_data->interfaces;
 	reg_id = g_dbus_connection_register_object (priv->connection,
 		                                    priv->object_path,
-		                                    infos[0],
+		                                    urf_dbus_urfkill_killswitch_interface_info (),
 		                                    &interface_vtable,
 		                                    killswitch,
 		                                    NULL,
@@ -426,11 +543,49 @@ urf_killswitch_register_switch (UrfKillswitch *killswitch)
 	return TRUE;
 }
 
+/**
+ * urf_killswitch_get_object_path:
+ **/
+const char *
+urf_killswitch_get_object_path (UrfKillswitch *killswitch)
+{
+	g_return_val_if_fail (URF_IS_KILLSWITCH (killswitch), NULL);
+
+	return killswitch->priv->object_path;
+}
+
+/**
+ * urf_killswitch_get_interfaces:
+ *
+ * Return value: a floating a{sa{sv}} #GVariant for GetManagedObjects
+ **/
+GVariant *
+urf_killswitch_get_interfaces (UrfKillswitch *killswitch)
+{
+	UrfKillswitchPrivate *priv = killswitch->priv;
+	GDBusInterfaceInfo *info;
+	GVariantBuilder builder;
+
+	info = urf_dbus_urfkill_killswitch_interface_info ();
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sa{sv}}"));
+	g_variant_builder_add (&builder, "{s@a{sv}}", info->name,
+			       urf_dbus_get_all_properties (priv->connection,
+							    priv->object_path,
+							    info,
+							    &interface_vtable,
+							    killswitch));
+
+	return g_variant_builder_end (&builder);
+}
+
 /**
  * urf_killswitch_new:
  **/
 UrfKillswitch *
-urf_killswitch_new (enum rfkill_type type)
+urf_killswitch_new (enum rfkill_type  type,
+		    UrfRfkillWriter  *writer,
+		    GDBusConnection  *connection)
 {
 	UrfKillswitch *killswitch;
 
@@ -439,8 +594,9 @@ urf_killswitch_new (enum rfkill_type type)
 
 	killswitch = URF_KILLSWITCH (g_object_new (URF_TYPE_KILLSWITCH, NULL));
 	killswitch->priv->type = type;
+	killswitch->priv->writer = g_object_ref (writer);
 
-	if (!urf_killswitch_register_switch (killswitch)) {
+	if (!urf_killswitch_register_switch (killswitch, connection)) {
 		g_object_unref (killswitch);
 		return NULL;
 	}
@@ -25,6 +25,7 @@
 #include <glib-object.h>
 
 #include "urf-device.h"
+#include "urf-rfkill-writer.h"
 #include "urf-utils.h"
 
 G_BEGIN_DECLS
@@ -54,7 +55,9 @@ typedef struct {
 
 GType			 urf_killswitch_get_type		(void);
 
-UrfKillswitch		*urf_killswitch_new			(enum rfkill_type	 type);
+UrfKillswitch		*urf_killswitch_new			(enum rfkill_type	 type,
+								 UrfRfkillWriter	*writer,
+								 GDBusConnection	*connection);
 void			 urf_killswitch_add_device		(UrfKillswitch		*killswitch,
 								 UrfDevice		*device);
 void			 urf_killswitch_del_device		(UrfKillswitch		*killswitch,
@@ -65,6 +68,8 @@ void			 urf_killswitch_set_saved_state		(UrfKillswitch		*killswitch,
 								 KillswitchState         state);
 gboolean		 urf_killswitch_set_software_blocked	(UrfKillswitch		*killswitch,
 								 gboolean		 blocked);
+const char		*urf_killswitch_get_object_path		(UrfKillswitch		*killswitch);
+GVariant		*urf_killswitch_get_interfaces		(UrfKillswitch		*killswitch);
 
 G_END_DECLS
 
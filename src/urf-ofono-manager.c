@@ -31,24 +31,29 @@
 #include "urf-device.h"
 #include "urf-device-ofono.h"
 
+/* Kernel rfkill indexes count up from 0 and are never reused, and a
+ * device's object path is made from its index. Number the modems from
+ * far above anything the kernel hands out. */
+#define MODEM_INDEX_BASE	(1 << 30)
+
 struct _UrfOfonoManager {
 	GObject parent_instance;
 
 	UrfArbitrator *arbitrator;
+	GDBusConnection *connection;
 
 	GDBusProxy *proxy;
 	GCancellable *cancellable;
-	int watch_id;
+	guint watch_id;
 
-	GSList *devices;
+	GHashTable *modems;
+	guint next_index;
 };
 
 typedef GObjectClass UrfOfonoManagerClass;
 
 G_DEFINE_TYPE (UrfOfonoManager, urf_ofono_manager, G_TYPE_OBJECT)
 
-static gint modem_idx = 100;
-
 static void
 urf_ofono_manager_finalize (GObject *object)
 {
@@ -57,68 +62,121 @@ urf_ofono_manager_finalize (GObject *object)
 	g_return_if_fail (URF_IS_OFONO_MANAGER (object));
 	ofono = URF_OFONO_MANAGER (object);
 
+	if (ofono->watch_id > 0) {
+		g_bus_unwatch_name (ofono->watch_id);
+		ofono->watch_id = 0;
+	}
+
+	if (ofono->cancellable) {
+		g_cancellable_cancel (ofono->cancellable);
+		g_object_unref (ofono->cancellable);
+		ofono->cancellable = NULL;
+	}
+
 	if (ofono->proxy) {
 		g_object_unref (ofono->proxy);
 		ofono->proxy = NULL;
 	}
 
+	/* The arbitrator drops its own references to the modems */
+	g_hash_table_destroy (ofono->modems);
+
 	if (ofono->arbitrator) {
 		g_object_unref (ofono->arbitrator);
 		ofono->arbitrator = NULL;
 	}
 
-	if (ofono->devices) {
-		g_slist_free_full (ofono->devices, g_object_unref);
-		ofono->devices = NULL;
+	if (ofono->connection) {
+		g_object_unref (ofono->connection);
+		ofono->connection = NULL;
 	}
 
 	G_OBJECT_CLASS (urf_ofono_manager_parent_class)->finalize (object);
 }
 
+/**
+ * urf_ofono_manager_next_index:
+ *
+ * Indexes are never handed out twice, so a client holding on to the
+ * object path of a modem that went away cannot end up with another one.
+ **/
+static gint
+urf_ofono_manager_next_index (UrfOfonoManager *ofono)
+{
+	UrfDevice *device;
+	gint index;
+
+	for (;;) {
+		index = ofono->next_index;
+		if (ofono->next_index == G_MAXINT)
+			ofono->next_index = MODEM_INDEX_BASE;
+		else
+			ofono->next_index++;
+
+		device = urf_arbitrator_get_device (ofono->arbitrator, index);
+		if (device == NULL)
+			return index;
+		g_object_unref (device);
+	}
+}
+
 static void
 urf_ofono_manager_add_modem (UrfOfonoManager *ofono,
                              const char *object_path)
 {
 	UrfDevice *device;
 
-	device = urf_device_ofono_new (modem_idx, object_path);
-	modem_idx++;
+	if (g_hash_table_lookup (ofono->modems, object_path) != NULL)
+		return;
 
-	/* Keep our own list to avoid the overhead of iterating through all
-	 * devices when we need to remove a modem
-	 */
-	ofono->devices = g_slist_append (ofono->devices, device);
+	device = urf_device_ofono_new (urf_ofono_manager_next_index (ofono),
+	                               object_path,
+	                               ofono->connection);
+	if (device == NULL)
+		return;
 
-	urf_arbitrator_add_device (ofono->arbitrator, device);
+	/* The arbitrator owns the reference we got */
+	if (!urf_arbitrator_add_device (ofono->arbitrator, device)) {
+		g_object_unref (device);
+		return;
+	}
+
+	g_hash_table_insert (ofono->modems,
+	                     g_strdup (object_path),
+	                     g_object_ref (device));
 }
 
 static void
 urf_ofono_manager_remove_modem (UrfOfonoManager *ofono,
                                 const char *object_path)
 {
-	UrfDeviceOfono *device = NULL;
-	GSList *dev = NULL;
-	gchar *path;
+	UrfDevice *device;
 
-	for (dev = ofono->devices; dev; dev = dev->next) {
-		path = urf_device_ofono_get_path (dev->data);
+	device = g_hash_table_lookup (ofono->modems, object_path);
+	if (device == NULL)
+		return;
 
-		if (g_strcmp0 (path, object_path) == 0) {
-			device = dev->data;
-			break;
-		}
-	}
+	if (urf_arbitrator_remove_device (ofono->arbitrator, device))
+		g_object_unref (device);
 
-	if (device) {
-		ofono->devices = g_slist_remove (ofono->devices, device);
-		urf_arbitrator_remove_device (ofono->arbitrator, URF_DEVICE (device));
-	}
+	/* drops our reference, which unregisters the device from the bus */
+	g_hash_table_remove (ofono->modems, object_path);
 }
 
 static void
 urf_ofono_manager_remove_all_modems (UrfOfonoManager *ofono)
 {
+	GHashTableIter iter;
+	UrfDevice *device;
+
 	g_debug ("Remove all modems.");
+
+	g_hash_table_iter_init (&iter, ofono->modems);
+	while (g_hash_table_iter_next (&iter, NULL, (gpointer *) &device)) {
+		if (urf_arbitrator_remove_device (ofono->arbitrator, device))
+			g_object_unref (device);
+		g_hash_table_iter_remove (&iter);
+	}
 }
 
 static void
@@ -128,28 +186,30 @@ ofono_get_modems_cb (GObject *source_object,
 {
 	UrfOfonoManager *ofono = user_data;
 	GVariant *value, *modems;
-	GVariantIter iter, dict_iter;
-	gchar *modem_path;
+	GVariantIter iter;
+	const gchar *modem_path;
 	GError *error = NULL;
 
-	value = g_dbus_proxy_call_finish (ofono->proxy, res, &error);
+	value = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
 
 	if (!error) {
-		g_debug ("variant %p: %s", value, g_variant_get_type_string (value));
-
 		modems = g_variant_get_child_value (value, 0);
 		g_debug ("found %zd modems", g_variant_n_children (modems));
 
 		g_variant_iter_init (&iter, modems);
-		while (g_variant_iter_next (&iter, "(oa{sv})", &modem_path, &dict_iter)) {
+		while (g_variant_iter_next (&iter, "(&oa{sv})", &modem_path, NULL)) {
 			g_message ("Modem found: '%s'", modem_path);
 
 			urf_ofono_manager_add_modem (ofono, modem_path);
-
-			g_free (modem_path);
 		}
+
+		g_variant_unref (modems);
+		g_variant_unref (value);
 	} else {
-		g_warning ("Could not get list of modems.");
+		/* oFono went away in the meantime */
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Could not get list of modems: %s", error->message);
+		g_error_free (error);
 	}
 }
 
@@ -164,10 +224,10 @@ ofono_signal_cb (GDBusProxy *proxy,
 	const char *object_path;
 
 	if (g_strcmp0 (signal_name, "ModemAdded") == 0) {
-		g_variant_get (parameters, "(oa{sv})", &object_path, NULL);
+		g_variant_get (parameters, "(&oa{sv})", &object_path, NULL);
 		urf_ofono_manager_add_modem (ofono, object_path);
 	} else if (g_strcmp0 (signal_name, "ModemRemoved") == 0) {
-		g_variant_get (parameters, "(o)", &object_path);
+		g_variant_get (parameters, "(&o)", &object_path);
 		urf_ofono_manager_remove_modem (ofono, object_path);
 	}
 }
@@ -178,12 +238,15 @@ ofono_proxy_ready_cb (GObject *source_object,
                       gpointer user_data)
 {
 	UrfOfonoManager *ofono = user_data;
+	GDBusProxy *proxy;
 	GError *error = NULL;
 
-	ofono->proxy = g_dbus_proxy_new_finish (res, &error);
+	proxy = g_dbus_proxy_new_finish (res, &error);
 
 	if (!error) {
-		g_cancellable_reset (ofono->cancellable);
+		ofono->proxy = proxy;
+		g_signal_connect (ofono->proxy, "g-signal",
+		                  G_CALLBACK (ofono_signal_cb), ofono);
 		g_dbus_proxy_call (ofono->proxy,
 		                   "GetModems",
 		                   NULL,
@@ -192,10 +255,10 @@ ofono_proxy_ready_cb (GObject *source_object,
 		                   ofono->cancellable,
 		                   ofono_get_modems_cb,
 		                   ofono);
-		g_signal_connect (ofono->proxy, "g-signal",
-		                  G_CALLBACK (ofono_signal_cb), ofono);
 	} else {
-		g_warning("Could not get oFono Modem proxy.");
+		if (!g_error_matches (error, G_IO_ERROR, G_IO_ERROR_CANCELLED))
+			g_warning ("Could not get oFono Modem proxy: %s", error->message);
+		g_error_free (error);
 	}
 }
 
@@ -209,8 +272,14 @@ on_ofono_appeared (GDBusConnection *connection,
 
 	g_debug("oFono appeared on the bus");
 
-	g_cancellable_reset (ofono->cancellable);
-	g_dbus_proxy_new (connection,
+	/* A cancelled cancellable can't be reset while the calls it was
+	 * given to may still be finishing, so every oFono instance gets
+	 * its own */
+	if (ofono->cancellable)
+		g_object_unref (ofono->cancellable);
+	ofono->cancellable = g_cancellable_new ();
+
+	g_dbus_proxy_new (ofono->connection,
 	                  G_DBUS_PROXY_FLAGS_NONE,
 	                  NULL,
 	                  "org.ofono",
@@ -231,17 +300,15 @@ on_ofono_vanished (GDBusConnection *connection,
 
 	g_debug("oFono vanished from the bus");
 
-	g_cancellable_cancel (ofono->cancellable);
+	if (ofono->cancellable)
+		g_cancellable_cancel (ofono->cancellable);
 
 	if (ofono->proxy) {
 		g_object_unref (ofono->proxy);
 		ofono->proxy = NULL;
 	}
 
-	if (ofono->devices) {
-		modem_idx = 100;
-		urf_ofono_manager_remove_all_modems (ofono);
-	}
+	urf_ofono_manager_remove_all_modems (ofono);
 }
 
 /**
@@ -255,17 +322,19 @@ urf_ofono_manager_class_init (GObjectClass *object_class)
 
 gboolean
 urf_ofono_manager_startup (UrfOfonoManager *ofono,
-                           UrfArbitrator *arbitrator)
+                           UrfArbitrator *arbitrator,
+                           GDBusConnection *connection)
 {
 	ofono->arbitrator = g_object_ref (arbitrator);
+	ofono->connection = g_object_ref (connection);
 
-	ofono->watch_id = g_bus_watch_name (G_BUS_TYPE_SYSTEM,
-	                                    "org.ofono",
-	                                    G_BUS_NAME_WATCHER_FLAGS_NONE,
-	                                    on_ofono_appeared,
-	                                    on_ofono_vanished,
-	                                    ofono,
-	                                    NULL);
+	ofono->watch_id = g_bus_watch_name_on_connection (connection,
+	                                                  "org.ofono",
+	                                                  G_BUS_NAME_WATCHER_FLAGS_NONE,
+	                                                  on_ofono_appeared,
+	                                                  on_ofono_vanished,
+	                                                  ofono,
+	                                                  NULL);
 
 	return TRUE;
 }
@@ -277,9 +346,13 @@ static void
 urf_ofono_manager_init (UrfOfonoManager *ofono)
 {
 	ofono->arbitrator = NULL;
-	ofono->cancellable = g_cancellable_new ();
+	ofono->connection = NULL;
+	ofono->cancellable = NULL;
 	ofono->proxy = NULL;
 	ofono->watch_id = 0;
+	ofono->modems = g_hash_table_new_full (g_str_hash, g_str_equal,
+	                                       g_free, g_object_unref);
+	ofono->next_index = MODEM_INDEX_BASE;
 
 	return;
 }
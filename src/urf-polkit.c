@@ -38,75 +38,489 @@
 struct UrfPolkitPrivate
 {
 	PolkitAuthority	*authority;
+	gulong		 changed_id;
+	GDBusConnection	*connection;
+	guint		 logind_id;
+	guint		 ck_seat_id;
+	guint		 ck_session_id;
+	gint64		 cache_ttl; /* microseconds, 0 disables the cache */
+	GHashTable	*cache; /* unique bus name -> UrfPolkitSender */
+	guint		 n_hits;
+	guint		 n_misses;
 };
 
+/* The authorizations granted to one bus connection. Unique bus names
+ * are never reused, so the entries only have to go when they expire
+ * or the connection goes away. */
+typedef struct {
+	UrfPolkit	*polkit;
+	char		*sender;
+	guint		 watch_id;
+	GHashTable	*actions; /* action id -> expiry time */
+} UrfPolkitSender;
+
 G_DEFINE_TYPE (UrfPolkit, urf_polkit, G_TYPE_OBJECT)
 static gpointer urf_polkit_object = NULL;
 
 /**
- * urf_polkit_get_subject:
+ * urf_polkit_sender_free:
  **/
-PolkitSubject *
-urf_polkit_get_subject (UrfPolkit             *polkit,
-                        GDBusMethodInvocation *invocation)
+static void
+urf_polkit_sender_free (UrfPolkitSender *cached)
 {
-	const gchar *sender;
-	PolkitSubject *subject;
+	g_dbus_connection_signal_unsubscribe (cached->polkit->priv->connection,
+					      cached->watch_id);
+	g_hash_table_destroy (cached->actions);
+	g_free (cached->sender);
+	g_free (cached);
+}
 
-	sender = g_dbus_method_invocation_get_sender (invocation);
-	subject = polkit_system_bus_name_new (sender);
+/**
+ * urf_polkit_name_owner_changed_cb:
+ **/
+static void
+urf_polkit_name_owner_changed_cb (GDBusConnection *connection,
+				  const gchar     *sender_name,
+				  const gchar     *object_path,
+				  const gchar     *interface_name,
+				  const gchar     *signal_name,
+				  GVariant        *parameters,
+				  gpointer         user_data)
+{
+	UrfPolkit *polkit = URF_POLKIT (user_data);
+	const char *name;
+	const char *old_owner;
+	const char *new_owner;
 
-	if (subject == NULL) {
-		g_dbus_method_invocation_return_error (invocation,
-		                                       URF_DAEMON_ERROR,
-		                                       URF_DAEMON_ERROR_GENERAL,
-		                                       "failed to get PolicyKit subject");
+	g_variant_get (parameters, "(&s&s&s)", &name, &old_owner, &new_owner);
+	if (new_owner[0] != '\0')
+		return;
+
+	g_debug ("dropping cached authorizations of %s", name);
+	g_hash_table_remove (polkit->priv->cache, name);
+}
+
+/**
+ * urf_polkit_authority_changed_cb:
+ **/
+static void
+urf_polkit_authority_changed_cb (PolkitAuthority *authority,
+				 gpointer         user_data)
+{
+	UrfPolkit *polkit = URF_POLKIT (user_data);
+
+	g_debug ("polkit configuration changed, dropping cached authorizations");
+	g_hash_table_remove_all (polkit->priv->cache);
+}
+
+/**
+ * urf_polkit_has_key:
+ **/
+static gboolean
+urf_polkit_has_key (GVariant    *dict,
+		    const gchar *key)
+{
+	GVariant *value;
+
+	value = g_variant_lookup_value (dict, key, NULL);
+	if (value == NULL)
+		return FALSE;
+	g_variant_unref (value);
+	return TRUE;
+}
+
+/**
+ * urf_polkit_session_changed_cb:
+ *
+ * A grant may depend on the caller's session being active, and the
+ * cache does not know which session a sender belongs to. So whenever
+ * a session becomes active or inactive, every cached grant goes.
+ **/
+static void
+urf_polkit_session_changed_cb (GDBusConnection *connection,
+			       const gchar     *sender_name,
+			       const gchar     *object_path,
+			       const gchar     *interface_name,
+			       const gchar     *signal_name,
+			       GVariant        *parameters,
+			       gpointer         user_data)
+{
+	UrfPolkit *polkit = URF_POLKIT (user_data);
+	GVariant *changed;
+	const gchar **invalidated;
+	gboolean active_changed = FALSE;
+	guint i;
+
+	if (g_strcmp0 (signal_name, "PropertiesChanged") == 0) {
+		if (!g_variant_is_of_type (parameters, G_VARIANT_TYPE ("(sa{sv}as)")))
+			return;
+
+		g_variant_get (parameters, "(&s@a{sv}^a&s)", NULL, &changed, &invalidated);
+		if (urf_polkit_has_key (changed, "Active") ||
+		    urf_polkit_has_key (changed, "ActiveSession"))
+			active_changed = TRUE;
+		for (i = 0; invalidated[i]; i++) {
+			if (g_strcmp0 (invalidated[i], "Active") == 0 ||
+			    g_strcmp0 (invalidated[i], "ActiveSession") == 0)
+				active_changed = TRUE;
+		}
+		g_variant_unref (changed);
+		g_free (invalidated);
+	} else {
+		/* ConsoleKit's ActiveChanged and ActiveSessionChanged */
+		active_changed = TRUE;
 	}
 
-	return subject;
+	if (!active_changed || g_hash_table_size (polkit->priv->cache) == 0)
+		return;
+
+	g_debug ("session activity changed, dropping cached authorizations");
+	g_hash_table_remove_all (polkit->priv->cache);
 }
 
 /**
- * urf_polkit_check_auth:
+ * urf_polkit_sender_expire:
+ *
+ * Drop the expired authorizations of a sender, and the sender itself
+ * once none are left.
  **/
-gboolean
-urf_polkit_check_auth (UrfPolkit             *polkit,
-		       PolkitSubject         *subject,
-		       const gchar           *action_id,
-		       GDBusMethodInvocation *invocation)
+static gboolean
+urf_polkit_sender_expire (gpointer key,
+			  gpointer value,
+			  gpointer user_data)
 {
-	gboolean ret = FALSE;
-	GError *error = NULL;
+	UrfPolkitSender *cached = value;
+	gint64 now = *(gint64 *)user_data;
+	GHashTableIter iter;
+	gpointer expires;
+
+	g_hash_table_iter_init (&iter, cached->actions);
+	while (g_hash_table_iter_next (&iter, NULL, &expires)) {
+		if (*(gint64 *)expires <= now)
+			g_hash_table_iter_remove (&iter);
+	}
+
+	return g_hash_table_size (cached->actions) == 0;
+}
+
+/**
+ * urf_polkit_cache_lookup:
+ **/
+static gboolean
+urf_polkit_cache_lookup (UrfPolkit   *polkit,
+			 const char  *sender,
+			 const gchar *action_id)
+{
+	UrfPolkitPrivate *priv = polkit->priv;
+	UrfPolkitSender *cached;
+	gint64 *expires;
+
+	if (priv->cache_ttl == 0 || sender == NULL)
+		return FALSE;
+
+	cached = g_hash_table_lookup (priv->cache, sender);
+	if (cached == NULL)
+		return FALSE;
+
+	expires = g_hash_table_lookup (cached->actions, action_id);
+	if (expires == NULL)
+		return FALSE;
+
+	if (*expires <= g_get_monotonic_time ()) {
+		g_hash_table_remove (cached->actions, action_id);
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * urf_polkit_cache_insert:
+ **/
+static void
+urf_polkit_cache_insert (UrfPolkit   *polkit,
+			 const char  *sender,
+			 const gchar *action_id)
+{
+	UrfPolkitPrivate *priv = polkit->priv;
+	UrfPolkitSender *cached;
+	gint64 now;
+	gint64 *expires;
+
+	if (priv->cache_ttl == 0 || sender == NULL)
+		return;
+
+	/* A miss is rare compared to a hit, so tidy up here. This also
+	 * catches senders that were gone before their watch was set up. */
+	now = g_get_monotonic_time ();
+	g_hash_table_foreach_remove (priv->cache, urf_polkit_sender_expire, &now);
+
+	cached = g_hash_table_lookup (priv->cache, sender);
+	if (cached == NULL) {
+		cached = g_new0 (UrfPolkitSender, 1);
+		cached->polkit = polkit;
+		cached->sender = g_strdup (sender);
+		cached->actions = g_hash_table_new_full (g_str_hash, g_str_equal,
+							 g_free, g_free);
+		cached->watch_id =
+			g_dbus_connection_signal_subscribe (priv->connection,
+							    "org.freedesktop.DBus",
+							    "org.freedesktop.DBus",
+							    "NameOwnerChanged",
+							    "/org/freedesktop/DBus",
+							    sender,
+							    G_DBUS_SIGNAL_FLAGS_NONE,
+							    urf_polkit_name_owner_changed_cb,
+							    polkit, NULL);
+		g_hash_table_insert (priv->cache, cached->sender, cached);
+	}
+
+	expires = g_new (gint64, 1);
+	*expires = now + priv->cache_ttl;
+	g_hash_table_replace (cached->actions, g_strdup (action_id), expires);
+}
+
+/**
+ * urf_polkit_get_counters:
+ *
+ * Report how many authorization checks were answered from the cache
+ * and how many had to ask polkit.
+ **/
+void
+urf_polkit_get_counters (UrfPolkit *polkit,
+			 guint     *n_hits,
+			 guint     *n_misses)
+{
+	g_return_if_fail (URF_IS_POLKIT (polkit));
+
+	if (n_hits)
+		*n_hits = polkit->priv->n_hits;
+	if (n_misses)
+		*n_misses = polkit->priv->n_misses;
+}
+
+/* One authorization that has to go all the way to polkitd */
+typedef struct {
+	UrfPolkit		*polkit;
+	GSimpleAsyncResult	*res;
+	char			*sender;
+	char			*action_id;
+	PolkitSubject		*subject;
+	gboolean		 interactive;
+} UrfPolkitCheck;
+
+static void urf_polkit_check_auth_cb (GObject      *source_object,
+				      GAsyncResult *res,
+				      gpointer      user_data);
+
+/**
+ * urf_polkit_check_auth_start:
+ **/
+static void
+urf_polkit_check_auth_start (UrfPolkitCheck *check)
+{
+	PolkitCheckAuthorizationFlags flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_NONE;
+
+	if (check->interactive)
+		flags = POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION;
+
+	polkit_authority_check_authorization (check->polkit->priv->authority,
+					      check->subject, check->action_id, NULL,
+					      flags, NULL, urf_polkit_check_auth_cb, check);
+}
+
+/**
+ * urf_polkit_check_auth_cb:
+ **/
+static void
+urf_polkit_check_auth_cb (GObject      *source_object,
+			  GAsyncResult *res,
+			  gpointer      user_data)
+{
+	UrfPolkitCheck *check = user_data;
 	PolkitAuthorizationResult *result;
+	GError *error = NULL;
 
-	/* check auth */
-	result = polkit_authority_check_authorization_sync (polkit->priv->authority,
-							    subject, action_id, NULL,
-							    POLKIT_CHECK_AUTHORIZATION_FLAGS_ALLOW_USER_INTERACTION,
-							    NULL, &error);
+	result = polkit_authority_check_authorization_finish (POLKIT_AUTHORITY (source_object),
+							      res, &error);
 	if (result == NULL) {
-		g_dbus_method_invocation_return_error (invocation,
-		                                       URF_DAEMON_ERROR,
-		                                       URF_DAEMON_ERROR_GENERAL,
-		                                       "failed to check authorisation: %s",
-		                                       error->message);
+		g_simple_async_result_set_error (check->res,
+						 URF_DAEMON_ERROR,
+						 URF_DAEMON_ERROR_GENERAL,
+						 "failed to check authorisation: %s",
+						 error->message);
 		g_error_free (error);
-		goto out;
-	}
-
-	/* okay? */
-	if (polkit_authorization_result_get_is_authorized (result)) {
-		ret = TRUE;
+	} else if (polkit_authorization_result_get_is_authorized (result)) {
+		/* Only grants are cached, so a refused or dismissed request
+		 * is asked again next time. A grant that took a challenge
+		 * is only cached if polkit keeps it around as well, or
+		 * auth_admin without _keep would be bypassed. */
+		if (!check->interactive ||
+		    polkit_authorization_result_get_retains_authorization (result))
+			urf_polkit_cache_insert (check->polkit, check->sender, check->action_id);
+		g_simple_async_result_set_op_res_gboolean (check->res, TRUE);
+	} else if (!check->interactive &&
+		   polkit_authorization_result_get_is_challenge (result)) {
+		/* ask again, this time letting polkit talk to the user */
+		g_object_unref (result);
+		check->interactive = TRUE;
+		urf_polkit_check_auth_start (check);
+		return;
 	} else {
-		g_dbus_method_invocation_return_error (invocation,
-		                                       URF_DAEMON_ERROR,
-		                                       URF_DAEMON_ERROR_GENERAL,
-		                                       "not authorized");
+		g_simple_async_result_set_error (check->res,
+						 URF_DAEMON_ERROR,
+						 URF_DAEMON_ERROR_GENERAL,
+						 "not authorized");
 	}
-out:
+
+	g_simple_async_result_complete (check->res);
+
 	if (result != NULL)
 		g_object_unref (result);
-	return ret;
+	g_object_unref (check->res);
+	g_object_unref (check->subject);
+	g_object_unref (check->polkit);
+	g_free (check->sender);
+	g_free (check->action_id);
+	g_free (check);
+}
+
+/**
+ * urf_polkit_check_auth_async:
+ *
+ * Check whether the sender of @invocation may perform @action_id
+ * without blocking the main loop while polkitd, and possibly the user,
+ * makes up its mind. A recent grant from the cache completes in an idle
+ * callback. Polkit is asked without user interaction first, and again
+ * with it only if that would take a challenge.
+ **/
+void
+urf_polkit_check_auth_async (UrfPolkit             *polkit,
+			     GDBusMethodInvocation *invocation,
+			     const gchar           *action_id,
+			     GAsyncReadyCallback    callback,
+			     gpointer               user_data)
+{
+	GSimpleAsyncResult *res;
+	PolkitSubject *subject;
+	UrfPolkitCheck *check;
+	const char *sender;
+
+	g_return_if_fail (URF_IS_POLKIT (polkit));
+
+	res = g_simple_async_result_new (G_OBJECT (polkit), callback, user_data,
+					 urf_polkit_check_auth_async);
+
+	/* granted to this connection a moment ago? */
+	sender = g_dbus_method_invocation_get_sender (invocation);
+	if (urf_polkit_cache_lookup (polkit, sender, action_id)) {
+		polkit->priv->n_hits++;
+		g_simple_async_result_set_op_res_gboolean (res, TRUE);
+		g_simple_async_result_complete_in_idle (res);
+		g_object_unref (res);
+		return;
+	}
+	polkit->priv->n_misses++;
+
+	subject = polkit_system_bus_name_new (sender);
+	if (subject == NULL) {
+		g_simple_async_result_set_error (res,
+						 URF_DAEMON_ERROR,
+						 URF_DAEMON_ERROR_GENERAL,
+						 "failed to get PolicyKit subject");
+		g_simple_async_result_complete_in_idle (res);
+		g_object_unref (res);
+		return;
+	}
+
+	check = g_new0 (UrfPolkitCheck, 1);
+	check->polkit = g_object_ref (polkit);
+	check->res = res;
+	check->sender = g_strdup (sender);
+	check->action_id = g_strdup (action_id);
+	check->subject = subject;
+
+	/* Without interaction first: only a grant that needs no challenge
+	 * may be cached */
+	check->interactive = FALSE;
+	urf_polkit_check_auth_start (check);
+}
+
+/**
+ * urf_polkit_check_auth_finish:
+ *
+ * Return value: %TRUE if the action is authorized. Otherwise @error
+ * holds a #URF_DAEMON_ERROR ready to be returned to the caller.
+ **/
+gboolean
+urf_polkit_check_auth_finish (UrfPolkit     *polkit,
+			      GAsyncResult  *res,
+			      GError       **error)
+{
+	GSimpleAsyncResult *simple;
+
+	g_return_val_if_fail (g_simple_async_result_is_valid (res, G_OBJECT (polkit),
+							      urf_polkit_check_auth_async),
+			      FALSE);
+
+	simple = G_SIMPLE_ASYNC_RESULT (res);
+	if (g_simple_async_result_propagate_error (simple, error))
+		return FALSE;
+
+	return g_simple_async_result_get_op_res_gboolean (simple);
+}
+
+/**
+ * urf_polkit_startup:
+ **/
+gboolean
+urf_polkit_startup (UrfPolkit       *polkit,
+		    UrfConfig       *config,
+		    GDBusConnection *connection)
+{
+	UrfPolkitPrivate *priv = polkit->priv;
+
+	g_return_val_if_fail (URF_IS_POLKIT (polkit), FALSE);
+	g_return_val_if_fail (priv->connection == NULL, FALSE);
+
+	priv->connection = g_object_ref (connection);
+	priv->cache_ttl = (gint64) urf_config_get_auth_cache_ttl (config) * G_USEC_PER_SEC;
+
+	if (priv->authority != NULL)
+		priv->changed_id = g_signal_connect (priv->authority, "changed",
+						     G_CALLBACK (urf_polkit_authority_changed_cb),
+						     polkit);
+
+	/* Grants may depend on an active session; watch both session
+	 * trackers since polkit may use either */
+	priv->logind_id =
+		g_dbus_connection_signal_subscribe (connection,
+						    "org.freedesktop.login1",
+						    "org.freedesktop.DBus.Properties",
+						    "PropertiesChanged",
+						    NULL, NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    urf_polkit_session_changed_cb,
+						    polkit, NULL);
+	priv->ck_seat_id =
+		g_dbus_connection_signal_subscribe (connection,
+						    "org.freedesktop.ConsoleKit",
+						    "org.freedesktop.ConsoleKit.Seat",
+						    "ActiveSessionChanged",
+						    NULL, NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    urf_polkit_session_changed_cb,
+						    polkit, NULL);
+	priv->ck_session_id =
+		g_dbus_connection_signal_subscribe (connection,
+						    "org.freedesktop.ConsoleKit",
+						    "org.freedesktop.ConsoleKit.Session",
+						    "ActiveChanged",
+						    NULL, NULL,
+						    G_DBUS_SIGNAL_FLAGS_NONE,
+						    urf_polkit_session_changed_cb,
+						    polkit, NULL);
+	return TRUE;
 }
 
 /**
@@ -119,6 +533,24 @@ urf_polkit_finalize (GObject *object)
 	g_return_if_fail (URF_IS_POLKIT (object));
 	polkit = URF_POLKIT (object);
 
+	g_debug ("authorization cache: %u hits, %u misses",
+		 polkit->priv->n_hits, polkit->priv->n_misses);
+
+	/* the entries unsubscribe from the connection */
+	g_hash_table_destroy (polkit->priv->cache);
+	if (polkit->priv->connection) {
+		g_dbus_connection_signal_unsubscribe (polkit->priv->connection,
+						      polkit->priv->logind_id);
+		g_dbus_connection_signal_unsubscribe (polkit->priv->connection,
+						      polkit->priv->ck_seat_id);
+		g_dbus_connection_signal_unsubscribe (polkit->priv->connection,
+						      polkit->priv->ck_session_id);
+		g_object_unref (polkit->priv->connection);
+	}
+
+	if (polkit->priv->changed_id)
+		g_signal_handler_disconnect (polkit->priv->authority,
+					     polkit->priv->changed_id);
 	g_object_unref (polkit->priv->authority);
 
 	G_OBJECT_CLASS (urf_polkit_parent_class)->finalize (object);
@@ -148,6 +580,8 @@ urf_polkit_init (UrfPolkit *polkit)
 	GError *error = NULL;
 
 	polkit->priv = URF_POLKIT_GET_PRIVATE (polkit);
+	polkit->priv->cache = g_hash_table_new_full (g_str_hash, g_str_equal, NULL,
+						     (GDestroyNotify) urf_polkit_sender_free);
 
 #ifdef USE_SECURITY_POLKIT_NEW
 	polkit->priv->authority = polkit_authority_get_sync (NULL, &error);
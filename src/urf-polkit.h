@@ -24,8 +24,11 @@
 #define __URF_POLKIT_H
 
 #include <glib-object.h>
+#include <gio/gio.h>
 #include <polkit/polkit.h>
 
+#include "urf-config.h"
+
 G_BEGIN_DECLS
 
 #define URF_TYPE_POLKIT		(urf_polkit_get_type ())
@@ -51,13 +54,21 @@ typedef struct
 GType		 urf_polkit_get_type		(void);
 UrfPolkit	*urf_polkit_new			(void);
 void		 urf_polkit_test		(gpointer		 user_data);
+gboolean	 urf_polkit_startup		(UrfPolkit		*polkit,
+						 UrfConfig		*config,
+						 GDBusConnection	*connection);
+void		 urf_polkit_get_counters	(UrfPolkit		*polkit,
+						 guint			*n_hits,
+						 guint			*n_misses);
 
-PolkitSubject	*urf_polkit_get_subject		(UrfPolkit		*polkit,
-						 GDBusMethodInvocation	*invocation);
-gboolean	 urf_polkit_check_auth		(UrfPolkit		*polkit,
-						 PolkitSubject		*subject,
+void		 urf_polkit_check_auth_async	(UrfPolkit		*polkit,
+						 GDBusMethodInvocation	*invocation,
 						 const gchar		*action_id,
-						 GDBusMethodInvocation	*invocation);
+						 GAsyncReadyCallback	 callback,
+						 gpointer		 user_data);
+gboolean	 urf_polkit_check_auth_finish	(UrfPolkit		*polkit,
+						 GAsyncResult		*res,
+						 GError			**error);
 G_END_DECLS
 
 #endif /* __URF_POLKIT_H */
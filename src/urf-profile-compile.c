@@ -0,0 +1,48 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 The urfkill authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+
+#include "urf-profile.h"
+
+/**
+ * main:
+ *
+ * Compile the XML profiles given on the command line into the ruleset
+ * urfkilld maps at startup. The build validates them against
+ * profile.dtd first.
+ **/
+int
+main (int argc, char **argv)
+{
+	if (argc < 2) {
+		g_printerr ("Usage: %s OUTPUT [PROFILE.xml...]\n", argv[0]);
+		return 1;
+	}
+
+	if (!urf_profile_db_compile (argv[1], argv + 2))
+		return 1;
+
+	return 0;
+}
@@ -0,0 +1,1670 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 The urfkill authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <glib.h>
+#include <string.h>
+#include <expat.h>
+
+#include "urf-profile.h"
+
+enum
+{
+	OPT_NONE,
+	OPT_KEY_CONTROL,
+	OPT_MASTER_KEY,
+	OPT_FORCE_SYNC,
+	OPT_PERSIST,
+	OPT_UNKNOWN,
+};
+
+enum
+{
+	OPT_TYPE_NONE,
+	OPT_TYPE_BOOLEAN,
+	OPT_TYPE_UNKNOWN,
+};
+
+enum
+{
+	OPER_STRING,
+	OPER_STRING_OUTOF,
+	OPER_CONTAINS,
+	OPER_CONTAINS_NCASE,
+	OPER_CONTAINS_NOT,
+	OPER_CONTAINS_OUTOF,
+	OPER_PREFIX,
+	OPER_PREFIX_NCASE,
+	OPER_PREFIX_OUTOF,
+	OPER_SUFFIX,
+	OPER_SUFFIX_NCASE,
+	OPER_SUFFIX_OUTOF,
+	OPER_UNKNOWN,
+};
+
+enum
+{
+	KEY_UNKNOWN,
+	KEY_SYS_VENDOR,
+	KEY_BIOS_DATE,
+	KEY_BIOS_VENDOR,
+	KEY_BIOS_VERSION,
+	KEY_PRODUCT_NAME,
+	KEY_PRODUCT_VERSION,
+	NUM_KEYS,
+};
+
+typedef struct {
+	int			 xml_depth;
+	int			 xml_bound;
+	int			 opt;
+	int			 opt_type;
+	UrfProfileOptions	 options;
+	DmiInfo			*hardware_info;
+	DmiInfo			*hardware_info_lower;
+} ParseInfo;
+
+static int
+get_option (const char *option)
+{
+	if (g_strcmp0 (option, "key_control") == 0)
+		return OPT_KEY_CONTROL;
+	else if (g_strcmp0 (option, "master_key") == 0)
+		return OPT_MASTER_KEY;
+	else if (g_strcmp0 (option, "force_sync") == 0)
+		return OPT_FORCE_SYNC;
+	else if (g_strcmp0 (option, "persist") == 0)
+		return OPT_PERSIST;
+	return OPT_UNKNOWN;
+}
+
+static int
+get_option_type (const char *type)
+{
+	if (g_strcmp0 (type, "bool") == 0)
+		return OPT_TYPE_BOOLEAN;
+	return OPT_TYPE_UNKNOWN;
+}
+
+static void
+set_option (UrfProfileOptions *options,
+	    int                opt,
+	    gboolean           value)
+{
+	switch (opt) {
+	case OPT_KEY_CONTROL:
+		options->key_control = value;
+		break;
+	case OPT_MASTER_KEY:
+		options->master_key = value;
+		break;
+	case OPT_FORCE_SYNC:
+		options->force_sync = value;
+		break;
+	case OPT_PERSIST:
+		options->persist = value;
+		break;
+	default:
+		break;
+	}
+}
+
+static int
+get_key (const char *key)
+{
+	if (g_strcmp0 (key, "sys_vendor") == 0)
+		return KEY_SYS_VENDOR;
+	else if (g_strcmp0 (key, "bios_date") == 0)
+		return KEY_BIOS_DATE;
+	else if (g_strcmp0 (key, "bios_vendor") == 0)
+		return KEY_BIOS_VENDOR;
+	else if (g_strcmp0 (key, "bios_version") == 0)
+		return KEY_BIOS_VERSION;
+	else if (g_strcmp0 (key, "product_name") == 0)
+		return KEY_PRODUCT_NAME;
+	else if (g_strcmp0 (key, "product_version") == 0)
+		return KEY_PRODUCT_VERSION;
+	return KEY_UNKNOWN;
+}
+
+static char *
+get_dmi_field (DmiInfo *hardware_info,
+	       int      key)
+{
+	if (hardware_info == NULL)
+		return NULL;
+
+	switch (key) {
+	case KEY_SYS_VENDOR:
+		return hardware_info->sys_vendor;
+	case KEY_BIOS_DATE:
+		return hardware_info->bios_date;
+	case KEY_BIOS_VENDOR:
+		return hardware_info->bios_vendor;
+	case KEY_BIOS_VERSION:
+		return hardware_info->bios_version;
+	case KEY_PRODUCT_NAME:
+		return hardware_info->product_name;
+	case KEY_PRODUCT_VERSION:
+		return hardware_info->product_version;
+	default:
+		return NULL;
+	}
+}
+
+static char *
+get_match_key (DmiInfo    *hardware_info,
+	       const char *key)
+{
+	return get_dmi_field (hardware_info, get_key (key));
+}
+
+static int
+get_operator (const char *operator)
+{
+	if (g_strcmp0 (operator, "string") == 0)
+		return OPER_STRING;
+	else if (g_strcmp0 (operator, "string_outof") == 0)
+		return OPER_STRING_OUTOF;
+	else if (g_strcmp0 (operator, "contains") == 0)
+		return OPER_CONTAINS;
+	else if (g_strcmp0 (operator, "contains_ncase") == 0)
+		return OPER_CONTAINS_NCASE;
+	else if (g_strcmp0 (operator, "contains_not") == 0)
+		return OPER_CONTAINS_NOT;
+	else if (g_strcmp0 (operator, "contains_outof") == 0)
+		return OPER_CONTAINS_OUTOF;
+	else if (g_strcmp0 (operator, "prefix") == 0)
+		return OPER_PREFIX;
+	else if (g_strcmp0 (operator, "prefix_ncase") == 0)
+		return OPER_PREFIX_NCASE;
+	else if (g_strcmp0 (operator, "prefix_outof") == 0)
+		return OPER_PREFIX_OUTOF;
+	else if (g_strcmp0 (operator, "suffix") == 0)
+		return OPER_SUFFIX;
+	else if (g_strcmp0 (operator, "suffix_ncase") == 0)
+		return OPER_SUFFIX_NCASE;
+	else if (g_strcmp0 (operator, "suffix_outof") == 0)
+		return OPER_SUFFIX_OUTOF;
+	return OPER_UNKNOWN;
+}
+
+static gboolean match_rule (const char *str1,
+			    const char *str1_lower,
+			    const int   operator,
+			    const char *str2);
+
+/**
+ * match_rule_outof:
+ *
+ * Match @str1 against every non-empty token of the ';' separated @list.
+ * The list is cut in place in a single copy instead of being split
+ * into a vector of new strings.
+ **/
+static gboolean
+match_rule_outof (const char *str1,
+		  const int   operator,
+		  const char *list)
+{
+	gboolean match = FALSE;
+	char *tokens;
+	char *token;
+	char *next;
+
+	tokens = g_strdup (list);
+	for (token = tokens; token; token = next) {
+		next = strchr (token, ';');
+		if (next)
+			*next++ = '\0';
+
+		if (match_rule (str1, NULL, operator, token)) {
+			match = TRUE;
+			break;
+		}
+	}
+	g_free (tokens);
+
+	return match;
+}
+
+/**
+ * match_rule:
+ * @str1: the DMI string
+ * @str1_lower: @str1 in lower case, or NULL if no _ncase operator is used
+ * @operator: the operator of the rule
+ * @str2: the body of the rule
+ **/
+static gboolean
+match_rule (const char *str1,
+	    const char *str1_lower,
+	    const int   operator,
+	    const char *str2)
+{
+	gboolean match = FALSE;
+	char *str2_lower;
+	gsize len1, len2;
+
+	if (str2 == NULL || str1[0] == '\0' || str2[0] == '\0')
+		return FALSE;
+
+	switch (operator) {
+	case OPER_STRING:
+		if (g_strcmp0 (str1, str2) == 0)
+			match = TRUE;
+		break;
+	case OPER_STRING_OUTOF:
+		match = match_rule_outof (str1, OPER_STRING, str2);
+		break;
+	case OPER_CONTAINS:
+		if (g_strrstr (str1, str2))
+			match = TRUE;
+		break;
+	case OPER_CONTAINS_NCASE:
+		g_return_val_if_fail (str1_lower != NULL, FALSE);
+		str2_lower = g_ascii_strdown (str2, -1);
+		if (g_strrstr (str1_lower, str2_lower))
+			match = TRUE;
+		g_free (str2_lower);
+		break;
+	case OPER_CONTAINS_NOT:
+		if (g_strrstr (str1, str2) == NULL)
+			match = TRUE;
+		break;
+	case OPER_CONTAINS_OUTOF:
+		match = match_rule_outof (str1, OPER_CONTAINS, str2);
+		break;
+	case OPER_PREFIX:
+		if (g_str_has_prefix (str1, str2))
+			match = TRUE;
+		break;
+	case OPER_PREFIX_NCASE:
+		len1 = strlen (str1);
+		len2 = strlen (str2);
+		if (len1 >= len2 && g_ascii_strncasecmp (str1, str2, len2) == 0)
+			match = TRUE;
+		break;
+	case OPER_PREFIX_OUTOF:
+		match = match_rule_outof (str1, OPER_PREFIX, str2);
+		break;
+	case OPER_SUFFIX:
+		if (g_str_has_suffix (str1, str2))
+			match = TRUE;
+		break;
+	case OPER_SUFFIX_NCASE:
+		len1 = strlen (str1);
+		len2 = strlen (str2);
+		if (len1 >= len2 && g_ascii_strcasecmp (str1 + len1 - len2, str2) == 0)
+			match = TRUE;
+		break;
+	case OPER_SUFFIX_OUTOF:
+		match = match_rule_outof (str1, OPER_SUFFIX, str2);
+		break;
+	default:
+		match = FALSE;
+		break;
+	}
+
+	return match;
+}
+
+static void
+parse_xml_cdata_handler (void       *data,
+			 const char *cdata,
+			 int         len)
+{
+	ParseInfo *info = (ParseInfo *)data;
+	char *str;
+
+	if (info->opt == OPT_NONE ||
+	    info->opt == OPT_UNKNOWN) {
+		return;
+	}
+
+	str = g_strndup (cdata, len);
+
+	if (g_ascii_strcasecmp (str, "TRUE") == 0)
+		set_option (&info->options, info->opt, TRUE);
+	else if (g_ascii_strcasecmp (str, "FALSE") == 0)
+		set_option (&info->options, info->opt, FALSE);
+
+	g_free (str);
+}
+
+static void
+parse_xml_start_element (void       *data,
+			 const char *name,
+			 const char **atts)
+{
+	ParseInfo *info = (ParseInfo *)data;
+	const char *key = NULL;
+	const char *type = NULL;
+	const char *match_key = NULL;
+	const char *match_body = NULL;
+	int operator = 0;
+	int i;
+
+	info->xml_depth++;
+
+	if (info->xml_depth > info->xml_bound)
+		return;
+	else if (info->xml_depth < info->xml_bound)
+		info->xml_bound = info->xml_depth + 1;
+
+	info->opt = OPT_NONE;
+	info->opt_type = OPT_TYPE_NONE;
+
+	if (g_strcmp0 (name, "match") == 0) {
+		for (i = 0; atts[i]; i++) {
+			if (g_strcmp0 (atts[i], "key") == 0) {
+				if (!atts[i+1])
+					continue;
+				key = atts[i+1];
+				i++;
+			} else if ((operator = get_operator (atts[i])) != OPER_UNKNOWN) {
+				if (!atts[i+1])
+					continue;
+				match_body = atts[i+1];
+				i++;
+			}
+		}
+
+		match_key = get_match_key (info->hardware_info, key);
+		if (match_key && !match_rule (match_key,
+					      get_match_key (info->hardware_info_lower, key),
+					      operator, match_body))
+			return;
+	} else if (g_strcmp0 (name, "option") == 0) {
+		for (i = 0; atts[i]; i++) {
+			if (g_strcmp0 (atts[i], "key") == 0) {
+				if (!atts[i+1])
+					continue;
+				key = atts[i+1];
+				i++;
+			} else if (g_strcmp0 (atts[i], "type") == 0) {
+				if (!atts[i+1])
+					continue;
+				type = atts[i+1];
+				i++;
+			}
+		}
+
+		info->opt = get_option (key);
+		info->opt_type = get_option_type (type);
+	}
+
+	info->xml_bound++;
+}
+
+static void
+parse_xml_end_element (void       *data,
+		       const char *name)
+{
+	ParseInfo *info = (ParseInfo *)data;
+
+	if (info->xml_bound > info->xml_depth)
+		info->xml_bound = info->xml_depth;
+
+	info->opt = OPT_NONE;
+	info->opt_type = OPT_TYPE_NONE;
+
+	info->xml_depth--;
+}
+
+/**
+ * urf_profile_xml_apply:
+ * @hardware_info: the DMI information of the machine
+ * @hardware_info_lower: the same in lower case
+ * @options: the options to update with what the profile sets
+ * @filename: the XML profile
+ **/
+gboolean
+urf_profile_xml_apply (DmiInfo           *hardware_info,
+		       DmiInfo           *hardware_info_lower,
+		       UrfProfileOptions *options,
+		       const char        *filename)
+{
+	ParseInfo *info;
+	XML_Parser parser;
+	char *content;
+	gsize length;
+	int len;
+
+	if (!g_file_get_contents (filename, &content, &length, NULL)) {
+		g_warning ("Failed to read profile: %s", filename);
+		return FALSE;
+	}
+
+	info = g_new0 (ParseInfo, 1);
+	info->hardware_info = hardware_info;
+	info->hardware_info_lower = hardware_info_lower;
+	info->xml_depth = 0;
+	info->xml_bound = 1;
+	info->opt = OPT_NONE;
+	info->opt_type = OPT_TYPE_NONE;
+	info->options = *options;
+
+	parser = XML_ParserCreate (NULL);
+	XML_SetUserData (parser, (void *)info);
+	XML_SetElementHandler (parser,
+			       parse_xml_start_element,
+			       parse_xml_end_element);
+	XML_SetCharacterDataHandler (parser,
+				     parse_xml_cdata_handler);
+	len = strlen (content);
+
+	if (XML_Parse (parser, content, len, 1) == XML_STATUS_ERROR) {
+		g_warning ("Profile Parse error: %s", filename);
+		XML_ParserFree (parser);
+		g_free (content);
+		g_free (info);
+		return FALSE;
+	}
+
+	XML_ParserFree (parser);
+	g_free (content);
+
+	*options = info->options;
+
+	g_free (info);
+	return TRUE;
+}
+
+/*
+ * The compiled ruleset
+ *
+ * Every <option> of the XML profiles becomes part of a rule: the chain of
+ * <match> elements around it, and the options it sets. Consecutive
+ * options under the same chain share one rule. Each rule is filed under
+ * the first sys_vendor condition of its chain, or under no condition if
+ * it has none, so a vendor condition shared by many rules is evaluated
+ * once. A bucket whose condition is an exact sys_vendor string is found
+ * by a binary search over the sorted vendor names; only the buckets of
+ * other conditions, and the one of rules without any, are scanned.
+ * The other conditions are stored with their _outof lists already
+ * split and their _ncase bodies already lowered. Rules keep their
+ * position in the profiles, sorted by file name, and the options of the
+ * matching ones are applied in that order, just like the XML path does.
+ *
+ * The file is a header followed by arrays of little-endian 32 bit
+ * integers, and a table of NUL-terminated strings at the end. It is
+ * mapped, not read, and nothing in it is copied to the heap.
+ */
+
+#define PROFILE_DB_MAGIC	"URFPDB02"
+#define PROFILE_DB_NO_COND	G_MAXUINT32
+
+typedef struct {
+	char	magic[8];
+	guint32	n_files;
+	guint32	files;
+	guint32	n_vendors;
+	guint32	vendors;
+	guint32	n_vendor_names;
+	guint32	vendor_names;
+	guint32	n_vendor_scan;
+	guint32	vendor_scan;
+	guint32	n_rules;
+	guint32	rules;
+	guint32	n_conds;
+	guint32	conds;
+	guint32	n_alts;
+	guint32	alts;
+	guint32	n_opts;
+	guint32	opts;
+	guint32	strings;
+	guint32	strings_size;
+} ProfileDbHeader;
+
+/* A source profile; the ruleset is only used while they are unchanged.
+ * Installing the profiles changes their times and inodes, so they are
+ * told apart by their content. */
+typedef struct {
+	guint32	name;
+	guint32	size;
+	guint32	checksum; /* SHA-256 of the content, in hex */
+} ProfileDbFile;
+
+typedef struct {
+	guint32	cond; /* or PROFILE_DB_NO_COND */
+	guint32	first_rule;
+	guint32	n_rules;
+} ProfileDbVendor;
+
+/* An exact sys_vendor, sorted by name; a bucket has one per alternative */
+typedef struct {
+	guint32	name;
+	guint32	vendor;
+} ProfileDbVendorName;
+
+typedef struct {
+	guint32	seq; /* the position in the profiles */
+	guint32	first_cond;
+	guint32	n_conds;
+	guint32	first_opt;
+	guint32	n_opts;
+} ProfileDbRule;
+
+/* Matches if any of the alternatives does */
+typedef struct {
+	guint32	key;
+	guint32	oper; /* never one of the _outof ones */
+	guint32	first_alt;
+	guint32	n_alts;
+} ProfileDbCond;
+
+typedef struct {
+	guint32	opt;
+	guint32	value;
+} ProfileDbOpt;
+
+struct UrfProfileDb {
+	GMappedFile		*file;
+	const ProfileDbFile	*files;
+	guint32			 n_files;
+	const ProfileDbVendor	*vendors;
+	guint32			 n_vendors;
+	const ProfileDbVendorName *vendor_names;
+	guint32			 n_vendor_names;
+	const guint32		*vendor_scan; /* the other buckets */
+	guint32			 n_vendor_scan;
+	const ProfileDbRule	*rules;
+	guint32			 n_rules;
+	const ProfileDbCond	*conds;
+	guint32			 n_conds;
+	const guint32		*alts;
+	guint32			 n_alts;
+	const ProfileDbOpt	*opts;
+	guint32			 n_opts;
+	const char		*strings;
+	guint32			 strings_size;
+};
+
+#define LE(value) GUINT32_FROM_LE (value)
+
+typedef struct {
+	guint32		 key;
+	guint32		 oper;
+	GPtrArray	*alts;
+} BuildCond;
+
+typedef struct {
+	guint32		 seq;
+	GPtrArray	*conds; /* BuildCond, owned by CompileInfo */
+	GArray		*opts; /* ProfileDbOpt in host order */
+} BuildRule;
+
+typedef struct {
+	GPtrArray	*stack; /* the conditions of the open <match> elements */
+	GPtrArray	*conds;
+	GPtrArray	*rules;
+	BuildRule	*open_rule;
+	int		 opt;
+	gboolean	 in_option;
+	GString		*cdata;
+	guint32		 seq;
+} CompileInfo;
+
+static void
+build_cond_free (BuildCond *cond)
+{
+	g_ptr_array_unref (cond->alts);
+	g_free (cond);
+}
+
+static void
+build_rule_free (BuildRule *rule)
+{
+	g_ptr_array_unref (rule->conds);
+	g_array_free (rule->opts, TRUE);
+	g_free (rule);
+}
+
+/**
+ * build_cond:
+ *
+ * Lower the operator of a <match> to what the compiled matcher knows:
+ * an _outof list becomes one alternative per token, and an _ncase body
+ * is lowered once here instead of on every match.
+ **/
+static BuildCond *
+build_cond (const char *key,
+	    int         operator,
+	    const char *body)
+{
+	BuildCond *cond;
+	char **tokens;
+	gboolean outof = FALSE;
+	gboolean ncase = FALSE;
+	guint i;
+
+	cond = g_new0 (BuildCond, 1);
+	cond->key = get_key (key);
+	cond->alts = g_ptr_array_new_with_free_func (g_free);
+
+	switch (operator) {
+	case OPER_STRING_OUTOF:
+		cond->oper = OPER_STRING;
+		outof = TRUE;
+		break;
+	case OPER_CONTAINS_OUTOF:
+		cond->oper = OPER_CONTAINS;
+		outof = TRUE;
+		break;
+	case OPER_PREFIX_OUTOF:
+		cond->oper = OPER_PREFIX;
+		outof = TRUE;
+		break;
+	case OPER_SUFFIX_OUTOF:
+		cond->oper = OPER_SUFFIX;
+		outof = TRUE;
+		break;
+	case OPER_CONTAINS_NCASE:
+	case OPER_PREFIX_NCASE:
+	case OPER_SUFFIX_NCASE:
+		cond->oper = operator;
+		ncase = TRUE;
+		break;
+	case OPER_UNKNOWN:
+		/* matches nothing */
+		cond->oper = OPER_STRING;
+		return cond;
+	default:
+		cond->oper = operator;
+		break;
+	}
+
+	if (body == NULL)
+		return cond;
+
+	if (outof) {
+		tokens = g_strsplit (body, ";", -1);
+		for (i = 0; tokens[i]; i++) {
+			if (tokens[i][0] != '\0')
+				g_ptr_array_add (cond->alts, g_strdup (tokens[i]));
+		}
+		g_strfreev (tokens);
+	} else if (body[0] != '\0') {
+		g_ptr_array_add (cond->alts,
+				 ncase ? g_ascii_strdown (body, -1) : g_strdup (body));
+	}
+
+	return cond;
+}
+
+static void
+compile_xml_cdata_handler (void       *data,
+			   const char *cdata,
+			   int         len)
+{
+	CompileInfo *info = (CompileInfo *)data;
+
+	if (info->in_option)
+		g_string_append_len (info->cdata, cdata, len);
+}
+
+static void
+compile_xml_start_element (void       *data,
+			   const char *name,
+			   const char **atts)
+{
+	CompileInfo *info = (CompileInfo *)data;
+	BuildCond *cond;
+	BuildRule *rule;
+	const char *key = NULL;
+	const char *match_body = NULL;
+	int operator = 0;
+	guint i;
+
+	if (g_strcmp0 (name, "match") == 0) {
+		/* the same attribute handling as parse_xml_start_element */
+		for (i = 0; atts[i]; i++) {
+			if (g_strcmp0 (atts[i], "key") == 0) {
+				if (!atts[i+1])
+					continue;
+				key = atts[i+1];
+				i++;
+			} else if ((operator = get_operator (atts[i])) != OPER_UNKNOWN) {
+				if (!atts[i+1])
+					continue;
+				match_body = atts[i+1];
+				i++;
+			}
+		}
+
+		cond = build_cond (key, operator, match_body);
+		g_ptr_array_add (info->conds, cond);
+		g_ptr_array_add (info->stack, cond);
+		info->open_rule = NULL;
+	} else if (g_strcmp0 (name, "option") == 0) {
+		for (i = 0; atts[i]; i += 2) {
+			if (g_strcmp0 (atts[i], "key") == 0)
+				key = atts[i+1];
+		}
+
+		if (info->open_rule == NULL) {
+			rule = g_new0 (BuildRule, 1);
+			rule->seq = info->seq++;
+			rule->conds = g_ptr_array_sized_new (info->stack->len);
+			for (i = 0; i < info->stack->len; i++)
+				g_ptr_array_add (rule->conds,
+						 g_ptr_array_index (info->stack, i));
+			rule->opts = g_array_new (FALSE, FALSE, sizeof (ProfileDbOpt));
+			g_ptr_array_add (info->rules, rule);
+			info->open_rule = rule;
+		}
+
+		info->opt = get_option (key);
+		info->in_option = TRUE;
+		g_string_truncate (info->cdata, 0);
+	}
+}
+
+static void
+compile_xml_end_element (void       *data,
+			 const char *name)
+{
+	CompileInfo *info = (CompileInfo *)data;
+	ProfileDbOpt opt;
+
+	if (g_strcmp0 (name, "match") == 0) {
+		if (info->stack->len > 0)
+			g_ptr_array_remove_index (info->stack, info->stack->len - 1);
+		info->open_rule = NULL;
+	} else if (g_strcmp0 (name, "option") == 0 && info->in_option) {
+		info->in_option = FALSE;
+		if (info->opt == OPT_UNKNOWN || info->open_rule == NULL)
+			return;
+
+		opt.opt = info->opt;
+		if (g_ascii_strcasecmp (info->cdata->str, "TRUE") == 0)
+			opt.value = TRUE;
+		else if (g_ascii_strcasecmp (info->cdata->str, "FALSE") == 0)
+			opt.value = FALSE;
+		else
+			return;
+		g_array_append_val (info->open_rule->opts, opt);
+	}
+}
+
+static void
+put (GByteArray *section,
+     guint32     value)
+{
+	value = GUINT32_TO_LE (value);
+	g_byte_array_append (section, (const guint8 *)&value, sizeof (value));
+}
+
+static guint32
+put_string (GString    *strings,
+	    GHashTable *offsets,
+	    const char *str)
+{
+	gpointer offset;
+
+	if (g_hash_table_lookup_extended (offsets, str, NULL, &offset))
+		return GPOINTER_TO_UINT (offset);
+
+	offset = GUINT_TO_POINTER (strings->len);
+	g_string_append_len (strings, str, strlen (str) + 1);
+	g_hash_table_insert (offsets, g_strdup (str), offset);
+
+	return GPOINTER_TO_UINT (offset);
+}
+
+static guint32
+put_cond (GByteArray *conds,
+	  GByteArray *alts,
+	  GString    *strings,
+	  GHashTable *offsets,
+	  BuildCond  *cond)
+{
+	guint32 index = conds->len / sizeof (ProfileDbCond);
+	guint i;
+
+	put (conds, cond->key);
+	put (conds, cond->oper);
+	put (conds, alts->len / sizeof (guint32));
+	put (conds, cond->alts->len);
+
+	for (i = 0; i < cond->alts->len; i++)
+		put (alts, put_string (strings, offsets,
+				       g_ptr_array_index (cond->alts, i)));
+
+	return index;
+}
+
+/**
+ * vendor_bucket_key:
+ *
+ * Two vendor conditions that would always match alike share a bucket.
+ **/
+static char *
+vendor_bucket_key (BuildCond *cond)
+{
+	GString *key;
+	const char *alt;
+	guint i;
+
+	if (cond == NULL)
+		return g_strdup ("");
+
+	key = g_string_new (NULL);
+	g_string_append_printf (key, "%u", cond->oper);
+	for (i = 0; i < cond->alts->len; i++) {
+		alt = g_ptr_array_index (cond->alts, i);
+		g_string_append_printf (key, ":%u:%s", (guint) strlen (alt), alt);
+	}
+
+	return g_string_free (key, FALSE);
+}
+
+typedef struct {
+	BuildCond	*cond;
+	GPtrArray	*rules;
+} VendorBucket;
+
+static void
+vendor_bucket_free (VendorBucket *bucket)
+{
+	g_ptr_array_unref (bucket->rules);
+	g_free (bucket);
+}
+
+typedef struct {
+	const char	*name;
+	guint32		 vendor;
+} BuildVendorName;
+
+static gint
+vendor_name_sorter (gconstpointer a,
+		    gconstpointer b)
+{
+	const BuildVendorName *name_a = a;
+	const BuildVendorName *name_b = b;
+	gint ret;
+
+	ret = strcmp (name_a->name, name_b->name);
+	if (ret != 0)
+		return ret;
+
+	return name_a->vendor < name_b->vendor ? -1 : name_a->vendor > name_b->vendor;
+}
+
+/**
+ * profile_db_write:
+ **/
+static gboolean
+profile_db_write (const char  *output,
+		  char       **names,
+		  guint32     *sizes,
+		  char       **checksums,
+		  GPtrArray   *rules)
+{
+	GPtrArray *buckets;
+	GHashTable *bucket_index;
+	GHashTable *offsets;
+	GByteArray *sections[8];
+	GByteArray *files, *vendors, *vendor_names, *vendor_scan;
+	GByteArray *rule_section, *conds, *alts, *opts;
+	GByteArray *data;
+	GString *strings;
+	GArray *names_index;
+	BuildVendorName *name, *last;
+	VendorBucket *bucket;
+	BuildRule *rule;
+	BuildCond *cond, *vendor_cond;
+	ProfileDbOpt *opt;
+	ProfileDbHeader header;
+	guint32 offset, first_cond, n_conds;
+	gboolean ret;
+	gpointer index;
+	char *key;
+	guint i, j, k;
+
+	strings = g_string_new (NULL);
+	offsets = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (i = 0; i < G_N_ELEMENTS (sections); i++)
+		sections[i] = g_byte_array_new ();
+	files = sections[0];
+	vendors = sections[1];
+	vendor_names = sections[2];
+	vendor_scan = sections[3];
+	rule_section = sections[4];
+	conds = sections[5];
+	alts = sections[6];
+	opts = sections[7];
+
+	for (i = 0; names[i]; i++) {
+		put (files, put_string (strings, offsets, names[i]));
+		put (files, sizes[i]);
+		put (files, put_string (strings, offsets, checksums[i]));
+	}
+
+	/* File the rules under their first vendor condition */
+	buckets = g_ptr_array_new_with_free_func ((GDestroyNotify) vendor_bucket_free);
+	bucket_index = g_hash_table_new_full (g_str_hash, g_str_equal, g_free, NULL);
+	for (i = 0; i < rules->len; i++) {
+		rule = g_ptr_array_index (rules, i);
+		if (rule->opts->len == 0)
+			continue;
+
+		vendor_cond = NULL;
+		for (j = 0; j < rule->conds->len; j++) {
+			cond = g_ptr_array_index (rule->conds, j);
+			if (cond->key == KEY_SYS_VENDOR) {
+				vendor_cond = cond;
+				break;
+			}
+		}
+
+		key = vendor_bucket_key (vendor_cond);
+		if (g_hash_table_lookup_extended (bucket_index, key, NULL, &index)) {
+			bucket = g_ptr_array_index (buckets, GPOINTER_TO_UINT (index));
+			g_free (key);
+		} else {
+			bucket = g_new0 (VendorBucket, 1);
+			bucket->cond = vendor_cond;
+			bucket->rules = g_ptr_array_new ();
+			g_hash_table_insert (bucket_index, key,
+					     GUINT_TO_POINTER (buckets->len));
+			g_ptr_array_add (buckets, bucket);
+		}
+		g_ptr_array_add (bucket->rules, rule);
+	}
+
+	/* Index the exact vendor names, and scan the buckets of the other
+	 * conditions. An exact condition without any name matches nothing
+	 * that has a sys_vendor, so it is neither indexed nor scanned. */
+	names_index = g_array_new (FALSE, FALSE, sizeof (BuildVendorName));
+	for (i = 0; i < buckets->len; i++) {
+		bucket = g_ptr_array_index (buckets, i);
+		if (bucket->cond == NULL || bucket->cond->oper != OPER_STRING) {
+			put (vendor_scan, i);
+			continue;
+		}
+		for (j = 0; j < bucket->cond->alts->len; j++) {
+			BuildVendorName entry;
+
+			entry.name = g_ptr_array_index (bucket->cond->alts, j);
+			entry.vendor = i;
+			g_array_append_val (names_index, entry);
+		}
+	}
+	g_array_sort (names_index, vendor_name_sorter);
+	last = NULL;
+	for (i = 0; i < names_index->len; i++) {
+		name = &g_array_index (names_index, BuildVendorName, i);
+		/* a name listed twice in one _outof list */
+		if (last && last->vendor == name->vendor &&
+		    strcmp (last->name, name->name) == 0)
+			continue;
+		put (vendor_names, put_string (strings, offsets, name->name));
+		put (vendor_names, name->vendor);
+		last = name;
+	}
+	g_array_free (names_index, TRUE);
+
+	for (i = 0; i < buckets->len; i++) {
+		bucket = g_ptr_array_index (buckets, i);
+
+		if (bucket->cond)
+			put (vendors, put_cond (conds, alts, strings, offsets, bucket->cond));
+		else
+			put (vendors, PROFILE_DB_NO_COND);
+		put (vendors, rule_section->len / sizeof (ProfileDbRule));
+		put (vendors, bucket->rules->len);
+
+		for (j = 0; j < bucket->rules->len; j++) {
+			rule = g_ptr_array_index (bucket->rules, j);
+
+			/* the vendor condition was checked for the bucket */
+			first_cond = conds->len / sizeof (ProfileDbCond);
+			n_conds = 0;
+			vendor_cond = NULL;
+			for (k = 0; k < rule->conds->len; k++) {
+				cond = g_ptr_array_index (rule->conds, k);
+				if (bucket->cond && vendor_cond == NULL &&
+				    cond->key == KEY_SYS_VENDOR) {
+					vendor_cond = cond;
+					continue;
+				}
+				put_cond (conds, alts, strings, offsets, cond);
+				n_conds++;
+			}
+
+			put (rule_section, rule->seq);
+			put (rule_section, first_cond);
+			put (rule_section, n_conds);
+			put (rule_section, opts->len / sizeof (ProfileDbOpt));
+			put (rule_section, rule->opts->len);
+
+			for (k = 0; k < rule->opts->len; k++) {
+				opt = &g_array_index (rule->opts, ProfileDbOpt, k);
+				put (opts, opt->opt);
+				put (opts, opt->value);
+			}
+		}
+	}
+
+	memset (&header, 0, sizeof (header));
+	memcpy (header.magic, PROFILE_DB_MAGIC, sizeof (header.magic));
+	offset = sizeof (header);
+	header.n_files = GUINT32_TO_LE (files->len / sizeof (ProfileDbFile));
+	header.files = GUINT32_TO_LE (offset);
+	offset += files->len;
+	header.n_vendors = GUINT32_TO_LE (vendors->len / sizeof (ProfileDbVendor));
+	header.vendors = GUINT32_TO_LE (offset);
+	offset += vendors->len;
+	header.n_vendor_names = GUINT32_TO_LE (vendor_names->len / sizeof (ProfileDbVendorName));
+	header.vendor_names = GUINT32_TO_LE (offset);
+	offset += vendor_names->len;
+	header.n_vendor_scan = GUINT32_TO_LE (vendor_scan->len / sizeof (guint32));
+	header.vendor_scan = GUINT32_TO_LE (offset);
+	offset += vendor_scan->len;
+	header.n_rules = GUINT32_TO_LE (rule_section->len / sizeof (ProfileDbRule));
+	header.rules = GUINT32_TO_LE (offset);
+	offset += rule_section->len;
+	header.n_conds = GUINT32_TO_LE (conds->len / sizeof (ProfileDbCond));
+	header.conds = GUINT32_TO_LE (offset);
+	offset += conds->len;
+	header.n_alts = GUINT32_TO_LE (alts->len / sizeof (guint32));
+	header.alts = GUINT32_TO_LE (offset);
+	offset += alts->len;
+	header.n_opts = GUINT32_TO_LE (opts->len / sizeof (ProfileDbOpt));
+	header.opts = GUINT32_TO_LE (offset);
+	offset += opts->len;
+	header.strings = GUINT32_TO_LE (offset);
+	header.strings_size = GUINT32_TO_LE (strings->len);
+
+	data = g_byte_array_new ();
+	g_byte_array_append (data, (const guint8 *)&header, sizeof (header));
+	for (i = 0; i < G_N_ELEMENTS (sections); i++)
+		g_byte_array_append (data, sections[i]->data, sections[i]->len);
+	g_byte_array_append (data, (const guint8 *)strings->str, strings->len);
+
+	ret = g_file_set_contents (output, (const char *)data->data, data->len, NULL);
+	if (!ret)
+		g_warning ("Failed to write the compiled profiles: %s", output);
+
+	g_byte_array_unref (data);
+	for (i = 0; i < G_N_ELEMENTS (sections); i++)
+		g_byte_array_unref (sections[i]);
+	g_hash_table_destroy (bucket_index);
+	g_ptr_array_unref (buckets);
+	g_hash_table_destroy (offsets);
+	g_string_free (strings, TRUE);
+
+	return ret;
+}
+
+static gint
+basename_sorter (gconstpointer a,
+		 gconstpointer b)
+{
+	char *name_a = g_path_get_basename (*(const char **)a);
+	char *name_b = g_path_get_basename (*(const char **)b);
+	gint ret;
+
+	ret = g_strcmp0 (name_a, name_b);
+	g_free (name_a);
+	g_free (name_b);
+
+	return ret;
+}
+
+/**
+ * urf_profile_db_compile:
+ * @output: the file to write the ruleset to
+ * @filenames: the XML profiles, %NULL terminated
+ *
+ * The profiles are taken in the order of their file names, the order
+ * urfkilld reads them in. They should have been validated against
+ * profile.dtd beforehand.
+ **/
+gboolean
+urf_profile_db_compile (const char  *output,
+			char       **filenames)
+{
+	CompileInfo *info;
+	XML_Parser parser;
+	GPtrArray *sorted;
+	char **names;
+	char **checksums;
+	guint32 *sizes;
+	char *content;
+	gsize length;
+	gboolean ret = FALSE;
+	guint n_files;
+	guint i;
+
+	n_files = g_strv_length (filenames);
+	sorted = g_ptr_array_sized_new (n_files);
+	for (i = 0; i < n_files; i++)
+		g_ptr_array_add (sorted, filenames[i]);
+	g_ptr_array_sort (sorted, basename_sorter);
+
+	names = g_new0 (char *, n_files + 1);
+	checksums = g_new0 (char *, n_files + 1);
+	sizes = g_new0 (guint32, n_files);
+
+	info = g_new0 (CompileInfo, 1);
+	info->stack = g_ptr_array_new ();
+	info->conds = g_ptr_array_new_with_free_func ((GDestroyNotify) build_cond_free);
+	info->rules = g_ptr_array_new_with_free_func ((GDestroyNotify) build_rule_free);
+	info->cdata = g_string_new (NULL);
+
+	for (i = 0; i < n_files; i++) {
+		const char *filename = g_ptr_array_index (sorted, i);
+
+		if (!g_file_get_contents (filename, &content, &length, NULL)) {
+			g_warning ("Failed to read profile: %s", filename);
+			goto out;
+		}
+		names[i] = g_path_get_basename (filename);
+		sizes[i] = length;
+		checksums[i] = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+							    (const guchar *)content,
+							    length);
+
+		g_ptr_array_set_size (info->stack, 0);
+		info->open_rule = NULL;
+		info->in_option = FALSE;
+
+		parser = XML_ParserCreate (NULL);
+		XML_SetUserData (parser, (void *)info);
+		XML_SetElementHandler (parser,
+				       compile_xml_start_element,
+				       compile_xml_end_element);
+		XML_SetCharacterDataHandler (parser,
+					     compile_xml_cdata_handler);
+
+		if (XML_Parse (parser, content, (int) length, 1) == XML_STATUS_ERROR) {
+			g_warning ("Profile Parse error: %s", filename);
+			XML_ParserFree (parser);
+			g_free (content);
+			goto out;
+		}
+
+		XML_ParserFree (parser);
+		g_free (content);
+	}
+
+	ret = profile_db_write (output, names, sizes, checksums, info->rules);
+out:
+	g_string_free (info->cdata, TRUE);
+	g_ptr_array_unref (info->rules);
+	g_ptr_array_unref (info->conds);
+	g_ptr_array_unref (info->stack);
+	g_free (info);
+	g_strfreev (names);
+	g_strfreev (checksums);
+	g_free (sizes);
+	g_ptr_array_unref (sorted);
+
+	return ret;
+}
+
+static gconstpointer
+get_section (GMappedFile *file,
+	     guint32      offset,
+	     guint32      n_entries,
+	     gsize        entry_size)
+{
+	if (offset % sizeof (guint32) != 0 ||
+	    (guint64) offset + (guint64) n_entries * entry_size > g_mapped_file_get_length (file))
+		return NULL;
+
+	return g_mapped_file_get_contents (file) + offset;
+}
+
+static gboolean
+range_valid (guint32 first,
+	     guint32 n,
+	     guint32 size)
+{
+	return (guint64) first + n <= size;
+}
+
+/**
+ * profile_db_validate:
+ *
+ * Check every index and string offset once, so that matching can
+ * follow them without checks.
+ **/
+static gboolean
+profile_db_validate (UrfProfileDb *db)
+{
+	const ProfileDbCond *cond;
+	const ProfileDbRule *rule;
+	const ProfileDbVendor *vendor;
+	const ProfileDbOpt *opt;
+	guint32 index, oper;
+	guint i;
+
+	if (db->strings_size > 0 && db->strings[db->strings_size - 1] != '\0')
+		return FALSE;
+
+	for (i = 0; i < db->n_files; i++) {
+		if (LE (db->files[i].name) >= db->strings_size ||
+		    LE (db->files[i].checksum) >= db->strings_size)
+			return FALSE;
+	}
+
+	for (i = 0; i < db->n_vendors; i++) {
+		vendor = &db->vendors[i];
+		index = LE (vendor->cond);
+		if (index != PROFILE_DB_NO_COND && index >= db->n_conds)
+			return FALSE;
+		if (!range_valid (LE (vendor->first_rule), LE (vendor->n_rules), db->n_rules))
+			return FALSE;
+	}
+
+	/* Sorted, or the binary search would miss names */
+	for (i = 0; i < db->n_vendor_names; i++) {
+		if (LE (db->vendor_names[i].name) >= db->strings_size ||
+		    LE (db->vendor_names[i].vendor) >= db->n_vendors)
+			return FALSE;
+		if (i > 0 &&
+		    strcmp (db->strings + LE (db->vendor_names[i-1].name),
+			    db->strings + LE (db->vendor_names[i].name)) > 0)
+			return FALSE;
+	}
+
+	for (i = 0; i < db->n_vendor_scan; i++) {
+		if (LE (db->vendor_scan[i]) >= db->n_vendors)
+			return FALSE;
+	}
+
+	for (i = 0; i < db->n_rules; i++) {
+		rule = &db->rules[i];
+		if (!range_valid (LE (rule->first_cond), LE (rule->n_conds), db->n_conds) ||
+		    !range_valid (LE (rule->first_opt), LE (rule->n_opts), db->n_opts))
+			return FALSE;
+	}
+
+	for (i = 0; i < db->n_conds; i++) {
+		cond = &db->conds[i];
+		oper = LE (cond->oper);
+		if (LE (cond->key) >= NUM_KEYS || oper >= OPER_UNKNOWN ||
+		    oper == OPER_STRING_OUTOF || oper == OPER_CONTAINS_OUTOF ||
+		    oper == OPER_PREFIX_OUTOF || oper == OPER_SUFFIX_OUTOF)
+			return FALSE;
+		if (!range_valid (LE (cond->first_alt), LE (cond->n_alts), db->n_alts))
+			return FALSE;
+	}
+
+	for (i = 0; i < db->n_alts; i++) {
+		if (LE (db->alts[i]) >= db->strings_size)
+			return FALSE;
+	}
+
+	for (i = 0; i < db->n_opts; i++) {
+		opt = &db->opts[i];
+		if (LE (opt->opt) <= OPT_NONE || LE (opt->opt) >= OPT_UNKNOWN ||
+		    LE (opt->value) > 1)
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * urf_profile_db_open:
+ *
+ * Map a ruleset written by urf_profile_db_compile().
+ *
+ * Return value: the ruleset, or %NULL if there is none or it is broken
+ **/
+UrfProfileDb *
+urf_profile_db_open (const char *filename)
+{
+	UrfProfileDb *db;
+	GMappedFile *file;
+	const ProfileDbHeader *header;
+	GError *error = NULL;
+
+	file = g_mapped_file_new (filename, FALSE, &error);
+	if (file == NULL) {
+		if (!g_error_matches (error, G_FILE_ERROR, G_FILE_ERROR_NOENT))
+			g_warning ("Failed to map the compiled profiles: %s", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	header = (const ProfileDbHeader *) g_mapped_file_get_contents (file);
+	if (g_mapped_file_get_length (file) < sizeof (ProfileDbHeader) ||
+	    memcmp (header->magic, PROFILE_DB_MAGIC, sizeof (header->magic)) != 0) {
+		g_warning ("Unknown format of the compiled profiles: %s", filename);
+		g_mapped_file_unref (file);
+		return NULL;
+	}
+
+	db = g_new0 (UrfProfileDb, 1);
+	db->file = file;
+	db->n_files = LE (header->n_files);
+	db->files = get_section (file, LE (header->files),
+				 db->n_files, sizeof (ProfileDbFile));
+	db->n_vendors = LE (header->n_vendors);
+	db->vendors = get_section (file, LE (header->vendors),
+				   db->n_vendors, sizeof (ProfileDbVendor));
+	db->n_vendor_names = LE (header->n_vendor_names);
+	db->vendor_names = get_section (file, LE (header->vendor_names),
+					db->n_vendor_names, sizeof (ProfileDbVendorName));
+	db->n_vendor_scan = LE (header->n_vendor_scan);
+	db->vendor_scan = get_section (file, LE (header->vendor_scan),
+				       db->n_vendor_scan, sizeof (guint32));
+	db->n_rules = LE (header->n_rules);
+	db->rules = get_section (file, LE (header->rules),
+				 db->n_rules, sizeof (ProfileDbRule));
+	db->n_conds = LE (header->n_conds);
+	db->conds = get_section (file, LE (header->conds),
+				 db->n_conds, sizeof (ProfileDbCond));
+	db->n_alts = LE (header->n_alts);
+	db->alts = get_section (file, LE (header->alts),
+				db->n_alts, sizeof (guint32));
+	db->n_opts = LE (header->n_opts);
+	db->opts = get_section (file, LE (header->opts),
+				db->n_opts, sizeof (ProfileDbOpt));
+	db->strings_size = LE (header->strings_size);
+	db->strings = get_section (file, LE (header->strings),
+				   db->strings_size, 1);
+
+	if (db->files == NULL || db->vendors == NULL ||
+	    db->vendor_names == NULL || db->vendor_scan == NULL || db->rules == NULL ||
+	    db->conds == NULL || db->alts == NULL || db->opts == NULL ||
+	    db->strings == NULL || !profile_db_validate (db)) {
+		g_warning ("The compiled profiles are corrupt: %s", filename);
+		urf_profile_db_free (db);
+		return NULL;
+	}
+
+	return db;
+}
+
+/**
+ * urf_profile_db_covers:
+ * @dir: the directory of the XML profiles
+ * @profile_list: the sorted file names of the XML profiles
+ *
+ * Reading the profiles costs much less than parsing them, so their
+ * content is compared, not just their sizes.
+ *
+ * Return value: %TRUE if the ruleset was compiled from exactly these
+ *               profiles, with the content they have now
+ **/
+gboolean
+urf_profile_db_covers (UrfProfileDb *db,
+		       const char   *dir,
+		       GList        *profile_list)
+{
+	GList *lptr;
+	char *full;
+	char *content;
+	char *checksum;
+	gsize length;
+	gboolean ret;
+	guint i = 0;
+
+	for (lptr = profile_list; lptr; lptr = lptr->next, i++) {
+		if (i >= db->n_files ||
+		    g_strcmp0 (lptr->data, db->strings + LE (db->files[i].name)) != 0)
+			return FALSE;
+
+		full = g_build_filename (dir, (const char *)lptr->data, NULL);
+		ret = g_file_get_contents (full, &content, &length, NULL);
+		g_free (full);
+		if (!ret)
+			return FALSE;
+
+		ret = (length == LE (db->files[i].size));
+		if (ret) {
+			checksum = g_compute_checksum_for_data (G_CHECKSUM_SHA256,
+								(const guchar *)content,
+								length);
+			ret = (g_strcmp0 (checksum, db->strings + LE (db->files[i].checksum)) == 0);
+			g_free (checksum);
+		}
+		g_free (content);
+
+		if (!ret)
+			return FALSE;
+	}
+
+	return i == db->n_files;
+}
+
+/**
+ * match_alternative:
+ *
+ * match_rule() for a compiled condition: @str is not empty, and an
+ * _ncase @alt is lower case already.
+ **/
+static gboolean
+match_alternative (const char *str,
+		   const char *str_lower,
+		   guint32     oper,
+		   const char *alt)
+{
+	switch (oper) {
+	case OPER_STRING:
+		return strcmp (str, alt) == 0;
+	case OPER_CONTAINS:
+		return strstr (str, alt) != NULL;
+	case OPER_CONTAINS_NCASE:
+		return str_lower && strstr (str_lower, alt) != NULL;
+	case OPER_CONTAINS_NOT:
+		return strstr (str, alt) == NULL;
+	case OPER_PREFIX:
+		return g_str_has_prefix (str, alt);
+	case OPER_PREFIX_NCASE:
+		return str_lower && g_str_has_prefix (str_lower, alt);
+	case OPER_SUFFIX:
+		return g_str_has_suffix (str, alt);
+	case OPER_SUFFIX_NCASE:
+		return str_lower && g_str_has_suffix (str_lower, alt);
+	default:
+		return FALSE;
+	}
+}
+
+static gboolean
+match_cond (UrfProfileDb  *db,
+	    guint32        index,
+	    DmiInfo       *hardware_info,
+	    DmiInfo       *hardware_info_lower)
+{
+	const ProfileDbCond *cond = &db->conds[index];
+	const char *str;
+	const char *str_lower;
+	guint32 key, oper, first, n;
+	guint32 i;
+
+	/* Like the XML path, a key the machine has no value for matches */
+	key = LE (cond->key);
+	str = get_dmi_field (hardware_info, key);
+	if (str == NULL)
+		return TRUE;
+	if (str[0] == '\0')
+		return FALSE;
+	str_lower = get_dmi_field (hardware_info_lower, key);
+
+	oper = LE (cond->oper);
+	first = LE (cond->first_alt);
+	n = LE (cond->n_alts);
+	for (i = first; i < first + n; i++) {
+		if (match_alternative (str, str_lower, oper,
+				       db->strings + LE (db->alts[i])))
+			return TRUE;
+	}
+
+	return FALSE;
+}
+
+static gint
+rule_sorter (gconstpointer a,
+	     gconstpointer b,
+	     gpointer      user_data)
+{
+	UrfProfileDb *db = user_data;
+	guint32 seq_a = LE (db->rules[*(const guint32 *)a].seq);
+	guint32 seq_b = LE (db->rules[*(const guint32 *)b].seq);
+
+	return seq_a < seq_b ? -1 : seq_a > seq_b;
+}
+
+/**
+ * match_vendor:
+ *
+ * Collect the rules of a bucket whose vendor condition matched.
+ **/
+static void
+match_vendor (UrfProfileDb  *db,
+	      guint32        vendor_index,
+	      DmiInfo       *hardware_info,
+	      DmiInfo       *hardware_info_lower,
+	      GArray        *matched)
+{
+	const ProfileDbVendor *vendor = &db->vendors[vendor_index];
+	const ProfileDbRule *rule;
+	guint32 index, first, n;
+	guint32 cond_first, cond_n;
+	guint32 j;
+	gboolean match;
+
+	first = LE (vendor->first_rule);
+	n = LE (vendor->n_rules);
+	for (index = first; index < first + n; index++) {
+		rule = &db->rules[index];
+		cond_first = LE (rule->first_cond);
+		cond_n = LE (rule->n_conds);
+		match = TRUE;
+		for (j = cond_first; match && j < cond_first + cond_n; j++)
+			match = match_cond (db, j, hardware_info, hardware_info_lower);
+		if (match)
+			g_array_append_val (matched, index);
+	}
+}
+
+/**
+ * find_vendor_name:
+ *
+ * Return value: the first entry for @sys_vendor in the sorted vendor
+ *               names, or n_vendor_names if there is none
+ **/
+static guint32
+find_vendor_name (UrfProfileDb *db,
+		  const char   *sys_vendor)
+{
+	guint32 low = 0;
+	guint32 high = db->n_vendor_names;
+	guint32 mid;
+
+	while (low < high) {
+		mid = low + (high - low) / 2;
+		if (strcmp (db->strings + LE (db->vendor_names[mid].name), sys_vendor) < 0)
+			low = mid + 1;
+		else
+			high = mid;
+	}
+
+	if (low < db->n_vendor_names &&
+	    strcmp (db->strings + LE (db->vendor_names[low].name), sys_vendor) == 0)
+		return low;
+
+	return db->n_vendor_names;
+}
+
+/**
+ * urf_profile_db_apply:
+ * @hardware_info: the DMI information of the machine
+ * @hardware_info_lower: the same in lower case
+ * @options: the options to update with what the profiles set
+ *
+ * Give @options the values that parsing every profile with
+ * urf_profile_xml_apply() would.
+ **/
+void
+urf_profile_db_apply (UrfProfileDb      *db,
+		      DmiInfo           *hardware_info,
+		      DmiInfo           *hardware_info_lower,
+		      UrfProfileOptions *options)
+{
+	const ProfileDbRule *rule;
+	const ProfileDbOpt *opt;
+	const char *sys_vendor;
+	GArray *matched;
+	guint32 index, first, n;
+	guint32 i, j;
+
+	matched = g_array_new (FALSE, FALSE, sizeof (guint32));
+	sys_vendor = get_dmi_field (hardware_info, KEY_SYS_VENDOR);
+
+	if (sys_vendor == NULL) {
+		/* Every vendor condition matches a machine without one */
+		for (i = 0; i < db->n_vendors; i++)
+			match_vendor (db, i, hardware_info, hardware_info_lower, matched);
+	} else {
+		for (i = find_vendor_name (db, sys_vendor);
+		     i < db->n_vendor_names &&
+		     strcmp (db->strings + LE (db->vendor_names[i].name), sys_vendor) == 0;
+		     i++)
+			match_vendor (db, LE (db->vendor_names[i].vendor),
+				      hardware_info, hardware_info_lower, matched);
+
+		for (i = 0; i < db->n_vendor_scan; i++) {
+			index = LE (db->vendor_scan[i]);
+			if (LE (db->vendors[index].cond) != PROFILE_DB_NO_COND &&
+			    !match_cond (db, LE (db->vendors[index].cond),
+					 hardware_info, hardware_info_lower))
+				continue;
+			match_vendor (db, index, hardware_info, hardware_info_lower, matched);
+		}
+	}
+
+	/* Later profiles and later options win, as in the XML path */
+	g_array_sort_with_data (matched, rule_sorter, db);
+	for (i = 0; i < matched->len; i++) {
+		rule = &db->rules[g_array_index (matched, guint32, i)];
+		first = LE (rule->first_opt);
+		n = LE (rule->n_opts);
+		for (j = first; j < first + n; j++) {
+			opt = &db->opts[j];
+			set_option (options, LE (opt->opt), LE (opt->value));
+		}
+	}
+
+	g_array_free (matched, TRUE);
+}
+
+/**
+ * urf_profile_db_free:
+ **/
+void
+urf_profile_db_free (UrfProfileDb *db)
+{
+	if (db == NULL)
+		return;
+
+	g_mapped_file_unref (db->file);
+	g_free (db);
+}
@@ -0,0 +1,60 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 The urfkill authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __URF_PROFILE_H__
+#define __URF_PROFILE_H__
+
+#include <glib.h>
+
+#include "urf-utils.h"
+
+G_BEGIN_DECLS
+
+typedef struct {
+	gboolean key_control;
+	gboolean master_key;
+	gboolean force_sync;
+	gboolean persist;
+} UrfProfileOptions;
+
+typedef struct UrfProfileDb UrfProfileDb;
+
+/* Match the DMI information against one XML profile */
+gboolean	 urf_profile_xml_apply		(DmiInfo		*hardware_info,
+						 DmiInfo		*hardware_info_lower,
+						 UrfProfileOptions	*options,
+						 const char		*filename);
+
+/* The XML profiles compiled into one ruleset indexed by sys_vendor */
+gboolean	 urf_profile_db_compile		(const char		*output,
+						 char			**filenames);
+UrfProfileDb	*urf_profile_db_open		(const char		*filename);
+gboolean	 urf_profile_db_covers		(UrfProfileDb		*db,
+						 const char		*dir,
+						 GList			*profile_list);
+void		 urf_profile_db_apply		(UrfProfileDb		*db,
+						 DmiInfo		*hardware_info,
+						 DmiInfo		*hardware_info_lower,
+						 UrfProfileOptions	*options);
+void		 urf_profile_db_free		(UrfProfileDb		*db);
+
+G_END_DECLS
+
+#endif /* __URF_PROFILE_H__ */
@@ -0,0 +1,276 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 The urfkill authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifdef HAVE_CONFIG_H
+#include <config.h>
+#endif
+
+#include <errno.h>
+#include <string.h>
+#include <unistd.h>
+
+#include <glib.h>
+
+#include "urf-rfkill-writer.h"
+#include "urf-utils.h"
+
+#define URF_RFKILL_WRITER_GET_PRIVATE(obj) (G_TYPE_INSTANCE_GET_PRIVATE((obj), \
+                                URF_TYPE_RFKILL_WRITER, UrfRfkillWriterPrivate))
+
+struct UrfRfkillWriterPrivate {
+	int		 fd;
+	GArray		*queue; /* struct rfkill_event waiting for flush */
+	GArray		*failed; /* struct rfkill_event rejected by the last flush */
+	guint		 n_queued;
+	guint		 n_superseded;
+	guint		 n_writes;
+};
+
+G_DEFINE_TYPE(UrfRfkillWriter, urf_rfkill_writer, G_TYPE_OBJECT)
+
+/**
+ * supersedes:
+ *
+ * Return value: #TRUE if writing @new makes writing @old pointless
+ **/
+static gboolean
+supersedes (const struct rfkill_event *new,
+	    const struct rfkill_event *old)
+{
+	if (new->op == RFKILL_OP_CHANGE_ALL)
+		return (old->type == new->type);
+
+	return (old->op == RFKILL_OP_CHANGE && old->idx == new->idx);
+}
+
+/**
+ * urf_rfkill_writer_queue:
+ *
+ * Queue a request for the rfkill control device. A queued request
+ * replaces any earlier request it makes redundant, so flushing the queue
+ * never writes the same device twice.
+ **/
+void
+urf_rfkill_writer_queue (UrfRfkillWriter *writer,
+			 guint8           op,
+			 guint32          index,
+			 guint8           type,
+			 gboolean         soft)
+{
+	UrfRfkillWriterPrivate *priv;
+	struct rfkill_event event;
+	guint i;
+
+	g_return_if_fail (URF_IS_RFKILL_WRITER (writer));
+	g_return_if_fail (op == RFKILL_OP_CHANGE || op == RFKILL_OP_CHANGE_ALL);
+
+	priv = writer->priv;
+
+	memset (&event, 0, sizeof(event));
+	event.op = op;
+	event.idx = index;
+	event.type = type;
+	event.soft = soft ? 1 : 0;
+
+	for (i = 0; i < priv->queue->len; ) {
+		if (supersedes (&event, &g_array_index (priv->queue, struct rfkill_event, i))) {
+			g_array_remove_index (priv->queue, i);
+			priv->n_superseded++;
+		} else {
+			i++;
+		}
+	}
+
+	g_array_append_val (priv->queue, event);
+	priv->n_queued++;
+}
+
+/**
+ * urf_rfkill_writer_flush:
+ *
+ * Write every queued request to the rfkill control device. The kernel
+ * accepts a single event per write(), so the queue is written back to
+ * back in one pass.
+ *
+ * Return value: #TRUE if all requests were accepted, otherwise #FALSE
+ **/
+gboolean
+urf_rfkill_writer_flush (UrfRfkillWriter *writer)
+{
+	UrfRfkillWriterPrivate *priv;
+	struct rfkill_event *event;
+	gboolean ret = TRUE;
+	ssize_t len;
+	guint i;
+
+	g_return_val_if_fail (URF_IS_RFKILL_WRITER (writer), FALSE);
+
+	priv = writer->priv;
+
+	g_array_set_size (priv->failed, 0);
+
+	for (i = 0; i < priv->queue->len; i++) {
+		event = &g_array_index (priv->queue, struct rfkill_event, i);
+
+		do {
+			len = write (priv->fd, event, sizeof(*event));
+			priv->n_writes++;
+		} while (len < 0 && errno == EINTR);
+
+		if (len < 0) {
+			g_warning ("Failed to change RFKILL state of %s %u: %s",
+				   type_to_string (event->type),
+				   event->idx,
+				   g_strerror (errno));
+			g_array_append_val (priv->failed, *event);
+			ret = FALSE;
+		}
+	}
+
+	if (priv->queue->len > 0)
+		g_debug ("Flushed %u RFKILL requests (%u queued, %u superseded, %u writes so far)",
+			 priv->queue->len, priv->n_queued,
+			 priv->n_superseded, priv->n_writes);
+
+	g_array_set_size (priv->queue, 0);
+
+	return ret;
+}
+
+/**
+ * urf_rfkill_writer_flushed:
+ *
+ * Tell whether the change of the device @index of @type reached the
+ * kernel in the last flush, either by itself or through a CHANGE_ALL of
+ * its type. Batched callers use this to report a result per device.
+ *
+ * Return value: #FALSE if a request covering the device was rejected
+ **/
+gboolean
+urf_rfkill_writer_flushed (UrfRfkillWriter *writer,
+			   guint32          index,
+			   guint8           type)
+{
+	struct rfkill_event *event;
+	guint i;
+
+	g_return_val_if_fail (URF_IS_RFKILL_WRITER (writer), FALSE);
+
+	for (i = 0; i < writer->priv->failed->len; i++) {
+		event = &g_array_index (writer->priv->failed, struct rfkill_event, i);
+
+		if (event->op == RFKILL_OP_CHANGE && event->idx == index)
+			return FALSE;
+		if (event->op == RFKILL_OP_CHANGE_ALL &&
+		    (event->type == type || event->type == RFKILL_TYPE_ALL))
+			return FALSE;
+	}
+
+	return TRUE;
+}
+
+/**
+ * urf_rfkill_writer_get_counters:
+ *
+ * Report how many requests were queued, how many of them were dropped
+ * because a later request made them redundant, and how many write()
+ * calls reached the kernel since the writer was created.
+ **/
+void
+urf_rfkill_writer_get_counters (UrfRfkillWriter *writer,
+				guint           *n_queued,
+				guint           *n_superseded,
+				guint           *n_writes)
+{
+	g_return_if_fail (URF_IS_RFKILL_WRITER (writer));
+
+	if (n_queued)
+		*n_queued = writer->priv->n_queued;
+	if (n_superseded)
+		*n_superseded = writer->priv->n_superseded;
+	if (n_writes)
+		*n_writes = writer->priv->n_writes;
+}
+
+/**
+ * urf_rfkill_writer_set_fd:
+ *
+ * The writer does not own @fd; it must stay open for as long as the
+ * writer is in use.
+ **/
+void
+urf_rfkill_writer_set_fd (UrfRfkillWriter *writer,
+			  int              fd)
+{
+	g_return_if_fail (URF_IS_RFKILL_WRITER (writer));
+
+	writer->priv->fd = fd;
+}
+
+/**
+ * urf_rfkill_writer_init:
+ **/
+static void
+urf_rfkill_writer_init (UrfRfkillWriter *writer)
+{
+	writer->priv = URF_RFKILL_WRITER_GET_PRIVATE (writer);
+	writer->priv->fd = -1;
+	writer->priv->queue = g_array_new (FALSE, FALSE, sizeof (struct rfkill_event));
+	writer->priv->failed = g_array_new (FALSE, FALSE, sizeof (struct rfkill_event));
+}
+
+/**
+ * urf_rfkill_writer_finalize:
+ **/
+static void
+urf_rfkill_writer_finalize (GObject *object)
+{
+	UrfRfkillWriterPrivate *priv = URF_RFKILL_WRITER_GET_PRIVATE (object);
+
+	if (priv->queue->len > 0)
+		g_warning ("Dropping %u unflushed RFKILL requests", priv->queue->len);
+	g_array_free (priv->queue, TRUE);
+	g_array_free (priv->failed, TRUE);
+
+	G_OBJECT_CLASS(urf_rfkill_writer_parent_class)->finalize(object);
+}
+
+/**
+ * urf_rfkill_writer_class_init:
+ **/
+static void
+urf_rfkill_writer_class_init (UrfRfkillWriterClass *klass)
+{
+	GObjectClass *object_class = (GObjectClass *) klass;
+
+	g_type_class_add_private(klass, sizeof(UrfRfkillWriterPrivate));
+	object_class->finalize = urf_rfkill_writer_finalize;
+}
+
+/**
+ * urf_rfkill_writer_new:
+ **/
+UrfRfkillWriter *
+urf_rfkill_writer_new (void)
+{
+	UrfRfkillWriter *writer;
+	writer = URF_RFKILL_WRITER (g_object_new (URF_TYPE_RFKILL_WRITER, NULL));
+	return writer;
+}
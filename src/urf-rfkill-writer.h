@@ -0,0 +1,73 @@
+/* -*- Mode: C; tab-width: 8; indent-tabs-mode: t; c-basic-offset: 8 -*-
+ *
+ * Copyright (C) 2014 The urfkill authors
+ *
+ * This program is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published by
+ * the Free Software Foundation; either version 2 of the License, or
+ * (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful,
+ * but WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ * GNU General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 51 Franklin St, Fifth Floor, Boston, MA  02110-1301  USA
+ *
+ */
+
+#ifndef __URF_RFKILL_WRITER_H__
+#define __URF_RFKILL_WRITER_H__
+
+#include <glib-object.h>
+#include <linux/rfkill.h>
+
+G_BEGIN_DECLS
+
+#define URF_TYPE_RFKILL_WRITER (urf_rfkill_writer_get_type())
+#define URF_RFKILL_WRITER(obj) (G_TYPE_CHECK_INSTANCE_CAST((obj), \
+					URF_TYPE_RFKILL_WRITER, UrfRfkillWriter))
+#define URF_RFKILL_WRITER_CLASS(klass) (G_TYPE_CHECK_CLASS_CAST((klass), \
+					URF_TYPE_RFKILL_WRITER, UrfRfkillWriterClass))
+#define URF_IS_RFKILL_WRITER(obj) (G_TYPE_CHECK_INSTANCE_TYPE((obj), \
+					URF_TYPE_RFKILL_WRITER))
+#define URF_IS_RFKILL_WRITER_CLASS(klass) (G_TYPE_CHECK_CLASS_TYPE((klass), \
+					URF_TYPE_RFKILL_WRITER))
+#define URF_GET_RFKILL_WRITER_CLASS(obj) (G_TYPE_INSTANCE_GET_CLASS((obj), \
+					URF_TYPE_RFKILL_WRITER, UrfRfkillWriterClass))
+
+typedef struct UrfRfkillWriterPrivate UrfRfkillWriterPrivate;
+
+typedef struct {
+	GObject			 parent;
+	UrfRfkillWriterPrivate	*priv;
+} UrfRfkillWriter;
+
+typedef struct {
+	GObjectClass		 parent_class;
+} UrfRfkillWriterClass;
+
+GType			 urf_rfkill_writer_get_type		(void);
+UrfRfkillWriter		*urf_rfkill_writer_new			(void);
+void			 urf_rfkill_writer_set_fd		(UrfRfkillWriter	*writer,
+								 int			 fd);
+
+void			 urf_rfkill_writer_queue		(UrfRfkillWriter	*writer,
+								 guint8			 op,
+								 guint32		 index,
+								 guint8			 type,
+								 gboolean		 soft);
+gboolean		 urf_rfkill_writer_flush		(UrfRfkillWriter	*writer);
+gboolean		 urf_rfkill_writer_flushed		(UrfRfkillWriter	*writer,
+								 guint32		 index,
+								 guint8			 type);
+void			 urf_rfkill_writer_get_counters		(UrfRfkillWriter	*writer,
+								 guint			*n_queued,
+								 guint			*n_superseded,
+								 guint			*n_writes);
+
+G_END_DECLS
+
+#endif /* __URF_RFKILL_WRITER_H__ */
@@ -66,25 +66,30 @@ urf_seat_get_active (UrfSeat *seat)
 }
 
 /**
- * urf_seat_proxy_signal_cb:
+ * urf_seat_proxy_properties_changed:
  **/
 static void
 urf_seat_proxy_properties_changed (GDBusProxy *proxy,
-                                   gchar *property,
-                                   GVariant *value,
+                                   GVariant *changed_properties,
+                                   GStrv invalidated_properties,
                                    gpointer user_data)
 {
 	UrfSeat *seat = URF_SEAT (user_data);
-	char *session_name, *session_path;
+	GVariant *value;
+	const char *session_name, *session_path;
 
-	if (g_strcmp0 (property, "ActiveSession") == 0) {
-		g_variant_get (value, "(so)", &session_name, &session_path);
+	value = g_variant_lookup_value (changed_properties, "ActiveSession",
+					G_VARIANT_TYPE ("(so)"));
+	if (value == NULL)
+		return;
 
-		g_free (seat->priv->active);
-		seat->priv->active = g_strdup (session_path);
+	g_variant_get (value, "(&s&o)", &session_name, &session_path);
 
-		g_signal_emit (seat, signals[SIGNAL_ACTIVE_CHANGED], 0, session_path);
-	}
+	g_free (seat->priv->active);
+	seat->priv->active = g_strdup (session_path);
+
+	g_signal_emit (seat, signals[SIGNAL_ACTIVE_CHANGED], 0, session_path);
+	g_variant_unref (value);
 }
 
 /**
@@ -96,7 +101,7 @@ urf_seat_object_path_sync (UrfSeat *seat,
 {
 	UrfSeatPrivate *priv = seat->priv;
 	GVariant *retval;
-	char *session_name, *session_path;
+	const char *session_name, *session_path;
 	GError *error;
 
 	priv->object_path = g_strdup (object_path);
@@ -122,7 +127,7 @@ urf_seat_object_path_sync (UrfSeat *seat,
 		return FALSE;
 	}
 
-	g_variant_get (retval, "(so)", &session_name, &session_path);
+	g_variant_get (retval, "(&s&o)", &session_name, &session_path);
 	priv->active = g_strdup (session_path);
 	g_variant_unref (retval);
 
@@ -24,6 +24,7 @@
 
 #include <glib.h>
 #include <string.h>
+#include <sys/types.h>
 #include <gio/gio.h>
 
 #include "urf-session-checker-consolekit.h"
@@ -35,12 +36,22 @@ typedef struct {
 	char		*reason;
 } UrfInhibitor;
 
+/* A seat and the active session it was last counted with */
+typedef struct {
+	UrfSeat		*seat;
+	char		*active;
+} UrfSeatEntry;
+
 struct UrfConsolekitPrivate {
 	GDBusProxy	*proxy;
 	GDBusProxy	*bus_proxy;
-	GList		*seats;
-	GList		*inhibitors;
-	gboolean	 inhibit;
+	GHashTable	*seats; /* object path -> UrfSeatEntry */
+	GHashTable	*inhibitors; /* cookie -> UrfInhibitor */
+	GHashTable	*inhibitors_by_bus_name; /* bus name -> UrfInhibitor */
+	GHashTable	*inhibitor_counts; /* session -> number of inhibitors */
+	GHashTable	*active_counts; /* session -> number of seats it is active on */
+	guint		 inhibited_seats; /* seats with an inhibitor in their active session */
+	GHashTable	*sessions; /* bus name -> UrfClientSession */
 };
 
 G_DEFINE_TYPE (UrfSessionChecker, urf_session_checker, G_TYPE_OBJECT)
@@ -48,102 +59,108 @@ G_DEFINE_TYPE (UrfSessionChecker, urf_session_checker, G_TYPE_OBJECT)
 #define URF_SESSION_CHECKER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
 				URF_TYPE_SESSION_CHECKER, UrfConsolekitPrivate))
 
-/**
- * urf_session_checker_is_inhibited:
- **/
 gboolean
 urf_session_checker_is_inhibited (UrfSessionChecker *consolekit)
 {
-	return consolekit->priv->inhibit;
+	return consolekit->priv->inhibited_seats > 0;
 }
 
-/**
- * urf_session_checker_find_seat:
- **/
 static UrfSeat *
 urf_session_checker_find_seat (UrfSessionChecker *consolekit,
-			  const char    *object_path)
+                               const char    *object_path)
 {
-	UrfConsolekitPrivate *priv = consolekit->priv;
-	UrfSeat *seat;
-	GList *item;
+	UrfSeatEntry *entry;
 
-	for (item = priv->seats; item; item = item->next) {
-		seat = URF_SEAT (item->data);
-		if (g_strcmp0 (urf_seat_get_object_path (seat), object_path) == 0)
-			return seat;
-	}
+	entry = g_hash_table_lookup (consolekit->priv->seats, object_path);
+	return entry ? entry->seat : NULL;
+}
 
-	return NULL;
+/**
+ * session_count:
+ **/
+static guint
+session_count (GHashTable *counts,
+	       const char *session_id)
+{
+	if (session_id == NULL)
+		return 0;
+	return GPOINTER_TO_UINT (g_hash_table_lookup (counts, session_id));
 }
 
-static UrfInhibitor *
-find_inhibitor_by_sid (UrfSessionChecker *consolekit,
-		       const char    *session_id)
+/**
+ * session_count_add:
+ *
+ * Return value: the count of @session_id before adding @delta
+ **/
+static guint
+session_count_add (GHashTable *counts,
+		   const char *session_id,
+		   gint        delta)
 {
-	UrfConsolekitPrivate *priv = consolekit->priv;
-	UrfInhibitor *inhibitor;
-	GList *item;
+	guint count;
 
-	for (item = priv->inhibitors; item; item = item->next) {
-		inhibitor = (UrfInhibitor *)item->data;
-		if (g_strcmp0 (inhibitor->session_id, session_id) == 0)
-			return inhibitor;
-	}
-	return NULL;
+	if (session_id == NULL)
+		return 0;
+
+	count = session_count (counts, session_id);
+	if (count + delta == 0)
+		g_hash_table_remove (counts, session_id);
+	else
+		g_hash_table_replace (counts, g_strdup (session_id),
+				      GUINT_TO_POINTER (count + delta));
+	return count;
 }
 
 static UrfInhibitor *
 find_inhibitor_by_bus_name (UrfSessionChecker *consolekit,
 			    const char    *bus_name)
 {
-	UrfConsolekitPrivate *priv = consolekit->priv;
-	UrfInhibitor *inhibitor;
-	GList *item;
-
-	for (item = priv->inhibitors; item; item = item->next) {
-		inhibitor = (UrfInhibitor *)item->data;
-		if (g_strcmp0 (inhibitor->bus_name, bus_name) == 0)
-			return inhibitor;
-	}
-	return NULL;
+	return g_hash_table_lookup (consolekit->priv->inhibitors_by_bus_name, bus_name);
 }
 
 static UrfInhibitor *
 find_inhibitor_by_cookie (UrfSessionChecker *consolekit,
 			  const guint    cookie)
 {
-	UrfConsolekitPrivate *priv = consolekit->priv;
-	UrfInhibitor *inhibitor;
-	GList *item;
-
 	if (cookie == 0)
 		return NULL;
 
-	for (item = priv->inhibitors; item; item = item->next) {
-		inhibitor = (UrfInhibitor *)item->data;
-		if (inhibitor->cookie == cookie)
-			return inhibitor;
-	}
-	return NULL;
+	return g_hash_table_lookup (consolekit->priv->inhibitors, GUINT_TO_POINTER (cookie));
 }
 
-static gboolean
-is_inhibited (UrfSessionChecker *consolekit)
+/**
+ * add_inhibitor:
+ *
+ * The first inhibitor of a session inhibits every seat the session is
+ * active on.
+ **/
+static void
+add_inhibitor (UrfSessionChecker *consolekit,
+	       UrfInhibitor      *inhibitor)
 {
 	UrfConsolekitPrivate *priv = consolekit->priv;
-	UrfSeat *seat;
-	const char *active_id;
-	GList *item;
-
-	for (item = priv->seats; item; item = item->next) {
-		seat = URF_SEAT (item->data);
-		active_id = urf_seat_get_active (seat);
-		if (find_inhibitor_by_sid (consolekit, active_id))
-			return TRUE;
-	}
 
-	return FALSE;
+	g_hash_table_insert (priv->inhibitors, GUINT_TO_POINTER (inhibitor->cookie), inhibitor);
+	g_hash_table_insert (priv->inhibitors_by_bus_name, inhibitor->bus_name, inhibitor);
+
+	if (session_count_add (priv->inhibitor_counts, inhibitor->session_id, 1) == 0)
+		priv->inhibited_seats += session_count (priv->active_counts, inhibitor->session_id);
+}
+
+static void
+remove_inhibitor (UrfSessionChecker *consolekit,
+		  UrfInhibitor      *inhibitor)
+{
+	UrfConsolekitPrivate *priv = consolekit->priv;
+
+	g_return_if_fail (priv->proxy != NULL);
+
+	if (session_count_add (priv->inhibitor_counts, inhibitor->session_id, -1) == 1)
+		priv->inhibited_seats -= session_count (priv->active_counts, inhibitor->session_id);
+
+	g_debug ("Remove inhibitor: %s", inhibitor->bus_name);
+	g_hash_table_remove (priv->inhibitors_by_bus_name, inhibitor->bus_name);
+	g_hash_table_remove (priv->inhibitors, GUINT_TO_POINTER (inhibitor->cookie));
 }
 
 static void
@@ -155,6 +172,40 @@ free_inhibitor (UrfInhibitor *inhibitor)
 	g_free (inhibitor);
 }
 
+/**
+ * seat_entry_set_active:
+ **/
+static void
+seat_entry_set_active (UrfSessionChecker *consolekit,
+		       UrfSeatEntry      *entry,
+		       const char        *active)
+{
+	UrfConsolekitPrivate *priv = consolekit->priv;
+
+	if (entry->active != NULL) {
+		if (session_count (priv->inhibitor_counts, entry->active) > 0)
+			priv->inhibited_seats--;
+		session_count_add (priv->active_counts, entry->active, -1);
+		g_free (entry->active);
+	}
+
+	entry->active = g_strdup (active);
+
+	if (entry->active != NULL) {
+		session_count_add (priv->active_counts, entry->active, 1);
+		if (session_count (priv->inhibitor_counts, entry->active) > 0)
+			priv->inhibited_seats++;
+	}
+}
+
+static void
+free_seat_entry (UrfSeatEntry *entry)
+{
+	g_object_unref (entry->seat);
+	g_free (entry->active);
+	g_free (entry);
+}
+
 /**
  * urf_session_checker_seat_active_changed:
  **/
@@ -163,114 +214,318 @@ urf_session_checker_seat_active_changed (UrfSeat       *seat,
 				    const char    *session_id,
 				    UrfSessionChecker *consolekit)
 {
-	consolekit->priv->inhibit = is_inhibited (consolekit);
+	UrfSeatEntry *entry;
+
+	entry = g_hash_table_lookup (consolekit->priv->seats, urf_seat_get_object_path (seat));
+	if (entry != NULL)
+		seat_entry_set_active (consolekit, entry, urf_seat_get_active (seat));
 	g_debug ("Active Session changed: %s", session_id);
 }
 
-static char *
-get_session_id (UrfSessionChecker *consolekit,
-		const char    *bus_name)
+/* The session of a client that inhibited. A process does not change
+ * its session, so it is kept until the client leaves the bus. */
+typedef struct {
+	char		*session_id;
+	guint		 watch_id;
+} UrfClientSession;
+
+static void
+free_client_session (UrfClientSession *client)
 {
-	UrfConsolekitPrivate *priv = consolekit->priv;
-	pid_t calling_pid;
-	char *session_id = NULL;
-	GVariant *retval;
-	GError *error;
+	g_bus_unwatch_name (client->watch_id);
+	g_free (client->session_id);
+	g_free (client);
+}
 
-        error = NULL;
-	retval = g_dbus_proxy_call_sync (priv->bus_proxy, "GetConnectionUnixProcessID",
-	                                 g_variant_new ("(s)", bus_name),
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error);
-	if (error) {
-		g_warning("GetConnectionUnixProcessID() failed: %s", error->message);
-		g_error_free (error);
-		goto out;
-	}
-	g_variant_get (retval, "(u)", &calling_pid);
-	g_variant_unref (retval);
+/**
+ * urf_session_checker_name_vanished:
+ **/
+static void
+urf_session_checker_name_vanished (GDBusConnection *connection,
+				   const gchar     *name,
+				   gpointer         user_data)
+{
+	UrfSessionChecker *consolekit = URF_SESSION_CHECKER (user_data);
+	UrfInhibitor *inhibitor;
 
-        error = NULL;
-	retval = g_dbus_proxy_call_sync (priv->proxy, "GetSessionForUnixProcess",
-	                                 g_variant_new ("(u)", (guint)calling_pid),
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error);
-	if (error) {
-		g_warning ("Couldn't sent GetSessionForUnixProcess: %s", error->message);
-		g_error_free (error);
-		session_id = NULL;
-		goto out;
-	}
+	/* A process disconnected from the bus */
+	inhibitor = find_inhibitor_by_bus_name (consolekit, name);
+	if (inhibitor != NULL)
+		remove_inhibitor (consolekit, inhibitor);
 
-	g_variant_get (retval, "(s)", &session_id);
-	session_id = g_strdup (session_id);
-	g_variant_unref (retval);
-out:
-	return session_id;
+	g_hash_table_remove (consolekit->priv->sessions, name);
 }
 
+/**
+ * remember_client_session:
+ *
+ * Only the clients that inhibit are watched, rather than every name
+ * that comes and goes on the system bus.
+ **/
+static void
+remember_client_session (UrfSessionChecker *consolekit,
+			 const char        *bus_name,
+			 const char        *session_id)
+{
+	UrfConsolekitPrivate *priv = consolekit->priv;
+	UrfClientSession *client;
+
+	if (g_hash_table_lookup (priv->sessions, bus_name) != NULL)
+		return;
+
+	client = g_new0 (UrfClientSession, 1);
+	client->session_id = g_strdup (session_id);
+	g_hash_table_insert (priv->sessions, g_strdup (bus_name), client);
+
+	/* this also catches a client that left before the watch was set up */
+	client->watch_id =
+		g_bus_watch_name_on_connection (g_dbus_proxy_get_connection (priv->bus_proxy),
+						bus_name,
+						G_BUS_NAME_WATCHER_FLAGS_NONE,
+						NULL,
+						urf_session_checker_name_vanished,
+						consolekit, NULL);
+}
+
+/* An Inhibit call waiting for the session of its caller */
+typedef struct {
+	UrfSessionChecker	*consolekit;
+	GSimpleAsyncResult	*res;
+	char			*bus_name;
+	char			*reason;
+} UrfInhibitRequest;
+
 static guint
 generate_unique_cookie (UrfSessionChecker *consolekit)
 {
-	UrfInhibitor *inhibitor;
 	guint cookie;
 
 	do {
 		cookie = g_random_int_range (1, G_MAXINT);
-		inhibitor = find_inhibitor_by_cookie (consolekit, cookie);
-	} while (inhibitor != NULL);
+	} while (g_hash_table_lookup (consolekit->priv->inhibitors, GUINT_TO_POINTER (cookie)) != NULL);
 
 	return cookie;
 }
 
 /**
- * urf_session_checker_inhibit:
+ * inhibit_request_complete:
+ *
+ * Add the inhibitor once the session of the caller is known, or fail
+ * with a cookie of 0 if @session_id is %NULL.
  **/
-guint
-urf_session_checker_inhibit (UrfSessionChecker *consolekit,
-			const char    *bus_name,
-			const char    *reason)
+static void
+inhibit_request_complete (UrfInhibitRequest *request,
+			  const char        *session_id)
 {
+	UrfSessionChecker *consolekit = request->consolekit;
 	UrfConsolekitPrivate *priv = consolekit->priv;
 	UrfInhibitor *inhibitor;
+	guint cookie = 0;
+
+	/* another call from the same client may have finished first */
+	inhibitor = find_inhibitor_by_bus_name (consolekit, request->bus_name);
+	if (inhibitor) {
+		cookie = inhibitor->cookie;
+	} else if (session_id != NULL) {
+		inhibitor = g_new0 (UrfInhibitor, 1);
+		inhibitor->session_id = g_strdup (session_id);
+		inhibitor->reason = g_strdup (request->reason);
+		inhibitor->bus_name = g_strdup (request->bus_name);
+		inhibitor->cookie = generate_unique_cookie (consolekit);
+
+		add_inhibitor (consolekit, inhibitor);
+		g_debug ("Inhibit: %s for %s", request->bus_name, request->reason);
+
+		cookie = inhibitor->cookie;
+
+		/* may remove the inhibitor again if the client is gone */
+		remember_client_session (consolekit, request->bus_name, session_id);
+	}
 
-	g_return_val_if_fail (priv->proxy != NULL, 0);
+	g_simple_async_result_set_op_res_gssize (request->res, cookie);
+	g_simple_async_result_complete_in_idle (request->res);
 
-	inhibitor = find_inhibitor_by_bus_name (consolekit, bus_name);
-	if (inhibitor)
-		return inhibitor->cookie;
+	g_object_unref (request->res);
+	g_object_unref (request->consolekit);
+	g_free (request->bus_name);
+	g_free (request->reason);
+	g_free (request);
+}
 
-	inhibitor = g_new0 (UrfInhibitor, 1);
-	inhibitor->session_id = get_session_id (consolekit, bus_name);
-	if (inhibitor->session_id == NULL) {
-		g_free (inhibitor);
-		return 0;
+/**
+ * get_session_cb:
+ **/
+static void
+get_session_cb (GObject      *source_object,
+		GAsyncResult *res,
+		gpointer      user_data)
+{
+	UrfInhibitRequest *request = user_data;
+	const char *session_id = NULL;
+	GVariant *retval;
+	GError *error = NULL;
+
+	retval = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
+	if (error) {
+		g_warning ("Couldn't sent GetSessionForUnixProcess: %s", error->message);
+		g_error_free (error);
+	} else {
+		g_variant_get (retval, "(&s)", &session_id);
 	}
 
-	inhibitor->reason = g_strdup (reason);
-	inhibitor->bus_name = g_strdup (bus_name);
-	inhibitor->cookie = generate_unique_cookie (consolekit);
+	inhibit_request_complete (request, session_id);
 
-	priv->inhibitors = g_list_prepend (priv->inhibitors, inhibitor);
+	if (retval)
+		g_variant_unref (retval);
+}
 
-	consolekit->priv->inhibit = is_inhibited (consolekit);
-	g_debug ("Inhibit: %s for %s", bus_name, reason);
+/**
+ * inhibit_request_got_pid:
+ **/
+static void
+inhibit_request_got_pid (UrfInhibitRequest *request,
+			 pid_t              pid)
+{
+	g_dbus_proxy_call (request->consolekit->priv->proxy, "GetSessionForUnixProcess",
+	                   g_variant_new ("(u)", (guint32) pid),
+	                   G_DBUS_CALL_FLAGS_NONE,
+	                   -1, NULL, get_session_cb, request);
+}
 
-	return inhibitor->cookie;
+/**
+ * get_unix_process_id_cb:
+ **/
+static void
+get_unix_process_id_cb (GObject      *source_object,
+			GAsyncResult *res,
+			gpointer      user_data)
+{
+	UrfInhibitRequest *request = user_data;
+	guint32 calling_pid;
+	GVariant *retval;
+	GError *error = NULL;
+
+	retval = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
+	if (error) {
+		g_warning ("GetConnectionUnixProcessID() failed: %s", error->message);
+		g_error_free (error);
+		inhibit_request_complete (request, NULL);
+		return;
+	}
+	g_variant_get (retval, "(u)", &calling_pid);
+	g_variant_unref (retval);
+
+	inhibit_request_got_pid (request, calling_pid);
 }
 
+/**
+ * get_credentials_cb:
+ **/
 static void
-remove_inhibitor (UrfSessionChecker *consolekit,
-		  UrfInhibitor  *inhibitor)
+get_credentials_cb (GObject      *source_object,
+		    GAsyncResult *res,
+		    gpointer      user_data)
+{
+	UrfInhibitRequest *request = user_data;
+	guint32 calling_pid;
+	GVariant *retval;
+	GVariant *credentials;
+	GError *error = NULL;
+	gboolean found;
+
+	retval = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
+	if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD)) {
+		/* dbus-daemon older than 1.7.6 */
+		g_error_free (error);
+		g_dbus_proxy_call (G_DBUS_PROXY (source_object), "GetConnectionUnixProcessID",
+		                   g_variant_new ("(s)", request->bus_name),
+		                   G_DBUS_CALL_FLAGS_NONE,
+		                   -1, NULL, get_unix_process_id_cb, request);
+		return;
+	} else if (error) {
+		g_warning ("GetConnectionCredentials() failed: %s", error->message);
+		g_error_free (error);
+		inhibit_request_complete (request, NULL);
+		return;
+	}
+
+	credentials = g_variant_get_child_value (retval, 0);
+	found = g_variant_lookup (credentials, "ProcessID", "u", &calling_pid);
+	g_variant_unref (credentials);
+	g_variant_unref (retval);
+
+	if (!found) {
+		g_warning ("No ProcessID for %s", request->bus_name);
+		inhibit_request_complete (request, NULL);
+		return;
+	}
+
+	inhibit_request_got_pid (request, calling_pid);
+}
+
+/**
+ * urf_session_checker_inhibit_async:
+ *
+ * The session of @bus_name is looked up without blocking, so key
+ * presses and rfkill events keep flowing in the meantime. Clients that
+ * inhibited before are answered from the cache.
+ **/
+void
+urf_session_checker_inhibit_async (UrfSessionChecker   *consolekit,
+				   const char          *bus_name,
+				   const char          *reason,
+				   GAsyncReadyCallback  callback,
+				   gpointer             user_data)
 {
 	UrfConsolekitPrivate *priv = consolekit->priv;
+	UrfInhibitRequest *request;
+	UrfInhibitor *inhibitor;
+	GSimpleAsyncResult *res;
+	UrfClientSession *client;
 
-	g_return_if_fail (priv->proxy != NULL);
+	res = g_simple_async_result_new (G_OBJECT (consolekit), callback, user_data,
+					 urf_session_checker_inhibit_async);
 
-	priv->inhibitors = g_list_remove (priv->inhibitors, inhibitor);
-	consolekit->priv->inhibit = is_inhibited (consolekit);
-	g_debug ("Remove inhibitor: %s", inhibitor->bus_name);
-	free_inhibitor (inhibitor);
+	inhibitor = find_inhibitor_by_bus_name (consolekit, bus_name);
+	if (inhibitor || priv->proxy == NULL) {
+		g_simple_async_result_set_op_res_gssize (res, inhibitor ? inhibitor->cookie : 0);
+		g_simple_async_result_complete_in_idle (res);
+		g_object_unref (res);
+		return;
+	}
+
+	request = g_new0 (UrfInhibitRequest, 1);
+	request->consolekit = g_object_ref (consolekit);
+	request->res = res;
+	request->bus_name = g_strdup (bus_name);
+	request->reason = g_strdup (reason);
+
+	client = g_hash_table_lookup (priv->sessions, bus_name);
+	if (client != NULL) {
+		inhibit_request_complete (request, client->session_id);
+		return;
+	}
+
+	g_dbus_proxy_call (priv->bus_proxy, "GetConnectionCredentials",
+	                   g_variant_new ("(s)", bus_name),
+	                   G_DBUS_CALL_FLAGS_NONE,
+	                   -1, NULL, get_credentials_cb, request);
+}
+
+/**
+ * urf_session_checker_inhibit_finish:
+ *
+ * Return value: the cookie of the inhibitor, or 0 on failure
+ **/
+guint
+urf_session_checker_inhibit_finish (UrfSessionChecker *consolekit,
+				    GAsyncResult      *res)
+{
+	g_return_val_if_fail (g_simple_async_result_is_valid (res, G_OBJECT (consolekit),
+							      urf_session_checker_inhibit_async),
+			      0);
+
+	return g_simple_async_result_get_op_res_gssize (G_SIMPLE_ASYNC_RESULT (res));
 }
 
 /**
@@ -299,16 +554,21 @@ urf_session_checker_add_seat (UrfSessionChecker *consolekit,
 {
 	UrfConsolekitPrivate *priv = consolekit->priv;
 	UrfSeat *seat = urf_seat_new ();
+	UrfSeatEntry *entry;
 	gboolean ret;
 
 	ret = urf_seat_object_path_sync (seat, object_path);
 
 	if (!ret) {
 		g_warning ("Failed to sync %s", object_path);
+		g_object_unref (seat);
 		return;
 	}
 
-	priv->seats = g_list_prepend (priv->seats, seat);
+	entry = g_new0 (UrfSeatEntry, 1);
+	entry->seat = seat;
+	g_hash_table_insert (priv->seats, g_strdup (object_path), entry);
+	seat_entry_set_active (consolekit, entry, urf_seat_get_active (seat));
 
 	/* connect signal */
 	g_signal_connect (seat, "active-changed",
@@ -340,15 +600,18 @@ urf_session_checker_seat_removed (UrfSessionChecker *consolekit,
                              const char    *object_path)
 {
 	UrfConsolekitPrivate *priv = consolekit->priv;
-	UrfSeat *seat;
+	UrfSeatEntry *entry;
 
-	seat = urf_session_checker_find_seat (consolekit, object_path);
-	if (seat == NULL)
+	entry = g_hash_table_lookup (priv->seats, object_path);
+	if (entry == NULL)
 		return;
 
-	priv->seats = g_list_remove (priv->seats, seat);
+	g_signal_handlers_disconnect_by_func (entry->seat,
+					      urf_session_checker_seat_active_changed,
+					      consolekit);
+	seat_entry_set_active (consolekit, entry, NULL);
+	g_hash_table_remove (priv->seats, object_path);
 
-	g_object_unref (seat);
 	g_debug ("Removed seat: %s", object_path);
 }
 
@@ -374,47 +637,6 @@ urf_session_checker_proxy_signal_cb (GDBusProxy *proxy,
 	}
 }
 
-/**
- * urf_session_checker_bus_owner_changed:
- **/
-static void
-urf_session_checker_bus_owner_changed (UrfSessionChecker *consolekit,
-                                  const char    *old_owner,
-                                  const char    *new_owner)
-{
-	UrfInhibitor *inhibitor;
-
-	if (strlen (new_owner) == 0 &&
-	    strlen (old_owner) > 0) {
-		/* A process disconnected from the bus */
-		inhibitor = find_inhibitor_by_bus_name (consolekit, old_owner);
-		if (inhibitor == NULL)
-			return;
-		remove_inhibitor (consolekit, inhibitor);
-	}
-}
-
-/**
- * urf_session_checker_bus_proxy_signal_cb
- **/
-static void
-urf_session_checker_bus_proxy_signal_cb (GDBusProxy *proxy,
-                                    gchar      *sender_name,
-                                    gchar      *signal_name,
-                                    GVariant   *parameters,
-                                    gpointer    user_data)
-{
-	UrfSessionChecker *consolekit = URF_SESSION_CHECKER (user_data);
-	char *name;
-	char *old_owner;
-	char *new_owner;
-
-	if (g_strcmp0 (signal_name, "NameOwnerChanged") == 0) {
-		g_variant_get (parameters, "(sss)", &name, &old_owner, &new_owner);
-		urf_session_checker_bus_owner_changed (consolekit, old_owner, new_owner);
-	}
-}
-
 /**
  * urf_session_checker_get_seats:
  **/
@@ -479,8 +701,11 @@ urf_session_checker_startup (UrfSessionChecker *consolekit)
 	}
 
 	error = NULL;
+	/* only used for calls; the clients that inhibit are watched
+	 * one by one instead of receiving every NameOwnerChanged */
 	priv->bus_proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                                 G_DBUS_PROXY_FLAGS_NONE,
+	                                                 G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+	                                                 G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
 	                                                 NULL,
 	                                                 "org.freedesktop.DBus",
 	                                                 "/org/freedesktop/DBus",
@@ -501,8 +726,6 @@ urf_session_checker_startup (UrfSessionChecker *consolekit)
 	/* connect signals */
 	g_signal_connect (G_OBJECT (priv->proxy), "g-signal",
 	                  G_CALLBACK (urf_session_checker_proxy_signal_cb), consolekit);
-	g_signal_connect (G_CALLBACK (priv->bus_proxy), "g-signal",
-	                  G_CALLBACK (urf_session_checker_bus_proxy_signal_cb), consolekit);
 
 	return TRUE;
 }
@@ -534,20 +757,13 @@ static void
 urf_session_checker_finalize (GObject *object)
 {
 	UrfSessionChecker *consolekit = URF_SESSION_CHECKER (object);
-	GList *item;
 
-	if (consolekit->priv->seats) {
-		for (item = consolekit->priv->seats; item; item = item->next)
-			g_object_unref (item->data);
-		g_list_free (consolekit->priv->seats);
-		consolekit->priv->seats = NULL;
-	}
-	if (consolekit->priv->inhibitors) {
-		for (item = consolekit->priv->inhibitors; item; item = item->next)
-			free_inhibitor (item->data);
-		g_list_free (consolekit->priv->inhibitors);
-		consolekit->priv->inhibitors = NULL;
-	}
+	g_hash_table_destroy (consolekit->priv->seats);
+	g_hash_table_destroy (consolekit->priv->inhibitors_by_bus_name);
+	g_hash_table_destroy (consolekit->priv->inhibitors);
+	g_hash_table_destroy (consolekit->priv->inhibitor_counts);
+	g_hash_table_destroy (consolekit->priv->active_counts);
+	g_hash_table_destroy (consolekit->priv->sessions);
 
 	G_OBJECT_CLASS (urf_session_checker_parent_class)->finalize (object);
 }
@@ -573,9 +789,18 @@ static void
 urf_session_checker_init (UrfSessionChecker *consolekit)
 {
 	consolekit->priv = URF_SESSION_CHECKER_GET_PRIVATE (consolekit);
-	consolekit->priv->seats = NULL;
-	consolekit->priv->inhibitors = NULL;
-	consolekit->priv->inhibit = FALSE;
+	consolekit->priv->seats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						     (GDestroyNotify) free_seat_entry);
+	consolekit->priv->inhibitors = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+							  (GDestroyNotify) free_inhibitor);
+	consolekit->priv->inhibitors_by_bus_name = g_hash_table_new (g_str_hash, g_str_equal);
+	consolekit->priv->inhibitor_counts = g_hash_table_new_full (g_str_hash, g_str_equal,
+								g_free, NULL);
+	consolekit->priv->active_counts = g_hash_table_new_full (g_str_hash, g_str_equal,
+							     g_free, NULL);
+	consolekit->priv->inhibited_seats = 0;
+	consolekit->priv->sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+							(GDestroyNotify) free_client_session);
 	consolekit->priv->proxy = NULL;
 	consolekit->priv->bus_proxy = NULL;
 }
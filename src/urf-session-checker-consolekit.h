@@ -22,6 +22,7 @@
 #define __URF_SESSION_CHECKER_CONSOLEKIT_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include "urf-seat-consolekit.h"
 
@@ -57,9 +58,13 @@ UrfSessionChecker	*urf_session_checker_new		(void);
 gboolean		 urf_session_checker_startup		(UrfSessionChecker *consolekit);
 
 gboolean		 urf_session_checker_is_inhibited	(UrfSessionChecker *consolekit);
-guint			 urf_session_checker_inhibit		(UrfSessionChecker *consolekit,
+void			 urf_session_checker_inhibit_async	(UrfSessionChecker *consolekit,
 								 const char	*bus_name,
-								 const char	*reason);
+								 const char	*reason,
+								 GAsyncReadyCallback callback,
+								 gpointer	 user_data);
+guint			 urf_session_checker_inhibit_finish	(UrfSessionChecker *consolekit,
+								 GAsyncResult	*res);
 void			 urf_session_checker_uninhibit		(UrfSessionChecker *consolekit,
 								 const guint	 cookie);
 
@@ -23,8 +23,13 @@
 #endif
 
 #include <glib.h>
+#include <stdlib.h>
 #include <string.h>
+#include <sys/types.h>
 #include <gio/gio.h>
+#ifdef HAVE_SYSTEMD_LOGIN
+#include <systemd/sd-login.h>
+#endif
 
 #include "urf-session-checker-logind.h"
 
@@ -35,12 +40,22 @@ typedef struct {
 	char		*reason;
 } UrfInhibitor;
 
+/* A seat and the active session it was last counted with */
+typedef struct {
+	UrfSeat		*seat;
+	char		*active;
+} UrfSeatEntry;
+
 struct UrfLogindPrivate {
 	GDBusProxy	*proxy;
 	GDBusProxy	*bus_proxy;
-	GList		*seats;
-	GList		*inhibitors;
-	gboolean	 inhibit;
+	GHashTable	*seats; /* object path -> UrfSeatEntry */
+	GHashTable	*inhibitors; /* cookie -> UrfInhibitor */
+	GHashTable	*inhibitors_by_bus_name; /* bus name -> UrfInhibitor */
+	GHashTable	*inhibitor_counts; /* session -> number of inhibitors */
+	GHashTable	*active_counts; /* session -> number of seats it is active on */
+	guint		 inhibited_seats; /* seats with an inhibitor in their active session */
+	GHashTable	*sessions; /* bus name -> UrfClientSession */
 };
 
 G_DEFINE_TYPE (UrfSessionChecker, urf_session_checker, G_TYPE_OBJECT)
@@ -48,102 +63,108 @@ G_DEFINE_TYPE (UrfSessionChecker, urf_session_checker, G_TYPE_OBJECT)
 #define URF_SESSION_CHECKER_GET_PRIVATE(o) (G_TYPE_INSTANCE_GET_PRIVATE ((o), \
 				URF_TYPE_SESSION_CHECKER, UrfLogindPrivate))
 
-/**
- * urf_session_checker_is_inhibited:
- **/
 gboolean
 urf_session_checker_is_inhibited (UrfSessionChecker *logind)
 {
-	return logind->priv->inhibit;
+	return logind->priv->inhibited_seats > 0;
 }
 
-/**
- * urf_session_checker_find_seat:
- **/
 static UrfSeat *
 urf_session_checker_find_seat (UrfSessionChecker *logind,
                                const char    *object_path)
 {
-	UrfLogindPrivate *priv = logind->priv;
-	UrfSeat *seat;
-	GList *item;
+	UrfSeatEntry *entry;
 
-	for (item = priv->seats; item; item = item->next) {
-		seat = URF_SEAT (item->data);
-		if (g_strcmp0 (urf_seat_get_object_path (seat), object_path) == 0)
-			return seat;
-	}
+	entry = g_hash_table_lookup (logind->priv->seats, object_path);
+	return entry ? entry->seat : NULL;
+}
 
-	return NULL;
+/**
+ * session_count:
+ **/
+static guint
+session_count (GHashTable *counts,
+	       const char *session_id)
+{
+	if (session_id == NULL)
+		return 0;
+	return GPOINTER_TO_UINT (g_hash_table_lookup (counts, session_id));
 }
 
-static UrfInhibitor *
-find_inhibitor_by_sid (UrfSessionChecker *logind,
-                       const char *session_id)
+/**
+ * session_count_add:
+ *
+ * Return value: the count of @session_id before adding @delta
+ **/
+static guint
+session_count_add (GHashTable *counts,
+		   const char *session_id,
+		   gint        delta)
 {
-	UrfLogindPrivate *priv = logind->priv;
-	UrfInhibitor *inhibitor;
-	GList *item;
+	guint count;
 
-	for (item = priv->inhibitors; item; item = item->next) {
-		inhibitor = (UrfInhibitor *)item->data;
-		if (g_strcmp0 (inhibitor->session_id, session_id) == 0)
-			return inhibitor;
-	}
-	return NULL;
+	if (session_id == NULL)
+		return 0;
+
+	count = session_count (counts, session_id);
+	if (count + delta == 0)
+		g_hash_table_remove (counts, session_id);
+	else
+		g_hash_table_replace (counts, g_strdup (session_id),
+				      GUINT_TO_POINTER (count + delta));
+	return count;
 }
 
 static UrfInhibitor *
 find_inhibitor_by_bus_name (UrfSessionChecker *logind,
-			    const char *bus_name)
+			    const char    *bus_name)
 {
-	UrfLogindPrivate *priv = logind->priv;
-	UrfInhibitor *inhibitor;
-	GList *item;
-
-	for (item = priv->inhibitors; item; item = item->next) {
-		inhibitor = (UrfInhibitor *)item->data;
-		if (g_strcmp0 (inhibitor->bus_name, bus_name) == 0)
-			return inhibitor;
-	}
-	return NULL;
+	return g_hash_table_lookup (logind->priv->inhibitors_by_bus_name, bus_name);
 }
 
 static UrfInhibitor *
 find_inhibitor_by_cookie (UrfSessionChecker *logind,
-                          const guint cookie)
+			  const guint    cookie)
 {
-	UrfLogindPrivate *priv = logind->priv;
-	UrfInhibitor *inhibitor;
-	GList *item;
-
 	if (cookie == 0)
 		return NULL;
 
-	for (item = priv->inhibitors; item; item = item->next) {
-		inhibitor = (UrfInhibitor *)item->data;
-		if (inhibitor->cookie == cookie)
-			return inhibitor;
-	}
-	return NULL;
+	return g_hash_table_lookup (logind->priv->inhibitors, GUINT_TO_POINTER (cookie));
 }
 
-static gboolean
-is_inhibited (UrfSessionChecker *logind)
+/**
+ * add_inhibitor:
+ *
+ * The first inhibitor of a session inhibits every seat the session is
+ * active on.
+ **/
+static void
+add_inhibitor (UrfSessionChecker *logind,
+	       UrfInhibitor      *inhibitor)
 {
 	UrfLogindPrivate *priv = logind->priv;
-	UrfSeat *seat;
-	const char *active_id;
-	GList *item;
-
-	for (item = priv->seats; item; item = item->next) {
-		seat = URF_SEAT (item->data);
-		active_id = urf_seat_get_active (seat);
-		if (find_inhibitor_by_sid (logind, active_id))
-			return TRUE;
-	}
 
-	return FALSE;
+	g_hash_table_insert (priv->inhibitors, GUINT_TO_POINTER (inhibitor->cookie), inhibitor);
+	g_hash_table_insert (priv->inhibitors_by_bus_name, inhibitor->bus_name, inhibitor);
+
+	if (session_count_add (priv->inhibitor_counts, inhibitor->session_id, 1) == 0)
+		priv->inhibited_seats += session_count (priv->active_counts, inhibitor->session_id);
+}
+
+static void
+remove_inhibitor (UrfSessionChecker *logind,
+		  UrfInhibitor      *inhibitor)
+{
+	UrfLogindPrivate *priv = logind->priv;
+
+	g_return_if_fail (priv->proxy != NULL);
+
+	if (session_count_add (priv->inhibitor_counts, inhibitor->session_id, -1) == 1)
+		priv->inhibited_seats -= session_count (priv->active_counts, inhibitor->session_id);
+
+	g_debug ("Remove inhibitor: %s", inhibitor->bus_name);
+	g_hash_table_remove (priv->inhibitors_by_bus_name, inhibitor->bus_name);
+	g_hash_table_remove (priv->inhibitors, GUINT_TO_POINTER (inhibitor->cookie));
 }
 
 static void
@@ -155,6 +176,40 @@ free_inhibitor (UrfInhibitor *inhibitor)
 	g_free (inhibitor);
 }
 
+/**
+ * seat_entry_set_active:
+ **/
+static void
+seat_entry_set_active (UrfSessionChecker *logind,
+		       UrfSeatEntry      *entry,
+		       const char        *active)
+{
+	UrfLogindPrivate *priv = logind->priv;
+
+	if (entry->active != NULL) {
+		if (session_count (priv->inhibitor_counts, entry->active) > 0)
+			priv->inhibited_seats--;
+		session_count_add (priv->active_counts, entry->active, -1);
+		g_free (entry->active);
+	}
+
+	entry->active = g_strdup (active);
+
+	if (entry->active != NULL) {
+		session_count_add (priv->active_counts, entry->active, 1);
+		if (session_count (priv->inhibitor_counts, entry->active) > 0)
+			priv->inhibited_seats++;
+	}
+}
+
+static void
+free_seat_entry (UrfSeatEntry *entry)
+{
+	g_object_unref (entry->seat);
+	g_free (entry->active);
+	g_free (entry);
+}
+
 /**
  * urf_session_checker_seat_active_changed:
  **/
@@ -163,114 +218,422 @@ urf_session_checker_seat_active_changed (UrfSeat *seat,
                                          const char *session_id,
                                          UrfSessionChecker *logind)
 {
-	logind->priv->inhibit = is_inhibited (logind);
+	UrfSeatEntry *entry;
+
+	entry = g_hash_table_lookup (logind->priv->seats, urf_seat_get_object_path (seat));
+	if (entry != NULL)
+		seat_entry_set_active (logind, entry, urf_seat_get_active (seat));
 	g_debug ("Active Session changed: %s", session_id);
 }
 
+#ifndef HAVE_SYSTEMD_LOGIN
+/**
+ * get_session_id_from_cgroup:
+ *
+ * Find the session scope of @pid in the systemd hierarchy of
+ * /proc/<pid>/cgroup, e.g. "/user.slice/user-1000.slice/session-2.scope",
+ * or "/user/1000.user/2.session" with older systemd.
+ **/
 static char *
-get_session_id (UrfSessionChecker *logind,
-                const char *bus_name)
+get_session_id_from_cgroup (pid_t pid)
 {
-	UrfLogindPrivate *priv = logind->priv;
-	pid_t calling_pid;
+	char *filename;
+	char *contents = NULL;
+	char **lines = NULL;
+	char **names;
+	const char *path;
 	char *session_id = NULL;
-	GVariant *retval;
-	GError *error;
+	int i, j;
 
-        error = NULL;
-	retval = g_dbus_proxy_call_sync (priv->bus_proxy, "GetConnectionUnixProcessID",
-	                                 g_variant_new ("(s)", bus_name),
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error);
-	if (error) {
-		g_warning("GetConnectionUnixProcessID() failed: %s", error->message);
-		g_error_free (error);
+	filename = g_strdup_printf ("/proc/%u/cgroup", (guint) pid);
+	if (!g_file_get_contents (filename, &contents, NULL, NULL))
 		goto out;
-	}
-	g_variant_get (retval, "(u)", &calling_pid);
-	g_variant_unref (retval);
 
-        error = NULL;
-	retval = g_dbus_proxy_call_sync (priv->proxy, "GetSessionByPID",
-	                                 g_variant_new ("(u)", (guint)calling_pid),
-	                                 G_DBUS_CALL_FLAGS_NONE,
-	                                 -1, NULL, &error);
-	if (error) {
-		g_warning ("Couldn't send GetSessionByPID: %s", error->message);
-		g_error_free (error);
-		session_id = NULL;
-		goto out;
+	lines = g_strsplit (contents, "\n", -1);
+	for (i = 0; lines[i] && session_id == NULL; i++) {
+		path = strstr (lines[i], ":name=systemd:");
+		if (path)
+			path += strlen (":name=systemd:");
+		else if (g_str_has_prefix (lines[i], "0::"))
+			path = lines[i] + strlen ("0::");
+		else
+			continue;
+
+		names = g_strsplit (path, "/", -1);
+		for (j = 0; names[j] && session_id == NULL; j++) {
+			if (g_str_has_prefix (names[j], "session-") &&
+			    g_str_has_suffix (names[j], ".scope"))
+				session_id = g_strndup (names[j] + strlen ("session-"),
+							strlen (names[j]) - strlen ("session-.scope"));
+			else if (g_str_has_suffix (names[j], ".session"))
+				session_id = g_strndup (names[j],
+							strlen (names[j]) - strlen (".session"));
+		}
+		g_strfreev (names);
 	}
-
-	g_variant_get (retval, "(o)", &session_id);
-	session_id = g_strdup (session_id);
-	g_variant_unref (retval);
 out:
+	g_strfreev (lines);
+	g_free (contents);
+	g_free (filename);
 	return session_id;
 }
+#endif
+
+/**
+ * get_session_path_local:
+ *
+ * Work out the logind session of @pid without asking logind. Session
+ * objects are named after the session id, escaped like any other bus
+ * label: everything but letters, and digits after the first character,
+ * becomes _xx.
+ **/
+static char *
+get_session_path_local (pid_t pid)
+{
+	GString *path;
+	char *session_id = NULL;
+	const char *p;
+#ifdef HAVE_SYSTEMD_LOGIN
+	char *sd_session = NULL;
+
+	if (sd_pid_get_session (pid, &sd_session) >= 0) {
+		session_id = g_strdup (sd_session);
+		free (sd_session);
+	}
+#else
+	session_id = get_session_id_from_cgroup (pid);
+#endif
+	if (session_id == NULL || session_id[0] == '\0') {
+		g_free (session_id);
+		return NULL;
+	}
+
+	path = g_string_new ("/org/freedesktop/login1/session/");
+	for (p = session_id; *p; p++) {
+		if (g_ascii_isalpha (*p) || (g_ascii_isdigit (*p) && p != session_id))
+			g_string_append_c (path, *p);
+		else
+			g_string_append_printf (path, "_%02x", (guchar) *p);
+	}
+	g_free (session_id);
+
+	return g_string_free (path, FALSE);
+}
+
+/* The session of a client that inhibited. A process does not change
+ * its session, so it is kept until the client leaves the bus. */
+typedef struct {
+	char		*session_id;
+	guint		 watch_id;
+} UrfClientSession;
+
+static void
+free_client_session (UrfClientSession *client)
+{
+	g_bus_unwatch_name (client->watch_id);
+	g_free (client->session_id);
+	g_free (client);
+}
+
+/**
+ * urf_session_checker_name_vanished:
+ **/
+static void
+urf_session_checker_name_vanished (GDBusConnection *connection,
+				   const gchar     *name,
+				   gpointer         user_data)
+{
+	UrfSessionChecker *logind = URF_SESSION_CHECKER (user_data);
+	UrfInhibitor *inhibitor;
+
+	/* A process disconnected from the bus */
+	inhibitor = find_inhibitor_by_bus_name (logind, name);
+	if (inhibitor != NULL)
+		remove_inhibitor (logind, inhibitor);
+
+	g_hash_table_remove (logind->priv->sessions, name);
+}
+
+/**
+ * remember_client_session:
+ *
+ * Only the clients that inhibit are watched, rather than every name
+ * that comes and goes on the system bus.
+ **/
+static void
+remember_client_session (UrfSessionChecker *logind,
+			 const char        *bus_name,
+			 const char        *session_id)
+{
+	UrfLogindPrivate *priv = logind->priv;
+	UrfClientSession *client;
+
+	if (g_hash_table_lookup (priv->sessions, bus_name) != NULL)
+		return;
+
+	client = g_new0 (UrfClientSession, 1);
+	client->session_id = g_strdup (session_id);
+	g_hash_table_insert (priv->sessions, g_strdup (bus_name), client);
+
+	/* this also catches a client that left before the watch was set up */
+	client->watch_id =
+		g_bus_watch_name_on_connection (g_dbus_proxy_get_connection (priv->bus_proxy),
+						bus_name,
+						G_BUS_NAME_WATCHER_FLAGS_NONE,
+						NULL,
+						urf_session_checker_name_vanished,
+						logind, NULL);
+}
+
+/* An Inhibit call waiting for the session of its caller */
+typedef struct {
+	UrfSessionChecker	*logind;
+	GSimpleAsyncResult	*res;
+	char			*bus_name;
+	char			*reason;
+} UrfInhibitRequest;
 
 static guint
 generate_unique_cookie (UrfSessionChecker *logind)
 {
-	UrfInhibitor *inhibitor;
 	guint cookie;
 
 	do {
 		cookie = g_random_int_range (1, G_MAXINT);
-		inhibitor = find_inhibitor_by_cookie (logind, cookie);
-	} while (inhibitor != NULL);
+	} while (g_hash_table_lookup (logind->priv->inhibitors, GUINT_TO_POINTER (cookie)) != NULL);
 
 	return cookie;
 }
 
 /**
- * urf_session_checker_inhibit:
+ * inhibit_request_complete:
+ *
+ * Add the inhibitor once the session of the caller is known, or fail
+ * with a cookie of 0 if @session_id is %NULL.
  **/
-guint
-urf_session_checker_inhibit (UrfSessionChecker *logind,
-                             const char *bus_name,
-                             const char *reason)
+static void
+inhibit_request_complete (UrfInhibitRequest *request,
+			  const char        *session_id)
 {
+	UrfSessionChecker *logind = request->logind;
 	UrfLogindPrivate *priv = logind->priv;
 	UrfInhibitor *inhibitor;
+	guint cookie = 0;
+
+	/* another call from the same client may have finished first */
+	inhibitor = find_inhibitor_by_bus_name (logind, request->bus_name);
+	if (inhibitor) {
+		cookie = inhibitor->cookie;
+	} else if (session_id != NULL) {
+		inhibitor = g_new0 (UrfInhibitor, 1);
+		inhibitor->session_id = g_strdup (session_id);
+		inhibitor->reason = g_strdup (request->reason);
+		inhibitor->bus_name = g_strdup (request->bus_name);
+		inhibitor->cookie = generate_unique_cookie (logind);
+
+		add_inhibitor (logind, inhibitor);
+		g_debug ("Inhibit: %s for %s", request->bus_name, request->reason);
+
+		cookie = inhibitor->cookie;
+
+		/* may remove the inhibitor again if the client is gone */
+		remember_client_session (logind, request->bus_name, session_id);
+	}
 
-	g_return_val_if_fail (priv->proxy != NULL, 0);
+	g_simple_async_result_set_op_res_gssize (request->res, cookie);
+	g_simple_async_result_complete_in_idle (request->res);
 
-	inhibitor = find_inhibitor_by_bus_name (logind, bus_name);
-	if (inhibitor)
-		return inhibitor->cookie;
+	g_object_unref (request->res);
+	g_object_unref (request->logind);
+	g_free (request->bus_name);
+	g_free (request->reason);
+	g_free (request);
+}
 
-	inhibitor = g_new0 (UrfInhibitor, 1);
-	inhibitor->session_id = get_session_id (logind, bus_name);
-	if (inhibitor->session_id == NULL) {
-		g_free (inhibitor);
-		return 0;
+/**
+ * get_session_cb:
+ **/
+static void
+get_session_cb (GObject      *source_object,
+		GAsyncResult *res,
+		gpointer      user_data)
+{
+	UrfInhibitRequest *request = user_data;
+	const char *session_id = NULL;
+	GVariant *retval;
+	GError *error = NULL;
+
+	retval = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
+	if (error) {
+		g_warning ("Couldn't send GetSessionByPID: %s", error->message);
+		g_error_free (error);
+	} else {
+		g_variant_get (retval, "(&o)", &session_id);
 	}
 
-	inhibitor->reason = g_strdup (reason);
-	inhibitor->bus_name = g_strdup (bus_name);
-	inhibitor->cookie = generate_unique_cookie (logind);
+	inhibit_request_complete (request, session_id);
 
-	priv->inhibitors = g_list_prepend (priv->inhibitors, inhibitor);
+	if (retval)
+		g_variant_unref (retval);
+}
 
-	logind->priv->inhibit = is_inhibited (logind);
-	g_debug ("Inhibit: %s for %s", bus_name, reason);
+/**
+ * inhibit_request_got_pid:
+ **/
+static void
+inhibit_request_got_pid (UrfInhibitRequest *request,
+			 pid_t              pid)
+{
+	char *session_id;
 
-	return inhibitor->cookie;
+	session_id = get_session_path_local (pid);
+	if (session_id != NULL) {
+		inhibit_request_complete (request, session_id);
+		g_free (session_id);
+		return;
+	}
+
+	/* not in a session scope we know how to read, ask logind */
+	g_dbus_proxy_call (request->logind->priv->proxy, "GetSessionByPID",
+	                   g_variant_new ("(u)", (guint32) pid),
+	                   G_DBUS_CALL_FLAGS_NONE,
+	                   -1, NULL, get_session_cb, request);
 }
 
+/**
+ * get_unix_process_id_cb:
+ **/
 static void
-remove_inhibitor (UrfSessionChecker *logind,
-                  UrfInhibitor *inhibitor)
+get_unix_process_id_cb (GObject      *source_object,
+			GAsyncResult *res,
+			gpointer      user_data)
+{
+	UrfInhibitRequest *request = user_data;
+	guint32 calling_pid;
+	GVariant *retval;
+	GError *error = NULL;
+
+	retval = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
+	if (error) {
+		g_warning ("GetConnectionUnixProcessID() failed: %s", error->message);
+		g_error_free (error);
+		inhibit_request_complete (request, NULL);
+		return;
+	}
+	g_variant_get (retval, "(u)", &calling_pid);
+	g_variant_unref (retval);
+
+	inhibit_request_got_pid (request, calling_pid);
+}
+
+/**
+ * get_credentials_cb:
+ **/
+static void
+get_credentials_cb (GObject      *source_object,
+		    GAsyncResult *res,
+		    gpointer      user_data)
+{
+	UrfInhibitRequest *request = user_data;
+	guint32 calling_pid;
+	GVariant *retval;
+	GVariant *credentials;
+	GError *error = NULL;
+	gboolean found;
+
+	retval = g_dbus_proxy_call_finish (G_DBUS_PROXY (source_object), res, &error);
+	if (g_error_matches (error, G_DBUS_ERROR, G_DBUS_ERROR_UNKNOWN_METHOD)) {
+		/* dbus-daemon older than 1.7.6 */
+		g_error_free (error);
+		g_dbus_proxy_call (G_DBUS_PROXY (source_object), "GetConnectionUnixProcessID",
+		                   g_variant_new ("(s)", request->bus_name),
+		                   G_DBUS_CALL_FLAGS_NONE,
+		                   -1, NULL, get_unix_process_id_cb, request);
+		return;
+	} else if (error) {
+		g_warning ("GetConnectionCredentials() failed: %s", error->message);
+		g_error_free (error);
+		inhibit_request_complete (request, NULL);
+		return;
+	}
+
+	credentials = g_variant_get_child_value (retval, 0);
+	found = g_variant_lookup (credentials, "ProcessID", "u", &calling_pid);
+	g_variant_unref (credentials);
+	g_variant_unref (retval);
+
+	if (!found) {
+		g_warning ("No ProcessID for %s", request->bus_name);
+		inhibit_request_complete (request, NULL);
+		return;
+	}
+
+	inhibit_request_got_pid (request, calling_pid);
+}
+
+/**
+ * urf_session_checker_inhibit_async:
+ *
+ * The session of @bus_name is looked up without blocking, so key
+ * presses and rfkill events keep flowing in the meantime. Clients that
+ * inhibited before are answered from the cache.
+ **/
+void
+urf_session_checker_inhibit_async (UrfSessionChecker   *logind,
+				   const char          *bus_name,
+				   const char          *reason,
+				   GAsyncReadyCallback  callback,
+				   gpointer             user_data)
 {
 	UrfLogindPrivate *priv = logind->priv;
+	UrfInhibitRequest *request;
+	UrfInhibitor *inhibitor;
+	GSimpleAsyncResult *res;
+	UrfClientSession *client;
 
-	g_return_if_fail (priv->proxy != NULL);
+	res = g_simple_async_result_new (G_OBJECT (logind), callback, user_data,
+					 urf_session_checker_inhibit_async);
 
-	priv->inhibitors = g_list_remove (priv->inhibitors, inhibitor);
-	logind->priv->inhibit = is_inhibited (logind);
-	g_debug ("Remove inhibitor: %s", inhibitor->bus_name);
-	free_inhibitor (inhibitor);
+	inhibitor = find_inhibitor_by_bus_name (logind, bus_name);
+	if (inhibitor || priv->proxy == NULL) {
+		g_simple_async_result_set_op_res_gssize (res, inhibitor ? inhibitor->cookie : 0);
+		g_simple_async_result_complete_in_idle (res);
+		g_object_unref (res);
+		return;
+	}
+
+	request = g_new0 (UrfInhibitRequest, 1);
+	request->logind = g_object_ref (logind);
+	request->res = res;
+	request->bus_name = g_strdup (bus_name);
+	request->reason = g_strdup (reason);
+
+	client = g_hash_table_lookup (priv->sessions, bus_name);
+	if (client != NULL) {
+		inhibit_request_complete (request, client->session_id);
+		return;
+	}
+
+	g_dbus_proxy_call (priv->bus_proxy, "GetConnectionCredentials",
+	                   g_variant_new ("(s)", bus_name),
+	                   G_DBUS_CALL_FLAGS_NONE,
+	                   -1, NULL, get_credentials_cb, request);
+}
+
+/**
+ * urf_session_checker_inhibit_finish:
+ *
+ * Return value: the cookie of the inhibitor, or 0 on failure
+ **/
+guint
+urf_session_checker_inhibit_finish (UrfSessionChecker *logind,
+				    GAsyncResult      *res)
+{
+	g_return_val_if_fail (g_simple_async_result_is_valid (res, G_OBJECT (logind),
+							      urf_session_checker_inhibit_async),
+			      0);
+
+	return g_simple_async_result_get_op_res_gssize (G_SIMPLE_ASYNC_RESULT (res));
 }
 
 /**
@@ -299,16 +662,21 @@ urf_session_checker_add_seat (UrfSessionChecker *logind,
 {
 	UrfLogindPrivate *priv = logind->priv;
 	UrfSeat *seat = urf_seat_new ();
+	UrfSeatEntry *entry;
 	gboolean ret;
 
 	ret = urf_seat_object_path_sync (seat, object_path);
 
 	if (!ret) {
 		g_warning ("Failed to sync %s", object_path);
+		g_object_unref (seat);
 		return;
 	}
 
-	priv->seats = g_list_prepend (priv->seats, seat);
+	entry = g_new0 (UrfSeatEntry, 1);
+	entry->seat = seat;
+	g_hash_table_insert (priv->seats, g_strdup (object_path), entry);
+	seat_entry_set_active (logind, entry, urf_seat_get_active (seat));
 
 	/* connect signal */
 	g_signal_connect (seat, "active-changed",
@@ -340,15 +708,18 @@ urf_session_checker_seat_removed (UrfSessionChecker *logind,
                                   const char *object_path)
 {
 	UrfLogindPrivate *priv = logind->priv;
-	UrfSeat *seat;
+	UrfSeatEntry *entry;
 
-	seat = urf_session_checker_find_seat (logind, object_path);
-	if (seat == NULL)
+	entry = g_hash_table_lookup (priv->seats, object_path);
+	if (entry == NULL)
 		return;
 
-	priv->seats = g_list_remove (priv->seats, seat);
+	g_signal_handlers_disconnect_by_func (entry->seat,
+					      urf_session_checker_seat_active_changed,
+					      logind);
+	seat_entry_set_active (logind, entry, NULL);
+	g_hash_table_remove (priv->seats, object_path);
 
-	g_object_unref (seat);
 	g_debug ("Removed seat: %s", object_path);
 }
 
@@ -377,47 +748,6 @@ urf_session_checker_proxy_signal_cb (GDBusProxy *proxy,
 	}
 }
 
-/**
- * urf_session_checker_bus_owner_changed:
- **/
-static void
-urf_session_checker_bus_owner_changed (UrfSessionChecker *logind,
-                                       const char *old_owner,
-                                       const char *new_owner)
-{
-	UrfInhibitor *inhibitor;
-
-	if (strlen (new_owner) == 0 &&
-	    strlen (old_owner) > 0) {
-		/* A process disconnected from the bus */
-		inhibitor = find_inhibitor_by_bus_name (logind, old_owner);
-		if (inhibitor == NULL)
-			return;
-		remove_inhibitor (logind, inhibitor);
-	}
-}
-
-/**
- * urf_session_checker_bus_proxy_signal_cb
- **/
-static void
-urf_session_checker_bus_proxy_signal_cb (GDBusProxy *proxy,
-                                         gchar *sender_name,
-                                         gchar *signal_name,
-                                         GVariant *parameters,
-                                         gpointer user_data)
-{
-	UrfSessionChecker *logind = URF_SESSION_CHECKER (user_data);
-	char *name;
-	char *old_owner;
-	char *new_owner;
-
-	if (g_strcmp0 (signal_name, "NameOwnerChanged") == 0) {
-		g_variant_get (parameters, "(sss)", &name, &old_owner, &new_owner);
-		urf_session_checker_bus_owner_changed (logind, old_owner, new_owner);
-	}
-}
-
 /**
  * urf_session_checker_get_seats:
  **/
@@ -482,8 +812,11 @@ urf_session_checker_startup (UrfSessionChecker *logind)
 	}
 
 	error = NULL;
+	/* only used for calls; the clients that inhibit are watched
+	 * one by one instead of receiving every NameOwnerChanged */
 	priv->bus_proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
-	                                                 G_DBUS_PROXY_FLAGS_NONE,
+	                                                 G_DBUS_PROXY_FLAGS_DO_NOT_LOAD_PROPERTIES |
+	                                                 G_DBUS_PROXY_FLAGS_DO_NOT_CONNECT_SIGNALS,
 	                                                 NULL,
 	                                                 "org.freedesktop.DBus",
 	                                                 "/org/freedesktop/DBus",
@@ -504,8 +837,6 @@ urf_session_checker_startup (UrfSessionChecker *logind)
 	/* connect signals */
 	g_signal_connect (G_OBJECT (priv->proxy), "g-signal",
 	                  G_CALLBACK (urf_session_checker_proxy_signal_cb), logind);
-	g_signal_connect (G_CALLBACK (priv->bus_proxy), "g-signal",
-	                  G_CALLBACK (urf_session_checker_bus_proxy_signal_cb), logind);
 
 	return TRUE;
 }
@@ -537,20 +868,13 @@ static void
 urf_session_checker_finalize (GObject *object)
 {
 	UrfSessionChecker *logind = URF_SESSION_CHECKER (object);
-	GList *item;
 
-	if (logind->priv->seats) {
-		for (item = logind->priv->seats; item; item = item->next)
-			g_object_unref (item->data);
-		g_list_free (logind->priv->seats);
-		logind->priv->seats = NULL;
-	}
-	if (logind->priv->inhibitors) {
-		for (item = logind->priv->inhibitors; item; item = item->next)
-			free_inhibitor (item->data);
-		g_list_free (logind->priv->inhibitors);
-		logind->priv->inhibitors = NULL;
-	}
+	g_hash_table_destroy (logind->priv->seats);
+	g_hash_table_destroy (logind->priv->inhibitors_by_bus_name);
+	g_hash_table_destroy (logind->priv->inhibitors);
+	g_hash_table_destroy (logind->priv->inhibitor_counts);
+	g_hash_table_destroy (logind->priv->active_counts);
+	g_hash_table_destroy (logind->priv->sessions);
 
 	G_OBJECT_CLASS (urf_session_checker_parent_class)->finalize (object);
 }
@@ -576,9 +900,18 @@ static void
 urf_session_checker_init (UrfSessionChecker *logind)
 {
 	logind->priv = URF_SESSION_CHECKER_GET_PRIVATE (logind);
-	logind->priv->seats = NULL;
-	logind->priv->inhibitors = NULL;
-	logind->priv->inhibit = FALSE;
+	logind->priv->seats = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+						     (GDestroyNotify) free_seat_entry);
+	logind->priv->inhibitors = g_hash_table_new_full (g_direct_hash, g_direct_equal, NULL,
+							  (GDestroyNotify) free_inhibitor);
+	logind->priv->inhibitors_by_bus_name = g_hash_table_new (g_str_hash, g_str_equal);
+	logind->priv->inhibitor_counts = g_hash_table_new_full (g_str_hash, g_str_equal,
+								g_free, NULL);
+	logind->priv->active_counts = g_hash_table_new_full (g_str_hash, g_str_equal,
+							     g_free, NULL);
+	logind->priv->inhibited_seats = 0;
+	logind->priv->sessions = g_hash_table_new_full (g_str_hash, g_str_equal, g_free,
+							(GDestroyNotify) free_client_session);
 	logind->priv->proxy = NULL;
 	logind->priv->bus_proxy = NULL;
 }
@@ -22,6 +22,7 @@
 #define __URF_SESSION_CHECKER_LOGIND_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 #include "urf-seat-logind.h"
 
@@ -57,9 +58,13 @@ UrfSessionChecker	*urf_session_checker_new		(void);
 gboolean		 urf_session_checker_startup		(UrfSessionChecker *logind);
 
 gboolean		 urf_session_checker_is_inhibited	(UrfSessionChecker *logind);
-guint			 urf_session_checker_inhibit		(UrfSessionChecker *logind,
+void			 urf_session_checker_inhibit_async	(UrfSessionChecker *logind,
 								 const char	*bus_name,
-								 const char	*reason);
+								 const char	*reason,
+								 GAsyncReadyCallback callback,
+								 gpointer	 user_data);
+guint			 urf_session_checker_inhibit_finish	(UrfSessionChecker *logind,
+								 GAsyncResult	*res);
 void			 urf_session_checker_uninhibit		(UrfSessionChecker *logind,
 								 const guint	 cookie);
 
@@ -58,12 +58,30 @@ urf_session_checker_is_inhibited (UrfSessionChecker *session_checker)
 }
 
 /**
- * urf_session_checker_inhibit:
+ * urf_session_checker_inhibit_async:
+ **/
+void
+urf_session_checker_inhibit_async (UrfSessionChecker   *session_checker,
+				   const char          *bus_name,
+				   const char          *reason,
+				   GAsyncReadyCallback  callback,
+				   gpointer             user_data)
+{
+	GSimpleAsyncResult *res;
+
+	res = g_simple_async_result_new (G_OBJECT (session_checker), callback, user_data,
+					 urf_session_checker_inhibit_async);
+	g_simple_async_result_set_op_res_gssize (res, 0);
+	g_simple_async_result_complete_in_idle (res);
+	g_object_unref (res);
+}
+
+/**
+ * urf_session_checker_inhibit_finish:
  **/
 guint
-urf_session_checker_inhibit (UrfSessionChecker *session_checker,
-                             const char *bus_name,
-                             const char *reason)
+urf_session_checker_inhibit_finish (UrfSessionChecker *session_checker,
+				    GAsyncResult      *res)
 {
 	return 0;
 }
@@ -22,6 +22,7 @@
 #define __URF_SESSION_CHECKER_NONE_H__
 
 #include <glib-object.h>
+#include <gio/gio.h>
 
 G_BEGIN_DECLS
 
@@ -52,9 +53,13 @@ UrfSessionChecker	*urf_session_checker_new		(void);
 gboolean		 urf_session_checker_startup		(UrfSessionChecker *session_checker);
 
 gboolean		 urf_session_checker_is_inhibited	(UrfSessionChecker *session_checker);
-guint			 urf_session_checker_inhibit		(UrfSessionChecker *session_checker,
+void			 urf_session_checker_inhibit_async	(UrfSessionChecker *session_checker,
 								 const char	*bus_name,
-								 const char	*reason);
+								 const char	*reason,
+								 GAsyncReadyCallback callback,
+								 gpointer	 user_data);
+guint			 urf_session_checker_inhibit_finish	(UrfSessionChecker *session_checker,
+								 GAsyncResult	*res);
 void			 urf_session_checker_uninhibit		(UrfSessionChecker *session_checker,
 								 const guint	 cookie);
 
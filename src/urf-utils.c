@@ -1,73 +1,66 @@
 #include <stdlib.h>
+#include <string.h>
 #include <libudev.h>
 #include "urf-utils.h"
 
+/* Tests point this to a tree of their own */
+#ifndef URFKILL_SYSFS_DIR
+#define URFKILL_SYSFS_DIR "/sys"
+#endif
+
+/**
+ * get_udev_context:
+ *
+ * Return value: the udev context shared by the whole daemon. It is
+ * owned by this module and must not be unreferenced.
+ **/
+struct udev *
+get_udev_context (void)
+{
+	static struct udev *udev = NULL;
+
+	if (udev == NULL) {
+		udev = udev_new ();
+		if (udev == NULL)
+			g_warning ("Cannot create udev");
+	}
+
+	return udev;
+}
+
 /**
  * get_dmi_info:
+ *
+ * All the DMI attributes live on the single dmi device, i.e.
+ * /sys/class/dmi/id, so look it up directly instead of enumerating.
  **/
 DmiInfo *
 get_dmi_info ()
 {
 	struct udev *udev;
-	struct udev_enumerate *enumerate;
-	struct udev_list_entry *devices;
-	struct udev_list_entry *dev_list_entry;
 	struct udev_device *dev;
 	DmiInfo *info = NULL;
 
-	udev = udev_new ();
-	if (!udev) {
-		g_warning ("Cannot create udev");
+	udev = get_udev_context ();
+	if (!udev)
 		return NULL;
-	}
 
-	enumerate = udev_enumerate_new (udev);
-	udev_enumerate_add_match_subsystem (enumerate, "dmi");
-	udev_enumerate_scan_devices (enumerate);
-	devices = udev_enumerate_get_list_entry (enumerate);
-
-	if (devices == NULL) {
+	dev = udev_device_new_from_subsystem_sysname (udev, "dmi", "id");
+	if (dev == NULL) {
 		g_warning("No dmi devices found.");
 		return NULL;
 	}
 
 	info = g_new0 (DmiInfo, 1);
 
-	udev_list_entry_foreach (dev_list_entry, devices) {
-		const char *path;
-		const char *attribute;
-		path = udev_list_entry_get_name (dev_list_entry);
-		dev = udev_device_new_from_syspath (udev, path);
-
-		attribute = udev_device_get_sysattr_value (dev, "sys_vendor");
-		if (attribute)
-			info->sys_vendor = g_strdup (attribute);
-
-		attribute = udev_device_get_sysattr_value (dev, "bios_date");
-		if (attribute)
-			info->bios_date = g_strdup (attribute);
-
-		attribute = udev_device_get_sysattr_value (dev, "bios_vendor");
-		if (attribute)
-			info->bios_vendor = g_strdup (attribute);
-
-		attribute = udev_device_get_sysattr_value (dev, "bios_version");
-		if (attribute)
-			info->bios_version = g_strdup (attribute);
-
-		attribute = udev_device_get_sysattr_value (dev, "product_name");
-		if (attribute)
-			info->product_name = g_strdup (attribute);
+	info->sys_vendor = g_strdup (udev_device_get_sysattr_value (dev, "sys_vendor"));
+	info->bios_date = g_strdup (udev_device_get_sysattr_value (dev, "bios_date"));
+	info->bios_vendor = g_strdup (udev_device_get_sysattr_value (dev, "bios_vendor"));
+	info->bios_version = g_strdup (udev_device_get_sysattr_value (dev, "bios_version"));
+	info->product_name = g_strdup (udev_device_get_sysattr_value (dev, "product_name"));
+	info->product_version = g_strdup (udev_device_get_sysattr_value (dev, "product_version"));
 
-		attribute = udev_device_get_sysattr_value (dev, "product_version");
-		if (attribute)
-			info->product_version = g_strdup (attribute);
-
-		udev_device_unref (dev);
-	}
-
-	udev_enumerate_unref (enumerate);
-	udev_unref (udev);
+	udev_device_unref (dev);
 
 	return info;
 }
@@ -88,38 +81,91 @@ dmi_info_free (DmiInfo *info)
 }
 
 /**
- * get_rfkill_device_by_index:
+ * has_platform_parent:
+ *
+ * Walk up from the sysfs directory of a device the way
+ * udev_device_get_parent_with_subsystem_devtype() does, looking for a
+ * parent on the platform bus.
  **/
-struct udev_device *
-get_rfkill_device_by_index (struct udev *udev,
-			    gint         index)
+static gboolean
+has_platform_parent (const char *syspath)
 {
-	struct udev_enumerate *enumerate;
-	struct udev_list_entry *devices;
-	struct udev_list_entry *dev_list_entry;
-	struct udev_device *dev;
+	char *resolved, *path, *devices, *dir, *link, *subsystem;
+	gboolean ret = FALSE;
+
+	resolved = realpath (syspath, NULL);
+	if (resolved == NULL)
+		return FALSE;
+	path = g_strdup (resolved);
+	free (resolved);
+
+	resolved = realpath (URFKILL_SYSFS_DIR "/devices", NULL);
+	devices = g_strdup (resolved);
+	free (resolved);
+
+	while (!ret) {
+		dir = g_path_get_dirname (path);
+		g_free (path);
+		path = dir;
+
+		if (devices == NULL || strlen (path) <= strlen (devices) ||
+		    !g_str_has_prefix (path, devices))
+			break;
 
-	g_return_val_if_fail (index >= 0, NULL);
+		link = g_build_filename (path, "subsystem", NULL);
+		subsystem = g_file_read_link (link, NULL);
+		if (subsystem) {
+			dir = g_path_get_basename (subsystem);
+			ret = (g_strcmp0 (dir, "platform") == 0);
+			g_free (dir);
+			g_free (subsystem);
+		}
+		g_free (link);
+	}
 
-	enumerate = udev_enumerate_new(udev);
-	udev_enumerate_add_match_subsystem(enumerate, "rfkill");
-	udev_enumerate_scan_devices(enumerate);
-	devices = udev_enumerate_get_list_entry(enumerate);
+	g_free (path);
+	g_free (devices);
 
-	udev_list_entry_foreach(dev_list_entry, devices) {
-		const char *path, *index_c;
-		path = udev_list_entry_get_name(dev_list_entry);
-		dev = udev_device_new_from_syspath(udev, path);
+	return ret;
+}
 
-		index_c = udev_device_get_sysattr_value (dev, "index");
-		if (index_c && atoi(index_c) == index)
-			break;
+/**
+ * get_rfkill_device_attrs:
+ * @index: the rfkill index of the device
+ * @name: (out): the name the driver gave the device
+ * @platform: (out): whether a platform driver provides it
+ *
+ * The kernel names rfkill devices after their index, so the attributes
+ * are read directly from /sys/class/rfkill/rfkill<index>.
+ *
+ * Return value: %FALSE if there is no such device
+ **/
+gboolean
+get_rfkill_device_attrs (gint       index,
+			 char     **name,
+			 gboolean  *platform)
+{
+	char *syspath, *filename;
+	char *content = NULL;
+
+	g_return_val_if_fail (index >= 0, FALSE);
 
-		udev_device_unref (dev);
-		dev = NULL;
+	syspath = g_strdup_printf (URFKILL_SYSFS_DIR "/class/rfkill/rfkill%d", index);
+	filename = g_build_filename (syspath, "name", NULL);
+
+	if (!g_file_get_contents (filename, &content, NULL, NULL)) {
+		g_free (filename);
+		g_free (syspath);
+		return FALSE;
 	}
 
-	return dev;
+	*name = g_strchomp (content);
+	*platform = has_platform_parent (syspath);
+
+	g_free (filename);
+	g_free (syspath);
+
+	return TRUE;
 }
 
 KillswitchState
@@ -41,10 +41,12 @@ typedef struct {
 	char *product_version;
 } DmiInfo;
 
+struct udev		*get_udev_context		(void);
 DmiInfo			*get_dmi_info			(void);
 void			 dmi_info_free			(DmiInfo	*info);
-struct udev_device 	*get_rfkill_device_by_index	(struct udev	*udev,
-							 gint		 index);
+gboolean		 get_rfkill_device_attrs	(gint		 index,
+							 char		**name,
+							 gboolean	*platform);
 KillswitchState		 event_to_state			(gboolean	 soft,
 							 gboolean	 hard);
 const char 		*state_to_string		(KillswitchState state);
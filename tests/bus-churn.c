@@ -0,0 +1,74 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "test-helpers.h"
+
+#define DEFAULT_CONNECTIONS 1000
+#define SETTLE_MSEC 500
+
+/* Connects and disconnects bus clients that never talk to urfkilld, and
+ * reports how often urfkilld was woken up meanwhile. Each connection
+ * makes the bus emit NameOwnerChanged twice; a daemon that only watches
+ * its own clients should not see any of them. */
+
+int
+main (int argc, char **argv)
+{
+	GDBusConnection *connection;
+	char *address;
+	guint n_connections = DEFAULT_CONNECTIONS;
+	guint i;
+	gulong before, after;
+	gint64 start;
+	GError *error = NULL;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc < 2) {
+		printf ("Usage: %s <pid of urfkilld> [connections]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		n_connections = strtoul (argv[2], NULL, 10);
+
+	address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (address == NULL) {
+		printf ("No system bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	before = test_get_context_switches (argv[1]);
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < n_connections; i++) {
+		connection = g_dbus_connection_new_for_address_sync (address,
+								     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+								     G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+								     NULL, NULL, &error);
+		if (connection == NULL) {
+			printf ("Stopped at %u connections: %s\n", i, error->message);
+			g_error_free (error);
+			break;
+		}
+		g_dbus_connection_close_sync (connection, NULL, NULL);
+		g_object_unref (connection);
+	}
+
+	/* let the daemon drain whatever it was sent */
+	g_usleep (SETTLE_MSEC * 1000);
+	after = test_get_context_switches (argv[1]);
+
+	printf ("%u connections in %.3f s\n", i,
+		(g_get_monotonic_time () - start) / 1000000.0);
+	printf ("urfkilld context switches: %lu (%.2f per connection)\n",
+		after - before, i > 0 ? (double) (after - before) / i : 0.0);
+
+	g_free (address);
+
+	return 0;
+}
@@ -0,0 +1,80 @@
+#include <stdio.h>
+#include <urfkill.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+/* Counts the method calls liburfkill-glib sends to the daemon while a
+ * client enumerates the devices. Every device and killswitch comes with
+ * the one GetManagedObjects reply, so enumerating must take a single
+ * round trip however many devices the daemon exports.
+ *
+ * Needs urfkilld running on the system bus. */
+
+static volatile gint n_round_trips = 0;
+
+/* Called from the GDBus worker thread for every message */
+static GDBusMessage *
+filter_cb (GDBusConnection *connection,
+	   GDBusMessage    *message,
+	   gboolean         incoming,
+	   gpointer         user_data)
+{
+	if (!incoming &&
+	    g_dbus_message_get_message_type (message) == G_DBUS_MESSAGE_TYPE_METHOD_CALL &&
+	    !(g_dbus_message_get_flags (message) & G_DBUS_MESSAGE_FLAGS_NO_REPLY_EXPECTED) &&
+	    g_strcmp0 (g_dbus_message_get_destination (message), "org.freedesktop.URfkill") == 0)
+		g_atomic_int_inc (&n_round_trips);
+
+	return message;
+}
+
+int
+main ()
+{
+	GDBusConnection *connection;
+	UrfClient *client;
+	GList *devices;
+	guint n_connect;
+	guint n_enumerate;
+	GError *error = NULL;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	/* The client shares this connection with us */
+	connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (connection == NULL) {
+		printf ("No system bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	g_dbus_connection_add_filter (connection, filter_cb, NULL, NULL);
+
+	client = urf_client_new ();
+	n_connect = g_atomic_int_get (&n_round_trips);
+
+	if (!urf_client_enumerate_devices_sync (client, NULL, &error)) {
+		printf ("Failed to enumerate the devices: %s\n", error->message);
+		g_error_free (error);
+		g_object_unref (client);
+		g_object_unref (connection);
+		return 1;
+	}
+	n_enumerate = g_atomic_int_get (&n_round_trips) - n_connect;
+
+	devices = urf_client_get_devices (client);
+	printf ("%u devices: %u round trips to connect, %u to enumerate\n",
+		g_list_length (devices), n_connect, n_enumerate);
+
+	g_object_unref (client);
+	g_object_unref (connection);
+
+	if (n_enumerate != 1) {
+		printf ("FAILED: expected GetManagedObjects alone\n");
+		return 1;
+	}
+
+	printf ("OK\n");
+	return 0;
+}
@@ -0,0 +1,84 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib.h>
+#include <linux/rfkill.h>
+
+#include "rfkill-harness.h"
+
+#define DEFAULT_CYCLES 5000
+#define BATCH 16
+
+/* Hotplugs thousands of kernel devices through the daemon's arbitrator,
+ * with the test playing the kernel, and checks that the number of open
+ * file descriptors stays where it was after the first cycle. Every
+ * kernel device shares the arbitrator's rfkill control fd, so neither
+ * adding nor removing one may open anything. */
+
+int
+main (int argc, char **argv)
+{
+	TestRfkill *rfkill;
+	guint n_cycles = DEFAULT_CYCLES;
+	guint n_fds, baseline, peak;
+	guint i, j;
+	gboolean failed = FALSE;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc > 1)
+		n_cycles = strtoul (argv[1], NULL, 10);
+	if (n_cycles == 0)
+		n_cycles = 1;
+
+	rfkill = test_rfkill_new ();
+	if (rfkill == NULL || !test_rfkill_startup (rfkill))
+		return 1;
+
+	/* Whatever is opened once, on the first device, is not a leak */
+	test_rfkill_send (rfkill, RFKILL_OP_ADD, 0, RFKILL_TYPE_WLAN, FALSE, FALSE);
+	test_rfkill_settle (rfkill);
+	test_rfkill_send (rfkill, RFKILL_OP_DEL, 0, RFKILL_TYPE_WLAN, FALSE, FALSE);
+	test_rfkill_settle (rfkill);
+	baseline = peak = test_count_fds ();
+
+	/* A batch of devices comes and goes each cycle, with fresh indexes
+	 * the way the kernel hands them out */
+	for (i = 0; i < n_cycles; i++) {
+		for (j = 0; j < BATCH; j++)
+			test_rfkill_send (rfkill, RFKILL_OP_ADD, 1 + i * BATCH + j,
+					  j % 2 ? RFKILL_TYPE_BLUETOOTH : RFKILL_TYPE_WLAN,
+					  FALSE, FALSE);
+		test_rfkill_settle (rfkill);
+
+		n_fds = test_count_fds ();
+		peak = MAX (peak, n_fds);
+
+		for (j = 0; j < BATCH; j++)
+			test_rfkill_send (rfkill, RFKILL_OP_DEL, 1 + i * BATCH + j,
+					  j % 2 ? RFKILL_TYPE_BLUETOOTH : RFKILL_TYPE_WLAN,
+					  FALSE, FALSE);
+		test_rfkill_settle (rfkill);
+
+		n_fds = test_count_fds ();
+		if (n_fds != baseline) {
+			printf ("Cycle %u: %u fds open, %u before\n", i, n_fds, baseline);
+			failed = TRUE;
+			break;
+		}
+	}
+
+	printf ("%u devices hotplugged in %u cycles: %u fds before, %u at most with %u present\n",
+		i * BATCH, i, baseline, peak, BATCH);
+	if (peak != baseline) {
+		printf ("Adding devices opened fds\n");
+		failed = TRUE;
+	}
+
+	test_rfkill_free (rfkill);
+
+	printf ("%s\n", failed ? "FAILED" : "OK");
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,205 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#define URFKILL_DBUS_SERVICE	"org.freedesktop.URfkill"
+#define URFKILL_DBUS_PATH	"/org/freedesktop/URfkill"
+#define URFKILL_DBUS_INTERFACE	"org.freedesktop.URfkill"
+
+#define DEFAULT_CLIENTS 2000
+#define QUERIES 1000
+#define REPLY_TIMEOUT_SEC 30
+
+/* Every client is its own bus connection, so the daemon sees thousands
+ * of distinct bus names. The system bus limits the connections per
+ * user (256 by default), so raise max_connections_per_user in the bus
+ * configuration to go beyond that. */
+
+static GMainLoop *loop = NULL;
+static guint pending = 0;
+static guint failed = 0;
+
+static void
+call_done (GObject *source, GAsyncResult *res, gpointer data)
+{
+	guint *cookie = data;
+	GVariant *retval;
+	GError *error = NULL;
+
+	retval = g_dbus_connection_call_finish (G_DBUS_CONNECTION (source), res, &error);
+	if (error) {
+		failed++;
+		g_error_free (error);
+	} else {
+		if (cookie)
+			g_variant_get (retval, "(u)", cookie);
+		g_variant_unref (retval);
+	}
+
+	if (--pending == 0)
+		g_main_loop_quit (loop);
+}
+
+static gboolean
+timeout_cb (gpointer data)
+{
+	g_main_loop_quit (loop);
+	return FALSE;
+}
+
+static void
+print_rate (const char *phase, guint calls, gint64 usec)
+{
+	printf ("%-12s %u calls in %.3f s: %.1f calls/s\n",
+		phase, calls, usec / 1000000.0,
+		usec > 0 ? calls * 1000000.0 / usec : 0.0);
+}
+
+static void
+run_loop (void)
+{
+	guint id;
+
+	id = g_timeout_add_seconds (REPLY_TIMEOUT_SEC, timeout_cb, NULL);
+	g_main_loop_run (loop);
+	g_source_remove (id);
+	if (pending > 0)
+		printf ("%u calls timed out\n", pending);
+}
+
+static gboolean
+is_inhibited (GDBusConnection *connection)
+{
+	GVariant *retval;
+	gboolean inhibited = FALSE;
+
+	retval = g_dbus_connection_call_sync (connection, URFKILL_DBUS_SERVICE,
+					      URFKILL_DBUS_PATH, URFKILL_DBUS_INTERFACE,
+					      "IsInhibited", NULL, G_VARIANT_TYPE ("(b)"),
+					      G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+	if (retval) {
+		g_variant_get (retval, "(b)", &inhibited);
+		g_variant_unref (retval);
+	}
+	return inhibited;
+}
+
+int
+main (int argc, char **argv)
+{
+	GDBusConnection **connections;
+	guint *cookies;
+	char *address;
+	guint n_clients = DEFAULT_CLIENTS;
+	guint n_connected;
+	guint i;
+	gint64 start;
+	GError *error = NULL;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc > 1)
+		n_clients = strtoul (argv[1], NULL, 10);
+	if (n_clients == 0)
+		n_clients = 1;
+
+	address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (address == NULL) {
+		printf ("No system bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	connections = g_new0 (GDBusConnection *, n_clients);
+	cookies = g_new0 (guint, n_clients);
+
+	for (n_connected = 0; n_connected < n_clients; n_connected++) {
+		connections[n_connected] =
+			g_dbus_connection_new_for_address_sync (address,
+								G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+								G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+								NULL, NULL, &error);
+		if (connections[n_connected] == NULL) {
+			printf ("Stopped at %u clients: %s\n", n_connected, error->message);
+			g_error_free (error);
+			break;
+		}
+	}
+	printf ("%u clients connected\n", n_connected);
+	if (n_connected == 0)
+		return 1;
+
+	loop = g_main_loop_new (NULL, FALSE);
+
+	/* every client inhibits at once */
+	start = g_get_monotonic_time ();
+	for (i = 0; i < n_connected; i++) {
+		pending++;
+		g_dbus_connection_call (connections[i], URFKILL_DBUS_SERVICE,
+					URFKILL_DBUS_PATH, URFKILL_DBUS_INTERFACE,
+					"Inhibit", g_variant_new ("(s)", "stress test"),
+					G_VARIANT_TYPE ("(u)"), G_DBUS_CALL_FLAGS_NONE,
+					-1, NULL, call_done, &cookies[i]);
+	}
+	run_loop ();
+	print_rate ("Inhibit", n_connected, g_get_monotonic_time () - start);
+
+	/* the inhibited state must not get slower with the number of
+	 * inhibitors */
+	start = g_get_monotonic_time ();
+	for (i = 0; i < QUERIES; i++)
+		is_inhibited (connections[0]);
+	print_rate ("IsInhibited", QUERIES, g_get_monotonic_time () - start);
+	printf ("inhibited with %u inhibitors: %s\n", n_connected,
+		is_inhibited (connections[0]) ? "yes" : "no");
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < n_connected; i++) {
+		pending++;
+		g_dbus_connection_call (connections[i], URFKILL_DBUS_SERVICE,
+					URFKILL_DBUS_PATH, URFKILL_DBUS_INTERFACE,
+					"Uninhibit", g_variant_new ("(u)", cookies[i]),
+					NULL, G_DBUS_CALL_FLAGS_NONE,
+					-1, NULL, call_done, NULL);
+	}
+	run_loop ();
+	print_rate ("Uninhibit", n_connected, g_get_monotonic_time () - start);
+	printf ("inhibited after Uninhibit: %s\n",
+		is_inhibited (connections[0]) ? "yes" : "no");
+
+	/* inhibit again and let the disconnects clean up */
+	for (i = 0; i < n_connected; i++) {
+		pending++;
+		g_dbus_connection_call (connections[i], URFKILL_DBUS_SERVICE,
+					URFKILL_DBUS_PATH, URFKILL_DBUS_INTERFACE,
+					"Inhibit", g_variant_new ("(s)", "stress test"),
+					G_VARIANT_TYPE ("(u)"), G_DBUS_CALL_FLAGS_NONE,
+					-1, NULL, call_done, &cookies[i]);
+	}
+	run_loop ();
+
+	start = g_get_monotonic_time ();
+	for (i = 1; i < n_connected; i++) {
+		g_dbus_connection_close_sync (connections[i], NULL, NULL);
+		g_object_unref (connections[i]);
+	}
+	/* the daemon has normally seen the disconnects by the time
+	 * the remaining client gets its answer */
+	printf ("inhibited after %u disconnects: %s\n", n_connected - 1,
+		is_inhibited (connections[0]) ? "yes" : "no");
+	print_rate ("Disconnect", n_connected - 1, g_get_monotonic_time () - start);
+
+	if (failed > 0)
+		printf ("%u calls failed\n", failed);
+
+	g_object_unref (connections[0]);
+	g_main_loop_unref (loop);
+	g_free (connections);
+	g_free (cookies);
+	g_free (address);
+
+	return failed > 0 ? 1 : 0;
+}
@@ -0,0 +1,118 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/input.h>
+#include <linux/uinput.h>
+#include <glib.h>
+
+#include "test-helpers.h"
+
+#define DEFAULT_KEYSTROKES 10000
+#define SETTLE_MSEC 1000
+
+/* Creates a virtual keyboard that has an rfkill key, so urfkilld picks
+ * it up, types ordinary keys on it, and reports how often urfkilld was
+ * woken up meanwhile. With the events masked in the kernel, none of the
+ * keystrokes should reach the daemon. Needs write access to
+ * /dev/uinput. */
+
+static gboolean
+emit (int fd, int type, int code, int value)
+{
+	struct input_event event;
+
+	memset (&event, 0, sizeof (event));
+	event.type = type;
+	event.code = code;
+	event.value = value;
+
+	return write (fd, &event, sizeof (event)) == sizeof (event);
+}
+
+static int
+create_keyboard (void)
+{
+	struct uinput_user_dev dev;
+	int fd;
+
+	fd = open ("/dev/uinput", O_WRONLY | O_NONBLOCK);
+	if (fd < 0)
+		return -1;
+
+	ioctl (fd, UI_SET_EVBIT, EV_KEY);
+	ioctl (fd, UI_SET_EVBIT, EV_MSC);
+	ioctl (fd, UI_SET_MSCBIT, MSC_SCAN);
+	ioctl (fd, UI_SET_KEYBIT, KEY_A);
+	ioctl (fd, UI_SET_KEYBIT, KEY_WLAN);
+
+	memset (&dev, 0, sizeof (dev));
+	snprintf (dev.name, UINPUT_MAX_NAME_SIZE, "urfkill keystroke benchmark");
+	dev.id.bustype = BUS_VIRTUAL;
+
+	if (write (fd, &dev, sizeof (dev)) != sizeof (dev) ||
+	    ioctl (fd, UI_DEV_CREATE) < 0) {
+		close (fd);
+		return -1;
+	}
+
+	return fd;
+}
+
+int
+main (int argc, char **argv)
+{
+	guint n_keystrokes = DEFAULT_KEYSTROKES;
+	guint i;
+	gulong before, after;
+	gint64 start;
+	int fd;
+
+	if (argc < 2) {
+		printf ("Usage: %s <pid of urfkilld> [keystrokes]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		n_keystrokes = strtoul (argv[2], NULL, 10);
+
+	fd = create_keyboard ();
+	if (fd < 0) {
+		printf ("Failed to create the virtual keyboard: %s\n", g_strerror (errno));
+		return 1;
+	}
+
+	/* let the daemon see the new device */
+	g_usleep (SETTLE_MSEC * 1000);
+
+	before = test_get_context_switches (argv[1]);
+	start = g_get_monotonic_time ();
+
+	for (i = 0; i < n_keystrokes; i++) {
+		if (!emit (fd, EV_MSC, MSC_SCAN, 0x1e) ||
+		    !emit (fd, EV_KEY, KEY_A, 1) ||
+		    !emit (fd, EV_SYN, SYN_REPORT, 0) ||
+		    !emit (fd, EV_MSC, MSC_SCAN, 0x1e) ||
+		    !emit (fd, EV_KEY, KEY_A, 0) ||
+		    !emit (fd, EV_SYN, SYN_REPORT, 0)) {
+			printf ("Stopped at %u keystrokes: %s\n", i, g_strerror (errno));
+			break;
+		}
+	}
+
+	/* let the daemon drain whatever it was sent */
+	g_usleep (SETTLE_MSEC * 1000);
+	after = test_get_context_switches (argv[1]);
+
+	printf ("%u keystrokes in %.3f s\n", i,
+		(g_get_monotonic_time () - start) / 1000000.0);
+	printf ("urfkilld context switches: %lu (%.1f per 10k keystrokes)\n",
+		after - before, i > 0 ? (double) (after - before) * 10000 / i : 0.0);
+
+	ioctl (fd, UI_DEV_DESTROY);
+	close (fd);
+
+	return 0;
+}
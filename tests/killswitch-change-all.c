@@ -0,0 +1,143 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "urf-device.h"
+#include "urf-device-kernel.h"
+#include "urf-killswitch.h"
+#include "urf-rfkill-writer.h"
+
+#define DEFAULT_RADIOS 4
+
+/* Puts several kernel radios of two types behind their killswitches,
+ * blocks both types and checks what reaches the rfkill control device:
+ * one CHANGE_ALL per type, however many radios it has. A single device
+ * must still get a CHANGE with its own index. The writer is pointed at
+ * a pipe in place of /dev/rfkill.
+ *
+ * The killswitches and devices export themselves on the session bus,
+ * so run this under dbus-launch or dbus-run-session. */
+
+static const enum rfkill_type types[] = {
+	RFKILL_TYPE_WLAN,
+	RFKILL_TYPE_BLUETOOTH,
+};
+
+static guint
+read_events (int                  fd,
+	     struct rfkill_event *events,
+	     guint                max)
+{
+	guint n_events = 0;
+
+	while (n_events < max &&
+	       read (fd, &events[n_events], sizeof (events[0])) == sizeof (events[0]))
+		n_events++;
+
+	return n_events;
+}
+
+int
+main (int argc, char **argv)
+{
+	GDBusConnection *connection;
+	UrfRfkillWriter *writer;
+	UrfKillswitch *killswitch[G_N_ELEMENTS (types)];
+	UrfDevice *device;
+	GPtrArray *devices;
+	struct rfkill_event events[64];
+	guint n_radios = DEFAULT_RADIOS;
+	guint n_events, n_writes, n_writes_before;
+	guint i, j;
+	gboolean failed = FALSE;
+	int fds[2];
+	GError *error = NULL;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc > 1)
+		n_radios = strtoul (argv[1], NULL, 10);
+	if (n_radios < 2)
+		n_radios = 2;
+
+	connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+	if (connection == NULL) {
+		printf ("No session bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	if (pipe (fds) < 0 || fcntl (fds[0], F_SETFL, O_NONBLOCK) < 0) {
+		printf ("pipe: %s\n", g_strerror (errno));
+		return 1;
+	}
+
+	writer = urf_rfkill_writer_new ();
+	urf_rfkill_writer_set_fd (writer, fds[1]);
+
+	devices = g_ptr_array_new_with_free_func (g_object_unref);
+	for (i = 0; i < G_N_ELEMENTS (types); i++) {
+		killswitch[i] = urf_killswitch_new (types[i], writer, connection);
+		for (j = 0; j < n_radios; j++) {
+			device = urf_device_kernel_new (i * n_radios + j, types[i],
+							FALSE, FALSE, writer, connection);
+			urf_killswitch_add_device (killswitch[i], device);
+			g_ptr_array_add (devices, device);
+		}
+	}
+
+	/* Block every type, the way BlockTypes and FlightMode do */
+	urf_rfkill_writer_get_counters (writer, NULL, NULL, &n_writes_before);
+	for (i = 0; i < G_N_ELEMENTS (types); i++)
+		urf_killswitch_set_software_blocked (killswitch[i], TRUE);
+	urf_rfkill_writer_flush (writer);
+	urf_rfkill_writer_get_counters (writer, NULL, NULL, &n_writes);
+
+	n_events = read_events (fds[0], events, G_N_ELEMENTS (events));
+	printf ("%u types with %u radios each: %u writes, %u events\n",
+		(guint) G_N_ELEMENTS (types), n_radios, n_writes - n_writes_before, n_events);
+
+	if (n_events != G_N_ELEMENTS (types) ||
+	    n_writes - n_writes_before != G_N_ELEMENTS (types)) {
+		printf ("Expected one CHANGE_ALL per type\n");
+		failed = TRUE;
+	}
+	for (i = 0; i < n_events && i < G_N_ELEMENTS (types); i++) {
+		if (events[i].op != RFKILL_OP_CHANGE_ALL ||
+		    events[i].type != types[i] || events[i].soft != 1) {
+			printf ("Event %u: op %u type %u soft %u, expected CHANGE_ALL of %s\n",
+				i, events[i].op, events[i].type, events[i].soft,
+				type_to_string (types[i]));
+			failed = TRUE;
+		}
+	}
+
+	/* A single device, the way BlockIdx does */
+	device = g_ptr_array_index (devices, n_radios + 1);
+	urf_device_set_software_blocked (device, FALSE);
+	n_events = read_events (fds[0], events, G_N_ELEMENTS (events));
+	if (n_events != 1 || events[0].op != RFKILL_OP_CHANGE ||
+	    events[0].idx != n_radios + 1 || events[0].soft != 0) {
+		printf ("Expected a single CHANGE of device %u\n", n_radios + 1);
+		failed = TRUE;
+	}
+
+	g_ptr_array_unref (devices);
+	for (i = 0; i < G_N_ELEMENTS (types); i++)
+		g_object_unref (killswitch[i]);
+	g_object_unref (writer);
+	g_object_unref (connection);
+	close (fds[0]);
+	close (fds[1]);
+
+	printf ("%s\n", failed ? "FAILED" : "OK");
+
+	return failed ? 1 : 0;
+}
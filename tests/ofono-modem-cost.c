@@ -0,0 +1,129 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "test-helpers.h"
+
+#define DEFAULT_MODEMS 500
+#define DEFAULT_UPDATES 20000
+#define UPDATES_PER_BATCH 500
+#define SETTLE_TIMEOUT_SEC 30
+
+/* Plays oFono on the system bus with many modems, and reports how much
+ * memory urfkilld spends per modem and how much CPU time a
+ * PropertyChanged signal costs it, both for a property urfkilld does
+ * not use and for Online, which changes the block state.
+ *
+ * Owning org.ofono needs root and the bus policy that ships with oFono,
+ * and the real oFono must not be running. */
+
+static guint n_modems = DEFAULT_MODEMS;
+
+static void
+measure_updates (GDBusConnection *ofono,
+		 const char      *pid,
+		 const char      *property,
+		 guint            n_updates)
+{
+	GVariant *value;
+	char *path;
+	gdouble before, after;
+	guint i;
+
+	before = test_get_cpu_usec (pid);
+
+	for (i = 0; i < n_updates; i++) {
+		if (g_strcmp0 (property, "Online") == 0)
+			value = g_variant_new_boolean (i % 2);
+		else
+			value = g_variant_new_string (i % 2 ? "0123456789" : "9876543210");
+
+		path = g_strdup_printf ("/cost_%u", i % n_modems);
+		g_dbus_connection_emit_signal (ofono, NULL, path,
+					       "org.ofono.Modem", "PropertyChanged",
+					       g_variant_new ("(sv)", property, value),
+					       NULL);
+		g_free (path);
+
+		/* urfkilld answers after it went through the signals
+		 * we sent before the call */
+		if ((i + 1) % UPDATES_PER_BATCH == 0 || i + 1 == n_updates)
+			test_count_devices (ofono);
+	}
+
+	after = test_get_cpu_usec (pid);
+	printf ("%-8s %u updates: %.2f us of urfkilld CPU time per update\n",
+		property, n_updates, (after - before) / n_updates);
+}
+
+int
+main (int argc, char **argv)
+{
+	GDBusConnection *client;
+	GDBusConnection *ofono;
+	char *address;
+	guint n_updates = DEFAULT_UPDATES;
+	guint n_baseline;
+	gulong rss_before, rss_after;
+	gint64 deadline;
+	GError *error = NULL;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc < 2) {
+		printf ("Usage: %s <pid of urfkilld> [modems] [updates]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		n_modems = strtoul (argv[2], NULL, 10);
+	if (argc > 3)
+		n_updates = strtoul (argv[3], NULL, 10);
+	if (n_modems == 0)
+		n_modems = 1;
+
+	address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (address == NULL) {
+		printf ("No system bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	client = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+	n_baseline = test_count_devices (client);
+
+	rss_before = test_get_rss_kb (argv[1]);
+
+	ofono = test_ofono_start (address, "cost", n_modems);
+	if (ofono == NULL)
+		return 1;
+
+	deadline = g_get_monotonic_time () + SETTLE_TIMEOUT_SEC * G_USEC_PER_SEC;
+	while (test_ofono_get_property_calls () < n_modems ||
+	       test_count_devices (client) < n_baseline + n_modems) {
+		if (g_get_monotonic_time () > deadline) {
+			printf ("Only %u of %u modems showed up\n",
+				test_count_devices (client) - n_baseline, n_modems);
+			return 1;
+		}
+		while (g_main_context_iteration (NULL, FALSE))
+			;
+		g_usleep (10 * 1000);
+	}
+
+	rss_after = test_get_rss_kb (argv[1]);
+	printf ("%u modems: urfkilld RSS %lu -> %lu kB, %.2f kB per modem\n",
+		n_modems, rss_before, rss_after,
+		(gdouble) ((glong) rss_after - (glong) rss_before) / n_modems);
+
+	measure_updates (ofono, argv[1], "Serial", n_updates);
+	measure_updates (ofono, argv[1], "Online", n_updates);
+
+	test_ofono_stop (ofono);
+	g_object_unref (client);
+	g_free (address);
+
+	return 0;
+}
@@ -0,0 +1,123 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "test-helpers.h"
+
+#define DEFAULT_RESTARTS 1000
+#define DEFAULT_MODEMS 2
+#define WARMUP_RESTARTS 100
+#define MAX_GROWTH_KB 1024
+#define SETTLE_TIMEOUT_SEC 5
+
+/* Plays oFono on the system bus and restarts it over and over. Each
+ * instance announces a few modems; urfkilld has to export them, and
+ * drop them again once the instance leaves the bus. The resident set
+ * of urfkilld is sampled along the way and must not keep growing.
+ *
+ * Owning org.ofono needs root and the bus policy that ships with oFono,
+ * and the real oFono must not be running. */
+
+static guint n_modems = DEFAULT_MODEMS;
+
+/* Serves the stand-in oFono until urfkilld has the expected number of
+ * devices and, when adding, has fetched the modem properties */
+static gboolean
+wait_for_devices (GDBusConnection *client,
+		  guint            n_expected,
+		  guint            n_calls)
+{
+	gint64 deadline;
+
+	deadline = g_get_monotonic_time () + SETTLE_TIMEOUT_SEC * G_USEC_PER_SEC;
+	while (g_get_monotonic_time () < deadline) {
+		while (g_main_context_iteration (NULL, FALSE))
+			;
+		if (test_ofono_get_property_calls () >= n_calls &&
+		    test_count_devices (client) == n_expected)
+			return TRUE;
+		g_usleep (10 * 1000);
+	}
+
+	return FALSE;
+}
+
+int
+main (int argc, char **argv)
+{
+	GDBusConnection *client;
+	GDBusConnection *ofono;
+	char *address;
+	guint n_restarts = DEFAULT_RESTARTS;
+	guint n_baseline;
+	guint i;
+	gulong rss_warm = 0, rss;
+	gboolean failed = FALSE;
+	GError *error = NULL;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc < 2) {
+		printf ("Usage: %s <pid of urfkilld> [restarts] [modems]\n", argv[0]);
+		return 1;
+	}
+	if (argc > 2)
+		n_restarts = strtoul (argv[2], NULL, 10);
+	if (argc > 3)
+		n_modems = strtoul (argv[3], NULL, 10);
+
+	address = g_dbus_address_get_for_bus_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (address == NULL) {
+		printf ("No system bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	client = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, NULL);
+	n_baseline = test_count_devices (client);
+
+	for (i = 1; i <= n_restarts; i++) {
+		ofono = test_ofono_start (address, "soak", n_modems);
+		if (ofono == NULL) {
+			failed = TRUE;
+			break;
+		}
+
+		if (!wait_for_devices (client, n_baseline + n_modems,
+				       test_ofono_get_property_calls () + n_modems)) {
+			printf ("Restart %u: the modems did not show up\n", i);
+			failed = TRUE;
+		}
+
+		test_ofono_stop (ofono);
+
+		if (!wait_for_devices (client, n_baseline, 0)) {
+			printf ("Restart %u: the modems were not removed\n", i);
+			failed = TRUE;
+		}
+		if (failed)
+			break;
+
+		if (i == WARMUP_RESTARTS || i % 100 == 0) {
+			rss = test_get_rss_kb (argv[1]);
+			if (i == WARMUP_RESTARTS)
+				rss_warm = rss;
+			printf ("%u restarts: urfkilld RSS %lu kB\n", i, rss);
+		}
+	}
+
+	rss = test_get_rss_kb (argv[1]);
+	if (rss_warm > 0 && rss > rss_warm + MAX_GROWTH_KB) {
+		printf ("urfkilld grew by %lu kB after the first %u restarts\n",
+			rss - rss_warm, WARMUP_RESTARTS);
+		failed = TRUE;
+	}
+
+	g_object_unref (client);
+	g_free (address);
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,229 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <signal.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "urf-config.h"
+
+#define DEFAULT_ROUNDS 20
+/* Longer than the journal's debounce delay, so the checkpoint is synced */
+#define CHECKPOINT_SETTLE_MSEC 1000
+/* Longer than the journal's bounded delay, so kills land in every phase:
+ * between syncs, in the middle of a journal write, and while compacting */
+#define MAX_KILL_DELAY_MSEC 3500
+
+/* Kills a process that keeps changing the saved states with SIGKILL at
+ * a random point, then loads the states again the way urfkilld does at
+ * startup. Half of the types are flipped, synced and then left alone
+ * while the process keeps changing the others: those must come back
+ * exactly as synced, however often the journal was written or compacted
+ * in between. The other types must come back either as their checkpoint
+ * or as one of the values set after it; nothing torn may be read.
+ *
+ * The states are kept under PACKAGE_LOCALSTATE_DIR, which the build
+ * points to a directory of its own for this test. */
+
+static char persist_dir[] = PACKAGE_LOCALSTATE_DIR "/lib/urfkill";
+
+static gboolean
+write_byte (int fd, guchar byte)
+{
+	while (write (fd, &byte, 1) < 0) {
+		if (errno != EINTR)
+			return FALSE;
+	}
+	return TRUE;
+}
+
+static gboolean
+settle_cb (gpointer data)
+{
+	g_main_loop_quit (data);
+	return FALSE;
+}
+
+/* Frozen types alternate between rounds, so each is tested both ways */
+static gboolean
+is_frozen (guint round,
+	   gint  type)
+{
+	return (round + type) % 2 == 0;
+}
+
+/* Flips the frozen types away from what was saved before and sets the
+ * others to the checkpoint, waits for that to be synced and reports the
+ * frozen values to the parent, followed by 'S'. Then changes the other
+ * types until it is killed, reporting each change before it is made. */
+static void
+run_child (int      fd,
+	   guint    round,
+	   gboolean checkpoint)
+{
+	UrfConfig *config;
+	GMainLoop *loop;
+	gint type;
+	gboolean soft;
+
+	g_random_set_seed (getpid ());
+	config = urf_config_new ();
+
+	for (type = RFKILL_TYPE_ALL; type < NUM_RFKILL_TYPES; type++) {
+		if (is_frozen (round, type))
+			soft = !urf_config_get_persist_state (config, type);
+		else
+			soft = checkpoint;
+		urf_config_set_persist_state (config, type,
+					      soft ? KILLSWITCH_STATE_SOFT_BLOCKED
+						   : KILLSWITCH_STATE_UNBLOCKED);
+	}
+
+	loop = g_main_loop_new (NULL, FALSE);
+	g_timeout_add (CHECKPOINT_SETTLE_MSEC, settle_cb, loop);
+	g_main_loop_run (loop);
+	g_main_loop_unref (loop);
+
+	for (type = RFKILL_TYPE_ALL; type < NUM_RFKILL_TYPES; type++) {
+		if (!is_frozen (round, type))
+			continue;
+		soft = urf_config_get_persist_state (config, type);
+		if (!write_byte (fd, type * 2 + soft))
+			_exit (1);
+	}
+	if (!write_byte (fd, 'S'))
+		_exit (1);
+
+	for (;;) {
+		do
+			type = g_random_int_range (RFKILL_TYPE_ALL, NUM_RFKILL_TYPES);
+		while (is_frozen (round, type));
+		soft = g_random_boolean ();
+
+		if (!write_byte (fd, type * 2 + soft))
+			_exit (1);
+		urf_config_set_persist_state (config, type,
+					      soft ? KILLSWITCH_STATE_SOFT_BLOCKED
+						   : KILLSWITCH_STATE_UNBLOCKED);
+
+		while (g_main_context_iteration (NULL, FALSE))
+			;
+		g_usleep (500);
+	}
+}
+
+static gboolean
+run_round (guint round)
+{
+	UrfConfig *config;
+	gboolean checkpoint = round % 2;
+	gboolean seen[NUM_RFKILL_TYPES][2];
+	gboolean frozen[NUM_RFKILL_TYPES];
+	gboolean synced[NUM_RFKILL_TYPES];
+	gboolean recovered;
+	gboolean ret = TRUE;
+	guchar byte;
+	gint type;
+	pid_t pid;
+	int fds[2];
+
+	if (pipe (fds) < 0) {
+		printf ("pipe: %s\n", g_strerror (errno));
+		return FALSE;
+	}
+
+	pid = fork ();
+	if (pid < 0) {
+		printf ("fork: %s\n", g_strerror (errno));
+		return FALSE;
+	}
+	if (pid == 0) {
+		close (fds[0]);
+		run_child (fds[1], round, checkpoint);
+		_exit (0);
+	}
+	close (fds[1]);
+
+	memset (frozen, 0, sizeof (frozen));
+	memset (synced, 0, sizeof (synced));
+	for (;;) {
+		if (read (fds[0], &byte, 1) != 1 || (byte != 'S' && byte / 2 >= NUM_RFKILL_TYPES)) {
+			printf ("Round %u: the writer did not reach its checkpoint\n", round);
+			kill (pid, SIGKILL);
+			waitpid (pid, NULL, 0);
+			close (fds[0]);
+			return FALSE;
+		}
+		if (byte == 'S')
+			break;
+		frozen[byte / 2] = TRUE;
+		synced[byte / 2] = byte % 2;
+	}
+
+	g_usleep (g_random_int_range (0, MAX_KILL_DELAY_MSEC) * 1000);
+	kill (pid, SIGKILL);
+	waitpid (pid, NULL, 0);
+
+	memset (seen, 0, sizeof (seen));
+	for (type = RFKILL_TYPE_ALL; type < NUM_RFKILL_TYPES; type++)
+		seen[type][checkpoint] = TRUE;
+	while (read (fds[0], &byte, 1) == 1)
+		seen[byte / 2][byte % 2] = TRUE;
+	close (fds[0]);
+
+	/* a fresh start, as the daemon would make one */
+	config = urf_config_new ();
+	for (type = RFKILL_TYPE_ALL; type < NUM_RFKILL_TYPES; type++) {
+		recovered = urf_config_get_persist_state (config, type);
+		if (frozen[type]) {
+			if (recovered != synced[type]) {
+				printf ("Round %u: %s was synced %s but came back %s\n",
+					round, type_to_string (type),
+					synced[type] ? "blocked" : "unblocked",
+					recovered ? "blocked" : "unblocked");
+				ret = FALSE;
+			}
+		} else if (!seen[type][recovered]) {
+			printf ("Round %u: %s came back %s, which was never set\n",
+				round, type_to_string (type),
+				recovered ? "blocked" : "unblocked");
+			ret = FALSE;
+		}
+	}
+	g_object_unref (config);
+
+	return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+	guint n_rounds = DEFAULT_ROUNDS;
+	guint failed = 0;
+	guint i;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc > 1)
+		n_rounds = strtoul (argv[1], NULL, 10);
+
+	if (g_mkdir_with_parents (persist_dir, 0755) < 0) {
+		printf ("Could not create %s: %s\n", persist_dir, g_strerror (errno));
+		return 1;
+	}
+
+	for (i = 1; i <= n_rounds; i++) {
+		if (!run_round (i))
+			failed++;
+	}
+
+	printf ("%u of %u rounds recovered the saved states\n", n_rounds - failed, n_rounds);
+
+	return failed > 0 ? 1 : 0;
+}
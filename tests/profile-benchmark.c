@@ -0,0 +1,339 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <glib.h>
+#include <glib/gstdio.h>
+
+#include "urf-profile.h"
+
+#define DEFAULT_VENDORS 250
+#define RULES_PER_VENDOR 20
+#define ROUNDS 20
+
+/* Writes a synthetic set of profiles, one per vendor with several rules
+ * each, compiles them, and times how long it takes to match a machine
+ * against them: once by parsing every XML profile, the way urfkilld
+ * did, and once with the compiled ruleset, mapped and matched. Both
+ * must agree on every machine tried. Every other vendor is matched by
+ * its exact name, the rest by a part of it. */
+
+static char *
+write_profile (const char *dir,
+	       guint       vendor)
+{
+	GString *xml;
+	char *name, *filename;
+	guint j, model;
+
+	xml = g_string_new ("<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+			    "<profile version=\"0.1\">\n  <device>\n");
+	if (vendor % 2)
+		g_string_append_printf (xml,
+			"    <match key=\"sys_vendor\" string_outof=\"Vendor %03u Ltd.;Vendor %03u Inc.\">\n",
+			vendor, vendor);
+	else
+		g_string_append_printf (xml,
+			"    <match key=\"sys_vendor\" contains_ncase=\"vendor %03u\">\n",
+			vendor);
+
+	for (j = 0; j < RULES_PER_VENDOR; j++) {
+		model = vendor * RULES_PER_VENDOR + j;
+		switch (j % 4) {
+		case 0:
+			g_string_append_printf (xml,
+				"      <match key=\"product_name\" string_outof=\"Model %u;Model %u-B\">\n",
+				model, model);
+			break;
+		case 1:
+			g_string_append_printf (xml,
+				"      <match key=\"product_version\" prefix_ncase=\"REV %u \">\n",
+				model);
+			break;
+		case 2:
+			g_string_append_printf (xml,
+				"      <match key=\"bios_version\" suffix=\" %u.0\">\n",
+				model);
+			break;
+		case 3:
+			g_string_append_printf (xml,
+				"      <match key=\"product_name\" contains=\"Model %u\">\n"
+				"        <option key=\"persist\" type=\"bool\">%s</option>\n"
+				"        <match key=\"bios_vendor\" contains_not=\"Unknown\">\n",
+				model, j % 8 == 3 ? "false" : "true");
+			break;
+		}
+
+		g_string_append_printf (xml,
+			"        <option key=\"key_control\" type=\"bool\">%s</option>\n"
+			"        <option key=\"master_key\" type=\"bool\">%s</option>\n"
+			"        <option key=\"force_sync\" type=\"bool\">%s</option>\n",
+			j % 2 ? "true" : "false",
+			j % 3 ? "false" : "true",
+			j % 5 ? "false" : "true");
+
+		if (j % 4 == 3)
+			g_string_append (xml, "        </match>\n");
+		g_string_append (xml, "      </match>\n");
+	}
+
+	g_string_append (xml, "    </match>\n  </device>\n</profile>\n");
+
+	name = g_strdup_printf ("%03u-vendor.xml", vendor);
+	filename = g_build_filename (dir, name, NULL);
+	if (!g_file_set_contents (filename, xml->str, xml->len, NULL)) {
+		printf ("Failed to write %s\n", filename);
+		g_free (name);
+		name = NULL;
+	}
+
+	g_free (filename);
+	g_string_free (xml, TRUE);
+	return name;
+}
+
+/* A rule without any vendor condition, which every machine is tried on */
+static char *
+write_generic_profile (const char *dir,
+		       const char *bios_vendor)
+{
+	char *xml;
+	char *filename;
+	gboolean ret;
+
+	xml = g_strdup_printf (
+		"<?xml version=\"1.0\" encoding=\"UTF-8\"?>\n"
+		"<profile version=\"0.1\">\n  <device>\n"
+		"    <match key=\"bios_vendor\" string=\"%s\">\n"
+		"      <option key=\"force_sync\" type=\"bool\">true</option>\n"
+		"    </match>\n"
+		"  </device>\n</profile>\n", bios_vendor);
+	filename = g_build_filename (dir, "000-generic.xml", NULL);
+	ret = g_file_set_contents (filename, xml, -1, NULL);
+	g_free (xml);
+	g_free (filename);
+
+	return ret ? g_strdup ("000-generic.xml") : NULL;
+}
+
+static DmiInfo *
+make_machine (guint       vendor,
+	      guint       model,
+	      const char *bios_vendor,
+	      gboolean    lower)
+{
+	DmiInfo *info = g_new0 (DmiInfo, 1);
+
+	info->sys_vendor = g_strdup_printf ("Vendor %03u Inc.", vendor);
+	info->bios_date = g_strdup ("01/01/2014");
+	info->bios_vendor = g_strdup (bios_vendor);
+	info->bios_version = g_strdup_printf ("BIOS %u.0", model);
+	info->product_name = g_strdup_printf ("Model %u", model);
+	info->product_version = g_strdup_printf ("Rev %u A", model);
+
+	if (lower) {
+		char *str;
+#define LOWER_FIELD(field) \
+		str = info->field; \
+		info->field = g_ascii_strdown (str, -1); \
+		g_free (str)
+		LOWER_FIELD (sys_vendor);
+		LOWER_FIELD (bios_date);
+		LOWER_FIELD (bios_vendor);
+		LOWER_FIELD (bios_version);
+		LOWER_FIELD (product_name);
+		LOWER_FIELD (product_version);
+#undef LOWER_FIELD
+	}
+
+	return info;
+}
+
+static void
+free_machine (DmiInfo *info)
+{
+	g_free (info->sys_vendor);
+	g_free (info->bios_date);
+	g_free (info->bios_vendor);
+	g_free (info->bios_version);
+	g_free (info->product_name);
+	g_free (info->product_version);
+	g_free (info);
+}
+
+static void
+apply_xml (const char        *dir,
+	   GList             *profile_list,
+	   DmiInfo           *info,
+	   DmiInfo           *info_lower,
+	   UrfProfileOptions *options)
+{
+	GList *lptr;
+	char *filename;
+
+	for (lptr = profile_list; lptr; lptr = lptr->next) {
+		filename = g_build_filename (dir, (const char *)lptr->data, NULL);
+		urf_profile_xml_apply (info, info_lower, options, filename);
+		g_free (filename);
+	}
+}
+
+static gboolean
+apply_db (const char        *db_file,
+	  const char        *dir,
+	  GList             *profile_list,
+	  DmiInfo           *info,
+	  DmiInfo           *info_lower,
+	  UrfProfileOptions *options)
+{
+	UrfProfileDb *db;
+	gboolean ret = FALSE;
+
+	db = urf_profile_db_open (db_file);
+	if (db && urf_profile_db_covers (db, dir, profile_list)) {
+		urf_profile_db_apply (db, info, info_lower, options);
+		ret = TRUE;
+	}
+	urf_profile_db_free (db);
+
+	return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+	UrfProfileOptions defaults = { TRUE, FALSE, FALSE, TRUE };
+	UrfProfileOptions xml_options, db_options;
+	DmiInfo *info, *info_lower;
+	GList *profile_list = NULL;
+	GList *lptr;
+	GPtrArray *paths;
+	char *dir, *db_file, *name;
+	gint64 start, xml_usec, db_usec;
+	guint n_vendors = DEFAULT_VENDORS;
+	guint vendors[4], models[] = { 0, 1, 2, 3, 7, 11, RULES_PER_VENDOR - 1 };
+	const char *bios_vendors[] = { "Phoenix", "Generic BIOS", "Unknown" };
+	guint n_checked = 0;
+	guint i, j, k;
+	gboolean failed = FALSE;
+	GError *error = NULL;
+
+	if (argc > 1)
+		n_vendors = strtoul (argv[1], NULL, 10);
+	if (n_vendors == 0)
+		n_vendors = 1;
+
+	dir = g_dir_make_tmp ("urfkill-profiles-XXXXXX", &error);
+	if (dir == NULL) {
+		printf ("Could not create a directory: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+
+	name = write_generic_profile (dir, "Generic BIOS");
+	if (name == NULL)
+		return 1;
+	profile_list = g_list_append (profile_list, name);
+	for (i = 0; i < n_vendors; i++) {
+		name = write_profile (dir, i);
+		if (name == NULL)
+			return 1;
+		profile_list = g_list_append (profile_list, name);
+	}
+
+	/* The ruleset lives next to the profiles, as installed */
+	db_file = g_build_filename (dir, "profiles.db", NULL);
+	paths = g_ptr_array_new_with_free_func (g_free);
+	for (lptr = profile_list; lptr; lptr = lptr->next)
+		g_ptr_array_add (paths, g_build_filename (dir, (const char *)lptr->data, NULL));
+	g_ptr_array_add (paths, NULL);
+	if (!urf_profile_db_compile (db_file, (char **)paths->pdata)) {
+		printf ("Failed to compile the profiles\n");
+		return 1;
+	}
+	g_ptr_array_unref (paths);
+
+	/* Both ways must come to the same options */
+	vendors[0] = 0;
+	vendors[1] = n_vendors / 2;
+	vendors[2] = n_vendors - 1;
+	vendors[3] = n_vendors; /* no profile */
+	for (i = 0; i < G_N_ELEMENTS (vendors); i++) {
+		for (j = 0; j < G_N_ELEMENTS (models); j++) {
+			for (k = 0; k < G_N_ELEMENTS (bios_vendors); k++) {
+				guint model = vendors[i] * RULES_PER_VENDOR + models[j];
+
+				info = make_machine (vendors[i], model, bios_vendors[k], FALSE);
+				info_lower = make_machine (vendors[i], model, bios_vendors[k], TRUE);
+				xml_options = db_options = defaults;
+				apply_xml (dir, profile_list, info, info_lower, &xml_options);
+				if (!apply_db (db_file, dir, profile_list, info, info_lower, &db_options)) {
+					printf ("The compiled profiles were not used\n");
+					failed = TRUE;
+				} else if (memcmp (&xml_options, &db_options, sizeof (xml_options)) != 0) {
+					printf ("%s %s %s: the XML gives %d%d%d%d, the ruleset %d%d%d%d\n",
+						info->sys_vendor, info->product_name, info->bios_vendor,
+						xml_options.key_control, xml_options.master_key,
+						xml_options.force_sync, xml_options.persist,
+						db_options.key_control, db_options.master_key,
+						db_options.force_sync, db_options.persist);
+					failed = TRUE;
+				}
+				n_checked++;
+				free_machine (info);
+				free_machine (info_lower);
+			}
+		}
+	}
+
+	/* Time a cold start for a machine in the middle of the list */
+	info = make_machine (vendors[1], vendors[1] * RULES_PER_VENDOR + 7, "Phoenix", FALSE);
+	info_lower = make_machine (vendors[1], vendors[1] * RULES_PER_VENDOR + 7, "Phoenix", TRUE);
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < ROUNDS; i++) {
+		xml_options = defaults;
+		apply_xml (dir, profile_list, info, info_lower, &xml_options);
+	}
+	xml_usec = (g_get_monotonic_time () - start) / ROUNDS;
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < ROUNDS; i++) {
+		db_options = defaults;
+		apply_db (db_file, dir, profile_list, info, info_lower, &db_options);
+	}
+	db_usec = (g_get_monotonic_time () - start) / ROUNDS;
+
+	/* A profile edited after compiling, even to the same size, must
+	 * not be matched from the stale ruleset */
+	name = write_generic_profile (dir, "Generic BIOX");
+	g_free (name);
+	if (apply_db (db_file, dir, profile_list, info, info_lower, &db_options)) {
+		printf ("The compiled profiles were used after a profile changed\n");
+		failed = TRUE;
+	}
+
+	free_machine (info);
+	free_machine (info_lower);
+
+	printf ("%u profiles, %u rules, %u machines checked\n",
+		n_vendors + 1, n_vendors * RULES_PER_VENDOR + 1, n_checked);
+	printf ("XML: %.3f ms, compiled: %.3f ms, %.1f times faster\n",
+		xml_usec / 1000.0, db_usec / 1000.0,
+		db_usec > 0 ? (gdouble) xml_usec / db_usec : 0.0);
+
+	for (lptr = profile_list; lptr; lptr = lptr->next) {
+		name = g_build_filename (dir, (const char *)lptr->data, NULL);
+		g_unlink (name);
+		g_free (name);
+		g_free (lptr->data);
+	}
+	g_list_free (profile_list);
+	g_unlink (db_file);
+	g_rmdir (dir);
+	g_free (db_file);
+	g_free (dir);
+
+	printf ("%s\n", failed ? "FAILED" : "OK");
+
+	return failed ? 1 : 0;
+}
@@ -0,0 +1,70 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib.h>
+#include <linux/rfkill.h>
+
+#include "rfkill-harness.h"
+#include "test-helpers.h"
+
+#define DEFAULT_DEVICES 1000
+
+/* Registers a thousand simulated kernel devices through the daemon's
+ * arbitrator, one ADD event at a time, and reports what each costs:
+ * the time until the device is on the bus, and the resident memory
+ * they take together. The introspection data is parsed once per class,
+ * on the first device, so only that one should stand out. */
+
+int
+main (int argc, char **argv)
+{
+	TestRfkill *rfkill;
+	guint n_devices = DEFAULT_DEVICES;
+	gulong rss_before, rss_after;
+	gint64 start, usec, first, total = 0, max = 0;
+	guint i;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc > 1)
+		n_devices = strtoul (argv[1], NULL, 10);
+	if (n_devices < 2)
+		n_devices = 2;
+
+	rfkill = test_rfkill_new ();
+	if (rfkill == NULL || !test_rfkill_startup (rfkill))
+		return 1;
+
+	rss_before = test_get_rss_kb ("self");
+
+	for (i = 0; i < n_devices; i++) {
+		start = g_get_monotonic_time ();
+		test_rfkill_send (rfkill, RFKILL_OP_ADD, i,
+				  i % 2 ? RFKILL_TYPE_BLUETOOTH : RFKILL_TYPE_WLAN,
+				  FALSE, FALSE);
+		test_rfkill_settle (rfkill);
+		usec = g_get_monotonic_time () - start;
+
+		if (i == 0) {
+			first = usec;
+			continue;
+		}
+		total += usec;
+		max = MAX (max, usec);
+	}
+
+	rss_after = test_get_rss_kb ("self");
+
+	printf ("%u devices registered\n", n_devices);
+	printf ("first device: %.1f us\n", (gdouble) first);
+	printf ("others: %.1f us on average, %.1f us at most\n",
+		(gdouble) total / (n_devices - 1), (gdouble) max);
+	printf ("RSS: %lu kB before, %lu kB after, %.2f kB per device\n",
+		rss_before, rss_after,
+		(gdouble) ((glong) rss_after - (glong) rss_before) / n_devices);
+
+	test_rfkill_free (rfkill);
+
+	return 0;
+}
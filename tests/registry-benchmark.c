@@ -0,0 +1,86 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib.h>
+#include <linux/rfkill.h>
+
+#include "rfkill-harness.h"
+
+#define DEFAULT_CYCLES 10000
+#define LOOKUPS 100000
+
+/* Plays the kernel to the daemon's arbitrator: adds, changes and
+ * removes a device over and over, once next to a few resident devices
+ * and once next to many. With the devices kept in a registry indexed by
+ * rfkill index, the time per cycle and per lookup must not depend on
+ * how many devices are resident. */
+
+static const guint resident_counts[] = { 16, 1024 };
+
+static gboolean
+run (guint n_resident,
+     guint n_cycles)
+{
+	TestRfkill *rfkill;
+	gint64 start, cycles_usec, lookups_usec;
+	guint32 index;
+	guint i;
+
+	rfkill = test_rfkill_new ();
+	if (rfkill == NULL || !test_rfkill_startup (rfkill))
+		return FALSE;
+
+	for (i = 0; i < n_resident; i++) {
+		test_rfkill_send (rfkill, RFKILL_OP_ADD, i, RFKILL_TYPE_WLAN, FALSE, FALSE);
+		test_rfkill_settle (rfkill);
+	}
+
+	/* one index past the resident ones comes and goes */
+	index = n_resident;
+	start = g_get_monotonic_time ();
+	for (i = 0; i < n_cycles; i++) {
+		test_rfkill_send (rfkill, RFKILL_OP_ADD, index, RFKILL_TYPE_WLAN, FALSE, FALSE);
+		test_rfkill_settle (rfkill);
+		test_rfkill_send (rfkill, RFKILL_OP_CHANGE, index, RFKILL_TYPE_WLAN, TRUE, FALSE);
+		test_rfkill_settle (rfkill);
+		test_rfkill_send (rfkill, RFKILL_OP_DEL, index, RFKILL_TYPE_WLAN, TRUE, FALSE);
+		test_rfkill_settle (rfkill);
+	}
+	cycles_usec = g_get_monotonic_time () - start;
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < LOOKUPS; i++)
+		urf_arbitrator_get_state_idx (rfkill->arbitrator, g_random_int_range (0, n_resident));
+	lookups_usec = g_get_monotonic_time () - start;
+
+	printf ("%5u resident: %u add/change/remove cycles in %.3f s, %.1f us per cycle; "
+		"%.3f us per lookup\n",
+		n_resident, n_cycles, cycles_usec / 1000000.0,
+		(gdouble) cycles_usec / n_cycles,
+		(gdouble) lookups_usec / LOOKUPS);
+
+	test_rfkill_free (rfkill);
+	return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+	guint n_cycles = DEFAULT_CYCLES;
+	guint i;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc > 1)
+		n_cycles = strtoul (argv[1], NULL, 10);
+	if (n_cycles == 0)
+		n_cycles = 1;
+
+	for (i = 0; i < G_N_ELEMENTS (resident_counts); i++) {
+		if (!run (resident_counts[i], n_cycles))
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,206 @@
+#include <stdio.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/socket.h>
+#include <linux/rfkill.h>
+#include <glib/gstdio.h>
+
+#include "rfkill-harness.h"
+
+static guint n_warnings = 0;
+
+/* A simulated device without a node in the test's sysfs tree is looked
+ * up in vain, and each lookup warns; count the warnings instead of
+ * printing thousands */
+static void
+log_handler (const gchar    *log_domain,
+	     GLogLevelFlags  log_level,
+	     const gchar    *message,
+	     gpointer        user_data)
+{
+	if (log_level & (G_LOG_LEVEL_ERROR | G_LOG_LEVEL_CRITICAL))
+		g_log_default_handler (log_domain, log_level, message, user_data);
+	else if (log_level & G_LOG_LEVEL_WARNING)
+		n_warnings++;
+}
+
+TestRfkill *
+test_rfkill_new (void)
+{
+	TestRfkill *rfkill;
+	GDBusConnection *connection;
+	int fds[2];
+	GError *error = NULL;
+
+	g_log_set_default_handler (log_handler, NULL);
+
+	if (g_mkdir_with_parents (PACKAGE_LOCALSTATE_DIR "/lib/urfkill", 0755) < 0) {
+		printf ("Could not create the state directory: %s\n", g_strerror (errno));
+		return NULL;
+	}
+
+	connection = g_bus_get_sync (G_BUS_TYPE_SESSION, NULL, &error);
+	if (connection == NULL) {
+		printf ("No session bus: %s\n", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	/* Like /dev/rfkill, a seqpacket socket hands out one event per
+	 * read() */
+	if (socketpair (AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK, 0, fds) < 0) {
+		printf ("socketpair: %s\n", g_strerror (errno));
+		g_object_unref (connection);
+		return NULL;
+	}
+
+	rfkill = g_new0 (TestRfkill, 1);
+	rfkill->connection = connection;
+	rfkill->config = urf_config_new ();
+	rfkill->arbitrator = urf_arbitrator_new ();
+	rfkill->fd = fds[0];
+	rfkill->arbitrator_fd = fds[1];
+
+	return rfkill;
+}
+
+gboolean
+test_rfkill_startup (TestRfkill *rfkill)
+{
+	int fd = rfkill->arbitrator_fd;
+
+	/* the arbitrator owns it from now on */
+	rfkill->arbitrator_fd = -1;
+	if (!urf_arbitrator_startup_fd (rfkill->arbitrator, rfkill->config,
+					rfkill->connection, fd)) {
+		printf ("The arbitrator failed to start\n");
+		return FALSE;
+	}
+
+	test_rfkill_settle (rfkill);
+	return TRUE;
+}
+
+gboolean
+test_rfkill_send (TestRfkill *rfkill,
+		  guint8      op,
+		  guint32     index,
+		  guint8      type,
+		  gboolean    soft,
+		  gboolean    hard)
+{
+	struct rfkill_event event;
+
+	memset (&event, 0, sizeof (event));
+	event.op = op;
+	event.idx = index;
+	event.type = type;
+	event.soft = soft ? 1 : 0;
+	event.hard = hard ? 1 : 0;
+
+	if (write (rfkill->fd, &event, sizeof (event)) != sizeof (event)) {
+		printf ("Failed to send an event: %s\n", g_strerror (errno));
+		return FALSE;
+	}
+
+	return TRUE;
+}
+
+/* Let the arbitrator handle what was sent, and swallow what it wrote
+ * back; the simulated kernel does not answer */
+void
+test_rfkill_settle (TestRfkill *rfkill)
+{
+	struct rfkill_event event;
+
+	while (g_main_context_iteration (NULL, FALSE))
+		;
+
+	while (read (rfkill->fd, &event, sizeof (event)) > 0)
+		rfkill->n_requests++;
+}
+
+void
+test_rfkill_free (TestRfkill *rfkill)
+{
+	g_object_unref (rfkill->arbitrator);
+	g_object_unref (rfkill->config);
+	g_object_unref (rfkill->connection);
+	close (rfkill->fd);
+	if (rfkill->arbitrator_fd >= 0)
+		close (rfkill->arbitrator_fd);
+	g_free (rfkill);
+
+	if (n_warnings > 0)
+		printf ("(%u warnings, mostly sysfs lookups of the simulated devices)\n",
+			n_warnings);
+	n_warnings = 0;
+}
+
+/* Lay out a device the way the kernel does: the node under its parent
+ * in devices/, a platform parent with its subsystem link, and the link
+ * in class/rfkill the daemon looks it up by */
+gboolean
+test_sysfs_add_rfkill (guint32     index,
+		       const char *name,
+		       gboolean    platform)
+{
+	const char *parent;
+	char *devpath, *filename, *content, *link;
+	gboolean ret = FALSE;
+
+	parent = platform ? URFKILL_SYSFS_DIR "/devices/platform/urf-test"
+			  : URFKILL_SYSFS_DIR "/devices/virtual/urf-test";
+	devpath = g_strdup_printf ("%s/rfkill%u", parent, index);
+	filename = g_build_filename (devpath, "name", NULL);
+	content = g_strdup_printf ("%s\n", name);
+	link = g_strdup_printf (URFKILL_SYSFS_DIR "/class/rfkill/rfkill%u", index);
+
+	if (g_mkdir_with_parents (devpath, 0755) < 0 ||
+	    g_mkdir_with_parents (URFKILL_SYSFS_DIR "/class/rfkill", 0755) < 0)
+		goto out;
+
+	if (platform &&
+	    symlink ("../../../bus/platform", URFKILL_SYSFS_DIR "/devices/platform/urf-test/subsystem") < 0 &&
+	    errno != EEXIST)
+		goto out;
+
+	if (!g_file_set_contents (filename, content, -1, NULL))
+		goto out;
+
+	g_unlink (link);
+	if (symlink (devpath, link) < 0)
+		goto out;
+
+	ret = TRUE;
+out:
+	if (!ret)
+		printf ("Could not add rfkill%u to %s: %s\n",
+			index, URFKILL_SYSFS_DIR, g_strerror (errno));
+	g_free (link);
+	g_free (content);
+	g_free (filename);
+	g_free (devpath);
+
+	return ret;
+}
+
+guint
+test_count_fds (void)
+{
+	GDir *dir;
+	guint n_fds = 0;
+
+	dir = g_dir_open ("/proc/self/fd", 0, NULL);
+	if (dir == NULL)
+		return 0;
+
+	while (g_dir_read_name (dir) != NULL)
+		n_fds++;
+	g_dir_close (dir);
+
+	/* minus the one of the directory itself */
+	return n_fds - 1;
+}
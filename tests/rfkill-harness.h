@@ -0,0 +1,42 @@
+#ifndef __RFKILL_HARNESS_H__
+#define __RFKILL_HARNESS_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#include "urf-arbitrator.h"
+#include "urf-config.h"
+
+/* Runs the daemon's arbitrator in the test process, with the test
+ * playing the kernel on the other end of its rfkill control device.
+ * The devices export themselves on the session bus, so run the tests
+ * built on this under dbus-launch or dbus-run-session. */
+typedef struct {
+	UrfConfig	*config;
+	UrfArbitrator	*arbitrator;
+	GDBusConnection	*connection;
+	int		 fd; /* the kernel's end */
+	int		 arbitrator_fd; /* handed over at startup */
+	guint		 n_requests; /* events the arbitrator wrote */
+} TestRfkill;
+
+TestRfkill	*test_rfkill_new		(void);
+gboolean	 test_rfkill_startup		(TestRfkill	*rfkill);
+gboolean	 test_rfkill_send		(TestRfkill	*rfkill,
+						 guint8		 op,
+						 guint32	 index,
+						 guint8		 type,
+						 gboolean	 soft,
+						 gboolean	 hard);
+void		 test_rfkill_settle		(TestRfkill	*rfkill);
+void		 test_rfkill_free		(TestRfkill	*rfkill);
+
+guint		 test_count_fds			(void);
+
+/* The daemon reads the sysfs attributes of devices below
+ * URFKILL_SYSFS_DIR, which the build points to a tree of the tests' own */
+gboolean	 test_sysfs_add_rfkill		(guint32	 index,
+						 const char	*name,
+						 gboolean	 platform);
+
+#endif /* __RFKILL_HARNESS_H__ */
@@ -0,0 +1,128 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <glib.h>
+#include <linux/rfkill.h>
+
+#include "rfkill-harness.h"
+
+#define DEFAULT_ROUNDS 20
+/* The simulated devices from here on have nodes in the test's sysfs
+ * tree, half of them under a platform parent... */
+#define FIRST_INDEX 100000
+/* ...and those from here on have none, so their lookups fail */
+#define FIRST_MISSING_INDEX 200000
+
+/* Times how long the daemon's arbitrator takes to start with a number
+ * of rfkill entries already present, the test playing the kernel.
+ * Each device is looked up directly at class/rfkill/rfkill<index> in
+ * sysfs rather than by enumerating the subsystem, so the time per
+ * device must not grow with the number of entries, whether the lookup
+ * finds the device or not. */
+
+static const guint entry_counts[] = { 8, 64 };
+
+static const char *
+sysfs_name (guint i)
+{
+	return i % 2 ? "hci0" : "phy0";
+}
+
+/* The devices must have been found in sysfs, not just looked up */
+static gboolean
+check_sysfs_attrs (TestRfkill *rfkill,
+		   guint       n_entries)
+{
+	UrfDevice *device;
+	guint i;
+
+	for (i = 0; i < n_entries; i++) {
+		device = urf_arbitrator_get_device (rfkill->arbitrator, FIRST_INDEX + i);
+		if (device == NULL ||
+		    g_strcmp0 (urf_device_get_name (device), sysfs_name (i)) != 0 ||
+		    urf_device_is_platform (device) != (gboolean) (i % 2)) {
+			printf ("rfkill%u was not read from sysfs\n", FIRST_INDEX + i);
+			return FALSE;
+		}
+	}
+
+	return TRUE;
+}
+
+static gboolean
+run (guint    n_entries,
+     guint    n_rounds,
+     gboolean in_sysfs)
+{
+	TestRfkill *rfkill;
+	gint64 start, usec, total = 0, max = 0;
+	guint32 first = in_sysfs ? FIRST_INDEX : FIRST_MISSING_INDEX;
+	guint i, j;
+
+	for (i = 0; i < n_rounds; i++) {
+		rfkill = test_rfkill_new ();
+		if (rfkill == NULL)
+			return FALSE;
+
+		/* the kernel reports every device present on open */
+		for (j = 0; j < n_entries; j++)
+			test_rfkill_send (rfkill, RFKILL_OP_ADD, first + j,
+					  j % 2 ? RFKILL_TYPE_BLUETOOTH : RFKILL_TYPE_WLAN,
+					  FALSE, FALSE);
+
+		start = g_get_monotonic_time ();
+		if (!test_rfkill_startup (rfkill)) {
+			test_rfkill_free (rfkill);
+			return FALSE;
+		}
+		usec = g_get_monotonic_time () - start;
+
+		if (in_sysfs && !check_sysfs_attrs (rfkill, n_entries)) {
+			test_rfkill_free (rfkill);
+			return FALSE;
+		}
+
+		total += usec;
+		max = MAX (max, usec);
+		test_rfkill_free (rfkill);
+	}
+
+	printf ("%3u entries, %s: startup %.3f ms on average, %.3f ms at most, "
+		"%.1f us per entry\n",
+		n_entries, in_sysfs ? "in sysfs" : "missing ",
+		total / 1000.0 / n_rounds, max / 1000.0,
+		(gdouble) total / n_rounds / n_entries);
+
+	return TRUE;
+}
+
+int
+main (int argc, char **argv)
+{
+	guint n_rounds = DEFAULT_ROUNDS;
+	guint max_entries = 0;
+	guint i;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc > 1)
+		n_rounds = strtoul (argv[1], NULL, 10);
+	if (n_rounds == 0)
+		n_rounds = 1;
+
+	for (i = 0; i < G_N_ELEMENTS (entry_counts); i++)
+		max_entries = MAX (max_entries, entry_counts[i]);
+	for (i = 0; i < max_entries; i++) {
+		if (!test_sysfs_add_rfkill (FIRST_INDEX + i, sysfs_name (i), i % 2))
+			return 1;
+	}
+
+	for (i = 0; i < G_N_ELEMENTS (entry_counts); i++) {
+		if (!run (entry_counts[i], n_rounds, TRUE) ||
+		    !run (entry_counts[i], n_rounds, FALSE))
+			return 1;
+	}
+
+	return 0;
+}
@@ -0,0 +1,272 @@
+#include <stdlib.h>
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "test-helpers.h"
+
+/* Sums the given fields of /proc/<pid>/status */
+static gulong
+get_status_fields (const char  *pid,
+		   const char **fields)
+{
+	char *filename;
+	char *contents = NULL;
+	char **lines;
+	gulong sum = 0;
+	int i, j;
+
+	filename = g_strdup_printf ("/proc/%s/status", pid);
+	if (!g_file_get_contents (filename, &contents, NULL, NULL)) {
+		g_free (filename);
+		return 0;
+	}
+
+	lines = g_strsplit (contents, "\n", -1);
+	for (i = 0; lines[i]; i++) {
+		for (j = 0; fields[j]; j++) {
+			if (g_str_has_prefix (lines[i], fields[j]))
+				sum += strtoul (lines[i] + strlen (fields[j]), NULL, 10);
+		}
+	}
+
+	g_strfreev (lines);
+	g_free (contents);
+	g_free (filename);
+	return sum;
+}
+
+gulong
+test_get_rss_kb (const char *pid)
+{
+	const char *fields[] = { "VmRSS:", NULL };
+
+	return get_status_fields (pid, fields);
+}
+
+gulong
+test_get_context_switches (const char *pid)
+{
+	const char *fields[] = { "voluntary_ctxt_switches:",
+				 "nonvoluntary_ctxt_switches:",
+				 NULL };
+
+	return get_status_fields (pid, fields);
+}
+
+/* utime + stime in microseconds */
+gdouble
+test_get_cpu_usec (const char *pid)
+{
+	char *filename;
+	char *contents = NULL;
+	char **fields;
+	char *p;
+	gdouble usec = 0;
+
+	filename = g_strdup_printf ("/proc/%s/stat", pid);
+	if (!g_file_get_contents (filename, &contents, NULL, NULL)) {
+		g_free (filename);
+		return 0;
+	}
+
+	/* the command name may contain spaces, so skip past it */
+	p = strrchr (contents, ')');
+	if (p) {
+		fields = g_strsplit (p + 2, " ", -1);
+		/* state is field 3 of the line, utime 14 and stime 15 */
+		if (g_strv_length (fields) > 12)
+			usec = (strtoul (fields[11], NULL, 10) + strtoul (fields[12], NULL, 10))
+			       * 1000000.0 / sysconf (_SC_CLK_TCK);
+		g_strfreev (fields);
+	}
+
+	g_free (contents);
+	g_free (filename);
+	return usec;
+}
+
+guint
+test_count_devices (GDBusConnection *connection)
+{
+	GVariant *retval;
+	GVariant *paths;
+	guint n_devices = 0;
+
+	retval = g_dbus_connection_call_sync (connection, URFKILL_DBUS_SERVICE,
+					      URFKILL_DBUS_PATH, URFKILL_DBUS_INTERFACE,
+					      "EnumerateDevices", NULL, G_VARIANT_TYPE ("(ao)"),
+					      G_DBUS_CALL_FLAGS_NONE, -1, NULL, NULL);
+	if (retval) {
+		paths = g_variant_get_child_value (retval, 0);
+		n_devices = g_variant_n_children (paths);
+		g_variant_unref (paths);
+		g_variant_unref (retval);
+	}
+
+	return n_devices;
+}
+
+static const char ofono_introspection_xml[] =
+	"<node>"
+	"  <interface name='org.ofono.Manager'>"
+	"    <method name='GetModems'>"
+	"      <arg type='a(oa{sv})' direction='out'/>"
+	"    </method>"
+	"  </interface>"
+	"  <interface name='org.ofono.Modem'>"
+	"    <method name='GetProperties'>"
+	"      <arg type='a{sv}' direction='out'/>"
+	"    </method>"
+	"    <method name='SetProperty'>"
+	"      <arg type='s' direction='in'/>"
+	"      <arg type='v' direction='in'/>"
+	"    </method>"
+	"  </interface>"
+	"</node>";
+
+/* One running stand-in, attached to its connection */
+typedef struct {
+	char	*prefix;
+	guint	 n_modems;
+} TestOfono;
+
+static GDBusNodeInfo *ofono_node_info = NULL;
+static guint ofono_property_calls = 0;
+
+static GVariant *
+ofono_modem_properties (void)
+{
+	GVariantBuilder builder;
+
+	g_variant_builder_init (&builder, G_VARIANT_TYPE ("a{sv}"));
+	g_variant_builder_add (&builder, "{sv}", "Powered", g_variant_new_boolean (TRUE));
+	g_variant_builder_add (&builder, "{sv}", "Online", g_variant_new_boolean (TRUE));
+	g_variant_builder_add (&builder, "{sv}", "Manufacturer", g_variant_new_string ("urfkill"));
+	g_variant_builder_add (&builder, "{sv}", "Model", g_variant_new_string ("test modem"));
+	g_variant_builder_add (&builder, "{sv}", "Serial", g_variant_new_string ("0123456789"));
+	g_variant_builder_add (&builder, "{sv}", "Revision", g_variant_new_string ("1.0"));
+	g_variant_builder_add (&builder, "{sv}", "Type", g_variant_new_string ("hardware"));
+
+	return g_variant_builder_end (&builder);
+}
+
+static void
+ofono_method_call_cb (GDBusConnection       *connection,
+		      const gchar           *sender,
+		      const gchar           *object_path,
+		      const gchar           *interface_name,
+		      const gchar           *method_name,
+		      GVariant              *parameters,
+		      GDBusMethodInvocation *invocation,
+		      gpointer               user_data)
+{
+	TestOfono *ofono = user_data;
+	GVariantBuilder builder;
+	char *path;
+	guint i;
+
+	if (g_strcmp0 (method_name, "GetModems") == 0) {
+		g_variant_builder_init (&builder, G_VARIANT_TYPE ("a(oa{sv})"));
+		for (i = 0; i < ofono->n_modems; i++) {
+			path = g_strdup_printf ("/%s_%u", ofono->prefix, i);
+			g_variant_builder_add (&builder, "(o@a{sv})", path, ofono_modem_properties ());
+			g_free (path);
+		}
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(a(oa{sv}))", &builder));
+	} else if (g_strcmp0 (method_name, "GetProperties") == 0) {
+		ofono_property_calls++;
+		g_dbus_method_invocation_return_value (invocation,
+						       g_variant_new ("(@a{sv})", ofono_modem_properties ()));
+	} else {
+		g_dbus_method_invocation_return_value (invocation, NULL);
+	}
+}
+
+static const GDBusInterfaceVTable ofono_vtable = { ofono_method_call_cb, NULL, NULL };
+
+static void
+free_test_ofono (TestOfono *ofono)
+{
+	g_free (ofono->prefix);
+	g_free (ofono);
+}
+
+GDBusConnection *
+test_ofono_start (const char *address,
+		  const char *prefix,
+		  guint       n_modems)
+{
+	GDBusConnection *connection;
+	TestOfono *ofono;
+	GVariant *retval;
+	char *path;
+	guint reply = 0;
+	guint i;
+	GError *error = NULL;
+
+	if (ofono_node_info == NULL)
+		ofono_node_info = g_dbus_node_info_new_for_xml (ofono_introspection_xml, NULL);
+
+	connection = g_dbus_connection_new_for_address_sync (address,
+							     G_DBUS_CONNECTION_FLAGS_AUTHENTICATION_CLIENT |
+							     G_DBUS_CONNECTION_FLAGS_MESSAGE_BUS_CONNECTION,
+							     NULL, NULL, &error);
+	if (connection == NULL) {
+		printf ("Could not connect: %s\n", error->message);
+		g_error_free (error);
+		return NULL;
+	}
+
+	ofono = g_new0 (TestOfono, 1);
+	ofono->prefix = g_strdup (prefix);
+	ofono->n_modems = n_modems;
+	g_object_set_data_full (G_OBJECT (connection), "test-ofono", ofono,
+				(GDestroyNotify) free_test_ofono);
+
+	g_dbus_connection_register_object (connection, "/", ofono_node_info->interfaces[0],
+					   &ofono_vtable, ofono, NULL, NULL);
+	for (i = 0; i < n_modems; i++) {
+		path = g_strdup_printf ("/%s_%u", prefix, i);
+		g_dbus_connection_register_object (connection, path, ofono_node_info->interfaces[1],
+						   &ofono_vtable, ofono, NULL, NULL);
+		g_free (path);
+	}
+
+	/* DBUS_NAME_FLAG_DO_NOT_QUEUE */
+	retval = g_dbus_connection_call_sync (connection, "org.freedesktop.DBus",
+					      "/org/freedesktop/DBus", "org.freedesktop.DBus",
+					      "RequestName", g_variant_new ("(su)", "org.ofono", 4),
+					      G_VARIANT_TYPE ("(u)"), G_DBUS_CALL_FLAGS_NONE,
+					      -1, NULL, &error);
+	if (retval) {
+		g_variant_get (retval, "(u)", &reply);
+		g_variant_unref (retval);
+	}
+
+	/* DBUS_REQUEST_NAME_REPLY_PRIMARY_OWNER */
+	if (reply != 1) {
+		printf ("Could not own org.ofono: %s\n",
+			error ? error->message : "name already taken");
+		if (error)
+			g_error_free (error);
+		test_ofono_stop (connection);
+		return NULL;
+	}
+
+	return connection;
+}
+
+void
+test_ofono_stop (GDBusConnection *ofono)
+{
+	g_dbus_connection_close_sync (ofono, NULL, NULL);
+	g_object_unref (ofono);
+}
+
+guint
+test_ofono_get_property_calls (void)
+{
+	return ofono_property_calls;
+}
@@ -0,0 +1,29 @@
+#ifndef __TEST_HELPERS_H__
+#define __TEST_HELPERS_H__
+
+#include <glib.h>
+#include <gio/gio.h>
+
+#define URFKILL_DBUS_SERVICE	"org.freedesktop.URfkill"
+#define URFKILL_DBUS_PATH	"/org/freedesktop/URfkill"
+#define URFKILL_DBUS_INTERFACE	"org.freedesktop.URfkill"
+
+/* Read from /proc/<pid> of the daemon under test */
+gulong		 test_get_rss_kb		(const char		*pid);
+gulong		 test_get_context_switches	(const char		*pid);
+gdouble		 test_get_cpu_usec		(const char		*pid);
+
+/* The number of devices urfkilld exports */
+guint		 test_count_devices		(GDBusConnection	*connection);
+
+/* A stand-in oFono with n_modems modems at /<prefix>_<n>, owning
+ * org.ofono on the bus at address. Needs root and the bus policy that
+ * ships with oFono, and the real oFono must not be running. */
+GDBusConnection	*test_ofono_start		(const char		*address,
+						 const char		*prefix,
+						 guint			 n_modems);
+void		 test_ofono_stop		(GDBusConnection	*ofono);
+/* How often GetProperties was called on any of the modems */
+guint		 test_ofono_get_property_calls	(void);
+
+#endif /* __TEST_HELPERS_H__ */
@@ -0,0 +1,230 @@
+#include <stdlib.h>
+#include <urfkill.h>
+#include <stdio.h>
+#include <glib.h>
+#include <gio/gio.h>
+
+#define DEFAULT_TOGGLES 100
+#define REPLY_TIMEOUT_SEC 10
+
+/* Toggles the first device and times how long it takes until the
+ * daemon has answered every BlockIdx call, counting the replies on the
+ * bus connection liburfkill-glib uses:
+ *
+ *  per-call:  a proxy made for every toggle, the way UrfDevice used to
+ *  serial:    UrfDevice, waiting for each reply before the next toggle
+ *  pipelined: UrfDevice, all toggles in flight on the shared proxy
+ *
+ * Needs urfkilld running on the system bus. */
+
+G_LOCK_DEFINE_STATIC (calls);
+static GHashTable *calls = NULL; /* serials of BlockIdx calls in flight */
+static volatile gint replies = 0;
+static gint expected = 0;
+static GMainLoop *loop = NULL;
+
+static gboolean
+replied_cb (gpointer data)
+{
+	if (g_atomic_int_get (&replies) >= expected)
+		g_main_loop_quit (loop);
+	return FALSE;
+}
+
+/* Called from the GDBus worker thread for every message */
+static GDBusMessage *
+filter_cb (GDBusConnection *connection,
+	   GDBusMessage    *message,
+	   gboolean         incoming,
+	   gpointer         user_data)
+{
+	GDBusMessageType type = g_dbus_message_get_message_type (message);
+	gboolean replied = FALSE;
+
+	G_LOCK (calls);
+	if (!incoming && type == G_DBUS_MESSAGE_TYPE_METHOD_CALL &&
+	    g_strcmp0 (g_dbus_message_get_member (message), "BlockIdx") == 0) {
+		g_hash_table_insert (calls,
+				     GUINT_TO_POINTER (g_dbus_message_get_serial (message)),
+				     NULL);
+	} else if (incoming &&
+		   (type == G_DBUS_MESSAGE_TYPE_METHOD_RETURN ||
+		    type == G_DBUS_MESSAGE_TYPE_ERROR)) {
+		replied = g_hash_table_remove (calls,
+					       GUINT_TO_POINTER (g_dbus_message_get_reply_serial (message)));
+	}
+	G_UNLOCK (calls);
+
+	if (replied) {
+		g_atomic_int_inc (&replies);
+		g_idle_add (replied_cb, NULL);
+	}
+
+	return message;
+}
+
+static gboolean
+timeout_cb (gpointer data)
+{
+	g_main_loop_quit (loop);
+	return FALSE;
+}
+
+/* Wait until @n replies have come in since the count was reset */
+static gboolean
+wait_replies (gint n)
+{
+	guint timeout_id;
+
+	expected = n;
+	if (g_atomic_int_get (&replies) < expected) {
+		timeout_id = g_timeout_add_seconds (REPLY_TIMEOUT_SEC, timeout_cb, NULL);
+		g_main_loop_run (loop);
+		g_source_remove (timeout_id);
+	}
+
+	return g_atomic_int_get (&replies) >= expected;
+}
+
+static void
+print_rate (const char *mode, guint toggles, gint64 usec)
+{
+	printf ("%-10s %u toggles in %.3f s: %.1f toggles/s\n",
+		mode, toggles, usec / 1000000.0,
+		usec > 0 ? toggles * 1000000.0 / usec : 0.0);
+}
+
+static void
+per_call_cb (GDBusProxy   *proxy,
+	     GAsyncResult *res,
+	     gpointer      user_data)
+{
+	GVariant *retval;
+
+	retval = g_dbus_proxy_call_finish (proxy, res, NULL);
+	if (retval)
+		g_variant_unref (retval);
+	g_object_unref (proxy);
+}
+
+/* What urf_device_set_block() did before the proxy was shared */
+static void
+per_call_set_block (gint     index,
+		    gboolean block)
+{
+	GDBusProxy *proxy;
+	GError *error = NULL;
+
+	proxy = g_dbus_proxy_new_for_bus_sync (G_BUS_TYPE_SYSTEM,
+	                                       G_DBUS_PROXY_FLAGS_NONE,
+	                                       NULL,
+	                                       "org.freedesktop.URfkill",
+	                                       "/org/freedesktop/URfkill",
+	                                       "org.freedesktop.URfkill",
+	                                       NULL,
+	                                       &error);
+	if (error) {
+		printf ("Couldn't create a proxy: %s\n", error->message);
+		g_error_free (error);
+		return;
+	}
+
+	g_dbus_proxy_call (proxy, "BlockIdx",
+	                   g_variant_new ("(ub)", index, block),
+	                   G_DBUS_CALL_FLAGS_NONE,
+	                   -1, NULL,
+	                   (GAsyncReadyCallback) per_call_cb,
+	                   NULL);
+}
+
+static gboolean
+run_mode (const char *mode,
+	  UrfDevice  *device,
+	  guint       toggles)
+{
+	gboolean soft;
+	gboolean ret = TRUE;
+	gint index;
+	gint64 start;
+	guint i;
+
+	g_object_get (device,
+		      "index", &index,
+		      "soft", &soft,
+		      NULL);
+	g_atomic_int_set (&replies, 0);
+
+	start = g_get_monotonic_time ();
+	for (i = 0; i < toggles && ret; i++) {
+		gboolean block = (i % 2 == 0) ? !soft : soft;
+
+		if (g_strcmp0 (mode, "per-call") == 0) {
+			per_call_set_block (index, block);
+		} else {
+			g_object_set (device, "soft", block, NULL);
+			if (g_strcmp0 (mode, "serial") == 0)
+				ret = wait_replies (i + 1);
+		}
+	}
+	if (ret)
+		ret = wait_replies (toggles);
+	print_rate (mode, g_atomic_int_get (&replies), g_get_monotonic_time () - start);
+
+	if (!ret)
+		printf ("only %d of %u BlockIdx calls were answered\n",
+			g_atomic_int_get (&replies), toggles);
+
+	return ret;
+}
+
+int
+main (int argc, char **argv)
+{
+	GDBusConnection *connection;
+	UrfClient *client = NULL;
+	UrfDevice *device;
+	GList *devices;
+	guint toggles = DEFAULT_TOGGLES;
+	gboolean ret = FALSE;
+	GError *error = NULL;
+
+#if !GLIB_CHECK_VERSION(2,36,0)
+	g_type_init();
+#endif
+
+	if (argc > 1)
+		toggles = strtoul (argv[1], NULL, 10);
+	/* even, so the device ends up in its original state */
+	toggles += toggles % 2;
+
+	/* The client and its devices share this connection with us */
+	connection = g_bus_get_sync (G_BUS_TYPE_SYSTEM, NULL, &error);
+	if (connection == NULL) {
+		printf ("No system bus: %s\n", error->message);
+		g_error_free (error);
+		return 1;
+	}
+	calls = g_hash_table_new (g_direct_hash, g_direct_equal);
+	g_dbus_connection_add_filter (connection, filter_cb, NULL, NULL);
+	loop = g_main_loop_new (NULL, FALSE);
+
+	client = urf_client_new ();
+	urf_client_enumerate_devices_sync (client, NULL, NULL);
+	devices = urf_client_get_devices (client);
+
+	if (!devices) {
+		printf ("No device to toggle\n");
+		goto out;
+	}
+
+	device = (UrfDevice *)devices->data;
+	ret = run_mode ("per-call", device, toggles) &&
+	      run_mode ("serial", device, toggles) &&
+	      run_mode ("pipelined", device, toggles);
+out:
+	g_object_unref (client);
+	g_main_loop_unref (loop);
+	g_object_unref (connection);
+
+	return ret ? 0 : 1;
+}